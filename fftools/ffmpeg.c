@@ -72,6 +72,7 @@
 #include "libavutil/dict.h"
 #include "libavutil/mem.h"
 #include "libavutil/time.h"
+#include "libavutil/trace.h"
 
 #include "libavformat/avformat.h"
 
@@ -113,6 +114,8 @@ int        nb_filtergraphs;
 Decoder     **decoders;
 int        nb_decoders;
 
+FramePool    *frame_pool;
+
 #if HAVE_TERMIOS_H
 
 /* init terminal so that we can grab keys */
@@ -312,6 +315,14 @@ static void ffmpeg_cleanup(int ret)
         int64_t maxrss = getmaxrss() / 1024;
         av_log(NULL, AV_LOG_INFO, "bench: maxrss=%"PRId64"KiB\n", maxrss);
     }
+    if (do_benchmark_all && frame_pool) {
+        FramePoolStats st;
+
+        frame_pool_get_stats(frame_pool, &st);
+        av_log(NULL, AV_LOG_INFO, "bench: frame_pool hits=%"PRIu64" misses=%"PRIu64
+               " resident=%zuKiB peak=%zuKiB\n", st.hits, st.misses,
+               st.resident / 1024, st.resident_peak / 1024);
+    }
 
     for (int i = 0; i < nb_filtergraphs; i++)
         fg_free(&filtergraphs[i]);
@@ -336,9 +347,24 @@ static void ffmpeg_cleanup(int ret)
     av_freep(&vstats_filename);
     of_enc_stats_close();
 
+    if (trace_filename) {
+        int err;
+
+        av_trace_stop();
+        err = av_trace_write_json(trace_filename);
+        if (err < 0)
+            av_log(NULL, AV_LOG_ERROR, "Error writing trace file '%s': %s\n",
+                   trace_filename, av_err2str(err));
+        av_freep(&trace_filename);
+    }
+
     hw_device_free_all();
 
+    frame_pool_free(&frame_pool);
+
     av_freep(&filter_nbthreads);
+    av_freep(&filter_thread_type);
+    av_buffer_unref(&thread_pool);
 
     av_freep(&input_files);
     av_freep(&output_files);
@@ -970,6 +996,12 @@ int main(int argc, char **argv)
         goto finish;
     }
 
+    frame_pool = frame_pool_alloc();
+    if (!frame_pool) {
+        ret = AVERROR(ENOMEM);
+        goto finish;
+    }
+
     /* parse options and open all input/output files */
     ret = ffmpeg_parse_options(argc, argv, sch);
     if (ret < 0)
@@ -988,6 +1020,16 @@ int main(int argc, char **argv)
         goto finish;
     }
 
+    if (trace_filename) {
+        // enough for a few seconds of the busiest threads
+        ret = av_trace_start(1 << 16);
+        if (ret < 0) {
+            av_log(NULL, AV_LOG_FATAL, "Error starting tracing: %s\n",
+                   av_err2str(ret));
+            goto finish;
+        }
+    }
+
     current_time = ti = get_benchmark_time_stamps();
     ret = transcode(sch);
     if (ret >= 0 && do_benchmark) {
@@ -28,6 +28,7 @@
 
 #include "cmdutils.h"
 #include "ffmpeg_sched.h"
+#include "frame_pool.h"
 #include "sync_queue.h"
 
 #include "libavformat/avformat.h"
@@ -706,7 +707,10 @@ extern int        nb_filtergraphs;
 extern Decoder     **decoders;
 extern int        nb_decoders;
 
+extern FramePool    *frame_pool;
+
 extern char *vstats_filename;
+extern char *trace_filename;
 
 extern float dts_delta_threshold;
 extern float dts_error_threshold;
@@ -730,7 +734,9 @@ extern AVIOContext *progress_avio;
 extern float max_error_rate;
 
 extern char *filter_nbthreads;
+extern char *filter_thread_type;
 extern int filter_complex_nbthreads;
+extern AVBufferRef *thread_pool;
 extern int vstats_version;
 extern int auto_conversion_filters;
 
@@ -1371,6 +1371,24 @@ static int get_buffer(AVCodecContext *dec_ctx, AVFrame *frame, int flags)
         }
     }
 
+    if (frame_pool && dec_ctx->codec_type == AVMEDIA_TYPE_VIDEO &&
+        (dec_ctx->codec->capabilities & AV_CODEC_CAP_DR1) &&
+        !dec_ctx->hw_frames_ctx) {
+        const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get(frame->format);
+
+        if (desc && !(desc->flags & AV_PIX_FMT_FLAG_HWACCEL)) {
+            int stride_align[AV_NUM_DATA_POINTERS];
+            int w = frame->width, h = frame->height, align = 1;
+
+            avcodec_align_dimensions2(dec_ctx, &w, &h, stride_align);
+            // only the first four entries are set
+            for (int i = 0; i < 4; i++)
+                align = FFMAX(align, stride_align[i]);
+
+            return frame_pool_get_video(frame_pool, frame, w, h, align);
+        }
+    }
+
     return avcodec_default_get_buffer2(dec_ctx, frame, flags);
 }
 
@@ -1599,6 +1617,12 @@ static int dec_open(DecoderPriv *dp, AVDictionary **dec_opts,
     dp->apply_cropping          = dp->dec_ctx->apply_cropping;
     dp->dec_ctx->apply_cropping = 0;
 
+    if (thread_pool) {
+        ret = av_buffer_replace(&dp->dec_ctx->thread_pool, thread_pool);
+        if (ret < 0)
+            return ret;
+    }
+
     if ((ret = avcodec_open2(dp->dec_ctx, codec, NULL)) < 0) {
         av_log(dp, AV_LOG_ERROR, "Error while opening decoder: %s\n",
                av_err2str(ret));
@@ -503,8 +503,11 @@ static void readrate_sleep(Demuxer *d)
         stream_ts_offset = FFMAX(ds->first_dts != AV_NOPTS_VALUE ? ds->first_dts : 0, file_start);
         pts = av_rescale(ds->dts, 1000000, AV_TIME_BASE);
         now = (av_gettime_relative() - d->wallclock_start) * d->readrate + stream_ts_offset;
-        if (pts - burst_until > now)
+        if (pts - burst_until > now) {
+            sch_blocking_begin(d->sch);
             av_usleep(pts - burst_until - now);
+            sch_blocking_end(d->sch);
+        }
     }
 }
 
@@ -703,12 +706,15 @@ static int input_thread(void *arg)
         DemuxStream *ds;
         unsigned send_flags = 0;
 
+        sch_blocking_begin(d->sch);
         ret = av_read_frame(f->ctx, dt.pkt_demux);
 
         if (ret == AVERROR(EAGAIN)) {
             av_usleep(10000);
+            sch_blocking_end(d->sch);
             continue;
         }
+        sch_blocking_end(d->sch);
         if (ret < 0) {
             int ret_bsf;
 
@@ -319,6 +319,12 @@ int enc_open(void *opaque, const AVFrame *frame)
         return ret;
     }
 
+    if (thread_pool) {
+        ret = av_buffer_replace(&enc_ctx->thread_pool, thread_pool);
+        if (ret < 0)
+            return ret;
+    }
+
     if ((ret = avcodec_open2(ost->enc_ctx, enc, NULL)) < 0) {
         if (ret != AVERROR_EXPERIMENTAL)
             av_log(ost, AV_LOG_ERROR, "Error while opening encoder - maybe "
@@ -1882,6 +1882,13 @@ static int graph_is_meta(AVFilterGraph *graph)
 
 static int sub2video_frame(InputFilter *ifilter, AVFrame *frame, int buffer);
 
+static int filter_get_video_buffer(AVFilterGraph *graph, AVFrame *frame,
+                                   int align)
+{
+    return frame_pool_get_video(frame_pool, frame,
+                                frame->width, frame->height, align);
+}
+
 static int configure_filtergraph(FilterGraph *fg, FilterGraphThread *fgt)
 {
     FilterGraphPriv *fgp = fgp_from_fg(fg);
@@ -1896,6 +1903,21 @@ static int configure_filtergraph(FilterGraph *fg, FilterGraphThread *fgt)
     if (!fgt->graph)
         return AVERROR(ENOMEM);
 
+    if (filter_thread_type) {
+        ret = av_opt_set(fgt->graph, "thread_type", filter_thread_type, 0);
+        if (ret < 0)
+            goto fail;
+    }
+
+    if (thread_pool) {
+        ret = av_buffer_replace(&fgt->graph->thread_pool, thread_pool);
+        if (ret < 0)
+            goto fail;
+    }
+
+    if (frame_pool)
+        fgt->graph->get_video_buffer = filter_get_video_buffer;
+
     if (simple) {
         OutputFilterPriv *ofp = ofp_from_ofilter(fg->outputs[0]);
 
@@ -233,7 +233,9 @@ static int write_packet(Muxer *mux, OutputStream *ost, AVPacket *pkt)
     if (ms->stats.io)
         enc_stats_write(ost, &ms->stats, NULL, pkt, frame_num);
 
+    sch_blocking_begin(mux->sch);
     ret = av_interleaved_write_frame(s, pkt);
+    sch_blocking_end(mux->sch);
     if (ret < 0) {
         av_log(ost, AV_LOG_ERROR,
                "Error submitting a packet to the muxer: %s\n",
@@ -47,10 +47,12 @@
 #include "libavutil/opt.h"
 #include "libavutil/parseutils.h"
 #include "libavutil/stereo3d.h"
+#include "libavutil/threadpool.h"
 
 HWDevice *filter_hw_device;
 
 char *vstats_filename;
+char *trace_filename;
 
 float audio_drift_threshold = 0.1;
 float dts_delta_threshold   = 10;
@@ -74,7 +76,9 @@ int print_stats       = -1;
 int stdin_interaction = 1;
 float max_error_rate  = 2.0/3;
 char *filter_nbthreads;
+char *filter_thread_type;
 int filter_complex_nbthreads = 0;
+AVBufferRef *thread_pool;
 int vstats_version = 2;
 int auto_conversion_filters = 1;
 int64_t stats_period = 500000;
@@ -615,6 +619,37 @@ static int opt_sdp_file(void *optctx, const char *opt, const char *arg)
     return sch_sdp_filename(sch, arg);
 }
 
+static int opt_max_active_tasks(void *optctx, const char *opt, const char *arg)
+{
+    Scheduler *sch = optctx;
+    double num;
+    int ret;
+
+    ret = parse_number(opt, arg, OPT_TYPE_INT, 0, INT_MAX, &num);
+    if (ret < 0)
+        return ret;
+
+    sch_set_max_active_tasks(sch, num);
+    return 0;
+}
+
+static int opt_thread_pool(void *optctx, const char *opt, const char *arg)
+{
+    double num;
+    int ret;
+
+    ret = parse_number(opt, arg, OPT_TYPE_INT, 0, INT_MAX, &num);
+    if (ret < 0)
+        return ret;
+
+    av_buffer_unref(&thread_pool);
+    thread_pool = av_threadpool_alloc(num);
+    if (!thread_pool)
+        return AVERROR(ENOMEM);
+
+    return 0;
+}
+
 #if CONFIG_VAAPI
 static int opt_vaapi_device(void *optctx, const char *opt, const char *arg)
 {
@@ -947,6 +982,13 @@ static int opt_vstats_file(void *optctx, const char *opt, const char *arg)
     return 0;
 }
 
+static int opt_trace_file(void *optctx, const char *opt, const char *arg)
+{
+    av_free(trace_filename);
+    trace_filename = av_strdup(arg);
+    return trace_filename ? 0 : AVERROR(ENOMEM);
+}
+
 static int opt_vstats(void *optctx, const char *opt, const char *arg)
 {
     char filename[40];
@@ -1574,6 +1616,9 @@ const OptionDef options[] = {
     { "benchmark_all",          OPT_TYPE_BOOL, OPT_EXPERT,
         { &do_benchmark_all },
       "add timings for each task" },
+    { "trace_file",             OPT_TYPE_FUNC, OPT_FUNC_ARG | OPT_EXPERT,
+        { .func_arg = opt_trace_file },
+      "write a Chrome trace of the time spent in each thread to file", "file" },
     { "progress",               OPT_TYPE_FUNC, OPT_FUNC_ARG | OPT_EXPERT,
         { .func_arg = opt_progress },
       "write program-readable progress information", "url" },
@@ -1667,6 +1712,15 @@ const OptionDef options[] = {
     { "filter_threads",         OPT_TYPE_FUNC, OPT_FUNC_ARG | OPT_EXPERT,
         { .func_arg = opt_filter_threads },
         "number of non-complex filter threads" },
+    { "filter_thread_type",     OPT_TYPE_STRING, OPT_EXPERT,
+        { &filter_thread_type },
+        "threading types allowed in filtergraphs (slice, frame)", "flags" },
+    { "max_active_tasks",       OPT_TYPE_FUNC, OPT_FUNC_ARG | OPT_EXPERT,
+        { .func_arg = opt_max_active_tasks },
+        "maximum number of transcoding tasks running at the same time (0 = unlimited)", "number" },
+    { "thread_pool",            OPT_TYPE_FUNC, OPT_FUNC_ARG | OPT_EXPERT,
+        { .func_arg = opt_thread_pool },
+        "run the slice threads of all codecs, filters and scalers on a shared pool of this many threads (0 = one per CPU)", "number" },
 #if FFMPEG_OPT_FILTER_SCRIPT
     { "filter_script",          OPT_TYPE_STRING, OPT_PERSTREAM | OPT_EXPERT | OPT_OUTPUT,
         { .off = OFFSET(filter_scripts) },
@@ -39,6 +39,7 @@
 #include "libavutil/thread.h"
 #include "libavutil/threadmessage.h"
 #include "libavutil/time.h"
+#include "libavutil/trace.h"
 
 // 100 ms
 // FIXME: some other value? make this dynamic?
@@ -311,6 +312,18 @@ struct Scheduler {
     pthread_mutex_t     schedule_lock;
 
     atomic_int_least64_t last_dts;
+
+    /* Concurrency limit: bounds the number of tasks doing actual work at the
+     * same time, 0 for no limit. A task owns a run slot while it executes its
+     * own code, and gives it up whenever it calls into the scheduler to
+     * exchange data, where it may block on a queue or a choked waiter, and
+     * around blocking I/O and sleeps marked with
+     * sch_blocking_begin()/sch_blocking_end(). */
+    unsigned            nb_run_slots;
+    atomic_int          run_slots_free;
+    atomic_int          run_slots_waiting;
+    pthread_mutex_t     run_slots_lock;
+    pthread_cond_t      run_slots_cond;
 };
 
 /**
@@ -371,11 +384,58 @@ static void waiter_uninit(SchWaiter *w)
     pthread_cond_destroy(&w->cond);
 }
 
+static void run_slot_acquire(Scheduler *sch)
+{
+    int free_slots;
+
+    if (!sch->nb_run_slots)
+        return;
+
+    free_slots = atomic_load(&sch->run_slots_free);
+    while (1) {
+        if (free_slots > 0) {
+            if (atomic_compare_exchange_weak(&sch->run_slots_free, &free_slots,
+                                             free_slots - 1))
+                return;
+            continue;
+        }
+
+        pthread_mutex_lock(&sch->run_slots_lock);
+
+        atomic_fetch_add(&sch->run_slots_waiting, 1);
+        while ((free_slots = atomic_load(&sch->run_slots_free)) <= 0)
+            pthread_cond_wait(&sch->run_slots_cond, &sch->run_slots_lock);
+        atomic_fetch_sub(&sch->run_slots_waiting, 1);
+
+        pthread_mutex_unlock(&sch->run_slots_lock);
+    }
+}
+
+static void run_slot_release(Scheduler *sch)
+{
+    if (!sch->nb_run_slots)
+        return;
+
+    atomic_fetch_add(&sch->run_slots_free, 1);
+
+    if (atomic_load(&sch->run_slots_waiting)) {
+        pthread_mutex_lock(&sch->run_slots_lock);
+        pthread_cond_signal(&sch->run_slots_cond);
+        pthread_mutex_unlock(&sch->run_slots_lock);
+    }
+}
+
+/**
+ * Every queue is drained by exactly one task thread, so all of them can use
+ * the lock-free ring. single_producer must only be set when all sends to the
+ * queue happen from one thread or are serialized by a lock.
+ */
 static int queue_alloc(ThreadQueue **ptq, unsigned nb_streams, unsigned queue_size,
-                       enum QueueType type)
+                       enum QueueType type, int single_producer)
 {
     ThreadQueue *tq;
     ObjPool *op;
+    unsigned flags = THREAD_QUEUE_FLAG_LOCKFREE;
 
     if (queue_size <= 0) {
         if (type == QUEUE_FRAMES)
@@ -398,8 +458,11 @@ static int queue_alloc(ThreadQueue **ptq, unsigned nb_streams, unsigned queue_si
     if (!op)
         return AVERROR(ENOMEM);
 
+    if (single_producer)
+        flags |= THREAD_QUEUE_FLAG_SINGLE_PRODUCER;
+
     tq = tq_alloc(nb_streams, queue_size, op,
-                  (type == QUEUE_PACKETS) ? pkt_move : frame_move);
+                  (type == QUEUE_PACKETS) ? pkt_move : frame_move, flags);
     if (!tq) {
         objpool_free(&op);
         return AVERROR(ENOMEM);
@@ -574,6 +637,9 @@ void sch_free(Scheduler **psch)
     pthread_mutex_destroy(&sch->mux_done_lock);
     pthread_cond_destroy(&sch->mux_done_cond);
 
+    pthread_mutex_destroy(&sch->run_slots_lock);
+    pthread_cond_destroy(&sch->run_slots_cond);
+
     av_freep(psch);
 }
 
@@ -610,12 +676,39 @@ Scheduler *sch_alloc(void)
     if (ret)
         goto fail;
 
+    ret = pthread_mutex_init(&sch->run_slots_lock, NULL);
+    if (ret)
+        goto fail;
+
+    ret = pthread_cond_init(&sch->run_slots_cond, NULL);
+    if (ret)
+        goto fail;
+
     return sch;
 fail:
     sch_free(&sch);
     return NULL;
 }
 
+void sch_set_max_active_tasks(Scheduler *sch, unsigned nb_tasks)
+{
+    av_assert0(sch->state == SCH_STATE_UNINIT);
+
+    sch->nb_run_slots = nb_tasks;
+    atomic_init(&sch->run_slots_free, nb_tasks);
+    atomic_init(&sch->run_slots_waiting, 0);
+}
+
+void sch_blocking_begin(Scheduler *sch)
+{
+    run_slot_release(sch);
+}
+
+void sch_blocking_end(Scheduler *sch)
+{
+    run_slot_acquire(sch);
+}
+
 int sch_sdp_filename(Scheduler *sch, const char *sdp_filename)
 {
     av_freep(&sch->sdp_filename);
@@ -769,10 +862,6 @@ int sch_add_dec(Scheduler *sch, SchThreadFunc func, void *ctx, int send_end_ts)
     if (ret < 0)
         return ret;
 
-    ret = queue_alloc(&dec->queue, 1, 0, QUEUE_PACKETS);
-    if (ret < 0)
-        return ret;
-
     if (send_end_ts) {
         ret = av_thread_message_queue_alloc(&dec->queue_end_ts, 1, sizeof(Timestamp));
         if (ret < 0)
@@ -813,7 +902,9 @@ int sch_add_enc(Scheduler *sch, SchThreadFunc func, void *ctx,
     if (!enc->send_pkt)
         return AVERROR(ENOMEM);
 
-    ret = queue_alloc(&enc->queue, 1, 0, QUEUE_FRAMES);
+    // frames are sent either by the single source thread, or under the
+    // sync queue lock
+    ret = queue_alloc(&enc->queue, 1, 0, QUEUE_FRAMES, 1);
     if (ret < 0)
         return ret;
 
@@ -861,7 +952,7 @@ int sch_add_filtergraph(Scheduler *sch, unsigned nb_inputs, unsigned nb_outputs,
     if (ret < 0)
         return ret;
 
-    ret = queue_alloc(&fg->queue, fg->nb_inputs + 1, 0, QUEUE_FRAMES);
+    ret = queue_alloc(&fg->queue, fg->nb_inputs + 1, 0, QUEUE_FRAMES, 0);
     if (ret < 0)
         return ret;
 
@@ -1421,6 +1512,23 @@ fail:
     return ret;
 }
 
+static int dec_is_sub_heartbeat_dst(const Scheduler *sch, unsigned dec_idx)
+{
+    for (unsigned i = 0; i < sch->nb_mux; i++) {
+        const SchMux *mux = &sch->mux[i];
+
+        for (unsigned j = 0; j < mux->nb_streams; j++) {
+            const SchMuxStream *ms = &mux->streams[j];
+
+            for (unsigned k = 0; k < ms->nb_sub_heartbeat_dst; k++)
+                if (ms->sub_heartbeat_dst[k] == dec_idx)
+                    return 1;
+        }
+    }
+
+    return 0;
+}
+
 static int start_prepare(Scheduler *sch)
 {
     int ret;
@@ -1465,6 +1573,13 @@ static int start_prepare(Scheduler *sch)
             if (!o->dst_finished)
                 return AVERROR(ENOMEM);
         }
+
+        // packets come from the source thread, unless some muxer also sends
+        // subtitle heartbeats here
+        ret = queue_alloc(&dec->queue, 1, 0, QUEUE_PACKETS,
+                          !dec_is_sub_heartbeat_dst(sch, i));
+        if (ret < 0)
+            return ret;
     }
 
     for (unsigned i = 0; i < sch->nb_enc; i++) {
@@ -1514,8 +1629,10 @@ static int start_prepare(Scheduler *sch)
             }
         }
 
+        // before the muxer is started, all packets go through the pre-muxing
+        // queues, so with one stream there is only ever one sending thread
         ret = queue_alloc(&mux->queue, mux->nb_streams, mux->queue_size,
-                          QUEUE_PACKETS);
+                          QUEUE_PACKETS, mux->nb_streams == 1);
         if (ret < 0)
             return ret;
     }
@@ -2006,8 +2123,8 @@ static int demux_flush(Scheduler *sch, SchDemux *d, AVPacket *pkt)
     return 0;
 }
 
-int sch_demux_send(Scheduler *sch, unsigned demux_idx, AVPacket *pkt,
-                   unsigned flags)
+static int demux_send(Scheduler *sch, unsigned demux_idx, AVPacket *pkt,
+                      unsigned flags)
 {
     SchDemux *d;
     int terminate;
@@ -2028,6 +2145,20 @@ int sch_demux_send(Scheduler *sch, unsigned demux_idx, AVPacket *pkt,
     return demux_send_for_stream(sch, d, &d->streams[pkt->stream_index], pkt, flags);
 }
 
+int sch_demux_send(Scheduler *sch, unsigned demux_idx, AVPacket *pkt,
+                   unsigned flags)
+{
+    int ret;
+
+    av_trace_begin("sch_demux_send");
+    run_slot_release(sch);
+    ret = demux_send(sch, demux_idx, pkt, flags);
+    run_slot_acquire(sch);
+    av_trace_end("sch_demux_send");
+
+    return ret;
+}
+
 static int demux_done(Scheduler *sch, unsigned demux_idx)
 {
     SchDemux *d = &sch->demux[demux_idx];
@@ -2050,7 +2181,7 @@ static int demux_done(Scheduler *sch, unsigned demux_idx)
     return ret;
 }
 
-int sch_mux_receive(Scheduler *sch, unsigned mux_idx, AVPacket *pkt)
+static int mux_receive(Scheduler *sch, unsigned mux_idx, AVPacket *pkt)
 {
     SchMux *mux;
     int ret, stream_idx;
@@ -2063,6 +2194,19 @@ int sch_mux_receive(Scheduler *sch, unsigned mux_idx, AVPacket *pkt)
     return ret;
 }
 
+int sch_mux_receive(Scheduler *sch, unsigned mux_idx, AVPacket *pkt)
+{
+    int ret;
+
+    av_trace_begin("sch_mux_receive");
+    run_slot_release(sch);
+    ret = mux_receive(sch, mux_idx, pkt);
+    run_slot_acquire(sch);
+    av_trace_end("sch_mux_receive");
+
+    return ret;
+}
+
 void sch_mux_receive_finish(Scheduler *sch, unsigned mux_idx, unsigned stream_idx)
 {
     SchMux *mux;
@@ -2081,8 +2225,8 @@ void sch_mux_receive_finish(Scheduler *sch, unsigned mux_idx, unsigned stream_id
     pthread_mutex_unlock(&sch->schedule_lock);
 }
 
-int sch_mux_sub_heartbeat(Scheduler *sch, unsigned mux_idx, unsigned stream_idx,
-                          const AVPacket *pkt)
+static int mux_sub_heartbeat(Scheduler *sch, unsigned mux_idx, unsigned stream_idx,
+                             const AVPacket *pkt)
 {
     SchMux       *mux;
     SchMuxStream *ms;
@@ -2107,6 +2251,20 @@ int sch_mux_sub_heartbeat(Scheduler *sch, unsigned mux_idx, unsigned stream_idx,
     return 0;
 }
 
+int sch_mux_sub_heartbeat(Scheduler *sch, unsigned mux_idx, unsigned stream_idx,
+                          const AVPacket *pkt)
+{
+    int ret;
+
+    av_trace_begin("sch_mux_sub_heartbeat");
+    run_slot_release(sch);
+    ret = mux_sub_heartbeat(sch, mux_idx, stream_idx, pkt);
+    run_slot_acquire(sch);
+    av_trace_end("sch_mux_sub_heartbeat");
+
+    return ret;
+}
+
 static int mux_done(Scheduler *sch, unsigned mux_idx)
 {
     SchMux *mux = &sch->mux[mux_idx];
@@ -2134,7 +2292,7 @@ static int mux_done(Scheduler *sch, unsigned mux_idx)
     return 0;
 }
 
-int sch_dec_receive(Scheduler *sch, unsigned dec_idx, AVPacket *pkt)
+static int dec_receive(Scheduler *sch, unsigned dec_idx, AVPacket *pkt)
 {
     SchDec *dec;
     int ret, dummy;
@@ -2163,6 +2321,19 @@ int sch_dec_receive(Scheduler *sch, unsigned dec_idx, AVPacket *pkt)
     return ret;
 }
 
+int sch_dec_receive(Scheduler *sch, unsigned dec_idx, AVPacket *pkt)
+{
+    int ret;
+
+    av_trace_begin("sch_dec_receive");
+    run_slot_release(sch);
+    ret = dec_receive(sch, dec_idx, pkt);
+    run_slot_acquire(sch);
+    av_trace_end("sch_dec_receive");
+
+    return ret;
+}
+
 static int send_to_filter(Scheduler *sch, SchFilterGraph *fg,
                           unsigned in_idx, AVFrame *frame)
 {
@@ -2210,8 +2381,8 @@ finish:
     return AVERROR_EOF;
 }
 
-int sch_dec_send(Scheduler *sch, unsigned dec_idx,
-                 unsigned out_idx, AVFrame *frame)
+static int dec_send(Scheduler *sch, unsigned dec_idx,
+                    unsigned out_idx, AVFrame *frame)
 {
     SchDec *dec;
     SchDecOutput *o;
@@ -2254,6 +2425,20 @@ int sch_dec_send(Scheduler *sch, unsigned dec_idx,
     return (nb_done == o->nb_dst) ? AVERROR_EOF : 0;
 }
 
+int sch_dec_send(Scheduler *sch, unsigned dec_idx,
+                 unsigned out_idx, AVFrame *frame)
+{
+    int ret;
+
+    av_trace_begin("sch_dec_send");
+    run_slot_release(sch);
+    ret = dec_send(sch, dec_idx, out_idx, frame);
+    run_slot_acquire(sch);
+    av_trace_end("sch_dec_send");
+
+    return ret;
+}
+
 static int dec_done(Scheduler *sch, unsigned dec_idx)
 {
     SchDec *dec = &sch->dec[dec_idx];
@@ -2279,7 +2464,7 @@ static int dec_done(Scheduler *sch, unsigned dec_idx)
     return ret;
 }
 
-int sch_enc_receive(Scheduler *sch, unsigned enc_idx, AVFrame *frame)
+static int enc_receive(Scheduler *sch, unsigned enc_idx, AVFrame *frame)
 {
     SchEnc *enc;
     int ret, dummy;
@@ -2293,6 +2478,19 @@ int sch_enc_receive(Scheduler *sch, unsigned enc_idx, AVFrame *frame)
     return ret;
 }
 
+int sch_enc_receive(Scheduler *sch, unsigned enc_idx, AVFrame *frame)
+{
+    int ret;
+
+    av_trace_begin("sch_enc_receive");
+    run_slot_release(sch);
+    ret = enc_receive(sch, enc_idx, frame);
+    run_slot_acquire(sch);
+    av_trace_end("sch_enc_receive");
+
+    return ret;
+}
+
 static int enc_send_to_dst(Scheduler *sch, const SchedulerNode dst,
                            uint8_t *dst_finished, AVPacket *pkt)
 {
@@ -2323,7 +2521,7 @@ finish:
     return AVERROR_EOF;
 }
 
-int sch_enc_send(Scheduler *sch, unsigned enc_idx, AVPacket *pkt)
+static int enc_send(Scheduler *sch, unsigned enc_idx, AVPacket *pkt)
 {
     SchEnc *enc;
     int ret;
@@ -2356,6 +2554,19 @@ int sch_enc_send(Scheduler *sch, unsigned enc_idx, AVPacket *pkt)
     return 0;
 }
 
+int sch_enc_send(Scheduler *sch, unsigned enc_idx, AVPacket *pkt)
+{
+    int ret;
+
+    av_trace_begin("sch_enc_send");
+    run_slot_release(sch);
+    ret = enc_send(sch, enc_idx, pkt);
+    run_slot_acquire(sch);
+    av_trace_end("sch_enc_send");
+
+    return ret;
+}
+
 static int enc_done(Scheduler *sch, unsigned enc_idx)
 {
     SchEnc *enc = &sch->enc[enc_idx];
@@ -2372,8 +2583,8 @@ static int enc_done(Scheduler *sch, unsigned enc_idx)
     return ret;
 }
 
-int sch_filter_receive(Scheduler *sch, unsigned fg_idx,
-                       unsigned *in_idx, AVFrame *frame)
+static int filter_receive(Scheduler *sch, unsigned fg_idx,
+                          unsigned *in_idx, AVFrame *frame)
 {
     SchFilterGraph *fg;
 
@@ -2416,6 +2627,20 @@ int sch_filter_receive(Scheduler *sch, unsigned fg_idx,
     }
 }
 
+int sch_filter_receive(Scheduler *sch, unsigned fg_idx,
+                       unsigned *in_idx, AVFrame *frame)
+{
+    int ret;
+
+    av_trace_begin("sch_filter_receive");
+    run_slot_release(sch);
+    ret = filter_receive(sch, fg_idx, in_idx, frame);
+    run_slot_acquire(sch);
+    av_trace_end("sch_filter_receive");
+
+    return ret;
+}
+
 void sch_filter_receive_finish(Scheduler *sch, unsigned fg_idx, unsigned in_idx)
 {
     SchFilterGraph *fg;
@@ -2437,7 +2662,7 @@ void sch_filter_receive_finish(Scheduler *sch, unsigned fg_idx, unsigned in_idx)
     }
 }
 
-int sch_filter_send(Scheduler *sch, unsigned fg_idx, unsigned out_idx, AVFrame *frame)
+static int filter_send(Scheduler *sch, unsigned fg_idx, unsigned out_idx, AVFrame *frame)
 {
     SchFilterGraph *fg;
     SchedulerNode  dst;
@@ -2453,6 +2678,19 @@ int sch_filter_send(Scheduler *sch, unsigned fg_idx, unsigned out_idx, AVFrame *
            send_to_filter(sch, &sch->filters[dst.idx], dst.idx_stream, frame);
 }
 
+int sch_filter_send(Scheduler *sch, unsigned fg_idx, unsigned out_idx, AVFrame *frame)
+{
+    int ret;
+
+    av_trace_begin("sch_filter_send");
+    run_slot_release(sch);
+    ret = filter_send(sch, fg_idx, out_idx, frame);
+    run_slot_acquire(sch);
+    av_trace_end("sch_filter_send");
+
+    return ret;
+}
+
 static int filter_done(Scheduler *sch, unsigned fg_idx)
 {
     SchFilterGraph *fg = &sch->filters[fg_idx];
@@ -2511,11 +2749,16 @@ static void *task_wrapper(void *arg)
     int ret;
     int err = 0;
 
+    run_slot_acquire(sch);
+
     ret = task->func(task->func_arg);
     if (ret < 0)
         av_log(task->func_arg, AV_LOG_ERROR,
                "Task finished with error code: %d (%s)\n", ret, av_err2str(ret));
 
+    // cleanup may block sending EOF downstream
+    run_slot_release(sch);
+
     err = task_cleanup(sch, task->node);
     ret = err_merge(ret, err);
 
@@ -289,6 +289,34 @@ void sch_mux_stream_buffering(Scheduler *sch, unsigned mux_idx, unsigned stream_
  */
 int sch_mux_stream_ready(Scheduler *sch, unsigned mux_idx, unsigned stream_idx);
 
+/**
+ * Limit the number of tasks that may be doing work at the same time.
+ *
+ * This is not a thread pool: every task keeps its own thread, and the limit
+ * works like a counting semaphore. A task gives up its run slot while
+ * exchanging data with the scheduler and around the blocking operations
+ * marked with sch_blocking_begin()/sch_blocking_end(), so a task that is
+ * waiting for input, output space, I/O, or is choked by the scheduling logic
+ * never counts towards the limit. Must be called before sch_start().
+ *
+ * @param nb_tasks maximum number of concurrently running tasks, 0 for no limit
+ */
+void sch_set_max_active_tasks(Scheduler *sch, unsigned nb_tasks);
+
+/**
+ * Called by a task before an operation that may block outside of the
+ * scheduler, such as reading or writing a file, or sleeping. The task does
+ * not count towards the limit set with sch_set_max_active_tasks() until the
+ * matching sch_blocking_end().
+ */
+void sch_blocking_begin(Scheduler *sch);
+
+/**
+ * Called by a task after the operation started with sch_blocking_begin().
+ * May wait for a free run slot.
+ */
+void sch_blocking_end(Scheduler *sch);
+
 /**
  * Set the file path for the SDP.
  *
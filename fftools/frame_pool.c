@@ -0,0 +1,306 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include <stdatomic.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "libavutil/buffer.h"
+#include "libavutil/common.h"
+#include "libavutil/error.h"
+#include "libavutil/frame.h"
+#include "libavutil/imgutils.h"
+#include "libavutil/mem.h"
+#include "libavutil/thread.h"
+
+#include "frame_pool.h"
+
+// number of distinct frame geometries kept around; when a new one is needed
+// the least recently used one is dropped, so that e.g. resolution changes do
+// not pin the memory of every size ever seen
+#define MAX_ENTRIES 16
+
+typedef struct PlanePool {
+    FramePool *fp;
+    size_t     size;
+    // number of buffers allocated by this pool, only modified under fp->lock
+    unsigned   nb_buffers;
+} PlanePool;
+
+typedef struct PoolEntry {
+    int           format;
+    int           width, height;
+    int           align;
+
+    int           linesize[4];
+    AVBufferPool *pools[4];
+
+    uint64_t      last_used;
+} PoolEntry;
+
+struct FramePool {
+    pthread_mutex_t lock;
+
+    PoolEntry       entries[MAX_ENTRIES];
+    int             nb_entries;
+    uint64_t        clock;
+
+    // set by plane_alloc() when a frame could not be served from the pools
+    int             allocated;
+
+    uint64_t        hits;
+    uint64_t        misses;
+    size_t          resident_peak;
+    atomic_size_t   resident;
+
+    // one reference for the owner, plus one for every live AVBufferPool,
+    // since those may outlive frame_pool_free()
+    atomic_uint     refcount;
+};
+
+static void frame_pool_unref(FramePool *fp)
+{
+    if (atomic_fetch_sub_explicit(&fp->refcount, 1, memory_order_acq_rel) == 1) {
+        pthread_mutex_destroy(&fp->lock);
+        av_free(fp);
+    }
+}
+
+// called with fp->lock held, from av_buffer_pool_get()
+static AVBufferRef *plane_alloc(void *opaque, size_t size)
+{
+    PlanePool   *pp = opaque;
+    FramePool   *fp = pp->fp;
+    AVBufferRef *buf;
+    size_t resident;
+
+    buf = av_buffer_allocz(size);
+    if (!buf)
+        return NULL;
+
+    pp->nb_buffers++;
+    fp->allocated = 1;
+
+    resident = atomic_fetch_add(&fp->resident, size) + size;
+    fp->resident_peak = FFMAX(fp->resident_peak, resident);
+
+    return buf;
+}
+
+// called once the pool is uninitialized and all its buffers were returned
+static void plane_pool_free(void *opaque)
+{
+    PlanePool *pp = opaque;
+    FramePool *fp = pp->fp;
+
+    atomic_fetch_sub(&fp->resident, pp->size * pp->nb_buffers);
+    av_free(pp);
+
+    frame_pool_unref(fp);
+}
+
+static void entry_uninit(PoolEntry *e)
+{
+    for (int i = 0; i < FF_ARRAY_ELEMS(e->pools); i++)
+        av_buffer_pool_uninit(&e->pools[i]);
+    memset(e, 0, sizeof(*e));
+}
+
+static int entry_init(FramePool *fp, PoolEntry *e, int format,
+                      int width, int height, int align)
+{
+    ptrdiff_t linesize1[4];
+    size_t size[4];
+    int w = width, unaligned, ret;
+
+    do {
+        // same layout as avcodec_default_get_buffer2(): do not align
+        // linesizes individually, as decoders may rely on the ratio
+        // between luma and chroma linesizes
+        ret = av_image_fill_linesizes(e->linesize, format, w);
+        if (ret < 0)
+            return ret;
+        // increase alignment of w for next try (rhs gives the lowest bit set in w)
+        w += w & ~(w - 1);
+
+        unaligned = 0;
+        for (int i = 0; i < 4; i++)
+            unaligned |= e->linesize[i] % align;
+    } while (unaligned);
+
+    for (int i = 0; i < 4; i++)
+        linesize1[i] = e->linesize[i];
+    ret = av_image_fill_plane_sizes(size, format, height, linesize1);
+    if (ret < 0)
+        return ret;
+
+    e->format = format;
+    e->width  = width;
+    e->height = height;
+    e->align  = align;
+
+    for (int i = 0; i < 4 && size[i]; i++) {
+        PlanePool *pp;
+
+        if (size[i] > INT_MAX - (16 + align - 1))
+            return AVERROR(EINVAL);
+
+        pp = av_mallocz(sizeof(*pp));
+        if (!pp)
+            return AVERROR(ENOMEM);
+        pp->fp   = fp;
+        pp->size = size[i] + 16 + align - 1;
+
+        e->pools[i] = av_buffer_pool_init2(pp->size, pp, plane_alloc,
+                                           plane_pool_free);
+        if (!e->pools[i]) {
+            av_free(pp);
+            return AVERROR(ENOMEM);
+        }
+        atomic_fetch_add(&fp->refcount, 1);
+    }
+
+    return 0;
+}
+
+static int entry_get(FramePool *fp, PoolEntry **pe, int format,
+                     int width, int height, int align)
+{
+    PoolEntry *e = NULL;
+    int ret;
+
+    for (int i = 0; i < fp->nb_entries; i++) {
+        PoolEntry *cur = &fp->entries[i];
+
+        if (cur->format == format && cur->width == width &&
+            cur->height == height && cur->align == align) {
+            *pe = cur;
+            return 0;
+        }
+    }
+
+    if (fp->nb_entries < MAX_ENTRIES)
+        e = &fp->entries[fp->nb_entries++];
+    else {
+        e = &fp->entries[0];
+        for (int i = 1; i < fp->nb_entries; i++)
+            if (fp->entries[i].last_used < e->last_used)
+                e = &fp->entries[i];
+        entry_uninit(e);
+    }
+
+    ret = entry_init(fp, e, format, width, height, align);
+    if (ret < 0) {
+        // leave an unusable but harmless entry behind
+        entry_uninit(e);
+        e->format = -1;
+        return ret;
+    }
+
+    *pe = e;
+    return 0;
+}
+
+int frame_pool_get_video(FramePool *fp, AVFrame *frame,
+                         int width, int height, int align)
+{
+    PoolEntry *e;
+    int ret;
+
+    if (width <= 0 || height <= 0 || align <= 0)
+        return AVERROR(EINVAL);
+
+    pthread_mutex_lock(&fp->lock);
+
+    ret = entry_get(fp, &e, frame->format, width, height, align);
+    if (ret < 0)
+        goto finish;
+    e->last_used = ++fp->clock;
+
+    memset(frame->data,     0, sizeof(frame->data));
+    memset(frame->linesize, 0, sizeof(frame->linesize));
+    frame->extended_data = frame->data;
+
+    fp->allocated = 0;
+    for (int i = 0; i < 4 && e->pools[i]; i++) {
+        frame->buf[i] = av_buffer_pool_get(e->pools[i]);
+        if (!frame->buf[i]) {
+            ret = AVERROR(ENOMEM);
+            goto finish;
+        }
+
+        frame->data[i]     = frame->buf[i]->data;
+        frame->linesize[i] = e->linesize[i];
+    }
+
+    if (fp->allocated)
+        fp->misses++;
+    else
+        fp->hits++;
+
+finish:
+    pthread_mutex_unlock(&fp->lock);
+    if (ret < 0)
+        av_frame_unref(frame);
+    return ret;
+}
+
+void frame_pool_get_stats(FramePool *fp, FramePoolStats *stats)
+{
+    pthread_mutex_lock(&fp->lock);
+    stats->hits          = fp->hits;
+    stats->misses        = fp->misses;
+    stats->resident      = atomic_load(&fp->resident);
+    stats->resident_peak = fp->resident_peak;
+    pthread_mutex_unlock(&fp->lock);
+}
+
+FramePool *frame_pool_alloc(void)
+{
+    FramePool *fp = av_mallocz(sizeof(*fp));
+
+    if (!fp)
+        return NULL;
+
+    if (pthread_mutex_init(&fp->lock, NULL)) {
+        av_free(fp);
+        return NULL;
+    }
+
+    atomic_init(&fp->resident, 0);
+    atomic_init(&fp->refcount, 1);
+
+    return fp;
+}
+
+void frame_pool_free(FramePool **pfp)
+{
+    FramePool *fp = *pfp;
+
+    if (!fp)
+        return;
+
+    pthread_mutex_lock(&fp->lock);
+    for (int i = 0; i < fp->nb_entries; i++)
+        entry_uninit(&fp->entries[i]);
+    fp->nb_entries = 0;
+    pthread_mutex_unlock(&fp->lock);
+
+    frame_pool_unref(fp);
+    *pfp = NULL;
+}
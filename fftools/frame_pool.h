@@ -0,0 +1,72 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef FFTOOLS_FRAME_POOL_H
+#define FFTOOLS_FRAME_POOL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "libavutil/frame.h"
+
+/**
+ * A registry of AVBufferPools for video frame data, keyed by pixel format,
+ * allocation size and linesize alignment, that may be shared between any
+ * number of threads.
+ *
+ * Buffers are returned to the pool they came from when their last reference
+ * is dropped, wherever in the pipeline that happens, so frames released by
+ * an encoder are reused by the next decoder or filter asking for the same
+ * geometry.
+ */
+typedef struct FramePool FramePool;
+
+typedef struct FramePoolStats {
+    /// number of frames whose buffers were all taken from a pool
+    uint64_t hits;
+    /// number of frames for which at least one buffer had to be allocated
+    uint64_t misses;
+    /// bytes currently allocated by the pools, in use or idle
+    size_t   resident;
+    /// highest value of resident seen so far
+    size_t   resident_peak;
+} FramePoolStats;
+
+FramePool *frame_pool_alloc(void);
+
+/**
+ * Free the registry. Buffers still referenced elsewhere stay valid and are
+ * freed when their last reference goes away.
+ */
+void frame_pool_free(FramePool **fp);
+
+/**
+ * Allocate refcounted data buffers for a video frame.
+ *
+ * @param frame  frame with format set and no buffers attached; data[],
+ *               linesize[], buf[] and extended_data are filled on success
+ * @param width  allocated width in pixels, including any padding
+ * @param height allocated height in lines, including any padding
+ * @param align  required alignment of every linesize, in bytes
+ */
+int frame_pool_get_video(FramePool *fp, AVFrame *frame,
+                         int width, int height, int align);
+
+void frame_pool_get_stats(FramePool *fp, FramePoolStats *stats);
+
+#endif // FFTOOLS_FRAME_POOL_H
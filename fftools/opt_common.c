@@ -1104,6 +1104,16 @@ int opt_cpucount(void *optctx, const char *opt, const char *arg)
     return ret;
 }
 
+int opt_numa(void *optctx, const char *opt, const char *arg)
+{
+    int ret = av_cpu_bind_numa_nodes(arg);
+
+    if (ret < 0)
+        av_log(NULL, AV_LOG_ERROR, "Cannot bind to NUMA nodes '%s': %s\n",
+               arg, av_err2str(ret));
+    return ret;
+}
+
 static void expand_filename_template(AVBPrint *bp, const char *template,
                                      struct tm *tm)
 {
@@ -16,10 +16,15 @@
  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
  */
 
+#include <stdatomic.h>
 #include <stdint.h>
 #include <string.h>
 
+#include "config.h"
+
 #include "libavutil/avassert.h"
+#include "libavutil/common.h"
+#include "libavutil/cpu.h"
 #include "libavutil/error.h"
 #include "libavutil/fifo.h"
 #include "libavutil/intreadwrite.h"
@@ -34,15 +39,44 @@ enum {
     FINISHED_RECV = (1 << 1),
 };
 
+// bounds for the adaptive number of polls before a lock-free queue sleeps
+#define SPIN_MIN   16
+#define SPIN_MAX 4096
+
+/* Tell the CPU we are in a spin-wait loop, so that it does not speculate
+ * past it and leaves more resources to the other hardware thread. */
+static av_always_inline void cpu_relax(void)
+{
+#if HAVE_INLINE_ASM && ARCH_X86
+    __asm__ volatile ("pause" ::: "memory");
+#elif HAVE_INLINE_ASM && ARCH_AARCH64
+    __asm__ volatile ("yield" ::: "memory");
+#endif
+}
+
 typedef struct FifoElem {
     void        *obj;
     unsigned int stream_idx;
 } FifoElem;
 
+/**
+ * Slot of the lock-free ring. Each slot permanently owns one object from the
+ * pool; data is moved in and out of it.
+ *
+ * seq == pos     the slot is free for writing the item at position pos
+ * seq == pos + 1 the item at position pos has been written and can be read
+ */
+typedef struct RingSlot {
+    atomic_size_t seq;
+    FifoElem      elem;
+} RingSlot;
+
 struct ThreadQueue {
-    int              *finished;
+    atomic_int       *finished;
     unsigned int    nb_streams;
 
+    unsigned          flags;
+
     AVFifo  *fifo;
 
     ObjPool *obj_pool;
@@ -50,6 +84,24 @@ struct ThreadQueue {
 
     pthread_mutex_t lock;
     pthread_cond_t  cond;
+
+    /* lock-free mode only */
+    RingSlot         *ring;
+    size_t            ring_mask;
+
+    // number of threads sleeping on cond
+    atomic_int        nb_parked;
+    atomic_int        spin_send;
+    atomic_int        spin_recv;
+    // lower bound of spin_send/spin_recv, 0 to never poll
+    int               spin_min;
+
+    // next position to be claimed by a sender
+    atomic_size_t     head;
+    // keep the receiver-owned read position off the senders' cache line
+    uint8_t           pad[64];
+    // next position to be read, only accessed by the receiving thread
+    size_t            tail;
 };
 
 void tq_free(ThreadQueue **ptq)
@@ -66,6 +118,12 @@ void tq_free(ThreadQueue **ptq)
     }
     av_fifo_freep2(&tq->fifo);
 
+    if (tq->ring) {
+        for (size_t i = 0; i <= tq->ring_mask; i++)
+            objpool_release(tq->obj_pool, &tq->ring[i].elem.obj);
+    }
+    av_freep(&tq->ring);
+
     objpool_free(&tq->obj_pool);
 
     av_freep(&tq->finished);
@@ -76,8 +134,39 @@ void tq_free(ThreadQueue **ptq)
     av_freep(ptq);
 }
 
+static int ring_alloc(ThreadQueue *tq, size_t queue_size)
+{
+    size_t size = 1;
+
+    while (size < queue_size)
+        size <<= 1;
+
+    tq->ring = av_calloc(size, sizeof(*tq->ring));
+    if (!tq->ring)
+        return AVERROR(ENOMEM);
+    tq->ring_mask = size - 1;
+
+    for (size_t i = 0; i < size; i++) {
+        int ret = objpool_get(tq->obj_pool, &tq->ring[i].elem.obj);
+        if (ret < 0)
+            return ret;
+        atomic_init(&tq->ring[i].seq, i);
+    }
+
+    atomic_init(&tq->head,      0);
+    atomic_init(&tq->nb_parked, 0);
+    // polling cannot succeed with a single CPU, the other side only makes
+    // progress once we sleep
+    tq->spin_min = av_cpu_count() > 1 ? SPIN_MIN : 0;
+    atomic_init(&tq->spin_send, tq->spin_min);
+    atomic_init(&tq->spin_recv, tq->spin_min);
+
+    return 0;
+}
+
 ThreadQueue *tq_alloc(unsigned int nb_streams, size_t queue_size,
-                      ObjPool *obj_pool, void (*obj_move)(void *dst, void *src))
+                      ObjPool *obj_pool, void (*obj_move)(void *dst, void *src),
+                      unsigned flags)
 {
     ThreadQueue *tq;
     int ret;
@@ -103,13 +192,21 @@ ThreadQueue *tq_alloc(unsigned int nb_streams, size_t queue_size,
     if (!tq->finished)
         goto fail;
     tq->nb_streams = nb_streams;
-
-    tq->fifo = av_fifo_alloc2(queue_size, sizeof(FifoElem), 0);
-    if (!tq->fifo)
-        goto fail;
+    for (unsigned int i = 0; i < nb_streams; i++)
+        atomic_init(&tq->finished[i], 0);
 
     tq->obj_pool = obj_pool;
     tq->obj_move = obj_move;
+    tq->flags    = flags;
+
+    if (flags & THREAD_QUEUE_FLAG_LOCKFREE) {
+        if (ring_alloc(tq, queue_size) < 0)
+            goto fail;
+    } else {
+        tq->fifo = av_fifo_alloc2(queue_size, sizeof(FifoElem), 0);
+        if (!tq->fifo)
+            goto fail;
+    }
 
     return tq;
 fail:
@@ -117,27 +214,154 @@ fail:
     return NULL;
 }
 
+/**
+ * Wake up all threads sleeping in ring_wait(). Must be called after every
+ * change of the ring or finished state that a sleeper might be waiting for.
+ */
+static void ring_wake(ThreadQueue *tq)
+{
+    // pairs with the fence in ring_wait(): either we see the sleeper,
+    // or the sleeper sees the state change that triggered this call
+    atomic_thread_fence(memory_order_seq_cst);
+
+    if (!atomic_load_explicit(&tq->nb_parked, memory_order_relaxed))
+        return;
+
+    pthread_mutex_lock(&tq->lock);
+    pthread_cond_broadcast(&tq->cond);
+    pthread_mutex_unlock(&tq->lock);
+}
+
+/**
+ * Wait until ready() returns non-zero. Poll for an adaptive number of
+ * iterations first, which grows while polling succeeds and shrinks when we
+ * end up sleeping anyway.
+ */
+static void ring_wait(ThreadQueue *tq, atomic_int *spin,
+                      int (*ready)(ThreadQueue *tq, unsigned int stream_idx),
+                      unsigned int stream_idx)
+{
+    int nb_spin = atomic_load_explicit(spin, memory_order_relaxed);
+
+    for (int i = 0; i < nb_spin; i++) {
+        if (ready(tq, stream_idx)) {
+            atomic_store_explicit(spin, FFMIN(2 * nb_spin, SPIN_MAX),
+                                  memory_order_relaxed);
+            return;
+        }
+        cpu_relax();
+    }
+    atomic_store_explicit(spin, FFMAX(nb_spin / 2, tq->spin_min),
+                          memory_order_relaxed);
+
+    pthread_mutex_lock(&tq->lock);
+
+    atomic_fetch_add(&tq->nb_parked, 1);
+    atomic_thread_fence(memory_order_seq_cst);
+
+    while (!ready(tq, stream_idx))
+        pthread_cond_wait(&tq->cond, &tq->lock);
+
+    atomic_fetch_sub(&tq->nb_parked, 1);
+
+    pthread_mutex_unlock(&tq->lock);
+}
+
+static int ring_can_send(ThreadQueue *tq, unsigned int stream_idx)
+{
+    size_t    pos = atomic_load_explicit(&tq->head, memory_order_relaxed);
+    RingSlot *slot = &tq->ring[pos & tq->ring_mask];
+    size_t    seq = atomic_load_explicit(&slot->seq, memory_order_acquire);
+
+    return (intptr_t)(seq - pos) >= 0 ||
+           (atomic_load(&tq->finished[stream_idx]) & FINISHED_RECV);
+}
+
+static int ring_send(ThreadQueue *tq, unsigned int stream_idx, void *data)
+{
+    size_t    pos = atomic_load_explicit(&tq->head, memory_order_relaxed);
+    RingSlot *slot;
+
+    while (1) {
+        intptr_t diff;
+
+        slot = &tq->ring[pos & tq->ring_mask];
+        diff = (intptr_t)(atomic_load_explicit(&slot->seq, memory_order_acquire) - pos);
+
+        if (diff < 0)
+            return AVERROR(EAGAIN);
+
+        if (diff == 0) {
+            if (tq->flags & THREAD_QUEUE_FLAG_SINGLE_PRODUCER) {
+                atomic_store_explicit(&tq->head, pos + 1, memory_order_relaxed);
+                break;
+            }
+            if (atomic_compare_exchange_weak_explicit(&tq->head, &pos, pos + 1,
+                                                      memory_order_relaxed,
+                                                      memory_order_relaxed))
+                break;
+        } else
+            pos = atomic_load_explicit(&tq->head, memory_order_relaxed);
+    }
+
+    tq->obj_move(slot->elem.obj, data);
+    slot->elem.stream_idx = stream_idx;
+
+    atomic_store_explicit(&slot->seq, pos + 1, memory_order_release);
+
+    return 0;
+}
+
+static int tq_send_lockfree(ThreadQueue *tq, unsigned int stream_idx, void *data)
+{
+    atomic_int *finished = &tq->finished[stream_idx];
+    int ret;
+
+    if (atomic_load(finished) & FINISHED_SEND)
+        return AVERROR(EINVAL);
+
+    while (1) {
+        if (atomic_load(finished) & FINISHED_RECV) {
+            atomic_fetch_or(finished, FINISHED_SEND);
+            return AVERROR_EOF;
+        }
+
+        ret = ring_send(tq, stream_idx, data);
+        if (ret != AVERROR(EAGAIN))
+            break;
+
+        ring_wait(tq, &tq->spin_send, ring_can_send, stream_idx);
+    }
+
+    ring_wake(tq);
+
+    return ret;
+}
+
 int tq_send(ThreadQueue *tq, unsigned int stream_idx, void *data)
 {
-    int *finished;
+    atomic_int *finished;
     int ret;
 
     av_assert0(stream_idx < tq->nb_streams);
     finished = &tq->finished[stream_idx];
 
+    if (tq->flags & THREAD_QUEUE_FLAG_LOCKFREE)
+        return tq_send_lockfree(tq, stream_idx, data);
+
     pthread_mutex_lock(&tq->lock);
 
-    if (*finished & FINISHED_SEND) {
+    if (atomic_load(finished) & FINISHED_SEND) {
         ret = AVERROR(EINVAL);
         goto finish;
     }
 
-    while (!(*finished & FINISHED_RECV) && !av_fifo_can_write(tq->fifo))
+    while (!(atomic_load(finished) & FINISHED_RECV) && !av_fifo_can_write(tq->fifo))
         pthread_cond_wait(&tq->cond, &tq->lock);
 
-    if (*finished & FINISHED_RECV) {
+    if (atomic_load(finished) & FINISHED_RECV) {
         ret = AVERROR_EOF;
-        *finished |= FINISHED_SEND;
+        atomic_fetch_or(finished, FINISHED_SEND);
     } else {
         FifoElem elem = { .stream_idx = stream_idx };
 
@@ -158,14 +382,45 @@ finish:
     return ret;
 }
 
+/**
+ * Check the per-stream finished state once there are no more items to read.
+ */
+static int receive_eof(ThreadQueue *tq, int *stream_idx)
+{
+    unsigned int nb_finished = 0;
+
+    for (unsigned int i = 0; i < tq->nb_streams; i++) {
+        int finished = atomic_load(&tq->finished[i]);
+
+        if (!finished)
+            continue;
+
+        /* return EOF to the consumer at most once for each stream */
+        if (!(finished & FINISHED_RECV)) {
+            // with the lock-free ring, items sent before the stream was
+            // finished may still be in the process of being written
+            if ((tq->flags & THREAD_QUEUE_FLAG_LOCKFREE) &&
+                atomic_load(&tq->head) != tq->tail)
+                return AVERROR(EAGAIN);
+
+            atomic_fetch_or(&tq->finished[i], FINISHED_RECV);
+            *stream_idx   = i;
+            return AVERROR_EOF;
+        }
+
+        nb_finished++;
+    }
+
+    return nb_finished == tq->nb_streams ? AVERROR_EOF : AVERROR(EAGAIN);
+}
+
 static int receive_locked(ThreadQueue *tq, int *stream_idx,
                           void *data)
 {
     FifoElem elem;
-    unsigned int nb_finished = 0;
 
     while (av_fifo_read(tq->fifo, &elem, 1) >= 0) {
-        if (tq->finished[elem.stream_idx] & FINISHED_RECV) {
+        if (atomic_load(&tq->finished[elem.stream_idx]) & FINISHED_RECV) {
             objpool_release(tq->obj_pool, &elem.obj);
             continue;
         }
@@ -176,21 +431,87 @@ static int receive_locked(ThreadQueue *tq, int *stream_idx,
         return 0;
     }
 
+    return receive_eof(tq, stream_idx);
+}
+
+static int ring_can_receive(ThreadQueue *tq, unsigned int dummy)
+{
+    RingSlot *slot = &tq->ring[tq->tail & tq->ring_mask];
+    unsigned int nb_finished = 0;
+
+    if (atomic_load_explicit(&slot->seq, memory_order_acquire) == tq->tail + 1)
+        return 1;
+
+    // an item is being written, its sender will wake us
+    if (atomic_load(&tq->head) != tq->tail)
+        return 0;
+
     for (unsigned int i = 0; i < tq->nb_streams; i++) {
-        if (!tq->finished[i])
-            continue;
+        int finished = atomic_load(&tq->finished[i]);
 
-        /* return EOF to the consumer at most once for each stream */
-        if (!(tq->finished[i] & FINISHED_RECV)) {
-            tq->finished[i] |= FINISHED_RECV;
-            *stream_idx   = i;
-            return AVERROR_EOF;
+        if (finished && !(finished & FINISHED_RECV))
+            return 1;
+        nb_finished += !!finished;
+    }
+
+    return nb_finished == tq->nb_streams;
+}
+
+static int ring_receive(ThreadQueue *tq, int *stream_idx, void *data)
+{
+    while (1) {
+        RingSlot *slot = &tq->ring[tq->tail & tq->ring_mask];
+        int discard;
+
+        if (atomic_load_explicit(&slot->seq, memory_order_acquire) != tq->tail + 1)
+            break;
+
+        discard = atomic_load(&tq->finished[slot->elem.stream_idx]) & FINISHED_RECV;
+        if (discard) {
+            // the pool is only ever touched by the receiving thread in
+            // lock-free mode, so this gives us back the same object, reset
+            objpool_release(tq->obj_pool, &slot->elem.obj);
+            objpool_get(tq->obj_pool, &slot->elem.obj);
+            av_assert0(slot->elem.obj);
+        } else {
+            tq->obj_move(data, slot->elem.obj);
+            *stream_idx = slot->elem.stream_idx;
         }
 
-        nb_finished++;
+        atomic_store_explicit(&slot->seq, tq->tail + tq->ring_mask + 1,
+                              memory_order_release);
+        tq->tail++;
+
+        if (!discard)
+            return 0;
     }
 
-    return nb_finished == tq->nb_streams ? AVERROR_EOF : AVERROR(EAGAIN);
+    return receive_eof(tq, stream_idx);
+}
+
+static int tq_receive_lockfree(ThreadQueue *tq, int *stream_idx, void *data)
+{
+    size_t tail = tq->tail;
+    int ret;
+
+    while (1) {
+        ret = ring_receive(tq, stream_idx, data);
+        if (ret != AVERROR(EAGAIN))
+            break;
+
+        // make sure senders blocked on slots we freed get woken
+        if (tail != tq->tail) {
+            ring_wake(tq);
+            tail = tq->tail;
+        }
+
+        ring_wait(tq, &tq->spin_recv, ring_can_receive, 0);
+    }
+
+    // signal other threads if the ring or finished state changed
+    ring_wake(tq);
+
+    return ret;
 }
 
 int tq_receive(ThreadQueue *tq, int *stream_idx, void *data)
@@ -199,6 +520,9 @@ int tq_receive(ThreadQueue *tq, int *stream_idx, void *data)
 
     *stream_idx = -1;
 
+    if (tq->flags & THREAD_QUEUE_FLAG_LOCKFREE)
+        return tq_receive_lockfree(tq, stream_idx, data);
+
     pthread_mutex_lock(&tq->lock);
 
     while (1) {
@@ -227,12 +551,18 @@ void tq_send_finish(ThreadQueue *tq, unsigned int stream_idx)
 {
     av_assert0(stream_idx < tq->nb_streams);
 
+    if (tq->flags & THREAD_QUEUE_FLAG_LOCKFREE) {
+        atomic_fetch_or(&tq->finished[stream_idx], FINISHED_SEND);
+        ring_wake(tq);
+        return;
+    }
+
     pthread_mutex_lock(&tq->lock);
 
     /* mark the stream as send-finished;
      * next time the consumer thread tries to read this stream it will get
      * an EOF and recv-finished flag will be set */
-    tq->finished[stream_idx] |= FINISHED_SEND;
+    atomic_fetch_or(&tq->finished[stream_idx], FINISHED_SEND);
     pthread_cond_broadcast(&tq->cond);
 
     pthread_mutex_unlock(&tq->lock);
@@ -242,12 +572,18 @@ void tq_receive_finish(ThreadQueue *tq, unsigned int stream_idx)
 {
     av_assert0(stream_idx < tq->nb_streams);
 
+    if (tq->flags & THREAD_QUEUE_FLAG_LOCKFREE) {
+        atomic_fetch_or(&tq->finished[stream_idx], FINISHED_RECV);
+        ring_wake(tq);
+        return;
+    }
+
     pthread_mutex_lock(&tq->lock);
 
     /* mark the stream as recv-finished;
      * next time the producer thread tries to send for this stream, it will
      * get an EOF and send-finished flag will be set */
-    tq->finished[stream_idx] |= FINISHED_RECV;
+    atomic_fetch_or(&tq->finished[stream_idx], FINISHED_RECV);
     pthread_cond_broadcast(&tq->cond);
 
     pthread_mutex_unlock(&tq->lock);
@@ -25,6 +25,26 @@
 
 typedef struct ThreadQueue ThreadQueue;
 
+enum ThreadQueueFlags {
+    /**
+     * Store the items in a lock-free ring buffer instead of a mutex-protected
+     * FIFO. Waiting for space/data spins for a while before blocking, so a
+     * mutex is only ever taken when a thread actually has to sleep.
+     *
+     * tq_receive() and tq_receive_finish() must only ever be called from a
+     * single thread at a time. The queue size is rounded up to a power of two.
+     */
+    THREAD_QUEUE_FLAG_LOCKFREE          = (1 << 0),
+    /**
+     * Calls to tq_send() are never made concurrently, i.e. there is only one
+     * producer thread or the producers are serialized externally. Allows the
+     * lock-free ring to avoid compare-and-swap on the send side.
+     *
+     * Only meaningful together with THREAD_QUEUE_FLAG_LOCKFREE.
+     */
+    THREAD_QUEUE_FLAG_SINGLE_PRODUCER   = (1 << 1),
+};
+
 /**
  * Allocate a queue for sending data between threads.
  *
@@ -35,9 +55,11 @@ typedef struct ThreadQueue ThreadQueue;
  * @param obj_pool object pool that will be used to allocate items stored in the
  *                 queue; the pool becomes owned by the queue
  * @param callback that moves the contents between two data pointers
+ * @param flags a combination of ThreadQueueFlags
  */
 ThreadQueue *tq_alloc(unsigned int nb_streams, size_t queue_size,
-                      ObjPool *obj_pool, void (*obj_move)(void *dst, void *src));
+                      ObjPool *obj_pool, void (*obj_move)(void *dst, void *src),
+                      unsigned flags);
 void         tq_free(ThreadQueue **tq);
 
 /**
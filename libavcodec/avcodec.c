@@ -35,6 +35,7 @@
 #include "libavutil/mem.h"
 #include "libavutil/opt.h"
 #include "libavutil/thread.h"
+#include "libavutil/trace.h"
 #include "avcodec.h"
 #include "avcodec_internal.h"
 #include "bsf.h"
@@ -482,6 +483,7 @@ av_cold void ff_codec_close(AVCodecContext *avctx)
 
     av_buffer_unref(&avctx->hw_frames_ctx);
     av_buffer_unref(&avctx->hw_device_ctx);
+    av_buffer_unref(&avctx->thread_pool);
 
     if (avctx->priv_data && avctx->codec && avctx->codec->priv_class)
         av_opt_free(avctx->priv_data);
@@ -712,11 +714,18 @@ int avcodec_is_open(AVCodecContext *s)
 
 int attribute_align_arg avcodec_receive_frame(AVCodecContext *avctx, AVFrame *frame)
 {
+    int ret;
+
     av_frame_unref(frame);
 
+    av_trace_begin("avcodec_receive_frame");
     if (av_codec_is_decoder(avctx->codec))
-        return ff_decode_receive_frame(avctx, frame);
-    return ff_encode_receive_frame(avctx, frame);
+        ret = ff_decode_receive_frame(avctx, frame);
+    else
+        ret = ff_encode_receive_frame(avctx, frame);
+    av_trace_end("avcodec_receive_frame");
+
+    return ret;
 }
 
 #define WRAP_CONFIG(allowed_type, field, field_type, terminator)            \
@@ -2086,6 +2086,53 @@ typedef struct AVCodecContext {
      */
     AVFrameSideData  **decoded_side_data;
     int             nb_decoded_side_data;
+
+    /**
+     * NUMA nodes to run worker threads on, as a list of node indices and
+     * ranges, e.g. "0" or "0-1,3". Threads created by libavcodec for this
+     * context are bound to these nodes with av_cpu_bind_numa_nodes(), so the
+     * buffers they allocate are placed on those nodes as well.
+     *
+     * - encoding: Set by user.
+     * - decoding: Set by user.
+     */
+    char *numa_nodes;
+
+    /**
+     * A reference to a thread pool allocated with av_threadpool_alloc(),
+     * on which slice threading runs instead of on threads created for this
+     * context. thread_count then is the maximum number of threads working for
+     * this context at once, including the calling thread; automatic thread
+     * count selection is bounded by the size of the pool.
+     *
+     * Frame threading and codecs running a separate main function alongside
+     * their slice threads still create their own threads. With frame
+     * threading, the HEVC decoder additionally decodes the CTB rows of
+     * pictures using wavefront parallel processing on the pool.
+     *
+     * - encoding: May be set by the user before avcodec_open2(). Owned and
+     *             freed by libavcodec afterwards.
+     * - decoding: May be set by the user before avcodec_open2(). Owned and
+     *             freed by libavcodec afterwards.
+     */
+    AVBufferRef *thread_pool;
+
+    /**
+     * Maximum number of packets sent to a frame-threaded decoder after the one
+     * a frame was decoded from, before that frame is returned. A frame is
+     * returned as soon as it is decoded, and the packet it is decoded from is
+     * waited for once this many packets are in flight after it. Threads which
+     * are not busy then stay idle, so lower values trade decoding throughput
+     * for latency.
+     *
+     * -1 means thread_count - 1, where every thread gets a packet before the
+     * first frame is returned, and frames are only returned once all threads
+     * are busy.
+     *
+     * - encoding: unused
+     * - decoding: Set by user.
+     */
+    int max_frame_delay;
 } AVCodecContext;
 
 /**
@@ -38,6 +38,7 @@
 #include "libavutil/mastering_display_metadata.h"
 #include "libavutil/mem.h"
 #include "libavutil/stereo3d.h"
+#include "libavutil/trace.h"
 
 #include "avcodec.h"
 #include "avcodec_internal.h"
@@ -749,7 +750,9 @@ int attribute_align_arg avcodec_send_packet(AVCodecContext *avctx, const AVPacke
         dc->draining_started = 1;
 
     if (!avci->buffer_frame->buf[0] && !dc->draining_started) {
+        av_trace_begin("avcodec_send_packet");
         ret = decode_receive_frame_internal(avctx, avci->buffer_frame);
+        av_trace_end("avcodec_send_packet");
         if (ret < 0 && ret != AVERROR(EAGAIN) && ret != AVERROR_EOF)
             return ret;
     }
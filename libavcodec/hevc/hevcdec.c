@@ -35,6 +35,7 @@
 #include "libavutil/opt.h"
 #include "libavutil/pixdesc.h"
 #include "libavutil/stereo3d.h"
+#include "libavutil/threadpool.h"
 #include "libavutil/timecode.h"
 
 #include "aom_film_grain.h"
@@ -2830,6 +2831,32 @@ error:
     return ret;
 }
 
+typedef struct WPPPoolJobs {
+    AVCodecContext   *avctx;
+    HEVCLocalContext *lc;
+    int              *ret;
+} WPPPoolJobs;
+
+static void wpp_pool_job(void *arg, int jobnr, int threadnr, int nb_jobs, int nb_threads)
+{
+    WPPPoolJobs *jobs = arg;
+
+    jobs->ret[jobnr] = hls_decode_entry_wpp(jobs->avctx, jobs->lc, jobnr, threadnr);
+}
+
+/**
+ * With frame threading, the CTB rows of a WPP slice are decoded on the thread
+ * pool attached to the codec context, if any. The frame thread decoding the
+ * slice works on the rows too and picks them in order, so that every row is
+ * eventually decoded even if all pool threads wait for the rows of other
+ * frames. Only WPP rows are moved to the pool: tiles, and slices without
+ * entry points, are still decoded by the frame thread alone.
+ */
+static int wpp_use_pool(const HEVCContext *s)
+{
+    return s->avctx->active_thread_type == FF_THREAD_FRAME && s->avctx->thread_pool;
+}
+
 static int wpp_progress_init(HEVCContext *s, unsigned count)
 {
     if (s->nb_wpp_progress < count) {
@@ -2865,7 +2892,7 @@ static int hls_slice_data_wpp(HEVCContext *s, const H2645NAL *nal)
     int *ret;
     int64_t offset;
     int64_t startheader, cmpt = 0;
-    int i, j, res = 0;
+    int i, j, nb_threads, res = 0;
 
     if (s->sh.slice_ctb_addr_rs + s->sh.num_entry_point_offsets * sps->ctb_width >= sps->ctb_width * sps->ctb_height) {
         av_log(s->avctx, AV_LOG_ERROR, "WPP ctb addresses are wrong (%d %d %d %d)\n",
@@ -2875,8 +2902,10 @@ static int hls_slice_data_wpp(HEVCContext *s, const H2645NAL *nal)
         return AVERROR_INVALIDDATA;
     }
 
-    if (s->avctx->thread_count > s->nb_local_ctx) {
-        HEVCLocalContext *tmp = av_malloc_array(s->avctx->thread_count, sizeof(*s->local_ctx));
+    nb_threads = wpp_use_pool(s) ? av_threadpool_get_nb_threads(s->avctx->thread_pool) + 1 :
+                                   s->avctx->thread_count;
+    if (nb_threads > s->nb_local_ctx) {
+        HEVCLocalContext *tmp = av_malloc_array(nb_threads, sizeof(*s->local_ctx));
 
         if (!tmp)
             return AVERROR(ENOMEM);
@@ -2885,7 +2914,7 @@ static int hls_slice_data_wpp(HEVCContext *s, const H2645NAL *nal)
         av_free(s->local_ctx);
         s->local_ctx = tmp;
 
-        for (unsigned i = s->nb_local_ctx; i < s->avctx->thread_count; i++) {
+        for (unsigned i = s->nb_local_ctx; i < nb_threads; i++) {
             tmp = &s->local_ctx[i];
 
             memset(tmp, 0, sizeof(*tmp));
@@ -2895,7 +2924,7 @@ static int hls_slice_data_wpp(HEVCContext *s, const H2645NAL *nal)
             tmp->common_cabac_state = &s->cabac;
         }
 
-        s->nb_local_ctx = s->avctx->thread_count;
+        s->nb_local_ctx = nb_threads;
     }
 
     offset = s->sh.data_offset;
@@ -2948,8 +2977,14 @@ static int hls_slice_data_wpp(HEVCContext *s, const H2645NAL *nal)
     if (!ret)
         return AVERROR(ENOMEM);
 
-    if (pps->entropy_coding_sync_enabled_flag)
-        s->avctx->execute2(s->avctx, hls_decode_entry_wpp, s->local_ctx, ret, s->sh.num_entry_point_offsets + 1);
+    if (pps->entropy_coding_sync_enabled_flag) {
+        if (wpp_use_pool(s)) {
+            WPPPoolJobs jobs = { s->avctx, s->local_ctx, ret };
+            av_threadpool_execute(s->avctx->thread_pool, wpp_pool_job, &jobs,
+                                  s->sh.num_entry_point_offsets + 1, nb_threads, 0);
+        } else
+            s->avctx->execute2(s->avctx, hls_decode_entry_wpp, s->local_ctx, ret, s->sh.num_entry_point_offsets + 1);
+    }
 
     for (i = 0; i <= s->sh.num_entry_point_offsets; i++)
         res += ret[i];
@@ -3004,8 +3039,8 @@ static int decode_slice_data(HEVCContext *s, const HEVCLayerContext *l,
     s->local_ctx[0].tu.cu_qp_offset_cb = 0;
     s->local_ctx[0].tu.cu_qp_offset_cr = 0;
 
-    if (s->avctx->active_thread_type == FF_THREAD_SLICE  &&
-        s->sh.num_entry_point_offsets > 0                &&
+    if ((s->avctx->active_thread_type == FF_THREAD_SLICE || wpp_use_pool(s)) &&
+        s->sh.num_entry_point_offsets > 0                                   &&
         pps->num_tile_rows == 1 && pps->num_tile_columns == 1)
         return hls_slice_data_wpp(s, nal);
 
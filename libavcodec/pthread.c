@@ -29,6 +29,9 @@
  * @see doc/multithreading.txt
  */
 
+#include "libavutil/cpu.h"
+#include "libavutil/error.h"
+#include "libavutil/log.h"
 #include "libavutil/thread.h"
 
 #include "avcodec.h"
@@ -89,6 +92,19 @@ void ff_thread_free(AVCodecContext *avctx)
         ff_slice_thread_free(avctx);
 }
 
+void ff_thread_bind_numa_nodes(AVCodecContext *avctx)
+{
+    int ret;
+
+    if (!avctx->numa_nodes)
+        return;
+
+    ret = av_cpu_bind_numa_nodes(avctx->numa_nodes);
+    if (ret < 0)
+        av_log(avctx, AV_LOG_WARNING, "Could not bind thread to NUMA nodes %s: %s\n",
+               avctx->numa_nodes, av_err2str(ret));
+}
+
 av_cold void ff_pthread_free(void *obj, const unsigned offsets[])
 {
     unsigned cnt = *(unsigned*)((char*)obj + offsets[0]);
@@ -149,6 +149,7 @@ typedef struct FrameThreadContext {
 
     int next_decoding;             ///< The next context to submit a packet to.
     int next_finished;             ///< The next context to return output from.
+    int nb_pending;                ///< Number of contexts with output not returned yet.
 
     /* hwaccel state for thread-unsafe hwaccels is temporarily stored here in
      * order to transfer its ownership to the next decoding thread without the
@@ -252,6 +253,7 @@ static attribute_align_arg void *frame_worker_thread(void *arg)
     const FFCodec *codec = ffcodec(avctx->codec);
 
     thread_set_name(p);
+    ff_thread_bind_numa_nodes(avctx);
 
     pthread_mutex_lock(&p->mutex);
     while (1) {
@@ -563,6 +565,22 @@ static int submit_packet(PerThreadContext *p, AVCodecContext *user_avctx,
     return 0;
 }
 
+/**
+ * In low-delay mode, check whether the output of the oldest packet in flight
+ * should be returned before submitting another one: either because it is
+ * already decoded, or because max_frame_delay packets are in flight after it.
+ */
+static int output_due(const AVCodecContext *avctx, const FrameThreadContext *fctx)
+{
+    const PerThreadContext *p = &fctx->threads[fctx->next_finished];
+
+    if (avctx->max_frame_delay < 0 || !fctx->nb_pending)
+        return 0;
+
+    return fctx->nb_pending > avctx->max_frame_delay ||
+           atomic_load(&p->state) == STATE_INPUT_READY;
+}
+
 int ff_thread_receive_frame(AVCodecContext *avctx, AVFrame *frame)
 {
     FrameThreadContext *fctx = avctx->internal->thread_ctx;
@@ -576,24 +594,29 @@ int ff_thread_receive_frame(AVCodecContext *avctx, AVFrame *frame)
     while (!fctx->df.nb_f && !fctx->result) {
         PerThreadContext *p;
 
-        /* get a packet to be submitted to the next thread */
-        av_packet_unref(fctx->next_pkt);
-        ret = ff_decode_get_packet(avctx, fctx->next_pkt);
-        if (ret < 0 && ret != AVERROR_EOF)
-            goto finish;
-
-        ret = submit_packet(&fctx->threads[fctx->next_decoding], avctx,
-                            fctx->next_pkt);
-        if (ret < 0)
-             goto finish;
-
-        /* do not return any frames until all threads have something to do */
-        if (fctx->next_decoding != fctx->next_finished &&
-            !avctx->internal->draining)
-            continue;
+        if (!output_due(avctx, fctx)) {
+            /* get a packet to be submitted to the next thread */
+            av_packet_unref(fctx->next_pkt);
+            ret = ff_decode_get_packet(avctx, fctx->next_pkt);
+            if (ret < 0 && ret != AVERROR_EOF)
+                goto finish;
+
+            ret = submit_packet(&fctx->threads[fctx->next_decoding], avctx,
+                                fctx->next_pkt);
+            if (ret < 0)
+                 goto finish;
+            fctx->nb_pending++;
+
+            /* do not return any frames until all threads have something to do,
+             * unless in low-delay mode */
+            if (fctx->next_decoding != fctx->next_finished &&
+                !avctx->internal->draining)
+                continue;
+        }
 
         p                   = &fctx->threads[fctx->next_finished];
         fctx->next_finished = (fctx->next_finished + 1) % avctx->thread_count;
+        fctx->nb_pending--;
 
         if (atomic_load(&p->state) != STATE_INPUT_READY) {
             pthread_mutex_lock(&p->progress_mutex);
@@ -995,6 +1018,7 @@ void ff_thread_flush(AVCodecContext *avctx)
     }
 
     fctx->next_decoding = fctx->next_finished = 0;
+    fctx->nb_pending = 0;
     fctx->prev_thread = NULL;
 
     decoded_frames_flush(&fctx->df);
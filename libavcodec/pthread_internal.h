@@ -31,6 +31,11 @@ void ff_slice_thread_free(AVCodecContext *avctx);
 int ff_frame_thread_init(AVCodecContext *avctx);
 void ff_frame_thread_free(AVCodecContext *avctx, int thread_count);
 
+/**
+ * Bind the calling worker thread to AVCodecContext.numa_nodes, if set.
+ */
+void ff_thread_bind_numa_nodes(AVCodecContext *avctx);
+
 #define THREAD_SENTINEL 0 // This forbids putting a mutex/condition variable at the front.
 /**
  * Initialize/destroy a list of mutexes/conditions contained in a structure.
@@ -33,8 +33,10 @@
 #include "libavutil/avassert.h"
 #include "libavutil/common.h"
 #include "libavutil/cpu.h"
+#include "libavutil/log.h"
 #include "libavutil/mem.h"
 #include "libavutil/thread.h"
+#include "libavutil/threadpool.h"
 #include "libavutil/slicethread.h"
 
 typedef int (action_func)(AVCodecContext *c, void *arg);
@@ -112,6 +114,11 @@ int ff_slice_thread_execute_with_mainfunc(AVCodecContext *avctx, action_func2* f
     return thread_execute(avctx, NULL, arg, ret, job_count, 0);
 }
 
+static void thread_init(void *priv)
+{
+    ff_thread_bind_numa_nodes(priv);
+}
+
 int ff_slice_thread_init(AVCodecContext *avctx)
 {
     SliceThreadContext *c;
@@ -124,8 +131,14 @@ int ff_slice_thread_init(AVCodecContext *avctx)
         avctx->height > 2800)
         thread_count = avctx->thread_count = 1;
 
+    mainfunc = ffcodec(avctx->codec)->caps_internal & FF_CODEC_CAP_SLICE_THREAD_HAS_MF ? &main_function : NULL;
+    if (mainfunc && avctx->thread_pool)
+        av_log(avctx, AV_LOG_VERBOSE, "Codec needs its own slice threads, not using the thread pool\n");
+
     if (!thread_count) {
-        int nb_cpus = av_cpu_count();
+        int nb_cpus = avctx->thread_pool && !mainfunc ?
+                      av_threadpool_get_nb_threads(avctx->thread_pool) + 1 :
+                      av_cpu_count();
         if  (avctx->height)
             nb_cpus = FFMIN(nb_cpus, (avctx->height+15)/16);
         // use number of cores + 1 as thread count if there is more than one
@@ -141,8 +154,15 @@ int ff_slice_thread_init(AVCodecContext *avctx)
     }
 
     avctx->internal->thread_ctx = c = av_mallocz(sizeof(*c));
-    mainfunc = ffcodec(avctx->codec)->caps_internal & FF_CODEC_CAP_SLICE_THREAD_HAS_MF ? &main_function : NULL;
-    if (!c || (thread_count = avpriv_slicethread_create(&c->thread, avctx, worker_func, mainfunc, thread_count)) <= 1) {
+    if (c) {
+        if (avctx->thread_pool && !mainfunc)
+            thread_count = avpriv_slicethread_create_pool(&c->thread, avctx, worker_func,
+                                                          avctx->thread_pool, thread_count);
+        else
+            thread_count = avpriv_slicethread_create2(&c->thread, avctx, worker_func,
+                                                      mainfunc, thread_init, thread_count);
+    }
+    if (!c || thread_count <= 1) {
         if (c)
             avpriv_slicethread_free(&c->thread);
         av_freep(&avctx->internal->thread_ctx);
@@ -43,9 +43,8 @@ AVFrame *ff_null_get_audio_buffer(AVFilterLink *link, int nb_samples)
     return ff_get_audio_buffer(link->dst->outputs[0], nb_samples);
 }
 
-AVFrame *ff_default_get_audio_buffer(AVFilterLink *link, int nb_samples)
+static AVFrame *frame_pool_get_audio(AVFilterLink *link, int nb_samples)
 {
-    AVFrame *frame = NULL;
     FilterLinkInternal *const li = ff_link_internal(link);
     int channels = link->ch_layout.nb_channels;
     int align = av_cpu_max_align();
@@ -78,7 +77,17 @@ AVFrame *ff_default_get_audio_buffer(AVFilterLink *link, int nb_samples)
         }
     }
 
-    frame = ff_frame_pool_get(li->frame_pool);
+    return ff_frame_pool_get(li->frame_pool);
+}
+
+AVFrame *ff_default_get_audio_buffer(AVFilterLink *link, int nb_samples)
+{
+    AVFrame *frame = NULL;
+    int channels = link->ch_layout.nb_channels;
+
+    ff_graph_buffer_lock(link->src->graph);
+    frame = frame_pool_get_audio(link, nb_samples);
+    ff_graph_buffer_unlock(link->src->graph);
     if (!frame)
         return NULL;
 
@@ -99,7 +108,7 @@ AVFrame *ff_get_audio_buffer(AVFilterLink *link, int nb_samples)
 {
     AVFrame *ret = NULL;
 
-    if (link->dstpad->get_buffer.audio)
+    if (link->dstpad->get_buffer.audio && !ff_link_default_buffer(link))
         ret = link->dstpad->get_buffer.audio(link, nb_samples);
 
     if (!ret)
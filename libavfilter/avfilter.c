@@ -34,6 +34,7 @@
 #include "libavutil/pixdesc.h"
 #include "libavutil/rational.h"
 #include "libavutil/samplefmt.h"
+#include "libavutil/trace.h"
 
 #include "audio.h"
 #include "avfilter.h"
@@ -603,6 +604,9 @@ static int set_enable_expr(AVFilterContext *ctx, const char *expr)
 
 int avfilter_process_command(AVFilterContext *filter, const char *cmd, const char *arg, char *res, int res_len, int flags)
 {
+    if (fffilterctx(filter)->frame_busy)
+        ff_graph_frame_thread_wait(fffiltergraph(filter->graph), filter);
+
     if(!strcmp(cmd, "ping")){
         char local_res[256] = {0};
 
@@ -659,6 +663,7 @@ static const AVOption avfilter_options[] = {
     { "thread_type", "Allowed thread types", OFFSET(thread_type), AV_OPT_TYPE_FLAGS,
         { .i64 = AVFILTER_THREAD_SLICE }, 0, INT_MAX, FLAGS, .unit = "thread_type" },
         { "slice", NULL, 0, AV_OPT_TYPE_CONST, { .i64 = AVFILTER_THREAD_SLICE }, .flags = FLAGS, .unit = "thread_type" },
+        { "frame", NULL, 0, AV_OPT_TYPE_CONST, { .i64 = AVFILTER_THREAD_FRAME }, .flags = FLAGS, .unit = "thread_type" },
     { "enable", "set enable expression", OFFSET(enable_str), AV_OPT_TYPE_STRING, {.str=NULL}, .flags = TFLAGS },
     { "threads", "Allowed number of threads", OFFSET(nb_threads), AV_OPT_TYPE_INT,
         { .i64 = 0 }, 0, INT_MAX, FLAGS, .unit = "threads" },
@@ -793,8 +798,12 @@ void avfilter_free(AVFilterContext *filter)
     if (!filter)
         return;
 
-    if (filter->graph)
+    if (filter->graph) {
+        /* a filter running on a frame thread may still send frames here */
+        ff_graph_frame_thread_wait(fffiltergraph(filter->graph), NULL);
         ff_filter_graph_remove_filter(filter->graph, filter);
+    }
+    ff_filter_frame_thread_uninit(filter);
 
     if (filter->filter->uninit)
         filter->filter->uninit(filter);
@@ -907,7 +916,7 @@ int ff_filter_process_command(AVFilterContext *ctx, const char *cmd,
 int avfilter_init_dict(AVFilterContext *ctx, AVDictionary **options)
 {
     FFFilterContext *ctxi = fffilterctx(ctx);
-    int ret = 0;
+    int frame_threads, ret = 0;
 
     if (ctxi->initialized) {
         av_log(ctx, AV_LOG_ERROR, "Filter already initialized\n");
@@ -920,6 +929,7 @@ int avfilter_init_dict(AVFilterContext *ctx, AVDictionary **options)
         return ret;
     }
 
+    frame_threads = ctx->thread_type & ctx->graph->thread_type & AVFILTER_THREAD_FRAME;
     if (ctx->filter->flags & AVFILTER_FLAG_SLICE_THREADS &&
         ctx->thread_type & ctx->graph->thread_type & AVFILTER_THREAD_SLICE &&
         fffiltergraph(ctx->graph)->thread_execute) {
@@ -940,6 +950,12 @@ int avfilter_init_dict(AVFilterContext *ctx, AVDictionary **options)
             return ret;
     }
 
+    if (frame_threads) {
+        ret = ff_filter_frame_thread_init(ctx);
+        if (ret < 0)
+            return ret;
+    }
+
     ctxi->initialized = 1;
 
     return 0;
@@ -988,9 +1004,16 @@ static int default_filter_frame(AVFilterLink *link, AVFrame *frame)
     return ff_filter_frame(link->dst->outputs[0], frame);
 }
 
-static int ff_filter_frame_framed(AVFilterLink *link, AVFrame *frame)
+static void filter_frame_prepare(AVFilterLink *link, AVFrame *frame)
+{
+    AVFilterContext *dstctx = link->dst;
+
+    ff_inlink_process_commands(link, frame);
+    dstctx->is_disabled = !ff_inlink_evaluate_timeline_at_frame(link, frame);
+}
+
+int ff_filter_frame_run(AVFilterLink *link, AVFrame *frame)
 {
-    FilterLink *l = ff_filter_link(link);
     int (*filter_frame)(AVFilterLink *, AVFrame *);
     AVFilterContext *dstctx = link->dst;
     AVFilterPad *dst = link->dstpad;
@@ -1001,23 +1024,16 @@ static int ff_filter_frame_framed(AVFilterLink *link, AVFrame *frame)
 
     if (dst->flags & AVFILTERPAD_FLAG_NEEDS_WRITABLE) {
         ret = ff_inlink_make_frame_writable(link, &frame);
-        if (ret < 0)
-            goto fail;
+        if (ret < 0) {
+            av_frame_free(&frame);
+            return ret;
+        }
     }
 
-    ff_inlink_process_commands(link, frame);
-    dstctx->is_disabled = !ff_inlink_evaluate_timeline_at_frame(link, frame);
-
     if (dstctx->is_disabled &&
         (dstctx->filter->flags & AVFILTER_FLAG_SUPPORT_TIMELINE_GENERIC))
         filter_frame = default_filter_frame;
-    ret = filter_frame(link, frame);
-    l->frame_count_out++;
-    return ret;
-
-fail:
-    av_frame_free(&frame);
-    return ret;
+    return filter_frame(link, frame);
 }
 
 int ff_filter_frame(AVFilterLink *link, AVFrame *frame)
@@ -1026,6 +1042,9 @@ int ff_filter_frame(AVFilterLink *link, AVFrame *frame)
     int ret;
     FF_TPRINTF_START(NULL, filter_frame); ff_tlog_link(NULL, link, 1); ff_tlog(NULL, " "); tlog_ref(NULL, frame, 1);
 
+    if (fffilterctx(link->src)->frame_busy)
+        return ff_filter_frame_thread_output(link, frame);
+
     /* Consistency checks */
     if (link->type == AVMEDIA_TYPE_VIDEO) {
         if (strcmp(link->dst->filter->name, "buffersink") &&
@@ -1058,8 +1077,15 @@ int ff_filter_frame(AVFilterLink *link, AVFrame *frame)
     }
 
     li->frame_blocked_in = li->frame_wanted_out = 0;
-    li->l.frame_count_in++;
-    li->l.sample_count_in += frame->nb_samples;
+    if (fffilterctx(link->dst)->frame_busy) {
+        /* The destination is filtering on a frame thread and may read the
+         * counters of this link, they are updated once it is done. */
+        li->frame_count_in_busy++;
+        li->sample_count_in_busy += frame->nb_samples;
+    } else {
+        li->l.frame_count_in++;
+        li->l.sample_count_in += frame->nb_samples;
+    }
     filter_unblock(link->dst);
     ret = ff_framequeue_add(&li->fifo, frame);
     if (ret < 0) {
@@ -1162,15 +1188,26 @@ static int ff_filter_frame_to_filter(AVFilterLink *link)
        produce one or more: unblock its outputs. */
     filter_unblock(dst);
     /* AVFilterPad.filter_frame() expect frame_count_out to have the value
-       before the frame; ff_filter_frame_framed() will re-increment it. */
+       before the frame; ff_filter_frame_complete() will re-increment it. */
     li->l.frame_count_out--;
-    ret = ff_filter_frame_framed(link, frame);
+    filter_frame_prepare(link, frame);
+    if (fffilterctx(dst)->frame_job)
+        return ff_filter_frame_thread_submit(link, frame);
+    ret = ff_filter_frame_run(link, frame);
+    return ff_filter_frame_complete(link, ret);
+}
+
+int ff_filter_frame_complete(AVFilterLink *link, int ret)
+{
+    FilterLinkInternal * const li = ff_link_internal(link);
+
+    li->l.frame_count_out++;
     if (ret < 0 && ret != li->status_out) {
         link_set_out_status(link, ret, AV_NOPTS_VALUE);
     } else {
         /* Run once again, to see if several frames were available, or if
            the input status has also changed, or any other reason. */
-        ff_filter_set_ready(dst, 300);
+        ff_filter_set_ready(link->dst, 300);
     }
     return ret;
 }
@@ -1388,8 +1425,10 @@ int ff_filter_activate(AVFilterContext *filter)
     av_assert1(!(filter->filter->flags & AVFILTER_FLAG_SUPPORT_TIMELINE_GENERIC &&
                  filter->filter->activate));
     filter->ready = 0;
+    av_trace_begin(filter->filter->name);
     ret = filter->filter->activate ? filter->filter->activate(filter) :
           ff_filter_activate_default(filter);
+    av_trace_end(filter->filter->name);
     if (ret == FFERROR_NOT_READY)
         ret = 0;
     return ret;
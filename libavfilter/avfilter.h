@@ -452,6 +452,21 @@ unsigned avfilter_filter_pad_count(const AVFilter *filter, int is_output);
  * Process multiple parts of the frame concurrently.
  */
 #define AVFILTER_THREAD_SLICE (1 << 0)
+/**
+ * Run different filters of the graph concurrently, so that consecutive frames
+ * are pipelined through chains of filters. Each filter still processes a
+ * single frame at a time, in order. Only filters that support it, and whose
+ * AVFilterContext.thread_type also allows it, are run this way.
+ *
+ * While frames are in flight, requesting output from a sink may return
+ * AVERROR(EAGAIN) to ask for more input instead of waiting for them; they are
+ * returned by later calls, or once the inputs of the graph are closed.
+ *
+ * The filter graph API must still be used from one thread at a time. If
+ * AVFilterGraph.execute is set, it may be called from several threads
+ * concurrently when this is enabled together with AVFILTER_THREAD_SLICE.
+ */
+#define AVFILTER_THREAD_FRAME (1 << 1)
 
 /** An instance of a filter */
 struct AVFilterContext {
@@ -479,7 +494,8 @@ struct AVFilterContext {
      *
      * May be set by the caller before initializing the filter to forbid some
      * or all kinds of multithreading for this filter. The default is allowing
-     * everything.
+     * AVFILTER_THREAD_SLICE; AVFILTER_THREAD_FRAME must be allowed explicitly
+     * for each filter that should run on a frame thread.
      *
      * When the filter is initialized, this field is combined using bit AND with
      * AVFilterGraph.thread_type to get the final mask used for determining
@@ -769,7 +785,9 @@ typedef struct AVFilterGraph {
      * of AVFILTER_THREAD_* flags.
      *
      * May be set by the caller at any point, the setting will apply to all
-     * filters initialized after that. The default is allowing everything.
+     * filters initialized after that. The default is allowing
+     * AVFILTER_THREAD_SLICE; AVFILTER_THREAD_FRAME must be requested explicitly
+     * before adding any filters to the graph.
      *
      * When a filter in this graph is initialized, this field is combined using
      * bit AND with AVFilterContext.thread_type to get the final mask used for
@@ -807,6 +825,44 @@ typedef struct AVFilterGraph {
     avfilter_execute_func *execute;
 
     char *aresample_swr_opts; ///< swr options to use for the auto-inserted aresample filters, Access ONLY through AVOptions
+
+    /**
+     * NUMA nodes to run the threads of this graph on, as a list of node
+     * indices and ranges, e.g. "0" or "0-1,3". See av_cpu_bind_numa_nodes().
+     * May be set by the caller before adding any filters to the filtergraph.
+     * Access ONLY through AVOptions.
+     */
+    char *numa_nodes;
+
+    /**
+     * A reference to a thread pool allocated with av_threadpool_alloc(), on
+     * which slice threading runs instead of on threads created for this graph.
+     * nb_threads then is the maximum number of threads working for the graph
+     * at once, 0 meaning as many as the pool has. Also used by the filters
+     * that run their own slice threads, like scale.
+     *
+     * May be set by the caller before adding any filters to the filtergraph,
+     * owned and freed by libavfilter afterwards.
+     */
+    AVBufferRef *thread_pool;
+
+    /**
+     * If set, filters of this graph call this callback to allocate the data
+     * buffers of video frames in system memory, instead of taking them from
+     * pools kept for each link. This allows sharing buffers with other graphs
+     * or with decoders.
+     *
+     * frame->format, width and height are set. The callback must attach
+     * refcounted buffers to frame->buf[] and set data[] and linesize[], with
+     * every linesize a multiple of align. It returns 0 on success and a
+     * negative AVERROR code on failure. The palette of paletted formats is
+     * filled in by libavfilter.
+     *
+     * May be called from several threads at once. May be set by the caller
+     * before adding any filters to the filtergraph.
+     */
+    int (*get_video_buffer)(struct AVFilterGraph *graph, AVFrame *frame,
+                            int align);
 } AVFilterGraph;
 
 /**
@@ -48,6 +48,14 @@ typedef struct FilterLinkInternal {
      */
     int frame_blocked_in;
 
+    /**
+     * Frames and samples sent on the link while its destination was running
+     * on a frame thread, added to frame_count_in and sample_count_in once it
+     * is done.
+     */
+    int64_t frame_count_in_busy;
+    int64_t sample_count_in_busy;
+
     /**
      * Link input status.
      * If not zero, all attempts of filter_frame will fail with the
@@ -103,6 +111,18 @@ typedef struct FFFilterContext {
     // 1 when avfilter_init_*() was successfully called on this filter
     // 0 otherwise
     int initialized;
+
+    /**
+     * Non-NULL if filter_frame() is run on a frame thread for this filter,
+     * see AVFILTER_THREAD_FRAME.
+     */
+    struct FrameThreadJob *frame_job;
+
+    /**
+     * Set while filter_frame() is running on a frame thread. Only written by
+     * the thread running the graph.
+     */
+    int frame_busy;
 } FFFilterContext;
 
 static inline FFFilterContext *fffilterctx(AVFilterContext *ctx)
@@ -110,6 +130,17 @@ static inline FFFilterContext *fffilterctx(AVFilterContext *ctx)
     return (FFFilterContext*)ctx;
 }
 
+/**
+ * Whether buffers for the link must be allocated without the get_buffer()
+ * callback of its destination pad: that callback may use the state of the
+ * destination filter, so it must neither be run from a frame thread nor
+ * while the destination itself may be filtering on one.
+ */
+static inline int ff_link_default_buffer(AVFilterLink *link)
+{
+    return fffilterctx(link->src)->frame_busy || fffilterctx(link->dst)->frame_job;
+}
+
 typedef struct AVFilterCommand {
     double time;                ///< time expressed in seconds
     char *command;              ///< command
@@ -131,6 +162,7 @@ typedef struct FFFilterGraph {
 
     void *thread;
     avfilter_execute_func *thread_execute;
+    void *frame_thread;
     FFFrameQueueGlobal frame_queues;
 } FFFilterGraph;
 
@@ -179,6 +211,61 @@ int ff_graph_thread_init(FFFilterGraph *graph);
 
 void ff_graph_thread_free(FFFilterGraph *graph);
 
+/**
+ * Enable frame threading for a filter that was just initialized, if the
+ * graph uses it and the filter supports it.
+ */
+int ff_filter_frame_thread_init(AVFilterContext *ctx);
+
+void ff_filter_frame_thread_uninit(AVFilterContext *ctx);
+
+/**
+ * Run the filter_frame() callback of link->dst on a frame thread.
+ * Takes ownership of frame.
+ */
+int ff_filter_frame_thread_submit(AVFilterLink *link, AVFrame *frame);
+
+/**
+ * Queue a frame sent by a filter running on a frame thread; it is passed to
+ * ff_filter_frame() by the graph thread once filter_frame() returns.
+ */
+int ff_filter_frame_thread_output(AVFilterLink *link, AVFrame *frame);
+
+/**
+ * Finish the frame thread jobs that completed.
+ *
+ * @param wait if nonzero and some filters are running on frame threads,
+ *             block until at least one of them completed
+ * @return a negative error code returned by a job, 1 if any job was
+ *         finished, 0 otherwise
+ */
+int ff_graph_frame_thread_collect(FFFilterGraph *graph, int wait);
+
+/**
+ * Wait until ctx is not running on a frame thread anymore, or until no
+ * filter is if ctx is NULL.
+ */
+void ff_graph_frame_thread_wait(FFFilterGraph *graph, AVFilterContext *ctx);
+
+/**
+ * Serialize frame allocations from the link buffer pools while filters may
+ * run on frame threads.
+ */
+void ff_graph_buffer_lock(AVFilterGraph *graph);
+void ff_graph_buffer_unlock(AVFilterGraph *graph);
+
+/**
+ * Tail of passing a frame to a filter input, after filter_frame() returned
+ * ret: update the link counters and status and reschedule the filter.
+ */
+int ff_filter_frame_complete(AVFilterLink *link, int ret);
+
+/**
+ * Call the filter_frame() callback of link->dst, or pass the frame through
+ * if it is disabled by the timeline.
+ */
+int ff_filter_frame_run(AVFilterLink *link, AVFrame *frame);
+
 /**
  * Negotiate the media format, dimensions, etc of all inputs to a filter.
  *
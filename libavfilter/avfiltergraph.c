@@ -49,9 +49,12 @@ static const AVOption filtergraph_options[] = {
     { "thread_type", "Allowed thread types", OFFSET(thread_type), AV_OPT_TYPE_FLAGS,
         { .i64 = AVFILTER_THREAD_SLICE }, 0, INT_MAX, F|V|A, .unit = "thread_type" },
         { "slice", NULL, 0, AV_OPT_TYPE_CONST, { .i64 = AVFILTER_THREAD_SLICE }, .flags = F|V|A, .unit = "thread_type" },
+        { "frame", NULL, 0, AV_OPT_TYPE_CONST, { .i64 = AVFILTER_THREAD_FRAME }, .flags = F|V|A, .unit = "thread_type" },
     { "threads",     "Maximum number of threads", OFFSET(nb_threads), AV_OPT_TYPE_INT,
         { .i64 = 0 }, 0, INT_MAX, F|V|A, .unit = "threads"},
         {"auto", "autodetect a suitable number of threads to use", 0, AV_OPT_TYPE_CONST, {.i64 = 0 }, .flags = F|V|A, .unit = "threads"},
+    { "numa_nodes",  "Bind the graph threads to the given NUMA nodes", OFFSET(numa_nodes),
+        AV_OPT_TYPE_STRING, { .str = NULL }, 0, 0, F|V|A },
     {"scale_sws_opts"       , "default scale filter options"        , OFFSET(scale_sws_opts)        ,
         AV_OPT_TYPE_STRING, {.str = NULL}, 0, 0, F|V },
     {"aresample_swr_opts"   , "default aresample filter options"    , OFFSET(aresample_swr_opts)    ,
@@ -74,10 +77,51 @@ void ff_graph_thread_free(FFFilterGraph *graph)
 
 int ff_graph_thread_init(FFFilterGraph *graph)
 {
-    graph->p.thread_type = 0;
-    graph->p.nb_threads  = 1;
+    if (!graph->thread_execute) {
+        graph->p.thread_type = 0;
+        graph->p.nb_threads  = 1;
+    }
+    graph->p.thread_type &= ~AVFILTER_THREAD_FRAME;
+    return 0;
+}
+
+int ff_filter_frame_thread_init(AVFilterContext *ctx)
+{
+    return 0;
+}
+
+void ff_filter_frame_thread_uninit(AVFilterContext *ctx)
+{
+}
+
+int ff_filter_frame_thread_submit(AVFilterLink *link, AVFrame *frame)
+{
+    av_frame_free(&frame);
+    return AVERROR(ENOSYS);
+}
+
+int ff_filter_frame_thread_output(AVFilterLink *link, AVFrame *frame)
+{
+    av_frame_free(&frame);
+    return AVERROR(ENOSYS);
+}
+
+int ff_graph_frame_thread_collect(FFFilterGraph *graph, int wait)
+{
     return 0;
 }
+
+void ff_graph_frame_thread_wait(FFFilterGraph *graph, AVFilterContext *ctx)
+{
+}
+
+void ff_graph_buffer_lock(AVFilterGraph *graph)
+{
+}
+
+void ff_graph_buffer_unlock(AVFilterGraph *graph)
+{
+}
 #endif
 
 AVFilterGraph *avfilter_graph_alloc(void)
@@ -122,10 +166,13 @@ void avfilter_graph_free(AVFilterGraph **graphp)
     if (!graph)
         return;
 
+    ff_graph_frame_thread_wait(graphi, NULL);
+
     while (graph->nb_filters)
         avfilter_free(graph->filters[0]);
 
     ff_graph_thread_free(graphi);
+    av_buffer_unref(&graph->thread_pool);
 
     av_freep(&graphi->sink_links);
 
@@ -169,15 +216,15 @@ AVFilterContext *avfilter_graph_alloc_filter(AVFilterGraph *graph,
     AVFilterContext **filters, *s;
     FFFilterGraph *graphi = fffiltergraph(graph);
 
-    if (graph->thread_type && !graphi->thread_execute) {
-        if (graph->execute) {
+    if (graph->thread_type && !graphi->thread_execute && !graphi->frame_thread) {
+        int ret;
+
+        if (graph->execute)
             graphi->thread_execute = graph->execute;
-        } else {
-            int ret = ff_graph_thread_init(graphi);
-            if (ret < 0) {
-                av_log(graph, AV_LOG_ERROR, "Error initializing threading: %s.\n", av_err2str(ret));
-                return NULL;
-            }
+        ret = ff_graph_thread_init(graphi);
+        if (ret < 0) {
+            av_log(graph, AV_LOG_ERROR, "Error initializing threading: %s.\n", av_err2str(ret));
+            return NULL;
         }
     }
 
@@ -1468,12 +1515,62 @@ int avfilter_graph_request_oldest(AVFilterGraph *graph)
     return 0;
 }
 
+/**
+ * Check if the application is expected to feed a source filter before the
+ * graph can make progress on its own.
+ */
+static int source_starved(AVFilterGraph *graph)
+{
+    for (unsigned i = 0; i < graph->nb_filters; i++) {
+        AVFilterContext *filter = graph->filters[i];
+
+        if (filter->nb_inputs)
+            continue;
+        for (unsigned j = 0; j < filter->nb_outputs; j++) {
+            FilterLinkInternal *li = ff_link_internal(filter->outputs[j]);
+            if (li->frame_wanted_out && !li->status_in)
+                return 1;
+        }
+    }
+    return 0;
+}
+
+static int run_once_frame_threads(AVFilterGraph *graph)
+{
+    FFFilterGraph *graphi = fffiltergraph(graph);
+    AVFilterContext *filter = NULL;
+    int ret;
+
+    ret = ff_graph_frame_thread_collect(graphi, 0);
+    if (ret)
+        return FFMIN(ret, 0);
+
+    for (unsigned i = 0; i < graph->nb_filters; i++) {
+        AVFilterContext *f = graph->filters[i];
+        if (!fffilterctx(f)->frame_busy && (!filter || f->ready > filter->ready))
+            filter = f;
+    }
+    if (filter && filter->ready)
+        return ff_filter_activate(filter);
+
+    /* Nothing is ready: let the application feed more input if a source is
+     * waiting for it, which keeps the pipeline busy, otherwise wait for the
+     * filters running on frame threads, if any. */
+    if (source_starved(graph))
+        return AVERROR(EAGAIN);
+    ret = ff_graph_frame_thread_collect(graphi, 1);
+    return ret ? FFMIN(ret, 0) : AVERROR(EAGAIN);
+}
+
 int ff_filter_graph_run_once(AVFilterGraph *graph)
 {
     AVFilterContext *filter;
     unsigned i;
 
     av_assert0(graph->nb_filters);
+    if (fffiltergraph(graph)->frame_thread)
+        return run_once_frame_threads(graph);
+
     filter = graph->filters[0];
     for (i = 1; i < graph->nb_filters; i++)
         if (graph->filters[i]->ready > filter->ready)
@@ -532,6 +532,27 @@ static void blend_line_hv(uint8_t *dst, int dst_delta,
                     right, hband, hsub + vsub, xm);
 }
 
+static void blend_line_mask8(uint8_t *dst, int dst_delta,
+                             unsigned src, unsigned alpha,
+                             const uint8_t *mask, int w)
+{
+    int x;
+
+    /* the unit stride case is kept separate so that it can be vectorized */
+    if (dst_delta == 1) {
+        for (x = 0; x < w; x++) {
+            unsigned a = mask[x] * alpha;
+            dst[x] = ((0x1010101 - a) * dst[x] + a * src) >> 24;
+        }
+    } else {
+        for (x = 0; x < w; x++) {
+            unsigned a = mask[x] * alpha;
+            *dst = ((0x1010101 - a) * *dst + a * src) >> 24;
+            dst += dst_delta;
+        }
+    }
+}
+
 void ff_blend_mask(FFDrawContext *draw, FFDrawColor *color,
                    uint8_t *dst[], int dst_linesize[], int dst_w, int dst_h,
                    const uint8_t *mask,  int mask_linesize, int mask_w, int mask_h,
@@ -576,6 +597,18 @@ void ff_blend_mask(FFDrawContext *draw, FFDrawColor *color,
                 continue;
             p = p0 + offset;
             m = mask;
+            if (depth <= 8 && l2depth == 3 &&
+                !draw->hsub[plane] && !draw->vsub[plane]) {
+                /* one 8-bit mask byte per pixel: no averaging needed */
+                for (y = 0; y < h_sub; y++) {
+                    blend_line_mask8(p, draw->pixelstep[plane],
+                                     color->comp[plane].u8[index], alpha,
+                                     m + xm0, w_sub);
+                    p += dst_linesize[plane];
+                    m += mask_linesize;
+                }
+                continue;
+            }
             if (top) {
                 if (depth <= 8) {
                     blend_line_hv(p, draw->pixelstep[plane],
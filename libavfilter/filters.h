@@ -205,6 +205,17 @@ static inline FilterLink* ff_filter_link(AVFilterLink *link)
  */
 #define FF_FILTER_FLAG_HWFRAME_AWARE (1 << 0)
 
+/**
+ * The filter_frame() callback of the filter may be run on a frame thread (see
+ * AVFILTER_THREAD_FRAME), concurrently with the rest of the graph. It must
+ * then only access the private context of the filter, the frame, and the
+ * properties of its links that are fixed after configuration, allocate its
+ * output with ff_get_video_buffer()/ff_get_audio_buffer() and send it with
+ * ff_filter_frame(). In particular, it must not look at the frame and sample
+ * counters of its links nor at other filters.
+ */
+#define FF_FILTER_FLAG_FRAME_THREADS (1 << 1)
+
 /**
  * Find the index of a link.
  *
@@ -0,0 +1,195 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include <string.h>
+
+#include "libavutil/common.h"
+#include "libavutil/imgutils.h"
+#include "libavutil/log.h"
+#include "libavutil/mem.h"
+#include "libavutil/murmur3.h"
+#include "libavutil/pixdesc.h"
+
+#include "framecache.h"
+
+static void hash_props(struct AVMurMur3 *hash, const AVFrame *frame)
+{
+    const int64_t props[] = {
+        frame->format, frame->width, frame->height,
+        frame->color_range, frame->color_primaries, frame->color_trc,
+        frame->colorspace, frame->chroma_location,
+        frame->sample_aspect_ratio.num, frame->sample_aspect_ratio.den,
+        frame->flags & (AV_FRAME_FLAG_INTERLACED | AV_FRAME_FLAG_TOP_FIELD_FIRST),
+        frame->crop_top, frame->crop_bottom, frame->crop_left, frame->crop_right,
+    };
+
+    av_murmur3_update(hash, (const uint8_t *)props, sizeof(props));
+}
+
+/* Hash the visible part of the planes, not the padding. */
+static int hash_video(struct AVMurMur3 *hash, const AVFrame *frame)
+{
+    const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get(frame->format);
+    int linesizes[4];
+    int ret;
+
+    if (!desc || desc->flags & AV_PIX_FMT_FLAG_HWACCEL)
+        return AVERROR(ENOSYS);
+
+    ret = av_image_fill_linesizes(linesizes, frame->format, frame->width);
+    if (ret < 0)
+        return ret;
+
+    for (int p = 0; p < 4 && linesizes[p]; p++) {
+        const int h = (p == 1 || p == 2) ? AV_CEIL_RSHIFT(frame->height, desc->log2_chroma_h)
+                                         : frame->height;
+
+        for (int y = 0; y < h; y++)
+            av_murmur3_update(hash, frame->data[p] + y * (ptrdiff_t)frame->linesize[p],
+                              linesizes[p]);
+    }
+
+    if (desc->flags & AV_PIX_FMT_FLAG_PAL)
+        av_murmur3_update(hash, frame->data[1], AVPALETTE_SIZE);
+
+    return 0;
+}
+
+static int compute_key(FFFrameCache *fc, AVFrame * const *in, int nb_in,
+                       const void *params, size_t params_size)
+{
+    const uint8_t no_frame = 0;
+
+    av_murmur3_init(fc->hash);
+
+    for (int i = 0; i < nb_in; i++) {
+        int ret;
+
+        if (!in[i]) {
+            av_murmur3_update(fc->hash, &no_frame, sizeof(no_frame));
+            continue;
+        }
+
+        if (in[i]->hw_frames_ctx || !in[i]->width)
+            return AVERROR(ENOSYS);
+
+        hash_props(fc->hash, in[i]);
+        ret = hash_video(fc->hash, in[i]);
+        if (ret < 0)
+            return ret;
+    }
+
+    if (params_size)
+        av_murmur3_update(fc->hash, params, params_size);
+
+    av_murmur3_final(fc->hash, fc->key);
+    return 0;
+}
+
+int ff_frame_cache_get(void *log_ctx, FFFrameCache *fc,
+                       AVFrame * const *in, int nb_in,
+                       const void *params, size_t params_size,
+                       AVFrame **out)
+{
+    AVFrame *frame;
+    int ret;
+
+    fc->key_valid = 0;
+    if (!fc->enabled)
+        return 0;
+
+    if (!fc->hash) {
+        fc->hash = av_murmur3_alloc();
+        if (!fc->hash)
+            return AVERROR(ENOMEM);
+    }
+
+    ret = compute_key(fc, in, nb_in, params, params_size);
+    if (ret == AVERROR(ENOSYS)) {
+        av_log(log_ctx, AV_LOG_WARNING,
+               "Frame cache does not support these frames, disabling it\n");
+        fc->enabled = 0;
+        ff_frame_cache_reset(fc);
+        return 0;
+    } else if (ret < 0)
+        return ret;
+    fc->key_valid = 1;
+
+    if (!fc->out || memcmp(fc->key, fc->out_key, sizeof(fc->key))) {
+        fc->misses++;
+        return 0;
+    }
+
+    frame = av_frame_clone(fc->out);
+    if (!frame)
+        return AVERROR(ENOMEM);
+
+    ret = av_frame_copy_props(frame, in[0]);
+    if (ret < 0) {
+        av_frame_free(&frame);
+        return ret;
+    }
+    frame->color_range         = fc->out->color_range;
+    frame->color_primaries     = fc->out->color_primaries;
+    frame->color_trc           = fc->out->color_trc;
+    frame->colorspace          = fc->out->colorspace;
+    frame->chroma_location     = fc->out->chroma_location;
+    frame->sample_aspect_ratio = fc->out->sample_aspect_ratio;
+
+    fc->hits++;
+    *out = frame;
+    return 1;
+}
+
+int ff_frame_cache_put(FFFrameCache *fc, const AVFrame *out)
+{
+    int ret;
+
+    if (!fc->enabled || !fc->key_valid)
+        return 0;
+
+    ff_frame_cache_reset(fc);
+
+    fc->out = av_frame_alloc();
+    if (!fc->out)
+        return AVERROR(ENOMEM);
+
+    ret = av_frame_ref(fc->out, out);
+    if (ret < 0) {
+        av_frame_free(&fc->out);
+        return ret;
+    }
+
+    memcpy(fc->out_key, fc->key, sizeof(fc->key));
+    return 0;
+}
+
+void ff_frame_cache_reset(FFFrameCache *fc)
+{
+    av_frame_free(&fc->out);
+}
+
+void ff_frame_cache_uninit(void *log_ctx, FFFrameCache *fc)
+{
+    if (fc->hits || fc->misses)
+        av_log(log_ctx, AV_LOG_VERBOSE, "Frame cache: %"PRId64" hits, %"PRId64" misses\n",
+               fc->hits, fc->misses);
+
+    ff_frame_cache_reset(fc);
+    av_freep(&fc->hash);
+}
@@ -0,0 +1,106 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef AVFILTER_FRAMECACHE_H
+#define AVFILTER_FRAMECACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "libavutil/frame.h"
+#include "libavutil/opt.h"
+
+/**
+ * Result cache for filters whose output only depends on their input frames
+ * and parameters, e.g. a scaler fed the same slate for hours.
+ *
+ * The input frames are hashed, including the properties a filter may depend
+ * on, together with the filter parameters that can change between frames.
+ * When all of them match those of the previous output, that output is
+ * returned again as a new reference rather than computed.
+ *
+ * Hashing reads the complete inputs, so the cache only pays off for filters
+ * which do more work than that.
+ */
+typedef struct FFFrameCache {
+    int enabled;
+
+    int64_t hits;
+    int64_t misses;
+
+    // key of the inputs of the last lookup, and of the output kept in out
+    uint8_t key[16];
+    uint8_t out_key[16];
+    int     key_valid;
+    AVFrame *out;
+
+    struct AVMurMur3 *hash;
+} FFFrameCache;
+
+/**
+ * Options of an FFFrameCache in a filter context, to add to the options of
+ * the filter.
+ */
+#define FF_FRAME_CACHE_OPTIONS(context, field, flags)                             \
+    { "frame_cache", "reuse the previous output for identical inputs",            \
+      offsetof(context, field.enabled), AV_OPT_TYPE_BOOL, { .i64 = 0 }, 0, 1,     \
+      flags },                                                                    \
+    { "frame_cache_hits", "number of outputs reused by the frame cache",          \
+      offsetof(context, field.hits), AV_OPT_TYPE_INT64, { .i64 = 0 }, 0, INT64_MAX, \
+      flags | AV_OPT_FLAG_EXPORT | AV_OPT_FLAG_READONLY },                        \
+    { "frame_cache_misses", "number of outputs computed with the frame cache",    \
+      offsetof(context, field.misses), AV_OPT_TYPE_INT64, { .i64 = 0 }, 0, INT64_MAX, \
+      flags | AV_OPT_FLAG_EXPORT | AV_OPT_FLAG_READONLY }
+
+/**
+ * Look up the output for a set of inputs.
+ *
+ * @param in          input frames the output depends on, entries may be NULL
+ * @param nb_in       number of entries in in
+ * @param params      other parameters the output depends on, compared
+ *                    bytewise, may be NULL if params_size is 0
+ * @param out         set to a new reference to the previous output on a hit.
+ *                    Its properties, side data and metadata are those of
+ *                    in[0], except for the dimensions, format, color
+ *                    properties and sample aspect ratio.
+ * @return 1 on a hit, 0 on a miss or if the cache is disabled, a negative
+ *         AVERROR code on failure
+ */
+int ff_frame_cache_get(void *log_ctx, FFFrameCache *fc,
+                       AVFrame * const *in, int nb_in,
+                       const void *params, size_t params_size,
+                       AVFrame **out);
+
+/**
+ * Remember out as the output for the inputs of the last
+ * ff_frame_cache_get() call, which must have been a miss. Does nothing if the
+ * cache is disabled.
+ *
+ * @return 0 on success, a negative AVERROR code on failure
+ */
+int ff_frame_cache_put(FFFrameCache *fc, const AVFrame *out);
+
+/**
+ * Forget the previous output, e.g. after a parameter which is not part of
+ * the cache key has changed.
+ */
+void ff_frame_cache_reset(FFFrameCache *fc);
+
+void ff_frame_cache_uninit(void *log_ctx, FFFrameCache *fc);
+
+#endif /* AVFILTER_FRAMECACHE_H */
@@ -65,6 +65,13 @@ typedef struct LUT3DContext {
     int step;
     avfilter_action_func *interp;
     Lut3DPreLut prelut;
+    int allow_yuv;              ///< accept YUV input, converted to RGB and back around the LUT
+    int yuv;                    ///< the input is YUV
+    int hsub, vsub;
+    int depth;
+    float yuv2rgb[3][3];        ///< RGB in [0,1] from the YUV values minus yuv_offset
+    float rgb2yuv[3][3];        ///< YUV values minus yuv_offset from RGB in [0,1]
+    float yuv_offset[2];        ///< luma and chroma offsets of the YUV values
 #if CONFIG_HALDCLUT_FILTER
     int clut;
     int got_clut;
@@ -21,15 +21,24 @@
  * Libavfilter multithreading support
  */
 
+#include <inttypes.h>
 #include <stddef.h>
 
+#include "libavutil/avassert.h"
+#include "libavutil/cpu.h"
 #include "libavutil/error.h"
+#include "libavutil/executor.h"
+#include "libavutil/frame.h"
+#include "libavutil/log.h"
 #include "libavutil/macros.h"
 #include "libavutil/mem.h"
 #include "libavutil/slicethread.h"
+#include "libavutil/thread.h"
 
 #include "avfilter.h"
 #include "avfilter_internal.h"
+#include "filters.h"
+#include "framequeue.h"
 
 typedef struct ThreadContext {
     AVFilterGraph *graph;
@@ -42,6 +51,69 @@ typedef struct ThreadContext {
     int   *rets;
 } ThreadContext;
 
+typedef struct FrameThreadContext {
+    AVFilterGraph *graph;
+    AVExecutor *executor;
+
+    /* jobs whose filter_frame() returned, protected by lock */
+    AVMutex lock;
+    AVCond  cond;
+    struct FrameThreadJob  *done;
+    struct FrameThreadJob **done_tail;
+
+    /* number of submitted jobs not finished yet, only used by the graph thread */
+    unsigned nb_busy;
+
+    AVMutex buffer_lock;
+    /* the slice threads may be used by several frame threads at once */
+    AVMutex execute_lock;
+} FrameThreadContext;
+
+typedef struct FrameThreadOutput {
+    AVFilterLink *link;
+    AVFrame      *frame;
+} FrameThreadOutput;
+
+/**
+ * A filter_frame() call on a frame thread. There is at most one per filter,
+ * so frames go through each filter in order.
+ */
+typedef struct FrameThreadJob {
+    AVTask task;
+    FrameThreadContext *fc;
+
+    AVFilterLink *link;
+    AVFrame      *frame;
+    int           ret;
+    uint64_t      nb_frames;    ///< number of frames filtered on the pool
+
+    /* frames sent by the filter, forwarded once the job is finished */
+    FrameThreadOutput *outputs;
+    unsigned        nb_outputs;
+    unsigned int    outputs_size;
+
+    struct FrameThreadJob *next_done;
+} FrameThreadJob;
+
+static void bind_numa_nodes(AVFilterGraph *graph)
+{
+    int ret;
+
+    if (!graph->numa_nodes)
+        return;
+
+    ret = av_cpu_bind_numa_nodes(graph->numa_nodes);
+    if (ret < 0)
+        av_log(graph, AV_LOG_WARNING, "Could not bind thread to NUMA nodes %s: %s\n",
+               graph->numa_nodes, av_err2str(ret));
+}
+
+static void worker_thread_init(void *priv)
+{
+    ThreadContext *c = priv;
+    bind_numa_nodes(c->graph);
+}
+
 static void worker_func(void *priv, int jobnr, int threadnr, int nb_jobs, int nb_threads)
 {
     ThreadContext *c = priv;
@@ -58,58 +130,337 @@ static void slice_thread_uninit(ThreadContext *c)
 static int thread_execute(AVFilterContext *ctx, avfilter_action_func *func,
                           void *arg, int *ret, int nb_jobs)
 {
-    ThreadContext *c = fffiltergraph(ctx->graph)->thread;
+    FFFilterGraph *graphi = fffiltergraph(ctx->graph);
+    ThreadContext *c = graphi->thread;
+    FrameThreadContext *fc = graphi->frame_thread;
 
     if (nb_jobs <= 0)
         return 0;
+    if (fc)
+        ff_mutex_lock(&fc->execute_lock);
     c->ctx         = ctx;
     c->arg         = arg;
     c->func        = func;
     c->rets        = ret;
 
     avpriv_slicethread_execute(c->thread, nb_jobs, 0);
+    if (fc)
+        ff_mutex_unlock(&fc->execute_lock);
     return 0;
 }
 
 static int thread_init_internal(ThreadContext *c, int nb_threads)
 {
-    nb_threads = avpriv_slicethread_create(&c->thread, c, worker_func, NULL, nb_threads);
+    if (c->graph->thread_pool)
+        nb_threads = avpriv_slicethread_create_pool(&c->thread, c, worker_func,
+                                                    c->graph->thread_pool, nb_threads);
+    else
+        nb_threads = avpriv_slicethread_create2(&c->thread, c, worker_func, NULL,
+                                                worker_thread_init, nb_threads);
     if (nb_threads <= 1)
         avpriv_slicethread_free(&c->thread);
     return FFMAX(nb_threads, 1);
 }
 
+static int frame_job_priority_higher(const AVTask *a, const AVTask *b)
+{
+    // run jobs in submission order
+    return 1;
+}
+
+static int frame_job_run(AVTask *t, void *local_context, void *user_data)
+{
+    FrameThreadContext *fc = user_data;
+    FrameThreadJob    *job = (FrameThreadJob*)t;
+    int            *bound = local_context;
+
+    if (!*bound) {
+        bind_numa_nodes(fc->graph);
+        *bound = 1;
+    }
+
+    job->ret   = ff_filter_frame_run(job->link, job->frame);
+    job->frame = NULL;
+
+    ff_mutex_lock(&fc->lock);
+    job->next_done = NULL;
+    *fc->done_tail = job;
+    fc->done_tail  = &job->next_done;
+    ff_cond_signal(&fc->cond);
+    ff_mutex_unlock(&fc->lock);
+
+    return 0;
+}
+
+static void frame_thread_uninit(FrameThreadContext *fc)
+{
+    av_executor_free(&fc->executor);
+    ff_mutex_destroy(&fc->lock);
+    ff_cond_destroy(&fc->cond);
+    ff_mutex_destroy(&fc->buffer_lock);
+    ff_mutex_destroy(&fc->execute_lock);
+}
+
+static int frame_thread_init(FFFilterGraph *graphi)
+{
+    AVFilterGraph *graph = &graphi->p;
+    FrameThreadContext *fc;
+    int nb_threads = graph->nb_threads ? graph->nb_threads : av_cpu_count();
+    AVTaskCallbacks callbacks = {
+        .priority_higher = frame_job_priority_higher,
+        .run             = frame_job_run,
+        .local_context_size = sizeof(int),
+    };
+
+    if (nb_threads <= 1) {
+        graph->thread_type &= ~AVFILTER_THREAD_FRAME;
+        return 0;
+    }
+
+    fc = av_mallocz(sizeof(*fc));
+    if (!fc)
+        return AVERROR(ENOMEM);
+
+    if (ff_mutex_init(&fc->lock, NULL)) {
+        av_free(fc);
+        return AVERROR(ENOMEM);
+    }
+    if (ff_cond_init(&fc->cond, NULL)) {
+        ff_mutex_destroy(&fc->lock);
+        av_free(fc);
+        return AVERROR(ENOMEM);
+    }
+    ff_mutex_init(&fc->buffer_lock, NULL);
+    ff_mutex_init(&fc->execute_lock, NULL);
+    fc->done_tail = &fc->done;
+    fc->graph     = graph;
+
+    callbacks.user_data = fc;
+    fc->executor = av_executor_alloc(&callbacks, nb_threads);
+    if (!fc->executor) {
+        frame_thread_uninit(fc);
+        av_free(fc);
+        return AVERROR(ENOMEM);
+    }
+
+    graphi->frame_thread = fc;
+    return 0;
+}
+
 int ff_graph_thread_init(FFFilterGraph *graphi)
 {
     AVFilterGraph *graph = &graphi->p;
     int ret;
 
     if (graph->nb_threads == 1) {
-        graph->thread_type = 0;
+        if (!graphi->thread_execute)
+            graph->thread_type = 0;
+        graph->thread_type &= ~AVFILTER_THREAD_FRAME;
         return 0;
     }
 
-    graphi->thread = av_mallocz(sizeof(ThreadContext));
-    if (!graphi->thread)
-        return AVERROR(ENOMEM);
+    if (graph->thread_type & AVFILTER_THREAD_SLICE && !graphi->thread_execute) {
+        graphi->thread = av_mallocz(sizeof(ThreadContext));
+        if (!graphi->thread)
+            return AVERROR(ENOMEM);
+        ((ThreadContext*)graphi->thread)->graph = graph;
 
-    ret = thread_init_internal(graphi->thread, graph->nb_threads);
-    if (ret <= 1) {
-        av_freep(&graphi->thread);
-        graph->thread_type = 0;
-        graph->nb_threads  = 1;
-        return (ret < 0) ? ret : 0;
+        ret = thread_init_internal(graphi->thread, graph->nb_threads);
+        if (ret <= 1) {
+            av_freep(&graphi->thread);
+            graph->thread_type = 0;
+            graph->nb_threads  = 1;
+            return (ret < 0) ? ret : 0;
+        }
+        graph->nb_threads = ret;
+
+        graphi->thread_execute = thread_execute;
     }
-    graph->nb_threads = ret;
 
-    graphi->thread_execute = thread_execute;
+    if (graph->thread_type & AVFILTER_THREAD_FRAME)
+        return frame_thread_init(graphi);
 
     return 0;
 }
 
 void ff_graph_thread_free(FFFilterGraph *graph)
 {
+    if (graph->frame_thread) {
+        ff_graph_frame_thread_wait(graph, NULL);
+        frame_thread_uninit(graph->frame_thread);
+        av_freep(&graph->frame_thread);
+    }
     if (graph->thread)
         slice_thread_uninit(graph->thread);
     av_freep(&graph->thread);
 }
+
+int ff_filter_frame_thread_init(AVFilterContext *ctx)
+{
+    FFFilterGraph *graphi = fffiltergraph(ctx->graph);
+    FFFilterContext *ctxi = fffilterctx(ctx);
+
+    /* Filters using activate() may look at all their links at any time, only
+     * the filter_frame() call of legacy single-input filters that declare it
+     * safe can be moved to another thread. */
+    if (!graphi->frame_thread || ctx->filter->activate || ctx->nb_inputs != 1 ||
+        !(ctx->filter->flags_internal & FF_FILTER_FLAG_FRAME_THREADS))
+        return 0;
+
+    ctxi->frame_job = av_mallocz(sizeof(*ctxi->frame_job));
+    if (!ctxi->frame_job)
+        return AVERROR(ENOMEM);
+    ctxi->frame_job->fc = graphi->frame_thread;
+
+    ctx->thread_type |= AVFILTER_THREAD_FRAME;
+
+    return 0;
+}
+
+void ff_filter_frame_thread_uninit(AVFilterContext *ctx)
+{
+    FFFilterContext *ctxi = fffilterctx(ctx);
+    FrameThreadJob *job = ctxi->frame_job;
+
+    if (!job)
+        return;
+
+    av_assert0(!ctxi->frame_busy);
+    av_log(ctx, AV_LOG_VERBOSE, "%"PRIu64" frames filtered on frame threads\n",
+           job->nb_frames);
+    for (unsigned i = 0; i < job->nb_outputs; i++)
+        av_frame_free(&job->outputs[i].frame);
+    av_freep(&job->outputs);
+    av_freep(&ctxi->frame_job);
+}
+
+int ff_filter_frame_thread_submit(AVFilterLink *link, AVFrame *frame)
+{
+    AVFilterContext *ctx = link->dst;
+    FFFilterContext *ctxi = fffilterctx(ctx);
+    FilterLinkInternal *li = ff_link_internal(link);
+    FrameThreadJob *job = ctxi->frame_job;
+
+    av_assert1(!ctxi->frame_busy);
+
+    job->link  = link;
+    job->frame = frame;
+    job->nb_frames++;
+    ctxi->frame_busy = 1;
+    job->fc->nb_busy++;
+    av_executor_execute(job->fc->executor, &job->task);
+
+    /* If the output of the filter is wanted, ask for the next input frame
+     * right away, so that the upstream filters work on it meanwhile. */
+    if (ff_framequeue_queued_frames(&li->fifo) || li->status_in || li->status_out)
+        return 0;
+    for (unsigned i = 0; i < ctx->nb_outputs; i++) {
+        if (ff_link_internal(ctx->outputs[i])->frame_wanted_out) {
+            ff_inlink_request_frame(link);
+            break;
+        }
+    }
+
+    return 0;
+}
+
+int ff_filter_frame_thread_output(AVFilterLink *link, AVFrame *frame)
+{
+    FrameThreadJob *job = fffilterctx(link->src)->frame_job;
+    FrameThreadOutput *outputs;
+
+    outputs = av_fast_realloc(job->outputs, &job->outputs_size,
+                              (job->nb_outputs + 1) * sizeof(*job->outputs));
+    if (!outputs) {
+        av_frame_free(&frame);
+        return AVERROR(ENOMEM);
+    }
+    job->outputs = outputs;
+
+    outputs[job->nb_outputs].link  = link;
+    outputs[job->nb_outputs].frame = frame;
+    job->nb_outputs++;
+
+    return 0;
+}
+
+static int frame_job_finish(FrameThreadJob *job)
+{
+    AVFilterLink *link = job->link;
+    FilterLinkInternal *li = ff_link_internal(link);
+    int ret = job->ret;
+
+    fffilterctx(link->dst)->frame_busy = 0;
+    job->fc->nb_busy--;
+
+    li->l.frame_count_in  += li->frame_count_in_busy;
+    li->l.sample_count_in += li->sample_count_in_busy;
+    li->frame_count_in_busy = li->sample_count_in_busy = 0;
+
+    for (unsigned i = 0; i < job->nb_outputs; i++) {
+        int err = ff_filter_frame(job->outputs[i].link, job->outputs[i].frame);
+        if (err < 0 && ret >= 0)
+            ret = err;
+    }
+    job->nb_outputs = 0;
+
+    return ff_filter_frame_complete(link, ret);
+}
+
+int ff_graph_frame_thread_collect(FFFilterGraph *graph, int wait)
+{
+    FrameThreadContext *fc = graph->frame_thread;
+    FrameThreadJob *job;
+    int ret = 0;
+
+    if (!fc || !fc->nb_busy)
+        return 0;
+
+    ff_mutex_lock(&fc->lock);
+    while (wait && !fc->done)
+        ff_cond_wait(&fc->cond, &fc->lock);
+    job           = fc->done;
+    fc->done      = NULL;
+    fc->done_tail = &fc->done;
+    ff_mutex_unlock(&fc->lock);
+
+    while (job) {
+        FrameThreadJob *next = job->next_done;
+        int err = frame_job_finish(job);
+
+        if (err < 0 && ret >= 0)
+            ret = err;
+        else if (!ret)
+            ret = 1;
+        job = next;
+    }
+
+    return ret;
+}
+
+void ff_graph_frame_thread_wait(FFFilterGraph *graph, AVFilterContext *ctx)
+{
+    FrameThreadContext *fc = graph->frame_thread;
+
+    if (!fc)
+        return;
+
+    while (ctx ? fffilterctx(ctx)->frame_busy : fc->nb_busy)
+        ff_graph_frame_thread_collect(graph, 1);
+}
+
+void ff_graph_buffer_lock(AVFilterGraph *graph)
+{
+    FrameThreadContext *fc = graph ? fffiltergraph(graph)->frame_thread : NULL;
+
+    if (fc)
+        ff_mutex_lock(&fc->buffer_lock);
+}
+
+void ff_graph_buffer_unlock(AVFilterGraph *graph)
+{
+    FrameThreadContext *fc = graph ? fffiltergraph(graph)->frame_thread : NULL;
+
+    if (fc)
+        ff_mutex_unlock(&fc->buffer_lock);
+}
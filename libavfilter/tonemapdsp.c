@@ -0,0 +1,226 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include <float.h>
+#include <math.h>
+#include <string.h>
+
+#include "libavutil/attributes.h"
+#include "libavutil/common.h"
+#include "colorspace.h"
+#include "tonemapdsp.h"
+
+#define PQ_M1 (2610.0f / 16384.0f)
+#define PQ_M2 (2523.0f / 4096.0f * 128.0f)
+#define PQ_C1 (3424.0f / 4096.0f)
+#define PQ_C2 (2413.0f / 4096.0f * 32.0f)
+#define PQ_C3 (2392.0f / 4096.0f * 32.0f)
+
+static av_always_inline float pq_oetf(float x)
+{
+    x = powf(FFMAX(x * (REFERENCE_WHITE / 10000.0f), 0.0f), PQ_M1);
+    return powf((PQ_C1 + PQ_C2 * x) / (1.0f + PQ_C3 * x), PQ_M2);
+}
+
+static av_always_inline float pq_eotf(float x)
+{
+    x = powf(FFMAX(x, 0.0f), 1.0f / PQ_M2);
+    x = FFMAX(x - PQ_C1, 0.0f) / (PQ_C2 - PQ_C3 * x);
+    return powf(x, 1.0f / PQ_M1) * (10000.0f / REFERENCE_WHITE);
+}
+
+static av_always_inline float hable(float in)
+{
+    float a = 0.15f, b = 0.50f, c = 0.10f, d = 0.20f, e = 0.02f, f = 0.30f;
+    return (in * (in * a + b * c) + d * e) / (in * (in * a + b) + d * f) - e / f;
+}
+
+static av_always_inline float curve_none(float sig, const TonemapParams *p)
+{
+    return sig;
+}
+
+static av_always_inline float curve_linear(float sig, const TonemapParams *p)
+{
+    return sig * p->scale;
+}
+
+static av_always_inline float curve_gamma(float sig, const TonemapParams *p)
+{
+    return sig > 0.05f ? powf(sig * p->scale, p->a) : sig * p->b;
+}
+
+static av_always_inline float curve_clip(float sig, const TonemapParams *p)
+{
+    return av_clipf(sig * p->param, 0, 1.0f);
+}
+
+static av_always_inline float curve_reinhard(float sig, const TonemapParams *p)
+{
+    return sig / (sig + p->param) * p->scale;
+}
+
+static av_always_inline float curve_hable(float sig, const TonemapParams *p)
+{
+    return hable(sig) * p->scale;
+}
+
+static av_always_inline float curve_mobius(float sig, const TonemapParams *p)
+{
+    if (sig <= p->param)
+        return sig;
+    return p->c * (sig + p->a) / (sig + p->b);
+}
+
+/* ITU-R BT.2390 EETF, a hermite spline knee in the PQ domain */
+static av_always_inline float curve_bt2390(float sig, const TonemapParams *p)
+{
+    const float ks = p->c;
+    float e = pq_oetf(sig) / p->a;
+
+    if (e > ks) {
+        const float t  = FFMIN((e - ks) / (1.0f - ks), 1.0f);
+        const float t2 = t * t, t3 = t2 * t;
+
+        e = (2.0f * t3 - 3.0f * t2 + 1.0f) * ks +
+            (t3 - 2.0f * t2 + t) * (1.0f - ks) +
+            (-2.0f * t3 + 3.0f * t2) * p->b;
+    }
+    return pq_eotf(e * p->a);
+}
+
+#define MIX(x,y,a) (x) * (1 - (a)) + (y) * (a)
+#define DEFINE_TONEMAP_FUNC(name)                                                     \
+static void tonemap_##name##_c(float *dst[3], float *src[3], ptrdiff_t w,             \
+                               const TonemapParams *p)                                \
+{                                                                                     \
+    for (ptrdiff_t x = 0; x < w; x++) {                                               \
+        float r = src[0][x], g = src[1][x], b = src[2][x];                            \
+        float sig;                                                                    \
+                                                                                      \
+        /* desaturate to prevent unnatural colors */                                  \
+        if (p->desat > 0) {                                                           \
+            float luma = p->coeffs[0] * r + p->coeffs[1] * g + p->coeffs[2] * b;      \
+            float overbright = FFMAX(luma - p->desat, 1e-6f) / FFMAX(luma, 1e-6f);    \
+            r = MIX(r, luma, overbright);                                             \
+            g = MIX(g, luma, overbright);                                             \
+            b = MIX(b, luma, overbright);                                             \
+        }                                                                             \
+                                                                                      \
+        /* pick the brightest component, reducing the value range as necessary        \
+         * to keep the entire signal in range and preventing discoloration due to     \
+         * out-of-bounds clipping, then apply the computed scale factor to the        \
+         * color, linearly to prevent discoloration */                                \
+        sig = FFMAX(FFMAX3(r, g, b), 1e-6f);                                          \
+        sig = curve_##name(sig, p) / sig;                                             \
+                                                                                      \
+        dst[0][x] = r * sig;                                                          \
+        dst[1][x] = g * sig;                                                          \
+        dst[2][x] = b * sig;                                                          \
+    }                                                                                 \
+}
+
+DEFINE_TONEMAP_FUNC(none)
+DEFINE_TONEMAP_FUNC(linear)
+DEFINE_TONEMAP_FUNC(gamma)
+DEFINE_TONEMAP_FUNC(clip)
+DEFINE_TONEMAP_FUNC(reinhard)
+DEFINE_TONEMAP_FUNC(hable)
+DEFINE_TONEMAP_FUNC(mobius)
+DEFINE_TONEMAP_FUNC(bt2390)
+
+static void linearize_c(float *dst, const int16_t *src, ptrdiff_t w,
+                        const float *lut)
+{
+    for (ptrdiff_t x = 0; x < w; x++)
+        dst[x] = lut[av_clip_uintp2(2048 + src[x], 15)];
+}
+
+static void delinearize_c(int16_t *dst[3], float *src[3], ptrdiff_t w,
+                          const float m[3][3], const int16_t *lut)
+{
+    for (ptrdiff_t x = 0; x < w; x++) {
+        const float r = src[0][x], g = src[1][x], b = src[2][x];
+
+        for (int n = 0; n < 3; n++) {
+            float v = m[n][0] * r + m[n][1] * g + m[n][2] * b;
+
+            v = av_clipf(v, -1.0f, 2.0f);
+            dst[n][x] = lut[av_clip_uintp2(lrintf(v * 28672.0f) + 2048, 15)];
+        }
+    }
+}
+
+void ff_tonemap_params_init(TonemapParams *p, enum TonemapAlgorithm alg,
+                            float param, float desat, float peak,
+                            const float coeffs[3])
+{
+    memset(p, 0, sizeof(*p));
+    if (desat > 0) {
+        memcpy(p->coeffs, coeffs, sizeof(p->coeffs));
+        p->desat = desat;
+    }
+    p->param = param;
+    p->peak  = peak;
+
+    switch (alg) {
+    case TONEMAP_LINEAR:
+        p->scale = param / peak;
+        break;
+    case TONEMAP_GAMMA:
+        p->scale = 1.0f / peak;
+        p->a     = 1.0f / param;
+        p->b     = powf(0.05f / peak, 1.0f / param) / 0.05f;
+        break;
+    case TONEMAP_REINHARD:
+        p->scale = (peak + param) / peak;
+        break;
+    case TONEMAP_HABLE:
+        p->scale = 1.0f / hable(peak);
+        break;
+    case TONEMAP_MOBIUS: {
+        const float j = param;
+
+        p->a = -j * j * (peak - 1.0f) / (j * j - 2.0f * j + peak);
+        p->b = (j * j - 2.0f * j * peak + peak) / FFMAX(peak - 1.0f, 1e-6f);
+        p->c = (p->b * p->b + 2.0f * p->b * j + j * j) / (p->b - p->a);
+        break;
+    }
+    case TONEMAP_BT2390:
+        /* source peak and reference white in the PQ domain, and the knee */
+        p->a = pq_oetf(peak);
+        p->b = pq_oetf(1.0f) / p->a;
+        p->c = p->b < 1.0f ? 1.5f * p->b - 0.5f : FLT_MAX;
+        break;
+    }
+}
+
+av_cold void ff_tonemapdsp_init(TonemapDSPContext *dsp)
+{
+    dsp->tonemap[TONEMAP_NONE]     = tonemap_none_c;
+    dsp->tonemap[TONEMAP_LINEAR]   = tonemap_linear_c;
+    dsp->tonemap[TONEMAP_GAMMA]    = tonemap_gamma_c;
+    dsp->tonemap[TONEMAP_CLIP]     = tonemap_clip_c;
+    dsp->tonemap[TONEMAP_REINHARD] = tonemap_reinhard_c;
+    dsp->tonemap[TONEMAP_HABLE]    = tonemap_hable_c;
+    dsp->tonemap[TONEMAP_MOBIUS]   = tonemap_mobius_c;
+    dsp->tonemap[TONEMAP_BT2390]   = tonemap_bt2390_c;
+
+    dsp->linearize   = linearize_c;
+    dsp->delinearize = delinearize_c;
+}
@@ -0,0 +1,79 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef AVFILTER_TONEMAPDSP_H
+#define AVFILTER_TONEMAPDSP_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+enum TonemapAlgorithm {
+    TONEMAP_NONE,
+    TONEMAP_LINEAR,
+    TONEMAP_GAMMA,
+    TONEMAP_CLIP,
+    TONEMAP_REINHARD,
+    TONEMAP_HABLE,
+    TONEMAP_MOBIUS,
+    TONEMAP_BT2390,
+    TONEMAP_MAX,
+};
+
+/* Per-frame parameters of the tonemapping curve, in linear light where 1.0
+ * is the reference white. */
+typedef struct TonemapParams {
+    float coeffs[3];    ///< luma coefficients used for desaturation
+    float desat;        ///< desaturation strength, 0 disables desaturation
+    float param;        ///< tonemap parameter
+    float peak;         ///< signal peak
+    float scale;        ///< curve specific constants, see ff_tonemap_params_init()
+    float a, b, c;
+} TonemapParams;
+
+/* Internal RGB is the 15bpp format of colorspacedsp, with 1.0 at 28672 */
+#define TONEMAP_LUT_SIZE 32768
+
+typedef struct TonemapDSPContext {
+    /* Tonemap a row of planar linear RGB. src and dst may be the same, the
+     * planes are in R, G, B order. All rows here may be processed in blocks
+     * of 8 pixels and must be padded accordingly. */
+    void (*tonemap[TONEMAP_MAX])(float *dst[3], float *src[3], ptrdiff_t w,
+                                 const TonemapParams *p);
+
+    /* Convert a row of internal RGB to linear light with a LUT of
+     * TONEMAP_LUT_SIZE entries, indexed by the value plus 2048. */
+    void (*linearize)(float *dst, const int16_t *src, ptrdiff_t w,
+                      const float *lut);
+
+    /* Multiply a row of linear RGB by a 3x3 matrix and convert it back to
+     * internal RGB with a LUT of TONEMAP_LUT_SIZE entries, indexed by the
+     * value scaled by 28672 plus 2048. The LUT must have one more entry of
+     * padding. */
+    void (*delinearize)(int16_t *dst[3], float *src[3], ptrdiff_t w,
+                        const float m[3][3], const int16_t *lut);
+} TonemapDSPContext;
+
+void ff_tonemapdsp_init(TonemapDSPContext *dsp);
+
+/* Fill in the parameters of the curve alg for a signal of the given peak.
+ * coeffs may be NULL if desat is 0. */
+void ff_tonemap_params_init(TonemapParams *p, enum TonemapAlgorithm alg,
+                            float param, float desat, float peak,
+                            const float coeffs[3]);
+
+#endif /* AVFILTER_TONEMAPDSP_H */
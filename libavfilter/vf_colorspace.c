@@ -1037,4 +1037,5 @@ const AVFilter ff_vf_colorspace = {
     FILTER_OUTPUTS(outputs),
     FILTER_QUERY_FUNC(query_formats),
     .flags           = AVFILTER_FLAG_SUPPORT_TIMELINE_GENERIC | AVFILTER_FLAG_SLICE_THREADS,
+    .flags_internal  = FF_FILTER_FLAG_FRAME_THREADS,
 };
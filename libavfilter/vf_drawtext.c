@@ -181,7 +181,6 @@ enum text_alignment {
 
 typedef struct HarfbuzzData {
     hb_buffer_t* buf;
-    hb_font_t* font;
     unsigned int glyph_count;
     hb_glyph_info_t* glyph_info;
     hb_glyph_position_t* glyph_pos;
@@ -221,6 +220,31 @@ typedef struct Glyph {
     FT_BBox bbox;
 } Glyph;
 
+/** A glyph bitmap as positioned in the text box */
+typedef struct PlacedGlyph {
+    uint32_t code;                  ///< the glyph code point
+    int idx;                        ///< the subpixel index of the bitmap
+    int x;                          ///< the x position of the glyph origin
+    int y;                          ///< the y position of the glyph origin
+} PlacedGlyph;
+
+/** Coverage of the glyphs drawn in one color */
+typedef struct TextMask {
+    uint8_t *data;                  ///< 8-bit coverage, 0 where nothing is drawn
+    unsigned int size;              ///< allocated size of data
+    int linesize;
+    int x, y;                       ///< position of the mask in the frame
+    int w, h;                       ///< size of the mask
+    unsigned int fontsize;          ///< font size of the glyphs in the mask
+} TextMask;
+
+enum TextLayer {
+    LAYER_SHADOW,
+    LAYER_BORDER,
+    LAYER_TEXT,
+    LAYER_NB
+};
+
 /** Global text metrics */
 typedef struct TextMetrics {
     int offset_top64;               ///< ascender amount of the first line (in 26.6 units)
@@ -327,6 +351,23 @@ typedef struct DrawTextContext {
     int tab_count;                  ///< the number of tab characters
     int blank_advance64;            ///< the size of the space character
     int tab_warning_printed;        ///< ensure the tab warning to be printed only once
+
+    hb_font_t *hb_font;             ///< libharfbuzz font for the current font size
+
+    /* The lines are only shaped and measured again when the text or the font
+     * size change, and the glyphs only positioned again when the text moves. */
+    char *layout_text;              ///< the text the lines were computed for
+    unsigned int layout_fontsize;   ///< the font size the lines were computed for
+    TextMetrics layout_metrics;     ///< the metrics of the lines
+    int layout_x64, layout_y64;     ///< the position of the glyphs, INT_MIN if unset
+
+    /* The glyphs are drawn into coverage masks, which are only updated where
+     * the glyphs differ from the previous frame. */
+    PlacedGlyph *placed;            ///< the glyphs to draw
+    PlacedGlyph *prev_placed;       ///< the glyphs drawn in the masks
+    int nb_placed, nb_prev_placed;
+    unsigned int placed_size, prev_placed_size;
+    TextMask masks[LAYER_NB];
 } DrawTextContext;
 
 #define OFFSET(x) offsetof(DrawTextContext, x)
@@ -455,6 +496,10 @@ static av_cold int set_fontsize(AVFilterContext *ctx, unsigned int fontsize)
 
     s->fontsize = fontsize;
 
+    // the harfbuzz font takes the size of the face when it is created
+    hb_font_destroy(s->hb_font);
+    s->hb_font = NULL;
+
     return 0;
 }
 
@@ -1117,6 +1162,34 @@ static int glyph_enu_free(void *opaque, void *elem)
     return 0;
 }
 
+static void hb_destroy(HarfbuzzData *hb)
+{
+    hb_buffer_destroy(hb->buf);
+    hb->buf = NULL;
+    hb->glyph_info = NULL;
+    hb->glyph_pos = NULL;
+}
+
+static void free_layout(DrawTextContext *s)
+{
+    for (int l = 0; l < s->line_count; ++l) {
+        TextLine *line = &s->lines[l];
+        av_freep(&line->glyphs);
+        hb_destroy(&line->hb_data);
+    }
+    av_freep(&s->lines);
+    av_freep(&s->tab_clusters);
+    av_freep(&s->layout_text);
+    s->line_count = 0;
+    s->layout_x64 = s->layout_y64 = INT_MIN;
+}
+
+static void reset_masks(DrawTextContext *s)
+{
+    for (int i = 0; i < LAYER_NB; i++)
+        s->masks[i].w = s->masks[i].h = 0;
+}
+
 static av_cold void uninit(AVFilterContext *ctx)
 {
     DrawTextContext *s = ctx->priv;
@@ -1132,6 +1205,14 @@ static av_cold void uninit(AVFilterContext *ctx)
     av_tree_destroy(s->glyphs);
     s->glyphs = NULL;
 
+    free_layout(s);
+    hb_font_destroy(s->hb_font);
+    s->hb_font = NULL;
+    av_freep(&s->placed);
+    av_freep(&s->prev_placed);
+    for (int i = 0; i < LAYER_NB; i++)
+        av_freep(&s->masks[i].data);
+
     FT_Done_Face(s->face);
     FT_Stroker_Done(s->stroker);
     FT_Done_FreeType(s->library);
@@ -1165,6 +1246,10 @@ static int config_input(AVFilterLink *inlink)
 
     av_lfg_init(&s->prng, av_get_random_seed());
 
+    // the options may have changed, so lay out and draw the text from scratch
+    free_layout(s);
+    reset_masks(s);
+
     av_expr_free(s->x_pexpr);
     av_expr_free(s->y_pexpr);
     av_expr_free(s->a_pexpr);
@@ -1268,20 +1353,11 @@ static void update_alpha(DrawTextContext *s)
         s->alpha = 256 * alpha;
 }
 
-static int draw_glyphs(DrawTextContext *s, AVFrame *frame,
-                       FFDrawColor *color,
-                       TextMetrics *metrics,
-                       int x, int y, int borderw)
+// Compute the position of every glyph in the text box
+static int place_glyphs(DrawTextContext *s, TextMetrics *metrics)
 {
-    int g, l, x1, y1, w1, h1, idx;
-    int dx = 0, dy = 0, pdx = 0;
-    GlyphInfo *info;
-    Glyph dummy = { 0 }, *glyph;
-    FT_Bitmap bitmap;
-    FT_BitmapGlyph b_glyph;
-    uint8_t j_left = 0, j_right = 0, j_top = 0, j_bottom = 0;
-    int line_w, offset_y = 0;
-    int clip_x = 0, clip_y = 0;
+    int nb_glyphs = 0, offset_y = 0;
+    uint8_t j_left, j_right, j_top, j_bottom;
 
     j_left = !!(s->text_align & TA_LEFT);
     j_right = !!(s->text_align & TA_RIGHT);
@@ -1299,63 +1375,168 @@ static int draw_glyphs(DrawTextContext *s, AVFrame *frame,
         av_log(s, AV_LOG_WARNING, "Tab characters are only supported with left horizontal alignment\n");
     }
 
-    clip_x = FFMIN(metrics->rect_x + s->box_width + s->bb_right, frame->width);
-    clip_y = FFMIN(metrics->rect_y + s->box_height + s->bb_bottom, frame->height);
+    for (int l = 0; l < s->line_count; ++l)
+        nb_glyphs += s->lines[l].hb_data.glyph_count;
 
-    for (l = 0; l < s->line_count; ++l) {
+    av_fast_malloc(&s->placed, &s->placed_size, nb_glyphs * sizeof(*s->placed));
+    if (!s->placed)
+        return AVERROR(ENOMEM);
+    s->nb_placed = 0;
+
+    for (int l = 0; l < s->line_count; ++l) {
         TextLine *line = &s->lines[l];
-        line_w = POS_CEIL(line->width64, 64);
-        for (g = 0; g < line->hb_data.glyph_count; ++g) {
-            info = &line->glyphs[g];
-            dummy.fontsize = s->fontsize;
-            dummy.code = info->code;
-            glyph = av_tree_find(s->glyphs, &dummy, glyph_cmp, NULL);
-            if (!glyph) {
-                return AVERROR(EINVAL);
-            }
+        int line_w = POS_CEIL(line->width64, 64);
+        int offset_x = 0;
 
-            idx = get_subpixel_idx(info->shift_x64, info->shift_y64);
-            b_glyph = borderw ? glyph->border_bglyph[idx] : glyph->bglyph[idx];
-            bitmap = b_glyph->bitmap;
-            x1 = x + info->x + b_glyph->left;
-            y1 = y + info->y - b_glyph->top + offset_y;
-            w1 = bitmap.width;
-            h1 = bitmap.rows;
-
-            if (j_left && j_right) {
-                x1 += (s->box_width - line_w) / 2;
-            } else if (j_right) {
-                x1 += s->box_width - line_w;
-            }
+        if (j_left && j_right) {
+            offset_x = (s->box_width - line_w) / 2;
+        } else if (j_right) {
+            offset_x = s->box_width - line_w;
+        }
 
-            // Offset of the glyph's bitmap in the visible region
-            dx = dy = 0;
-            if (x1 < metrics->rect_x - s->bb_left) {
-                dx = metrics->rect_x - s->bb_left - x1;
-                x1 = metrics->rect_x - s->bb_left;
-            }
-            if (y1 < metrics->rect_y - s->bb_top) {
-                dy = metrics->rect_y - s->bb_top - y1;
-                y1 = metrics->rect_y - s->bb_top;
-            }
+        for (int g = 0; g < line->hb_data.glyph_count; ++g) {
+            GlyphInfo *info = &line->glyphs[g];
+            PlacedGlyph *p = &s->placed[s->nb_placed++];
 
-            // check if the glyph is empty or out of the clipping region
-            if (dx >= w1 || dy >= h1 || x1 >= clip_x || y1 >= clip_y) {
+            p->code = info->code;
+            p->idx = get_subpixel_idx(info->shift_x64, info->shift_y64);
+            p->x = info->x + offset_x;
+            p->y = info->y + offset_y;
+        }
+    }
+
+    return 0;
+}
+
+static FT_BitmapGlyph placed_bitmap(DrawTextContext *s, const PlacedGlyph *p, int border)
+{
+    Glyph dummy = { 0 }, *glyph;
+
+    dummy.fontsize = s->fontsize;
+    dummy.code = p->code;
+    glyph = av_tree_find(s->glyphs, &dummy, glyph_cmp, NULL);
+    if (!glyph)
+        return NULL;
+    return border ? glyph->border_bglyph[p->idx] : glyph->bglyph[p->idx];
+}
+
+// Draw the part of a glyph inside the given rectangle of the mask, over the
+// glyphs already drawn there
+static void draw_glyph_mask(TextMask *mask, FT_BitmapGlyph b_glyph, int x, int y,
+                            int rx0, int ry0, int rx1, int ry1)
+{
+    const FT_Bitmap *bitmap = &b_glyph->bitmap;
+    int x0, y0, x1, y1;
+
+    x += b_glyph->left;
+    y -= b_glyph->top;
+    x0 = FFMAX(x, rx0);
+    y0 = FFMAX(y, ry0);
+    x1 = FFMIN(x + (int)bitmap->width, rx1);
+    y1 = FFMIN(y + (int)bitmap->rows,  ry1);
+
+    for (int j = y0; j < y1; j++) {
+        const uint8_t *src = bitmap->buffer + (j - y) * bitmap->pitch + x0 - x;
+        uint8_t *dst = mask->data + (j - mask->y) * mask->linesize + x0 - mask->x;
+
+        for (int i = 0; i < x1 - x0; i++)
+            dst[i] += ((255 - dst[i]) * src[i] + 127) / 255;
+    }
+}
+
+static void extend_rect(FT_BitmapGlyph b_glyph, int x, int y,
+                        int *rx0, int *ry0, int *rx1, int *ry1)
+{
+    x += b_glyph->left;
+    y -= b_glyph->top;
+    *rx0 = FFMIN(*rx0, x);
+    *ry0 = FFMIN(*ry0, y);
+    *rx1 = FFMAX(*rx1, x + (int)b_glyph->bitmap.width);
+    *ry1 = FFMAX(*ry1, y + (int)b_glyph->bitmap.rows);
+}
+
+/**
+ * Draw the glyphs offset by (dx, dy) into the mask covering the given area of
+ * the frame. If the mask already covers that area, only the glyphs which
+ * differ from those of the previous frame, and the ones overlapping them,
+ * are drawn again.
+ */
+static int update_mask(DrawTextContext *s, TextMask *mask,
+                       int x, int y, int w, int h, int dx, int dy, int border)
+{
+    int rx0 = INT_MAX, ry0 = INT_MAX, rx1 = INT_MIN, ry1 = INT_MIN;
+
+    if (mask->x != x || mask->y != y || mask->w != w || mask->h != h ||
+        mask->fontsize != s->fontsize || s->nb_placed != s->nb_prev_placed) {
+        av_fast_malloc(&mask->data, &mask->size, (size_t)w * h);
+        if (!mask->data) {
+            mask->w = mask->h = 0;
+            return AVERROR(ENOMEM);
+        }
+        mask->linesize = w;
+        mask->x = x;
+        mask->y = y;
+        mask->w = w;
+        mask->h = h;
+        mask->fontsize = s->fontsize;
+        rx0 = x;
+        ry0 = y;
+        rx1 = x + w;
+        ry1 = y + h;
+    } else {
+        for (int i = 0; i < s->nb_placed; i++) {
+            const PlacedGlyph *p = &s->placed[i], *q = &s->prev_placed[i];
+            FT_BitmapGlyph b_glyph;
+
+            if (p->code == q->code && p->idx == q->idx && p->x == q->x && p->y == q->y)
                 continue;
-            }
+            if (!(b_glyph = placed_bitmap(s, q, border)))
+                return AVERROR(EINVAL);
+            extend_rect(b_glyph, q->x + dx, q->y + dy, &rx0, &ry0, &rx1, &ry1);
+            if (!(b_glyph = placed_bitmap(s, p, border)))
+                return AVERROR(EINVAL);
+            extend_rect(b_glyph, p->x + dx, p->y + dy, &rx0, &ry0, &rx1, &ry1);
+        }
+        rx0 = FFMAX(rx0, x);
+        ry0 = FFMAX(ry0, y);
+        rx1 = FFMIN(rx1, x + w);
+        ry1 = FFMIN(ry1, y + h);
+        if (rx0 >= rx1 || ry0 >= ry1)
+            return 0;
+    }
+
+    for (int j = ry0; j < ry1; j++)
+        memset(mask->data + (j - y) * mask->linesize + rx0 - x, 0, rx1 - rx0);
 
-            pdx = dx + dy * bitmap.pitch;
-            w1 = FFMIN(clip_x - x1, w1 - dx);
-            h1 = FFMIN(clip_y - y1, h1 - dy);
+    for (int i = 0; i < s->nb_placed; i++) {
+        FT_BitmapGlyph b_glyph = placed_bitmap(s, &s->placed[i], border);
 
-            ff_blend_mask(&s->dc, color, frame->data, frame->linesize, clip_x, clip_y,
-                bitmap.buffer + pdx, bitmap.pitch, w1, h1, 3, 0, x1, y1);
+        if (!b_glyph) {
+            mask->w = mask->h = 0;
+            return AVERROR(EINVAL);
         }
+        draw_glyph_mask(mask, b_glyph, s->placed[i].x + dx, s->placed[i].y + dy,
+                        rx0, ry0, rx1, ry1);
     }
 
     return 0;
 }
 
+static int draw_layer(DrawTextContext *s, AVFrame *frame, enum TextLayer layer,
+                      FFDrawColor *color, int x, int y, int w, int h,
+                      int dx, int dy, int border)
+{
+    TextMask *mask = &s->masks[layer];
+    int ret;
+
+    if ((ret = update_mask(s, mask, x, y, w, h, dx, dy, border)) < 0)
+        return ret;
+
+    ff_blend_mask(&s->dc, color, frame->data, frame->linesize, frame->width, frame->height,
+                  mask->data, mask->linesize, mask->w, mask->h, 3, 0, mask->x, mask->y);
+    return 0;
+}
+
 // Shapes a line of text using libharfbuzz
 static int shape_text_hb(DrawTextContext *s, HarfbuzzData* hb, const char* text, int textLen)
 {
@@ -1367,29 +1548,21 @@ static int shape_text_hb(DrawTextContext *s, HarfbuzzData* hb, const char* text,
     hb_buffer_set_script(hb->buf, HB_SCRIPT_LATIN);
     hb_buffer_set_language(hb->buf, hb_language_from_string("en", -1));
     hb_buffer_guess_segment_properties(hb->buf);
-    hb->font = hb_ft_font_create(s->face, NULL);
-    if(hb->font == NULL) {
-        return AVERROR(ENOMEM);
+    if (!s->hb_font) {
+        s->hb_font = hb_ft_font_create(s->face, NULL);
+        if (s->hb_font == NULL) {
+            return AVERROR(ENOMEM);
+        }
+        hb_ft_font_set_funcs(s->hb_font);
     }
-    hb_ft_font_set_funcs(hb->font);
     hb_buffer_add_utf8(hb->buf, text, textLen, 0, -1);
-    hb_shape(hb->font, hb->buf, NULL, 0);
+    hb_shape(s->hb_font, hb->buf, NULL, 0);
     hb->glyph_info = hb_buffer_get_glyph_infos(hb->buf, &hb->glyph_count);
     hb->glyph_pos = hb_buffer_get_glyph_positions(hb->buf, &hb->glyph_count);
 
     return 0;
 }
 
-static void hb_destroy(HarfbuzzData *hb)
-{
-    hb_buffer_destroy(hb->buf);
-    hb_font_destroy(hb->font);
-    hb->buf = NULL;
-    hb->font = NULL;
-    hb->glyph_info = NULL;
-    hb->glyph_pos = NULL;
-}
-
 static int measure_text(AVFilterContext *ctx, TextMetrics *metrics)
 {
     DrawTextContext *s = ctx->priv;
@@ -1624,9 +1797,19 @@ static int draw_text(AVFilterContext *ctx, AVFrame *frame)
         return ret;
     }
 
-    if ((ret = measure_text(ctx, &metrics)) < 0) {
-        return ret;
+    if (!s->layout_text || s->layout_fontsize != s->fontsize ||
+        strcmp(s->layout_text, s->expanded_text.str)) {
+        free_layout(s);
+        if ((ret = measure_text(ctx, &s->layout_metrics)) < 0) {
+            return ret;
+        }
+        s->layout_text = av_strdup(s->expanded_text.str);
+        if (!s->layout_text) {
+            return AVERROR(ENOMEM);
+        }
+        s->layout_fontsize = s->fontsize;
     }
+    metrics = s->layout_metrics;
 
     s->max_glyph_h = POS_CEIL(metrics.max_y64 - metrics.min_y64, 64);
     s->max_glyph_w = POS_CEIL(metrics.max_x64 - metrics.min_x64, 64);
@@ -1717,10 +1900,14 @@ static int draw_text(AVFilterContext *ctx, AVFrame *frame)
         y64 = (int)(s->y * 64. + metrics.offset_top64);
     }
 
-    for (int l = 0; l < s->line_count; ++l) {
+    for (int l = 0; l < s->line_count && (x64 != s->layout_x64 || y64 != s->layout_y64); ++l) {
         TextLine *line = &s->lines[l];
         HarfbuzzData *hb = &line->hb_data;
+        av_freep(&line->glyphs);
         line->glyphs = av_mallocz(hb->glyph_count * sizeof(GlyphInfo));
+        if (!line->glyphs) {
+            return AVERROR(ENOMEM);
+        }
 
         for (int t = 0; t < hb->glyph_count; ++t) {
             GlyphInfo *g_info = &line->glyphs[t];
@@ -1737,6 +1924,7 @@ static int draw_text(AVFilterContext *ctx, AVFrame *frame)
 
             ret = load_glyph(ctx, &glyph, hb->glyph_info[t].codepoint, shift_x64, shift_y64);
             if (ret != 0) {
+                av_freep(&line->glyphs);
                 return ret;
             }
             g_info->code = hb->glyph_info[t].codepoint;
@@ -1756,6 +1944,11 @@ static int draw_text(AVFilterContext *ctx, AVFrame *frame)
 
         y += metrics.line_height64 + s->line_spacing * 64;
         x = 0;
+
+        if (l == s->line_count - 1) {
+            s->layout_x64 = x64;
+            s->layout_y64 = y64;
+        }
     }
 
     metrics.rect_x = s->x;
@@ -1785,6 +1978,12 @@ static int draw_text(AVFilterContext *ctx, AVFrame *frame)
                     metrics.rect_y + s->box_height + s->bb_bottom <= 0;
 
     if (!is_outside) {
+        // the glyphs are clipped to the box and its borders
+        int mask_x = FFMAX(metrics.rect_x - s->bb_left, 0);
+        int mask_y = FFMAX(metrics.rect_y - s->bb_top, 0);
+        int mask_w = FFMIN(metrics.rect_x + s->box_width + s->bb_right, width) - mask_x;
+        int mask_h = FFMIN(metrics.rect_y + s->box_height + s->bb_bottom, height) - mask_y;
+
         /* draw box */
         if (s->draw_box) {
             rec_x = metrics.rect_x - s->bb_left;
@@ -1796,36 +1995,42 @@ static int draw_text(AVFilterContext *ctx, AVFrame *frame)
                 rec_x, rec_y, rec_width, rec_height);
         }
 
-        if (s->shadowx || s->shadowy) {
-            if ((ret = draw_glyphs(s, frame, &shadowcolor, &metrics,
-                    s->shadowx, s->shadowy, s->borderw)) < 0) {
-                return ret;
-            }
+        if ((ret = place_glyphs(s, &metrics)) < 0) {
+            return ret;
         }
 
-        if (s->borderw) {
-            if ((ret = draw_glyphs(s, frame, &bordercolor, &metrics,
-                    0, 0, s->borderw)) < 0) {
-                return ret;
+        if (mask_w > 0 && mask_h > 0) {
+            if (s->shadowx || s->shadowy) {
+                if ((ret = draw_layer(s, frame, LAYER_SHADOW, &shadowcolor,
+                        mask_x, mask_y, mask_w, mask_h,
+                        s->shadowx, s->shadowy, s->borderw)) < 0) {
+                    goto fail;
+                }
             }
-        }
 
-        if ((ret = draw_glyphs(s, frame, &fontcolor, &metrics, 0,
-                0, 0)) < 0) {
-            return ret;
-        }
-    }
+            if (s->borderw) {
+                if ((ret = draw_layer(s, frame, LAYER_BORDER, &bordercolor,
+                        mask_x, mask_y, mask_w, mask_h, 0, 0, s->borderw)) < 0) {
+                    goto fail;
+                }
+            }
 
-    // FREE data structures
-    for (int l = 0; l < s->line_count; ++l) {
-        TextLine *line = &s->lines[l];
-        av_freep(&line->glyphs);
-        hb_destroy(&line->hb_data);
+            if ((ret = draw_layer(s, frame, LAYER_TEXT, &fontcolor,
+                    mask_x, mask_y, mask_w, mask_h, 0, 0, 0)) < 0) {
+                goto fail;
+            }
+
+            FFSWAP(PlacedGlyph *, s->placed, s->prev_placed);
+            FFSWAP(unsigned int, s->placed_size, s->prev_placed_size);
+            s->nb_prev_placed = s->nb_placed;
+        }
     }
-    av_freep(&s->lines);
-    av_freep(&s->tab_clusters);
 
     return 0;
+
+fail:
+    reset_masks(s);
+    return ret;
 }
 
 static int filter_frame(AVFilterLink *inlink, AVFrame *frame)
@@ -34,8 +34,11 @@
 #include "libavutil/intfloat.h"
 #include "libavutil/avassert.h"
 #include "libavutil/avstring.h"
+#include "libavutil/csp.h"
+#include "colorspace.h"
 #include "drawutils.h"
 #include "filters.h"
+#include "formats.h"
 #include "video.h"
 #include "lut3d.h"
 
@@ -544,6 +547,94 @@ DEFINE_INTERP_FUNC(tetrahedral, 16)
 DEFINE_INTERP_FUNC(pyramid,     16)
 DEFINE_INTERP_FUNC(prism,       16)
 
+#define DEFINE_INTERP_FUNC_YUV(name, nbits)                                                                   \
+static int interp_##nbits##_##name##_yuv(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs)             \
+{                                                                                                             \
+    int x, y, cx, cy;                                                                                         \
+    const LUT3DContext *lut3d = ctx->priv;                                                                    \
+    const Lut3DPreLut *prelut = &lut3d->prelut;                                                               \
+    const ThreadData *td = arg;                                                                               \
+    const AVFrame *in  = td->in;                                                                              \
+    const AVFrame *out = td->out;                                                                             \
+    const int direct = out == in;                                                                             \
+    const int hsub = lut3d->hsub;                                                                             \
+    const int vsub = lut3d->vsub;                                                                             \
+    const int chroma_w = AV_CEIL_RSHIFT(in->width,  hsub);                                                    \
+    const int chroma_h = AV_CEIL_RSHIFT(in->height, vsub);                                                    \
+    const int slice_start = (chroma_h *  jobnr   ) / nb_jobs;                                                 \
+    const int slice_end   = (chroma_h * (jobnr+1)) / nb_jobs;                                                 \
+    const int depth = lut3d->depth;                                                                           \
+    const float y_offset = lut3d->yuv_offset[0];                                                              \
+    const float c_offset = lut3d->yuv_offset[1];                                                              \
+    const float (*yuv2rgb)[3] = lut3d->yuv2rgb;                                                               \
+    const float (*rgb2yuv)[3] = lut3d->rgb2yuv;                                                               \
+    const float lut_max = lut3d->lutsize - 1;                                                                 \
+    const float scale_r = lut3d->scale.r * lut_max;                                                           \
+    const float scale_g = lut3d->scale.g * lut_max;                                                           \
+    const float scale_b = lut3d->scale.b * lut_max;                                                           \
+                                                                                                              \
+    for (cy = slice_start; cy < slice_end; cy++) {                                                            \
+        const int y0 = cy << vsub;                                                                            \
+        const int y1 = FFMIN(y0 + (1 << vsub), in->height);                                                   \
+        const uint##nbits##_t *srcu = (const uint##nbits##_t *)(in->data[1] + cy * in->linesize[1]);          \
+        const uint##nbits##_t *srcv = (const uint##nbits##_t *)(in->data[2] + cy * in->linesize[2]);          \
+        uint##nbits##_t *dstu = (uint##nbits##_t *)(out->data[1] + cy * out->linesize[1]);                    \
+        uint##nbits##_t *dstv = (uint##nbits##_t *)(out->data[2] + cy * out->linesize[2]);                    \
+        for (cx = 0; cx < chroma_w; cx++) {                                                                   \
+            const int x0 = cx << hsub;                                                                        \
+            const int x1 = FFMIN(x0 + (1 << hsub), in->width);                                                \
+            const float u = srcu[cx] - c_offset;                                                              \
+            const float v = srcv[cx] - c_offset;                                                              \
+            const float cr = yuv2rgb[0][1] * u + yuv2rgb[0][2] * v;                                           \
+            const float cg = yuv2rgb[1][1] * u + yuv2rgb[1][2] * v;                                           \
+            const float cb = yuv2rgb[2][1] * u + yuv2rgb[2][2] * v;                                           \
+            float sum_u = 0.f, sum_v = 0.f;                                                                   \
+            /* every pixel sharing the chroma sample goes through the LUT, the                                \
+             * chroma of the results is averaged back into one sample */                                      \
+            for (y = y0; y < y1; y++) {                                                                       \
+                const uint##nbits##_t *srcy = (const uint##nbits##_t *)(in->data[0] + y * in->linesize[0]);   \
+                const uint##nbits##_t *srca = (const uint##nbits##_t *)(in->data[3] + y * in->linesize[3]);   \
+                uint##nbits##_t *dsty = (uint##nbits##_t *)(out->data[0] + y * out->linesize[0]);             \
+                uint##nbits##_t *dsta = (uint##nbits##_t *)(out->data[3] + y * out->linesize[3]);             \
+                for (x = x0; x < x1; x++) {                                                                   \
+                    const float l = srcy[x] - y_offset;                                                       \
+                    const struct rgbvec rgb = {yuv2rgb[0][0] * l + cr,                                        \
+                                               yuv2rgb[1][0] * l + cg,                                        \
+                                               yuv2rgb[2][0] * l + cb};                                       \
+                    const struct rgbvec prelut_rgb = apply_prelut(prelut, &rgb);                              \
+                    const struct rgbvec scaled_rgb = {av_clipf(prelut_rgb.r * scale_r, 0, lut_max),           \
+                                                      av_clipf(prelut_rgb.g * scale_g, 0, lut_max),           \
+                                                      av_clipf(prelut_rgb.b * scale_b, 0, lut_max)};          \
+                    struct rgbvec vec = interp_##name(lut3d, &scaled_rgb);                                    \
+                    const float luma = rgb2yuv[0][0] * vec.r + rgb2yuv[0][1] * vec.g + rgb2yuv[0][2] * vec.b; \
+                    dsty[x] = av_clip_uintp2(lrintf(luma + y_offset), depth);                                 \
+                    sum_u += rgb2yuv[1][0] * vec.r + rgb2yuv[1][1] * vec.g + rgb2yuv[1][2] * vec.b;           \
+                    sum_v += rgb2yuv[2][0] * vec.r + rgb2yuv[2][1] * vec.g + rgb2yuv[2][2] * vec.b;           \
+                    if (!direct && in->linesize[3])                                                           \
+                        dsta[x] = srca[x];                                                                    \
+                }                                                                                             \
+            }                                                                                                 \
+            sum_u /= (x1 - x0) * (y1 - y0);                                                                   \
+            sum_v /= (x1 - x0) * (y1 - y0);                                                                   \
+            dstu[cx] = av_clip_uintp2(lrintf(sum_u + c_offset), depth);                                       \
+            dstv[cx] = av_clip_uintp2(lrintf(sum_v + c_offset), depth);                                       \
+        }                                                                                                     \
+    }                                                                                                         \
+    return 0;                                                                                                 \
+}
+
+DEFINE_INTERP_FUNC_YUV(nearest,     8)
+DEFINE_INTERP_FUNC_YUV(trilinear,   8)
+DEFINE_INTERP_FUNC_YUV(tetrahedral, 8)
+DEFINE_INTERP_FUNC_YUV(pyramid,     8)
+DEFINE_INTERP_FUNC_YUV(prism,       8)
+
+DEFINE_INTERP_FUNC_YUV(nearest,     16)
+DEFINE_INTERP_FUNC_YUV(trilinear,   16)
+DEFINE_INTERP_FUNC_YUV(tetrahedral, 16)
+DEFINE_INTERP_FUNC_YUV(pyramid,     16)
+DEFINE_INTERP_FUNC_YUV(prism,       16)
+
 #define MAX_LINE_SIZE 512
 
 static int skip_line(const char *p)
@@ -1094,23 +1185,40 @@ static int set_identity_matrix(AVFilterContext *ctx, int size)
     return 0;
 }
 
+#define RGB_PIX_FMTS                         \
+    AV_PIX_FMT_RGB24,  AV_PIX_FMT_BGR24,     \
+    AV_PIX_FMT_RGBA,   AV_PIX_FMT_BGRA,      \
+    AV_PIX_FMT_ARGB,   AV_PIX_FMT_ABGR,      \
+    AV_PIX_FMT_0RGB,   AV_PIX_FMT_0BGR,      \
+    AV_PIX_FMT_RGB0,   AV_PIX_FMT_BGR0,      \
+    AV_PIX_FMT_RGB48,  AV_PIX_FMT_BGR48,     \
+    AV_PIX_FMT_RGBA64, AV_PIX_FMT_BGRA64,    \
+    AV_PIX_FMT_GBRP,   AV_PIX_FMT_GBRAP,     \
+    AV_PIX_FMT_GBRP9,                        \
+    AV_PIX_FMT_GBRP10, AV_PIX_FMT_GBRAP10,   \
+    AV_PIX_FMT_GBRP12, AV_PIX_FMT_GBRAP12,   \
+    AV_PIX_FMT_GBRP14,                       \
+    AV_PIX_FMT_GBRP16,  AV_PIX_FMT_GBRAP16,  \
+    AV_PIX_FMT_GBRPF32, AV_PIX_FMT_GBRAPF32
+
 static const enum AVPixelFormat pix_fmts[] = {
-    AV_PIX_FMT_RGB24,  AV_PIX_FMT_BGR24,
-    AV_PIX_FMT_RGBA,   AV_PIX_FMT_BGRA,
-    AV_PIX_FMT_ARGB,   AV_PIX_FMT_ABGR,
-    AV_PIX_FMT_0RGB,   AV_PIX_FMT_0BGR,
-    AV_PIX_FMT_RGB0,   AV_PIX_FMT_BGR0,
-    AV_PIX_FMT_RGB48,  AV_PIX_FMT_BGR48,
-    AV_PIX_FMT_RGBA64, AV_PIX_FMT_BGRA64,
-    AV_PIX_FMT_GBRP,   AV_PIX_FMT_GBRAP,
-    AV_PIX_FMT_GBRP9,
-    AV_PIX_FMT_GBRP10, AV_PIX_FMT_GBRAP10,
-    AV_PIX_FMT_GBRP12, AV_PIX_FMT_GBRAP12,
-    AV_PIX_FMT_GBRP14,
-    AV_PIX_FMT_GBRP16,  AV_PIX_FMT_GBRAP16,
-    AV_PIX_FMT_GBRPF32, AV_PIX_FMT_GBRAPF32,
+    RGB_PIX_FMTS,
+    AV_PIX_FMT_NONE
+};
+
+#if CONFIG_LUT3D_FILTER
+/* with the yuv option, YUV is converted to RGB and back around the LUT on the fly */
+static const enum AVPixelFormat lut3d_pix_fmts[] = {
+    RGB_PIX_FMTS,
+    AV_PIX_FMT_YUV420P,   AV_PIX_FMT_YUV422P,   AV_PIX_FMT_YUV444P,
+    AV_PIX_FMT_YUVA420P,  AV_PIX_FMT_YUVA422P,  AV_PIX_FMT_YUVA444P,
+    AV_PIX_FMT_YUV420P10, AV_PIX_FMT_YUV422P10, AV_PIX_FMT_YUV444P10,
+    AV_PIX_FMT_YUVA420P10, AV_PIX_FMT_YUVA422P10, AV_PIX_FMT_YUVA444P10,
+    AV_PIX_FMT_YUV420P12, AV_PIX_FMT_YUV422P12, AV_PIX_FMT_YUV444P12,
+    AV_PIX_FMT_YUV420P16, AV_PIX_FMT_YUV422P16, AV_PIX_FMT_YUV444P16,
     AV_PIX_FMT_NONE
 };
+#endif
 
 #if CONFIG_LUT3D_FILTER || CONFIG_HALDCLUT_FILTER
 
@@ -1124,11 +1232,19 @@ static int config_input(AVFilterLink *inlink)
     is16bit = desc->comp[0].depth > 8;
     planar = desc->flags & AV_PIX_FMT_FLAG_PLANAR;
     isfloat = desc->flags & AV_PIX_FMT_FLAG_FLOAT;
-    ff_fill_rgba_map(lut3d->rgba_map, inlink->format);
+    lut3d->yuv = !(desc->flags & AV_PIX_FMT_FLAG_RGB);
+    lut3d->hsub = desc->log2_chroma_w;
+    lut3d->vsub = desc->log2_chroma_h;
+    lut3d->depth = depth;
+    if (!lut3d->yuv)
+        ff_fill_rgba_map(lut3d->rgba_map, inlink->format);
     lut3d->step = av_get_padded_bits_per_pixel(desc) >> (3 + is16bit);
 
 #define SET_FUNC(name) do {                                     \
-    if (planar && !isfloat) {                                   \
+    if (lut3d->yuv) {                                           \
+        lut3d->interp = is16bit ? interp_16_##name##_yuv        \
+                                : interp_8_##name##_yuv;        \
+    } else if (planar && !isfloat) {                            \
         switch (depth) {                                        \
         case  8: lut3d->interp = interp_8_##name##_p8;   break; \
         case  9: lut3d->interp = interp_16_##name##_p9;  break; \
@@ -1153,12 +1269,44 @@ static int config_input(AVFilterLink *inlink)
     }
 
 #if ARCH_X86
-    ff_lut3d_init_x86(lut3d, desc);
+    if (!lut3d->yuv)
+        ff_lut3d_init_x86(lut3d, desc);
 #endif
 
     return 0;
 }
 
+/* Fill the matrices converting between the YUV input and RGB in [0,1] */
+static void update_yuv_coeffs(LUT3DContext *lut3d, const AVFrame *in)
+{
+    const AVLumaCoefficients *luma = av_csp_luma_coeffs_from_avcsp(in->colorspace);
+    const int shift = lut3d->depth - 8;
+    double rgb2yuv[3][3], yuv2rgb[3][3], scale[2];
+
+    // same default as swscale
+    if (!luma)
+        luma = av_csp_luma_coeffs_from_avcsp(AVCOL_SPC_BT470BG);
+    ff_fill_rgb2yuv_table(luma, rgb2yuv);
+    ff_matrix_invert_3x3(rgb2yuv, yuv2rgb);
+
+    if (in->color_range == AVCOL_RANGE_JPEG) {
+        scale[0] = scale[1] = (1 << lut3d->depth) - 1;
+        lut3d->yuv_offset[0] = 0;
+    } else {
+        scale[0] = 219 << shift;
+        scale[1] = 224 << shift;
+        lut3d->yuv_offset[0] = 16 << shift;
+    }
+    lut3d->yuv_offset[1] = 128 << shift;
+
+    for (int i = 0; i < 3; i++) {
+        for (int j = 0; j < 3; j++) {
+            lut3d->rgb2yuv[i][j] = rgb2yuv[i][j] * scale[i > 0];
+            lut3d->yuv2rgb[i][j] = yuv2rgb[i][j] / scale[j > 0];
+        }
+    }
+}
+
 static AVFrame *apply_lut(AVFilterLink *inlink, AVFrame *in)
 {
     AVFilterContext *ctx = inlink->dst;
@@ -1178,6 +1326,9 @@ static AVFrame *apply_lut(AVFilterLink *inlink, AVFrame *in)
         av_frame_copy_props(out, in);
     }
 
+    if (lut3d->yuv)
+        update_yuv_coeffs(lut3d, in);
+
     td.in  = in;
     td.out = out;
     ff_filter_execute(ctx, lut3d->interp, &td, NULL,
@@ -1213,10 +1364,11 @@ static int process_command(AVFilterContext *ctx, const char *cmd, const char *ar
 /* These options are shared between several filters;
  * &lut3d_haldclut_options[COMMON_OPTIONS_OFFSET] must always
  * point to the first of the COMMON_OPTIONS. */
-#define COMMON_OPTIONS_OFFSET CONFIG_LUT3D_FILTER
+#define COMMON_OPTIONS_OFFSET (2 * CONFIG_LUT3D_FILTER)
 static const AVOption lut3d_haldclut_options[] = {
 #if CONFIG_LUT3D_FILTER
     { "file", "set 3D LUT file name", OFFSET(file), AV_OPT_TYPE_STRING, {.str=NULL}, .flags = FLAGS },
+    { "yuv",  "accept YUV input directly", OFFSET(allow_yuv), AV_OPT_TYPE_BOOL, {.i64=0}, 0, 1, .flags = FLAGS },
 #endif
 #if CONFIG_HALDCLUT_FILTER
     { "clut", "when to process CLUT", OFFSET(clut), AV_OPT_TYPE_INT, {.i64=1}, 0, 1, .flags = TFLAGS, .unit = "clut" },
@@ -1294,6 +1446,13 @@ static av_cold void lut3d_uninit(AVFilterContext *ctx)
     }
 }
 
+static int lut3d_query_formats(AVFilterContext *ctx)
+{
+    const LUT3DContext *lut3d = ctx->priv;
+
+    return ff_set_common_formats_from_list(ctx, lut3d->allow_yuv ? lut3d_pix_fmts : pix_fmts);
+}
+
 static const AVFilterPad lut3d_inputs[] = {
     {
         .name         = "default",
@@ -1311,9 +1470,10 @@ const AVFilter ff_vf_lut3d = {
     .uninit        = lut3d_uninit,
     FILTER_INPUTS(lut3d_inputs),
     FILTER_OUTPUTS(ff_video_default_filterpad),
-    FILTER_PIXFMTS_ARRAY(pix_fmts),
+    FILTER_QUERY_FUNC(lut3d_query_formats),
     .priv_class    = &lut3d_class,
     .flags         = AVFILTER_FLAG_SUPPORT_TIMELINE_GENERIC | AVFILTER_FLAG_SLICE_THREADS,
+    .flags_internal = FF_FILTER_FLAG_FRAME_THREADS,
     .process_command = process_command,
 };
 #endif
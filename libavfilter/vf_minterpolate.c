@@ -39,6 +39,9 @@
 #define SCD_METHOD_NONE 0
 #define SCD_METHOD_FDIFF 1
 
+#define ME_METHOD_PYR (AV_ME_METHOD_UMH + 1)
+#define PYR_LEVELS_MAX 4
+
 #define NB_FRAMES 4
 #define NB_PIXEL_MVS 32
 #define NB_CLUSTERS 128
@@ -159,6 +162,7 @@ typedef struct PixelRefs {
 typedef struct Frame {
     AVFrame *avf;
     Block *blocks;
+    uint8_t *pyr[PYR_LEVELS_MAX + 1];   ///< downscaled luma, for me=pyr
 } Frame;
 
 typedef struct MIContext {
@@ -172,6 +176,7 @@ typedef struct MIContext {
     int mb_size;
     int search_param;
     int vsbmc;
+    int pyr_levels;
 
     Frame frames[NB_FRAMES];
     Cluster clusters[NB_CLUSTERS];
@@ -185,6 +190,14 @@ typedef struct MIContext {
     int log2_mb_size;
     int bitdepth;
 
+    AVMotionEstContext *slice_me_ctx;   ///< per job copies of me_ctx
+    int nb_slice_me_ctx;
+
+    int pyr_b_width[PYR_LEVELS_MAX + 1];
+    int pyr_b_height[PYR_LEVELS_MAX + 1];
+    int pyr_linesize[PYR_LEVELS_MAX + 1];
+    int16_t (*pyr_mvs[PYR_LEVELS_MAX + 1])[2];
+
     int scd_method;
     int scene_changed;
     ff_scene_sad_fn sad;
@@ -212,7 +225,7 @@ static const AVOption minterpolate_options[] = {
     { "me_mode", "motion estimation mode", OFFSET(me_mode), AV_OPT_TYPE_INT, {.i64 = ME_MODE_BILAT}, ME_MODE_BIDIR, ME_MODE_BILAT, FLAGS, .unit = "me_mode" },
         CONST("bidir",  "bidirectional motion estimation",      ME_MODE_BIDIR,          "me_mode"),
         CONST("bilat",  "bilateral motion estimation",          ME_MODE_BILAT,          "me_mode"),
-    { "me", "motion estimation method", OFFSET(me_method), AV_OPT_TYPE_INT, {.i64 = AV_ME_METHOD_EPZS}, AV_ME_METHOD_ESA, AV_ME_METHOD_UMH, FLAGS, .unit = "me" },
+    { "me", "motion estimation method", OFFSET(me_method), AV_OPT_TYPE_INT, {.i64 = AV_ME_METHOD_EPZS}, AV_ME_METHOD_ESA, ME_METHOD_PYR, FLAGS, .unit = "me" },
         CONST("esa",    "exhaustive search",                    AV_ME_METHOD_ESA,       "me"),
         CONST("tss",    "three step search",                    AV_ME_METHOD_TSS,       "me"),
         CONST("tdls",   "two dimensional logarithmic search",   AV_ME_METHOD_TDLS,      "me"),
@@ -222,9 +235,11 @@ static const AVOption minterpolate_options[] = {
         CONST("hexbs",  "hexagon-based search",                 AV_ME_METHOD_HEXBS,     "me"),
         CONST("epzs",   "enhanced predictive zonal search",     AV_ME_METHOD_EPZS,      "me"),
         CONST("umh",    "uneven multi-hexagon search",          AV_ME_METHOD_UMH,       "me"),
+        CONST("pyr",    "multi-resolution pyramid search",      ME_METHOD_PYR,          "me"),
     { "mb_size", "macroblock size", OFFSET(mb_size), AV_OPT_TYPE_INT, {.i64 = 16}, 4, 16, FLAGS },
     { "search_param", "search parameter", OFFSET(search_param), AV_OPT_TYPE_INT, {.i64 = 32}, 4, INT_MAX, FLAGS },
     { "vsbmc", "variable-size block motion compensation", OFFSET(vsbmc), AV_OPT_TYPE_INT, {.i64 = 0}, 0, 1, FLAGS },
+    { "pyr_levels", "number of downscaled levels of the pyramid search", OFFSET(pyr_levels), AV_OPT_TYPE_INT, {.i64 = 2}, 1, PYR_LEVELS_MAX, FLAGS },
     { "scd", "scene change detection method", OFFSET(scd_method), AV_OPT_TYPE_INT, {.i64 = SCD_METHOD_FDIFF}, SCD_METHOD_NONE, SCD_METHOD_FDIFF, FLAGS, .unit = "scene" },
         CONST("none",   "disable detection",                    SCD_METHOD_NONE,        "scene"),
         CONST("fdiff",  "frame difference",                     SCD_METHOD_FDIFF,       "scene"),
@@ -246,6 +261,10 @@ static const enum AVPixelFormat pix_fmts[] = {
     AV_PIX_FMT_NONE
 };
 
+/* size of the overlapped block around a block of size mb_size, the window
+ * starts mb_size / 2 before the block */
+#define OB_SIZE(mb_size) ((mb_size) / 2 + (mb_size) * 3 / 2)
+
 static uint64_t get_sbad(AVMotionEstContext *me_ctx, int x, int y, int x_mv, int y_mv)
 {
     uint8_t *data_cur = me_ctx->data_cur;
@@ -253,8 +272,8 @@ static uint64_t get_sbad(AVMotionEstContext *me_ctx, int x, int y, int x_mv, int
     int linesize = me_ctx->linesize;
     int mv_x1 = x_mv - x;
     int mv_y1 = y_mv - y;
-    int mv_x, mv_y, i, j;
-    uint64_t sbad = 0;
+    int mv_x, mv_y;
+    uint64_t sbad;
 
     x = av_clip(x, me_ctx->x_min, me_ctx->x_max);
     y = av_clip(y, me_ctx->y_min, me_ctx->y_max);
@@ -264,9 +283,7 @@ static uint64_t get_sbad(AVMotionEstContext *me_ctx, int x, int y, int x_mv, int
     data_cur += (y + mv_y) * linesize;
     data_next += (y - mv_y) * linesize;
 
-    for (j = 0; j < me_ctx->mb_size; j++)
-        for (i = 0; i < me_ctx->mb_size; i++)
-            sbad += FFABS(data_cur[x + mv_x + i + j * linesize] - data_next[x - mv_x + i + j * linesize]);
+    sbad = ff_me_sad(me_ctx, data_cur + x + mv_x, data_next + x - mv_x, me_ctx->mb_size);
 
     return sbad + (FFABS(mv_x1 - me_ctx->pred_x) + FFABS(mv_y1 - me_ctx->pred_y)) * COST_PRED_SCALE;
 }
@@ -282,17 +299,19 @@ static uint64_t get_sbad_ob(AVMotionEstContext *me_ctx, int x, int y, int x_mv,
     int y_max = me_ctx->y_max - me_ctx->mb_size / 2;
     int mv_x1 = x_mv - x;
     int mv_y1 = y_mv - y;
-    int mv_x, mv_y, i, j;
-    uint64_t sbad = 0;
+    int mv_x, mv_y;
+    uint64_t sbad;
 
     x = av_clip(x, x_min, x_max);
     y = av_clip(y, y_min, y_max);
     mv_x = av_clip(x_mv - x, -FFMIN(x - x_min, x_max - x), FFMIN(x - x_min, x_max - x));
     mv_y = av_clip(y_mv - y, -FFMIN(y - y_min, y_max - y), FFMIN(y - y_min, y_max - y));
 
-    for (j = -me_ctx->mb_size / 2; j < me_ctx->mb_size * 3 / 2; j++)
-        for (i = -me_ctx->mb_size / 2; i < me_ctx->mb_size * 3 / 2; i++)
-            sbad += FFABS(data_cur[x + mv_x + i + (y + mv_y + j) * linesize] - data_next[x - mv_x + i + (y - mv_y + j) * linesize]);
+    x -= me_ctx->mb_size / 2;
+    y -= me_ctx->mb_size / 2;
+
+    sbad = ff_me_sad(me_ctx, data_cur  + x + mv_x + (y + mv_y) * linesize,
+                             data_next + x - mv_x + (y - mv_y) * linesize, OB_SIZE(me_ctx->mb_size));
 
     return sbad + (FFABS(mv_x1 - me_ctx->pred_x) + FFABS(mv_y1 - me_ctx->pred_y)) * COST_PRED_SCALE;
 }
@@ -308,21 +327,85 @@ static uint64_t get_sad_ob(AVMotionEstContext *me_ctx, int x, int y, int x_mv, i
     int y_max = me_ctx->y_max - me_ctx->mb_size / 2;
     int mv_x = x_mv - x;
     int mv_y = y_mv - y;
-    int i, j;
-    uint64_t sad = 0;
+    uint64_t sad;
 
-    x = av_clip(x, x_min, x_max);
-    y = av_clip(y, y_min, y_max);
-    x_mv = av_clip(x_mv, x_min, x_max);
-    y_mv = av_clip(y_mv, y_min, y_max);
+    x = av_clip(x, x_min, x_max) - me_ctx->mb_size / 2;
+    y = av_clip(y, y_min, y_max) - me_ctx->mb_size / 2;
+    x_mv = av_clip(x_mv, x_min, x_max) - me_ctx->mb_size / 2;
+    y_mv = av_clip(y_mv, y_min, y_max) - me_ctx->mb_size / 2;
 
-    for (j = -me_ctx->mb_size / 2; j < me_ctx->mb_size * 3 / 2; j++)
-        for (i = -me_ctx->mb_size / 2; i < me_ctx->mb_size * 3 / 2; i++)
-            sad += FFABS(data_ref[x_mv + i + (y_mv + j) * linesize] - data_cur[x + i + (y + j) * linesize]);
+    sad = ff_me_sad(me_ctx, data_ref + x_mv + y_mv * linesize,
+                            data_cur + x    + y    * linesize, OB_SIZE(me_ctx->mb_size));
 
     return sad + (FFABS(mv_x - me_ctx->pred_x) + FFABS(mv_y - me_ctx->pred_y)) * COST_PRED_SCALE;
 }
 
+/* With fixed size blocks of bilateral motion estimation, every pixel depends
+ * on the at most 4 blocks overlapping it only and is interpolated directly,
+ * without collecting the motion vectors of all pixels first. */
+static int direct_obmc(const MIContext *mi_ctx)
+{
+    return mi_ctx->me_mode == ME_MODE_BILAT && mi_ctx->mc_mode == MC_MODE_OBMC && !mi_ctx->vsbmc;
+}
+
+static int init_pyramid(MIContext *mi_ctx, int width, int height)
+{
+    int level, i;
+
+    for (level = 1; level <= mi_ctx->pyr_levels; level++) {
+        const int b_width  = (width  >> level) >> mi_ctx->log2_mb_size;
+        const int b_height = (height >> level) >> mi_ctx->log2_mb_size;
+
+        /* the coarsest level needs at least 2x2 blocks as well */
+        if (b_width < 2 || b_height < 2)
+            break;
+
+        mi_ctx->pyr_b_width[level]  = b_width;
+        mi_ctx->pyr_b_height[level] = b_height;
+        mi_ctx->pyr_linesize[level] = width >> level;
+
+        mi_ctx->pyr_mvs[level] = av_calloc(b_width * b_height, sizeof(*mi_ctx->pyr_mvs[level]));
+        if (!mi_ctx->pyr_mvs[level])
+            return AVERROR(ENOMEM);
+
+        for (i = 0; i < NB_FRAMES; i++) {
+            Frame *frame = &mi_ctx->frames[i];
+            frame->pyr[level] = av_malloc_array(height >> level, mi_ctx->pyr_linesize[level]);
+            if (!frame->pyr[level])
+                return AVERROR(ENOMEM);
+        }
+    }
+    mi_ctx->pyr_levels = level - 1;
+
+    return 0;
+}
+
+static void build_pyramid(MIContext *mi_ctx, Frame *frame)
+{
+    const uint8_t *src = frame->avf->data[0];
+    ptrdiff_t src_linesize = frame->avf->linesize[0];
+    int level, x, y;
+
+    for (level = 1; level <= mi_ctx->pyr_levels; level++) {
+        const int width  = frame->avf->width  >> level;
+        const int height = frame->avf->height >> level;
+        const int linesize = mi_ctx->pyr_linesize[level];
+        uint8_t *dst = frame->pyr[level];
+
+        for (y = 0; y < height; y++) {
+            const uint8_t *src0 = src + 2 * y * src_linesize;
+            const uint8_t *src1 = src0 + src_linesize;
+
+            for (x = 0; x < width; x++)
+                dst[x + y * linesize] = (src0[2 * x] + src0[2 * x + 1] +
+                                         src1[2 * x] + src1[2 * x + 1] + 2) >> 2;
+        }
+
+        src = dst;
+        src_linesize = linesize;
+    }
+}
+
 static int config_input(AVFilterLink *inlink)
 {
     MIContext *mi_ctx = inlink->dst->priv;
@@ -367,12 +450,27 @@ static int config_input(AVFilterLink *inlink)
         else if (mi_ctx->me_mode == ME_MODE_BILAT)
             me_ctx->get_cost = &get_sbad_ob;
 
-        mi_ctx->pixel_mvs     = av_calloc(width * height, sizeof(*mi_ctx->pixel_mvs));
-        mi_ctx->pixel_weights = av_calloc(width * height, sizeof(*mi_ctx->pixel_weights));
-        mi_ctx->pixel_refs    = av_calloc(width * height, sizeof(*mi_ctx->pixel_refs));
-        if (!mi_ctx->pixel_mvs || !mi_ctx->pixel_weights || !mi_ctx->pixel_refs)
+        mi_ctx->nb_slice_me_ctx = ff_filter_get_nb_threads(inlink->dst);
+        mi_ctx->slice_me_ctx = av_calloc(mi_ctx->nb_slice_me_ctx, sizeof(*mi_ctx->slice_me_ctx));
+        if (!mi_ctx->slice_me_ctx)
             return AVERROR(ENOMEM);
 
+        mi_ctx->pyr_b_width[0]  = mi_ctx->b_width;
+        mi_ctx->pyr_b_height[0] = mi_ctx->b_height;
+        if (mi_ctx->me_method == ME_METHOD_PYR) {
+            int ret = init_pyramid(mi_ctx, width, height);
+            if (ret < 0)
+                return ret;
+        }
+
+        if (!direct_obmc(mi_ctx)) {
+            mi_ctx->pixel_mvs     = av_calloc(width * height, sizeof(*mi_ctx->pixel_mvs));
+            mi_ctx->pixel_weights = av_calloc(width * height, sizeof(*mi_ctx->pixel_weights));
+            mi_ctx->pixel_refs    = av_calloc(width * height, sizeof(*mi_ctx->pixel_refs));
+            if (!mi_ctx->pixel_mvs || !mi_ctx->pixel_weights || !mi_ctx->pixel_refs)
+                return AVERROR(ENOMEM);
+        }
+
         if (mi_ctx->me_mode == ME_MODE_BILAT)
             if (!FF_ALLOCZ_TYPED_ARRAY(mi_ctx->int_blocks, mi_ctx->b_count))
                 return AVERROR(ENOMEM);
@@ -413,9 +511,9 @@ static int config_output(AVFilterLink *outlink)
         preds.nb++;\
     } while(0)
 
-static void search_mv(MIContext *mi_ctx, Block *blocks, int mb_x, int mb_y, int dir)
+static void search_mv(MIContext *mi_ctx, AVMotionEstContext *me_ctx, Block *blocks,
+                      int mb_x, int mb_y, int dir)
 {
-    AVMotionEstContext *me_ctx = &mi_ctx->me_ctx;
     AVMotionEstPredictor *preds = me_ctx->preds;
     Block *block = &blocks[mb_x + mb_y * mi_ctx->b_width];
 
@@ -553,10 +651,174 @@ static void search_mv(MIContext *mi_ctx, Block *blocks, int mb_x, int mb_y, int
 
     block->mvs[dir][0] = mv[0] - x_mb;
     block->mvs[dir][1] = mv[1] - y_mb;
+
+    /* the costs evaluated after the search use the predictor of the last
+     * block, keep it as if the blocks were searched one by one */
+    if (mb_i == mi_ctx->b_count - 1) {
+        mi_ctx->me_ctx.pred_x = me_ctx->pred_x;
+        mi_ctx->me_ctx.pred_y = me_ctx->pred_y;
+    }
+}
+
+/* Search a block of the given level of the pyramid. The coarsest level uses
+ * an exhaustive search, the other ones refine the vectors of the level above
+ * with a predictive diamond search. */
+static void search_mv_pyr(MIContext *mi_ctx, AVMotionEstContext *me_ctx, Block *blocks,
+                          int level, int mb_x, int mb_y, int dir)
+{
+    AVMotionEstPredictor *preds = me_ctx->preds;
+    const int x_mb = mb_x << mi_ctx->log2_mb_size;
+    const int y_mb = mb_y << mi_ctx->log2_mb_size;
+    const int mb_i = mb_x + mb_y * mi_ctx->pyr_b_width[level];
+    int mv[2] = {x_mb, y_mb};
+
+    if (level == mi_ctx->pyr_levels) {
+        ff_me_search_esa(me_ctx, x_mb, y_mb, mv);
+    } else {
+        int16_t (*mvs)[2] = mi_ctx->pyr_mvs[level + 1];
+        const int p_width  = mi_ctx->pyr_b_width[level + 1];
+        const int p_height = mi_ctx->pyr_b_height[level + 1];
+        const int p_x = FFMIN(mb_x >> 1, p_width  - 1);
+        const int p_y = FFMIN(mb_y >> 1, p_height - 1);
+        const int p_i = p_x + p_y * p_width;
+
+        preds[0].nb = 0;
+        preds[1].nb = 0;
+
+        me_ctx->pred_x = mvs[p_i][0] * 2;
+        me_ctx->pred_y = mvs[p_i][1] * 2;
+
+        ADD_PRED(preds[0], 0, 0);
+
+        //left, right, top and bottom mb of the level above
+        if (p_x > 0)
+            ADD_PRED(preds[1], mvs[p_i - 1][0] * 2, mvs[p_i - 1][1] * 2);
+        if (p_x + 1 < p_width)
+            ADD_PRED(preds[1], mvs[p_i + 1][0] * 2, mvs[p_i + 1][1] * 2);
+        if (p_y > 0)
+            ADD_PRED(preds[1], mvs[p_i - p_width][0] * 2, mvs[p_i - p_width][1] * 2);
+        if (p_y + 1 < p_height)
+            ADD_PRED(preds[1], mvs[p_i + p_width][0] * 2, mvs[p_i + p_width][1] * 2);
+
+        ff_me_search_epzs(me_ctx, x_mb, y_mb, mv);
+    }
+
+    if (level) {
+        mi_ctx->pyr_mvs[level][mb_i][0] = mv[0] - x_mb;
+        mi_ctx->pyr_mvs[level][mb_i][1] = mv[1] - y_mb;
+        return;
+    }
+
+    blocks[mb_i].mvs[dir][0] = mv[0] - x_mb;
+    blocks[mb_i].mvs[dir][1] = mv[1] - y_mb;
+
+    if (mb_i == mi_ctx->b_count - 1) {
+        mi_ctx->me_ctx.pred_x = me_ctx->pred_x;
+        mi_ctx->me_ctx.pred_y = me_ctx->pred_y;
+    }
+}
+
+typedef struct ThreadData {
+    Block *blocks;
+    int dir;
+    int level;
+    int wave;
+    int alpha;
+    AVFrame *out;
+} ThreadData;
+
+static int search_mv_rows(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs)
+{
+    MIContext *mi_ctx = ctx->priv;
+    ThreadData *td = arg;
+    AVMotionEstContext *me_ctx = &mi_ctx->slice_me_ctx[jobnr];
+    const int b_width  = mi_ctx->pyr_b_width[td->level];
+    const int b_height = mi_ctx->pyr_b_height[td->level];
+    const int slice_start = (b_height *  jobnr     ) / nb_jobs;
+    const int slice_end   = (b_height * (jobnr + 1)) / nb_jobs;
+    int mb_x, mb_y;
+
+    for (mb_y = slice_start; mb_y < slice_end; mb_y++)
+        for (mb_x = 0; mb_x < b_width; mb_x++) {
+            if (mi_ctx->me_method == ME_METHOD_PYR)
+                search_mv_pyr(mi_ctx, me_ctx, td->blocks, td->level, mb_x, mb_y, td->dir);
+            else
+                search_mv(mi_ctx, me_ctx, td->blocks, mb_x, mb_y, td->dir);
+        }
+
+    return 0;
+}
+
+/* search the blocks with mb_x + 2 * mb_y == wave, their left, top-left, top
+ * and top-right neighbours have been searched by the previous waves */
+static int search_mv_wave(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs)
+{
+    MIContext *mi_ctx = ctx->priv;
+    ThreadData *td = arg;
+    AVMotionEstContext *me_ctx = &mi_ctx->slice_me_ctx[jobnr];
+    const int y_start = FFMAX((td->wave - mi_ctx->b_width + 2) / 2, 0);
+    const int y_end   = FFMIN(td->wave / 2 + 1, mi_ctx->b_height);
+    const int slice_start = y_start + ((y_end - y_start) *  jobnr     ) / nb_jobs;
+    const int slice_end   = y_start + ((y_end - y_start) * (jobnr + 1)) / nb_jobs;
+    int mb_y;
+
+    for (mb_y = slice_start; mb_y < slice_end; mb_y++)
+        search_mv(mi_ctx, me_ctx, td->blocks, td->wave - 2 * mb_y, mb_y, td->dir);
+
+    return 0;
+}
+
+/* Search all blocks between mi_ctx->me_ctx.data_cur and data_ref, cur and ref
+ * are the frames these belong to. */
+static void motion_search(AVFilterContext *ctx, Block *blocks,
+                          const Frame *cur, const Frame *ref, int dir)
+{
+    MIContext *mi_ctx = ctx->priv;
+    const int nb_ctx = mi_ctx->nb_slice_me_ctx;
+    ThreadData td = { .blocks = blocks, .dir = dir };
+    int i;
+
+    if (mi_ctx->me_method == ME_METHOD_PYR) {
+        for (td.level = mi_ctx->pyr_levels; td.level >= 0; td.level--) {
+            AVMotionEstContext me_ctx = mi_ctx->me_ctx;
+
+            if (td.level) {
+                me_ctx.data_cur     = cur->pyr[td.level];
+                me_ctx.data_ref     = ref->pyr[td.level];
+                me_ctx.linesize     = mi_ctx->pyr_linesize[td.level];
+                me_ctx.width      >>= td.level;
+                me_ctx.height     >>= td.level;
+                me_ctx.x_max        = (mi_ctx->pyr_b_width[td.level]  - 1) << mi_ctx->log2_mb_size;
+                me_ctx.y_max        = (mi_ctx->pyr_b_height[td.level] - 1) << mi_ctx->log2_mb_size;
+                me_ctx.search_param = FFMAX(me_ctx.search_param >> td.level, 1);
+            }
+
+            for (i = 0; i < nb_ctx; i++)
+                mi_ctx->slice_me_ctx[i] = me_ctx;
+            ff_filter_execute(ctx, search_mv_rows, &td, NULL,
+                              FFMIN(mi_ctx->pyr_b_height[td.level], nb_ctx));
+        }
+        return;
+    }
+
+    for (i = 0; i < nb_ctx; i++)
+        mi_ctx->slice_me_ctx[i] = mi_ctx->me_ctx;
+
+    if ((mi_ctx->me_method == AV_ME_METHOD_EPZS || mi_ctx->me_method == AV_ME_METHOD_UMH) && nb_ctx > 1) {
+        /* the predictors depend on the neighbours in the current frame */
+        for (td.wave = 0; td.wave < mi_ctx->b_width + 2 * (mi_ctx->b_height - 1); td.wave++) {
+            const int y_start = FFMAX((td.wave - mi_ctx->b_width + 2) / 2, 0);
+            const int y_end   = FFMIN(td.wave / 2 + 1, mi_ctx->b_height);
+
+            ff_filter_execute(ctx, search_mv_wave, &td, NULL, FFMIN(y_end - y_start, nb_ctx));
+        }
+    } else
+        ff_filter_execute(ctx, search_mv_rows, &td, NULL, FFMIN(mi_ctx->b_height, nb_ctx));
 }
 
-static void bilateral_me(MIContext *mi_ctx)
+static void bilateral_me(AVFilterContext *ctx)
 {
+    MIContext *mi_ctx = ctx->priv;
     Block *block;
     int mb_x, mb_y;
 
@@ -571,9 +833,7 @@ static void bilateral_me(MIContext *mi_ctx)
             block->mvs[0][1] = 0;
         }
 
-    for (mb_y = 0; mb_y < mi_ctx->b_height; mb_y++)
-        for (mb_x = 0; mb_x < mi_ctx->b_width; mb_x++)
-            search_mv(mi_ctx, mi_ctx->int_blocks, mb_x, mb_y, 0);
+    motion_search(ctx, mi_ctx->int_blocks, &mi_ctx->frames[1], &mi_ctx->frames[2], 0);
 }
 
 static int var_size_bme(MIContext *mi_ctx, Block *block, int x_mb, int y_mb, int n)
@@ -743,6 +1003,9 @@ static int inject_frame(AVFilterLink *inlink, AVFrame *avf_in)
 
     if (mi_ctx->mi_mode == MI_MODE_MCI) {
 
+        if (mi_ctx->me_method == ME_METHOD_PYR)
+            build_pyramid(mi_ctx, &mi_ctx->frames[NB_FRAMES - 1]);
+
         if (mi_ctx->me_method == AV_ME_METHOD_EPZS) {
             mi_ctx->mv_table[2] = memcpy(mi_ctx->mv_table[2], mi_ctx->mv_table[1], sizeof(*mi_ctx->mv_table[1]) * mi_ctx->b_count);
             mi_ctx->mv_table[1] = memcpy(mi_ctx->mv_table[1], mi_ctx->mv_table[0], sizeof(*mi_ctx->mv_table[0]) * mi_ctx->b_count);
@@ -756,9 +1019,8 @@ static int inject_frame(AVFilterLink *inlink, AVFrame *avf_in)
                     mi_ctx->me_ctx.data_cur = mi_ctx->frames[2].avf->data[0];
                     mi_ctx->me_ctx.data_ref = mi_ctx->frames[dir ? 3 : 1].avf->data[0];
 
-                    for (mb_y = 0; mb_y < mi_ctx->b_height; mb_y++)
-                        for (mb_x = 0; mb_x < mi_ctx->b_width; mb_x++)
-                            search_mv(mi_ctx, mi_ctx->frames[2].blocks, mb_x, mb_y, dir);
+                    motion_search(ctx, mi_ctx->frames[2].blocks, &mi_ctx->frames[2],
+                                  &mi_ctx->frames[dir ? 3 : 1], dir);
                 }
             }
 
@@ -773,7 +1035,7 @@ static int inject_frame(AVFilterLink *inlink, AVFrame *avf_in)
             mi_ctx->me_ctx.data_cur = mi_ctx->frames[1].avf->data[0];
             mi_ctx->me_ctx.data_ref = mi_ctx->frames[2].avf->data[0];
 
-            bilateral_me(mi_ctx);
+            bilateral_me(ctx);
 
             if (mi_ctx->mc_mode == MC_MODE_AOBMC) {
 
@@ -854,17 +1116,13 @@ static int detect_scene_change(AVFilterContext *ctx)
         pixel_refs->nb++;\
     } while(0)
 
-static void bidirectional_obmc(MIContext *mi_ctx, int alpha)
+static void bidirectional_obmc(MIContext *mi_ctx, int alpha, int slice_start, int slice_end)
 {
     int x, y;
     int width = mi_ctx->frames[0].avf->width;
     int height = mi_ctx->frames[0].avf->height;
     int mb_y, mb_x, dir;
 
-    for (y = 0; y < height; y++)
-        for (x = 0; x < width; x++)
-            mi_ctx->pixel_refs[x + y * width].nb = 0;
-
     for (dir = 0; dir < 2; dir++)
         for (mb_y = 0; mb_y < mi_ctx->b_height; mb_y++)
             for (mb_x = 0; mb_x < mi_ctx->b_width; mb_x++) {
@@ -882,6 +1140,9 @@ static void bidirectional_obmc(MIContext *mi_ctx, int alpha)
                 endc_x = av_clip(start_x + (2 << mi_ctx->log2_mb_size), 0, width - 1);
                 endc_y = av_clip(start_y + (2 << mi_ctx->log2_mb_size), 0, height - 1);
 
+                startc_y = FFMAX(startc_y, slice_start);
+                endc_y = FFMIN(endc_y, slice_end);
+
                 if (dir) {
                     mv_x = -mv_x;
                     mv_y = -mv_y;
@@ -904,7 +1165,7 @@ static void bidirectional_obmc(MIContext *mi_ctx, int alpha)
             }
 }
 
-static void set_frame_data(MIContext *mi_ctx, int alpha, AVFrame *avf_out)
+static void set_frame_data(MIContext *mi_ctx, int alpha, AVFrame *avf_out, int slice_start, int slice_end)
 {
     int x, y, plane;
 
@@ -912,8 +1173,14 @@ static void set_frame_data(MIContext *mi_ctx, int alpha, AVFrame *avf_out)
         int width = avf_out->width;
         int height = avf_out->height;
         int chroma = plane == 1 || plane == 2;
+        int mask_w = chroma ? (1 << mi_ctx->log2_chroma_w) - 1 : 0;
+        int mask_h = chroma ? (1 << mi_ctx->log2_chroma_h) - 1 : 0;
+
+        for (y = slice_start; y < slice_end; y++) {
+            /* a chroma sample is set from the last luma pixel mapping to it */
+            if ((y + 1) & mask_h && y != height - 1)
+                continue;
 
-        for (y = 0; y < height; y++)
             for (x = 0; x < width; x++) {
                 int x_mv, y_mv;
                 int weight_sum = 0;
@@ -922,6 +1189,9 @@ static void set_frame_data(MIContext *mi_ctx, int alpha, AVFrame *avf_out)
                 PixelWeights *pixel_weights = &mi_ctx->pixel_weights[x + y * avf_out->width];
                 PixelRefs *pixel_refs = &mi_ctx->pixel_refs[x + y * avf_out->width];
 
+                if ((x + 1) & mask_w && x != width - 1)
+                    continue;
+
                 for (i = 0; i < pixel_refs->nb; i++)
                     weight_sum += pixel_weights->weights[i];
 
@@ -959,10 +1229,12 @@ static void set_frame_data(MIContext *mi_ctx, int alpha, AVFrame *avf_out)
                 else
                     avf_out->data[plane][x + y * avf_out->linesize[plane]] = val;
             }
+        }
     }
 }
 
-static void var_size_bmc(MIContext *mi_ctx, Block *block, int x_mb, int y_mb, int n, int alpha)
+static void var_size_bmc(MIContext *mi_ctx, Block *block, int x_mb, int y_mb, int n, int alpha,
+                         int slice_start, int slice_end)
 {
     int sb_x, sb_y;
     int width = mi_ctx->frames[0].avf->width;
@@ -973,7 +1245,8 @@ static void var_size_bmc(MIContext *mi_ctx, Block *block, int x_mb, int y_mb, in
             Block *sb = &block->subs[sb_x + sb_y * 2];
 
             if (sb->sb)
-                var_size_bmc(mi_ctx, sb, x_mb + (sb_x << (n - 1)), y_mb + (sb_y << (n - 1)), n - 1, alpha);
+                var_size_bmc(mi_ctx, sb, x_mb + (sb_x << (n - 1)), y_mb + (sb_y << (n - 1)), n - 1, alpha,
+                             slice_start, slice_end);
             else {
                 int x, y;
                 int mv_x = sb->mvs[0][0] * 2;
@@ -984,6 +1257,9 @@ static void var_size_bmc(MIContext *mi_ctx, Block *block, int x_mb, int y_mb, in
                 int end_x = start_x + (1 << (n - 1));
                 int end_y = start_y + (1 << (n - 1));
 
+                start_y = FFMAX(start_y, slice_start);
+                end_y = FFMIN(end_y, slice_end);
+
                 for (y = start_y; y < end_y; y++)  {
                     int y_min = -y;
                     int y_max = height - y - 1;
@@ -1001,7 +1277,8 @@ static void var_size_bmc(MIContext *mi_ctx, Block *block, int x_mb, int y_mb, in
         }
 }
 
-static void bilateral_obmc(MIContext *mi_ctx, Block *block, int mb_x, int mb_y, int alpha)
+static void bilateral_obmc(MIContext *mi_ctx, Block *block, int mb_x, int mb_y, int alpha,
+                           int slice_start, int slice_end)
 {
     int x, y;
     int width = mi_ctx->frames[0].avf->width;
@@ -1016,6 +1293,19 @@ static void bilateral_obmc(MIContext *mi_ctx, Block *block, int mb_x, int mb_y,
     int start_x, start_y;
     int startc_x, startc_y, endc_x, endc_y;
 
+    start_x = (mb_x << mi_ctx->log2_mb_size) - mi_ctx->mb_size / 2;
+    start_y = (mb_y << mi_ctx->log2_mb_size) - mi_ctx->mb_size / 2;
+
+    startc_x = av_clip(start_x, 0, width - 1);
+    startc_y = av_clip(start_y, 0, height - 1);
+    endc_x = av_clip(start_x + (2 << mi_ctx->log2_mb_size), 0, width - 1);
+    endc_y = av_clip(start_y + (2 << mi_ctx->log2_mb_size), 0, height - 1);
+
+    startc_y = FFMAX(startc_y, slice_start);
+    endc_y = FFMIN(endc_y, slice_end);
+    if (startc_y >= endc_y)
+        return;
+
     if (mi_ctx->mc_mode == MC_MODE_AOBMC)
         for (nb_y = FFMAX(0, mb_y - 1); nb_y < FFMIN(mb_y + 2, mi_ctx->b_height); nb_y++)
             for (nb_x = FFMAX(0, mb_x - 1); nb_x < FFMIN(mb_x + 2, mi_ctx->b_width); nb_x++) {
@@ -1026,14 +1316,6 @@ static void bilateral_obmc(MIContext *mi_ctx, Block *block, int mb_x, int mb_y,
                     sbads[nb_x - mb_x + 1 + (nb_y - mb_y + 1) * 3] = get_sbad(&mi_ctx->me_ctx, x_nb, y_nb, x_nb + block->mvs[0][0], y_nb + block->mvs[0][1]);
             }
 
-    start_x = (mb_x << mi_ctx->log2_mb_size) - mi_ctx->mb_size / 2;
-    start_y = (mb_y << mi_ctx->log2_mb_size) - mi_ctx->mb_size / 2;
-
-    startc_x = av_clip(start_x, 0, width - 1);
-    startc_y = av_clip(start_y, 0, height - 1);
-    endc_x = av_clip(start_x + (2 << mi_ctx->log2_mb_size), 0, width - 1);
-    endc_y = av_clip(start_y + (2 << mi_ctx->log2_mb_size), 0, height - 1);
-
     for (y = startc_y; y < endc_y; y++) {
         int y_min = -y;
         int y_max = height - y - 1;
@@ -1049,7 +1331,7 @@ static void bilateral_obmc(MIContext *mi_ctx, Block *block, int mb_x, int mb_y,
                 nb_x = (((x - start_x) >> (mi_ctx->log2_mb_size - 1)) * 2 - 3) / 2;
                 nb_y = (((y - start_y) >> (mi_ctx->log2_mb_size - 1)) * 2 - 3) / 2;
 
-                if (nb_x || nb_y) {
+                if ((nb_x || nb_y) && mb_x + nb_x < mi_ctx->b_width && mb_y + nb_y < mi_ctx->b_height) {
                     uint64_t sbad = sbads[nb_x + 1 + (nb_y + 1) * 3];
                     nb = &mi_ctx->int_blocks[mb_x + nb_x + (mb_y + nb_y) * mi_ctx->b_width];
 
@@ -1065,6 +1347,131 @@ static void bilateral_obmc(MIContext *mi_ctx, Block *block, int mb_x, int mb_y,
     }
 }
 
+/* the same as bilateral_obmc() for all blocks followed by set_frame_data() */
+static void bilateral_obmc_direct(MIContext *mi_ctx, int alpha, AVFrame *avf_out,
+                                  int slice_start, int slice_end)
+{
+    const int width  = avf_out->width;
+    const int height = avf_out->height;
+    const int log2_mb_size = mi_ctx->log2_mb_size;
+    const uint8_t *obmc_tab = obmc_tab_linear[4 - log2_mb_size];
+    const AVFrame *prev = mi_ctx->frames[1].avf;
+    const AVFrame *next = mi_ctx->frames[2].avf;
+    int plane, x, y;
+
+    for (plane = 0; plane < mi_ctx->nb_planes; plane++) {
+        const int chroma = plane == 1 || plane == 2;
+        const int log2_w = chroma ? mi_ctx->log2_chroma_w : 0;
+        const int log2_h = chroma ? mi_ctx->log2_chroma_h : 0;
+        const uint8_t *src_prev = prev->data[plane];
+        const uint8_t *src_next = next->data[plane];
+        const ptrdiff_t linesize_prev = prev->linesize[plane];
+        const ptrdiff_t linesize_next = next->linesize[plane];
+        uint8_t *dst = avf_out->data[plane];
+
+        for (y = slice_start; y < slice_end; y++) {
+            const int k_y = (y + mi_ctx->mb_size / 2) >> log2_mb_size;
+            const int y_min = -y;
+            const int y_max = height - y - 1;
+
+            if ((y + 1) & ((1 << log2_h) - 1) && y != height - 1)
+                continue;
+
+            for (x = 0; x < width; x++) {
+                const int k_x = (x + mi_ctx->mb_size / 2) >> log2_mb_size;
+                const int x_min = -x;
+                const int x_max = width - x - 1;
+                int weight_sum = 0, val = 0;
+                int mb_x, mb_y;
+
+                if ((x + 1) & ((1 << log2_w) - 1) && x != width - 1)
+                    continue;
+
+                /* the windows end one pixel before the right and bottom edge */
+                for (mb_y = FFMAX(k_y - 1, 0); mb_y <= FFMIN(k_y, mi_ctx->b_height - 1) && y < height - 1; mb_y++)
+                    for (mb_x = FFMAX(k_x - 1, 0); mb_x <= FFMIN(k_x, mi_ctx->b_width - 1) && x < width - 1; mb_x++) {
+                        const Block *block = &mi_ctx->int_blocks[mb_x + mb_y * mi_ctx->b_width];
+                        const int start_x = (mb_x << log2_mb_size) - mi_ctx->mb_size / 2;
+                        const int start_y = (mb_y << log2_mb_size) - mi_ctx->mb_size / 2;
+                        const int obmc_weight = obmc_tab[(x - start_x) + ((y - start_y) << (log2_mb_size + 1))];
+                        const int mv_x = block->mvs[0][0] * 2;
+                        const int mv_y = block->mvs[0][1] * 2;
+                        int mv_x0, mv_y0, mv_x1, mv_y1;
+
+                        if (!obmc_weight)
+                            continue;
+
+                        mv_x0 = av_clip((mv_x * alpha) / ALPHA_MAX, x_min, x_max);
+                        mv_y0 = av_clip((mv_y * alpha) / ALPHA_MAX, y_min, y_max);
+                        mv_x1 = av_clip(-mv_x * (ALPHA_MAX - alpha) / ALPHA_MAX, x_min, x_max);
+                        mv_y1 = av_clip(-mv_y * (ALPHA_MAX - alpha) / ALPHA_MAX, y_min, y_max);
+
+                        mv_x0 = (x >> log2_w) + mv_x0 / (1 << log2_w);
+                        mv_y0 = (y >> log2_h) + mv_y0 / (1 << log2_h);
+                        mv_x1 = (x >> log2_w) + mv_x1 / (1 << log2_w);
+                        mv_y1 = (y >> log2_h) + mv_y1 / (1 << log2_h);
+
+                        val += obmc_weight * (ALPHA_MAX - alpha) * src_prev[mv_x0 + mv_y0 * linesize_prev] +
+                               obmc_weight * alpha * src_next[mv_x1 + mv_y1 * linesize_next];
+                        weight_sum += obmc_weight * ALPHA_MAX;
+                    }
+
+                if (!weight_sum) {
+                    val = (ALPHA_MAX - alpha) * src_prev[(x >> log2_w) + (y >> log2_h) * linesize_prev] +
+                          alpha * src_next[(x >> log2_w) + (y >> log2_h) * linesize_next];
+                    weight_sum = ALPHA_MAX;
+                }
+
+                dst[(x >> log2_w) + (y >> log2_h) * avf_out->linesize[plane]] = ROUNDED_DIV(val, weight_sum);
+            }
+        }
+    }
+}
+
+static int motion_compensation_slice(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs)
+{
+    MIContext *mi_ctx = ctx->priv;
+    ThreadData *td = arg;
+    const int width  = td->out->width;
+    const int height = td->out->height;
+    /* all rows of a chroma line belong to the same slice */
+    const int nb_lines = AV_CEIL_RSHIFT(height, mi_ctx->log2_chroma_h);
+    const int slice_start = (nb_lines * jobnr / nb_jobs) << mi_ctx->log2_chroma_h;
+    const int slice_end = FFMIN((nb_lines * (jobnr + 1) / nb_jobs) << mi_ctx->log2_chroma_h, height);
+    int x, y;
+
+    if (direct_obmc(mi_ctx)) {
+        bilateral_obmc_direct(mi_ctx, td->alpha, td->out, slice_start, slice_end);
+        return 0;
+    }
+
+    for (y = slice_start; y < slice_end; y++)
+        for (x = 0; x < width; x++)
+            mi_ctx->pixel_refs[x + y * width].nb = 0;
+
+    if (mi_ctx->me_mode == ME_MODE_BIDIR) {
+        bidirectional_obmc(mi_ctx, td->alpha, slice_start, slice_end);
+    } else if (mi_ctx->me_mode == ME_MODE_BILAT) {
+        int mb_x, mb_y;
+        Block *block;
+
+        for (mb_y = 0; mb_y < mi_ctx->b_height; mb_y++)
+            for (mb_x = 0; mb_x < mi_ctx->b_width; mb_x++) {
+                block = &mi_ctx->int_blocks[mb_x + mb_y * mi_ctx->b_width];
+
+                if (block->sb)
+                    var_size_bmc(mi_ctx, block, mb_x << mi_ctx->log2_mb_size, mb_y << mi_ctx->log2_mb_size, mi_ctx->log2_mb_size, td->alpha,
+                                 slice_start, slice_end);
+
+                bilateral_obmc(mi_ctx, block, mb_x, mb_y, td->alpha, slice_start, slice_end);
+            }
+    }
+
+    set_frame_data(mi_ctx, td->alpha, td->out, slice_start, slice_end);
+
+    return 0;
+}
+
 static void interpolate(AVFilterLink *inlink, AVFrame *avf_out)
 {
     AVFilterContext *ctx = inlink->dst;
@@ -1122,34 +1529,15 @@ static void interpolate(AVFilterLink *inlink, AVFrame *avf_out)
             }
 
             break;
-        case MI_MODE_MCI:
-            if (mi_ctx->me_mode == ME_MODE_BIDIR) {
-                bidirectional_obmc(mi_ctx, alpha);
-                set_frame_data(mi_ctx, alpha, avf_out);
-
-            } else if (mi_ctx->me_mode == ME_MODE_BILAT) {
-                int mb_x, mb_y;
-                Block *block;
+        case MI_MODE_MCI: {
+            ThreadData td = { .alpha = alpha, .out = avf_out };
 
-                for (y = 0; y < mi_ctx->frames[0].avf->height; y++)
-                    for (x = 0; x < mi_ctx->frames[0].avf->width; x++)
-                        mi_ctx->pixel_refs[x + y * mi_ctx->frames[0].avf->width].nb = 0;
-
-                for (mb_y = 0; mb_y < mi_ctx->b_height; mb_y++)
-                    for (mb_x = 0; mb_x < mi_ctx->b_width; mb_x++) {
-                        block = &mi_ctx->int_blocks[mb_x + mb_y * mi_ctx->b_width];
-
-                        if (block->sb)
-                            var_size_bmc(mi_ctx, block, mb_x << mi_ctx->log2_mb_size, mb_y << mi_ctx->log2_mb_size, mi_ctx->log2_mb_size, alpha);
-
-                        bilateral_obmc(mi_ctx, block, mb_x, mb_y, alpha);
-
-                    }
-
-                set_frame_data(mi_ctx, alpha, avf_out);
-            }
+            ff_filter_execute(ctx, motion_compensation_slice, &td, NULL,
+                              FFMIN(AV_CEIL_RSHIFT(avf_out->height, mi_ctx->log2_chroma_h),
+                                    ff_filter_get_nb_threads(ctx)));
 
             break;
+        }
     }
 }
 
@@ -1217,6 +1605,7 @@ static av_cold void uninit(AVFilterContext *ctx)
     MIContext *mi_ctx = ctx->priv;
     int i, m;
 
+    av_freep(&mi_ctx->slice_me_ctx);
     av_freep(&mi_ctx->pixel_mvs);
     av_freep(&mi_ctx->pixel_weights);
     av_freep(&mi_ctx->pixel_refs);
@@ -1229,10 +1618,14 @@ static av_cold void uninit(AVFilterContext *ctx)
         Frame *frame = &mi_ctx->frames[i];
         av_freep(&frame->blocks);
         av_frame_free(&frame->avf);
+        for (m = 0; m <= PYR_LEVELS_MAX; m++)
+            av_freep(&frame->pyr[m]);
     }
 
     for (i = 0; i < 3; i++)
         av_freep(&mi_ctx->mv_table[i]);
+    for (i = 0; i <= PYR_LEVELS_MAX; i++)
+        av_freep(&mi_ctx->pyr_mvs[i]);
 }
 
 static const AVFilterPad minterpolate_inputs[] = {
@@ -1258,6 +1651,7 @@ const AVFilter ff_vf_minterpolate = {
     .priv_size     = sizeof(MIContext),
     .priv_class    = &minterpolate_class,
     .uninit        = uninit,
+    .flags         = AVFILTER_FLAG_SLICE_THREADS,
     FILTER_INPUTS(minterpolate_inputs),
     FILTER_OUTPUTS(minterpolate_outputs),
     FILTER_PIXFMTS_ARRAY(pix_fmts),
@@ -32,7 +32,9 @@
 #include "libavutil/avstring.h"
 #include "libavutil/pixdesc.h"
 #include "libavutil/imgutils.h"
+#include "libavutil/intreadwrite.h"
 #include "libavutil/mathematics.h"
+#include "libavutil/mem.h"
 #include "libavutil/opt.h"
 #include "libavutil/timestamp.h"
 #include "filters.h"
@@ -43,6 +45,7 @@
 
 typedef struct ThreadData {
     AVFrame *dst, *src;
+    int x, y;
 } ThreadData;
 
 static const char *const var_names[] = {
@@ -85,6 +88,9 @@ static av_cold void uninit(AVFilterContext *ctx)
     OverlayContext *s = ctx->priv;
 
     ff_framesync_uninit(&s->fs);
+    ff_frame_cache_uninit(ctx, &s->cache);
+    av_frame_free(&s->area_src);
+    av_freep(&s->areas);
     av_expr_free(s->x_pexpr); s->x_pexpr = NULL;
     av_expr_free(s->y_pexpr); s->y_pexpr = NULL;
 }
@@ -477,6 +483,8 @@ static av_always_inline void blend_plane_##depth##_##nbits##bits(AVFilterContext
     const uint##depth##_t max = (1 << nbits) - 1;                                                          \
     const uint##depth##_t mid = (1 << (nbits -1)) ;                                                        \
     int bytes = depth / 8;                                                                                 \
+    const ptrdiff_t alinesize  = src->linesize[3] / bytes;                                                 \
+    const ptrdiff_t dalinesize = dst->linesize[3] / bytes;                                                 \
                                                                                                            \
     dst_step /= bytes;                                                                                     \
     j = FFMAX(-yp, 0);                                                                                     \
@@ -515,13 +523,13 @@ static av_always_inline void blend_plane_##depth##_##nbits##bits(AVFilterContext
                                                                                                            \
             /* average alpha for color components, improve quality */                                      \
             if (hsub && vsub && j+1 < src_hp && k+1 < src_wp) {                                            \
-                alpha = (a[0] + a[src->linesize[3]] +                                                      \
-                         a[1] + a[src->linesize[3]+1]) >> 2;                                               \
+                alpha = (a[0] + a[alinesize] +                                                             \
+                         a[1] + a[alinesize+1]) >> 2;                                                      \
             } else if (hsub || vsub) {                                                                     \
                 alpha_h = hsub && k+1 < src_wp ?                                                           \
                     (a[0] + a[1]) >> 1 : a[0];                                                             \
                 alpha_v = vsub && j+1 < src_hp ?                                                           \
-                    (a[0] + a[src->linesize[3]]) >> 1 : a[0];                                              \
+                    (a[0] + a[alinesize]) >> 1 : a[0];                                                     \
                 alpha = (alpha_v + alpha_h) >> 1;                                                          \
             } else                                                                                         \
                 alpha = a[0];                                                                              \
@@ -531,13 +539,13 @@ static av_always_inline void blend_plane_##depth##_##nbits##bits(AVFilterContext
                 /* average alpha for color components, improve quality */                                  \
                 uint8_t alpha_d;                                                                           \
                 if (hsub && vsub && j+1 < src_hp && k+1 < src_wp) {                                        \
-                    alpha_d = (da[0] + da[dst->linesize[3]] +                                              \
-                               da[1] + da[dst->linesize[3]+1]) >> 2;                                       \
+                    alpha_d = (da[0] + da[dalinesize] +                                                    \
+                               da[1] + da[dalinesize+1]) >> 2;                                             \
                 } else if (hsub || vsub) {                                                                 \
                     alpha_h = hsub && k+1 < src_wp ?                                                       \
                         (da[0] + da[1]) >> 1 : da[0];                                                      \
                     alpha_v = vsub && j+1 < src_hp ?                                                       \
-                        (da[0] + da[dst->linesize[3]]) >> 1 : da[0];                                       \
+                        (da[0] + da[dalinesize]) >> 1 : da[0];                                             \
                     alpha_d = (alpha_v + alpha_h) >> 1;                                                    \
                 } else                                                                                     \
                     alpha_d = da[0];                                                                       \
@@ -693,11 +701,10 @@ static av_always_inline void blend_slice_planar_rgb(AVFilterContext *ctx,
 #define DEFINE_BLEND_SLICE_PLANAR_FMT(format_, blend_slice_fn_suffix_, hsub_, vsub_, main_has_alpha_, direct_) \
 static int blend_slice_##format_(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs)           \
 {                                                                       \
-    OverlayContext *s = ctx->priv;                                      \
     ThreadData *td = arg;                                               \
     blend_slice_##blend_slice_fn_suffix_(ctx, td->dst, td->src,         \
                                          hsub_, vsub_, main_has_alpha_, \
-                                         s->x, s->y, direct_,           \
+                                         td->x, td->y, direct_,         \
                                          jobnr, nb_jobs);               \
     return 0;                                                           \
 }
@@ -729,11 +736,10 @@ DEFINE_BLEND_SLICE_PLANAR_FMT(gbrap_pm,    planar_rgb,    0, 0, 1, 0);
 #define DEFINE_BLEND_SLICE_PACKED_FMT(format_, blend_slice_fn_suffix_, main_has_alpha_, direct_) \
 static int blend_slice_##format_(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs)        \
 {                                                                       \
-    OverlayContext *s = ctx->priv;                                      \
     ThreadData *td = arg;                                               \
     blend_slice_packed_##blend_slice_fn_suffix_(ctx, td->dst, td->src,  \
                                                 main_has_alpha_,        \
-                                                s->x, s->y, direct_,    \
+                                                td->x, td->y, direct_,  \
                                                 jobnr, nb_jobs);        \
     return 0;                                                           \
 }
@@ -875,6 +881,134 @@ end:
     return 0;
 }
 
+static int first_visible(const uint8_t *line, int w, int step, int bytes)
+{
+    int x = 0;
+
+    if (step == bytes)
+        for (; x + 8 / bytes <= w && !AV_RN64(line + x * bytes); x += 8 / bytes);
+
+    for (; x < w; x++)
+        if (bytes == 1 ? line[x * step] : AV_RN16(line + x * step))
+            return x;
+    return -1;
+}
+
+static int last_visible(const uint8_t *line, int w, int step, int bytes)
+{
+    int x = w;
+
+    if (step == bytes)
+        for (; x >= 8 / bytes && !AV_RN64(line + (x - 8 / bytes) * bytes); x -= 8 / bytes);
+
+    while (x-- > 0)
+        if (bytes == 1 ? line[x * step] : AV_RN16(line + x * step))
+            return x;
+    return -1;
+}
+
+static int add_visible_area(OverlayContext *s, const AVFrame *overlay,
+                            int hsub, int vsub, int x0, int x1, int y0, int y1)
+{
+    OverlayArea *area;
+
+    area = av_fast_realloc(s->areas, &s->areas_size,
+                           (s->nb_areas + 1) * sizeof(*s->areas));
+    if (!area)
+        return AVERROR(ENOMEM);
+    s->areas = area;
+    area += s->nb_areas++;
+
+    /* Chroma is blended with the average alpha of the pixels it covers,
+     * except for the last column and row of the overlay, which use the
+     * alpha of their first pixel. Align the area on whole chroma samples
+     * and keep a transparent one after it, so that cropping does not
+     * change the alpha used for any visible chroma sample. */
+    x0 &= ~((1 << hsub) - 1);
+    y0 &= ~((1 << vsub) - 1);
+    if (hsub)
+        x1 = FFALIGN(x1, 1 << hsub) + (1 << hsub);
+    if (vsub)
+        y1 = FFALIGN(y1, 1 << vsub) + (1 << vsub);
+    area->x = x0;
+    area->y = y0;
+    area->w = FFMIN(x1, overlay->width)  - x0;
+    area->h = FFMIN(y1, overlay->height) - y0;
+    return 0;
+}
+
+/**
+ * Find the areas outside of which the overlay is fully transparent: one
+ * rectangle for each band of rows which are not, so that transparent rows
+ * between visible parts, e.g. between a logo and a lower third, are skipped
+ * too. The areas are only computed again when the overlay picture changes:
+ * a reference to the last one is kept, so a frame using the same buffer
+ * holds the same picture.
+ */
+static int update_visible_area(OverlayContext *s, AVFrame *overlay)
+{
+    const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get(overlay->format);
+    const AVComponentDescriptor *comp = &desc->comp[3];
+    const int bytes = (comp->depth + 7) >> 3;
+    const int hsub  = desc->log2_chroma_w;
+    const int vsub  = desc->log2_chroma_h;
+    AVFrame *last = s->area_src;
+    int x0 = 0, x1 = 0, y0 = -1, y1 = 0, ret;
+
+    if (last->buf[0] && overlay->buf[0] &&
+        last->buf[0]->buffer == overlay->buf[0]->buffer &&
+        last->data[0] == overlay->data[0] &&
+        last->width   == overlay->width  &&
+        last->height  == overlay->height)
+        return 0;
+
+    s->nb_areas = 0;
+    for (int y = 0; y < overlay->height; y++) {
+        const uint8_t *line = overlay->data[comp->plane] +
+                              y * overlay->linesize[comp->plane] + comp->offset;
+        int x = first_visible(line, overlay->width, comp->step, bytes);
+
+        if (x < 0)
+            continue;
+
+        /* A band ends once a whole chroma row is transparent: the
+         * transparent row kept after it cannot overlap the next band. */
+        if (y0 >= 0 && (y >> vsub) > ((y1 - 1) >> vsub) + 1) {
+            ret = add_visible_area(s, overlay, hsub, vsub, x0, x1, y0, y1);
+            if (ret < 0)
+                return ret;
+            y0 = -1;
+        }
+        if (y0 < 0) {
+            x0 = overlay->width;
+            x1 = 0;
+            y0 = y;
+        }
+        x0 = FFMIN(x0, x);
+        x1 = FFMAX(x1, last_visible(line, overlay->width, comp->step, bytes) + 1);
+        y1 = y + 1;
+    }
+    if (y0 >= 0) {
+        ret = add_visible_area(s, overlay, hsub, vsub, x0, x1, y0, y1);
+        if (ret < 0)
+            return ret;
+    }
+
+    av_frame_unref(last);
+    return av_frame_ref(last, overlay);
+}
+
+static void blend_area(AVFilterContext *ctx, ThreadData *td)
+{
+    OverlayContext *s = ctx->priv;
+    const AVFrame *dst = td->dst, *src = td->src;
+
+    if (td->x < dst->width  && td->x + src->width  >= 0 &&
+        td->y < dst->height && td->y + src->height >= 0)
+        ff_filter_execute(ctx, s->blend_slice, td, NULL, FFMIN(FFMAX(1, FFMIN3(td->y + src->height, FFMIN(src->height, dst->height), dst->height - td->y)),
+                                                               ff_filter_get_nb_threads(ctx)));
+}
+
 static int do_blend(FFFrameSync *fs)
 {
     AVFilterContext *ctx = fs->parent;
@@ -916,16 +1050,69 @@ FF_ENABLE_DEPRECATION_WARNINGS
                s->var_values[VAR_Y], s->y);
     }
 
+    if (s->cache.enabled) {
+        AVFrame *in[2] = { mainpic, second }, *out;
+        const int pos[2] = { s->x, s->y };
+
+        ret = ff_frame_cache_get(ctx, &s->cache, in, 2, pos, sizeof(pos), &out);
+        if (ret != 0) {
+            av_frame_free(&mainpic);
+            return ret < 0 ? ret : ff_filter_frame(ctx->outputs[0], out);
+        }
+    }
+
     if (s->x < mainpic->width  && s->x + second->width  >= 0 &&
         s->y < mainpic->height && s->y + second->height >= 0) {
         ThreadData td;
 
         td.dst = mainpic;
         td.src = second;
-        ff_filter_execute(ctx, s->blend_slice, &td, NULL, FFMIN(FFMAX(1, FFMIN3(s->y + second->height, FFMIN(second->height, mainpic->height), mainpic->height - s->y)),
-                                                                ff_filter_get_nb_threads(ctx)));
+        td.x   = s->x;
+        td.y   = s->y;
+
+        /* blending fully transparent pixels does not change the main picture
+         * with straight alpha, so only blend the visible parts of the overlay */
+        if (s->skip_transparent && !s->alpha_format) {
+            ret = update_visible_area(s, second);
+            if (ret < 0)
+                goto fail;
+
+            for (int i = 0; i < s->nb_areas; i++) {
+                const OverlayArea *a = &s->areas[i];
+                AVFrame *area = av_frame_clone(second);
+
+                if (!area) {
+                    ret = AVERROR(ENOMEM);
+                    goto fail;
+                }
+                area->crop_left   = a->x;
+                area->crop_top    = a->y;
+                area->crop_right  = second->width  - a->x - a->w;
+                area->crop_bottom = second->height - a->y - a->h;
+                ret = av_frame_apply_cropping(area, AV_FRAME_CROP_UNALIGNED);
+                if (ret < 0) {
+                    av_frame_free(&area);
+                    goto fail;
+                }
+
+                td.src = area;
+                td.x   = s->x + a->x;
+                td.y   = s->y + a->y;
+                blend_area(ctx, &td);
+                av_frame_free(&area);
+            }
+        } else {
+            blend_area(ctx, &td);
+        }
     }
+
+    ret = ff_frame_cache_put(&s->cache, mainpic);
+    if (ret < 0)
+        goto fail;
     return ff_filter_frame(ctx->outputs[0], mainpic);
+fail:
+    av_frame_free(&mainpic);
+    return ret;
 }
 
 static av_cold int init(AVFilterContext *ctx)
@@ -933,6 +1120,12 @@ static av_cold int init(AVFilterContext *ctx)
     OverlayContext *s = ctx->priv;
 
     s->fs.on_event = do_blend;
+
+    if (s->skip_transparent) {
+        s->area_src = av_frame_alloc();
+        if (!s->area_src)
+            return AVERROR(ENOMEM);
+    }
     return 0;
 }
 
@@ -972,6 +1165,8 @@ static const AVOption overlay_options[] = {
     { "alpha", "alpha format", OFFSET(alpha_format), AV_OPT_TYPE_INT, {.i64=0}, 0, 1, FLAGS, .unit = "alpha_format" },
         { "straight",      "", 0, AV_OPT_TYPE_CONST, {.i64=0}, .flags = FLAGS, .unit = "alpha_format" },
         { "premultiplied", "", 0, AV_OPT_TYPE_CONST, {.i64=1}, .flags = FLAGS, .unit = "alpha_format" },
+    { "skip_transparent", "only blend the area of the overlay which is not fully transparent", OFFSET(skip_transparent), AV_OPT_TYPE_BOOL, {.i64=0}, 0, 1, FLAGS },
+    FF_FRAME_CACHE_OPTIONS(OverlayContext, cache, FLAGS),
     { NULL }
 };
 
@@ -21,6 +21,7 @@
 
 #include "libavutil/eval.h"
 #include "libavutil/pixdesc.h"
+#include "framecache.h"
 #include "framesync.h"
 #include "avfilter.h"
 
@@ -54,6 +55,10 @@ enum OverlayFormat {
     OVERLAY_FORMAT_NB
 };
 
+typedef struct OverlayArea {
+    int x, y, w, h;
+} OverlayArea;
+
 typedef struct OverlayContext {
     const AVClass *class;
     int x, y;                   ///< position of overlaid picture
@@ -69,6 +74,13 @@ typedef struct OverlayContext {
     int eval_mode;              ///< EvalMode
 
     FFFrameSync fs;
+    FFFrameCache cache;
+
+    int skip_transparent;
+    AVFrame *area_src;          ///< last overlay frame the visible areas were computed for
+    OverlayArea *areas;         ///< visible areas of area_src
+    unsigned int areas_size;
+    int nb_areas;
 
     int main_pix_step[4];       ///< steps per pixel for each plane of the main output
     int overlay_pix_step[4];    ///< steps per pixel for each plane of the overlay
@@ -30,6 +30,7 @@
 #include "avfilter.h"
 #include "filters.h"
 #include "formats.h"
+#include "framecache.h"
 #include "framesync.h"
 #include "scale_eval.h"
 #include "video.h"
@@ -180,6 +181,7 @@ typedef struct ScaleContext {
 
     int eval_mode;              ///< expression evaluation mode
 
+    FFFrameCache cache;
 } ScaleContext;
 
 const AVFilter ff_vf_scale2ref;
@@ -469,6 +471,7 @@ static av_cold void uninit(AVFilterContext *ctx)
     sws_freeContext(scale->isws[0]);
     sws_freeContext(scale->isws[1]);
     scale->sws = NULL;
+    ff_frame_cache_uninit(ctx, &scale->cache);
 }
 
 static int query_formats(AVFilterContext *ctx)
@@ -718,6 +721,7 @@ static int config_props(AVFilterLink *outlink)
     if (scale->isws[1])
         sws_freeContext(scale->isws[1]);
     scale->isws[0] = scale->isws[1] = scale->sws = NULL;
+    ff_frame_cache_reset(&scale->cache);
     if (inlink0->w == outlink->w &&
         inlink0->h == outlink->h &&
         in_range == outlink->color_range &&
@@ -742,6 +746,10 @@ static int config_props(AVFilterLink *outlink)
             if (ret < 0)
                 return ret;
 
+            ret = sws_set_thread_pool(s, ctx->graph->thread_pool);
+            if (ret < 0)
+                return ret;
+
             av_opt_set_int(s, "srcw", inlink0 ->w, 0);
             av_opt_set_int(s, "srch", inlink0 ->h >> !!i, 0);
             av_opt_set_int(s, "src_format", inlink0->format, 0);
@@ -929,6 +937,7 @@ static int scale_frame(AVFilterLink *link, AVFrame **frame_in,
     char buf[32];
     int ret;
     int frame_changed;
+    int out_size[2];
 
     *frame_in = NULL;
     if (in->colorspace == AVCOL_SPC_YCGCO)
@@ -1016,6 +1025,18 @@ scale:
         return 0;
     }
 
+    // config_props() resets the cache along with the scalers, the output
+    // size is part of the key as it can be evaluated per frame
+    out_size[0] = outlink->w;
+    out_size[1] = outlink->h;
+    ret = ff_frame_cache_get(ctx, &scale->cache, &in, 1,
+                             out_size, sizeof(out_size), frame_out);
+    if (ret != 0) {
+        if (ret > 0)
+            ret = 0;
+        goto err;
+    }
+
     scale->hsub = desc->log2_chroma_w;
     scale->vsub = desc->log2_chroma_h;
 
@@ -1050,6 +1071,8 @@ scale:
         ret = sws_scale_frame(scale->sws, out, in);
     }
 
+    if (ret >= 0)
+        ret = ff_frame_cache_put(&scale->cache, out);
     if (ret < 0)
         av_frame_free(&out);
     *frame_out = out;
@@ -1293,6 +1316,7 @@ static const AVOption scale_options[] = {
     { "eval", "specify when to evaluate expressions", OFFSET(eval_mode), AV_OPT_TYPE_INT, {.i64 = EVAL_MODE_INIT}, 0, EVAL_MODE_NB-1, FLAGS, .unit = "eval" },
          { "init",  "eval expressions once during initialization", 0, AV_OPT_TYPE_CONST, {.i64=EVAL_MODE_INIT},  .flags = FLAGS, .unit = "eval" },
          { "frame", "eval expressions during initialization and per-frame", 0, AV_OPT_TYPE_CONST, {.i64=EVAL_MODE_FRAME}, .flags = FLAGS, .unit = "eval" },
+    FF_FRAME_CACHE_OPTIONS(ScaleContext, cache, FLAGS),
     { NULL }
 };
 
@@ -0,0 +1,394 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/**
+ * @file
+ * Scale the input to several sizes at once, e.g. for the renditions of an
+ * adaptive bitrate ladder.
+ *
+ * Rather than every rendition being scaled from the full size input, each is
+ * scaled from the smallest rendition computed before it that is at least
+ * cascade_ratio times as large, so that the input is only read for the first
+ * ones and the work shrinks along the ladder. Requiring the intermediate
+ * rendition to be sufficiently larger keeps the attenuation of its own
+ * filter out of the band kept by the second one.
+ */
+
+#include "libavutil/avstring.h"
+#include "libavutil/mem.h"
+#include "libavutil/opt.h"
+#include "libavutil/parseutils.h"
+#include "libavutil/pixdesc.h"
+
+#include "libswscale/swscale.h"
+
+#include "avfilter.h"
+#include "filters.h"
+#include "formats.h"
+#include "video.h"
+
+typedef struct Rendition {
+    int w, h;
+    // index of the rendition this one is scaled from, -1 for the input
+    int src;
+    struct SwsContext *sws;
+} Rendition;
+
+typedef struct ScaleLadderContext {
+    const AVClass *class;
+
+    char *sizes_str;
+    char *flags_str;
+    int   cascade;
+    double cascade_ratio;
+
+    Rendition *renditions;
+    int     nb_renditions;
+
+    AVFrame **frames;
+    uint8_t  *needed;
+    uint8_t  *pending;
+} ScaleLadderContext;
+
+static int config_output(AVFilterLink *outlink)
+{
+    AVFilterContext *ctx = outlink->src;
+    ScaleLadderContext *s = ctx->priv;
+    AVFilterLink *inlink = ctx->inputs[0];
+    Rendition *r = &s->renditions[FF_OUTLINK_IDX(outlink)];
+    int src_w = inlink->w, src_h = inlink->h;
+    struct SwsContext *sws;
+    int ret;
+
+    r->src = -1;
+    if (s->cascade) {
+        for (int i = 0; i < r - s->renditions; i++) {
+            const Rendition *prev = &s->renditions[i];
+
+            if (prev->w >= r->w * s->cascade_ratio &&
+                prev->h >= r->h * s->cascade_ratio &&
+                (int64_t)prev->w * prev->h < (int64_t)src_w * src_h) {
+                r->src = i;
+                src_w  = prev->w;
+                src_h  = prev->h;
+            }
+        }
+    }
+
+    outlink->w = r->w;
+    outlink->h = r->h;
+    if (inlink->sample_aspect_ratio.num)
+        outlink->sample_aspect_ratio = av_mul_q((AVRational){ r->h * inlink->w, r->w * inlink->h },
+                                                inlink->sample_aspect_ratio);
+    else
+        outlink->sample_aspect_ratio = inlink->sample_aspect_ratio;
+
+    sws_freeContext(r->sws);
+    r->sws = sws = sws_alloc_context();
+    if (!sws)
+        return AVERROR(ENOMEM);
+
+    av_opt_set_int(sws, "srcw",       src_w,          0);
+    av_opt_set_int(sws, "srch",       src_h,          0);
+    av_opt_set_int(sws, "src_format", inlink->format, 0);
+    av_opt_set_int(sws, "dstw",       r->w,           0);
+    av_opt_set_int(sws, "dsth",       r->h,           0);
+    av_opt_set_int(sws, "dst_format", inlink->format, 0);
+    av_opt_set_int(sws, "threads",    ff_filter_get_nb_threads(ctx), 0);
+    if (inlink->color_range != AVCOL_RANGE_UNSPECIFIED) {
+        av_opt_set_int(sws, "src_range", inlink->color_range == AVCOL_RANGE_JPEG, 0);
+        av_opt_set_int(sws, "dst_range", inlink->color_range == AVCOL_RANGE_JPEG, 0);
+    }
+
+    ret = av_opt_set(sws, "sws_flags", s->flags_str, 0);
+    if (ret < 0)
+        return ret;
+
+    ret = sws_set_thread_pool(sws, ctx->graph->thread_pool);
+    if (ret < 0)
+        return ret;
+
+    ret = sws_init_context(sws, NULL, NULL);
+    if (ret < 0)
+        return ret;
+
+    av_log(ctx, AV_LOG_VERBOSE, "output%td: %dx%d from %s %dx%d\n",
+           r - s->renditions, r->w, r->h, r->src < 0 ? "input" : "rendition",
+           src_w, src_h);
+
+    return 0;
+}
+
+static av_cold int init(AVFilterContext *ctx)
+{
+    ScaleLadderContext *s = ctx->priv;
+    const char *p = s->sizes_str;
+    int ret;
+
+    if (!p || !*p) {
+        av_log(ctx, AV_LOG_ERROR, "No output sizes given\n");
+        return AVERROR(EINVAL);
+    }
+
+    while (*p) {
+        char *size = av_get_token(&p, "|");
+        Rendition *r;
+        AVFilterPad pad = { 0 };
+
+        if (!size)
+            return AVERROR(ENOMEM);
+
+        r = av_dynarray2_add((void **)&s->renditions, &s->nb_renditions,
+                             sizeof(*s->renditions), NULL);
+        if (!r) {
+            av_free(size);
+            return AVERROR(ENOMEM);
+        }
+        memset(r, 0, sizeof(*r));
+
+        ret = av_parse_video_size(&r->w, &r->h, size);
+        if (ret < 0) {
+            av_log(ctx, AV_LOG_ERROR, "Invalid output size '%s'\n", size);
+            av_free(size);
+            return ret;
+        }
+        av_free(size);
+
+        pad.type         = AVMEDIA_TYPE_VIDEO;
+        pad.config_props = config_output;
+        pad.name         = av_asprintf("output%d", s->nb_renditions - 1);
+        if (!pad.name)
+            return AVERROR(ENOMEM);
+
+        if ((ret = ff_append_outpad_free_name(ctx, &pad)) < 0)
+            return ret;
+
+        if (*p)
+            p++;
+    }
+
+    s->frames = av_calloc(s->nb_renditions, sizeof(*s->frames));
+    s->needed  = av_calloc(s->nb_renditions, sizeof(*s->needed));
+    s->pending = av_calloc(s->nb_renditions, sizeof(*s->pending));
+    if (!s->frames || !s->needed || !s->pending)
+        return AVERROR(ENOMEM);
+
+    return 0;
+}
+
+static av_cold void uninit(AVFilterContext *ctx)
+{
+    ScaleLadderContext *s = ctx->priv;
+
+    for (int i = 0; i < s->nb_renditions; i++)
+        sws_freeContext(s->renditions[i].sws);
+    av_freep(&s->renditions);
+    av_freep(&s->frames);
+    av_freep(&s->needed);
+    av_freep(&s->pending);
+}
+
+static int query_formats(AVFilterContext *ctx)
+{
+    AVFilterFormats *formats = NULL;
+    const AVPixFmtDescriptor *desc = NULL;
+    int ret;
+
+    // the input and all the outputs share the same format, which must be
+    // both readable and writable by swscale for the renditions to cascade
+    while ((desc = av_pix_fmt_desc_next(desc))) {
+        enum AVPixelFormat pix_fmt = av_pix_fmt_desc_get_id(desc);
+
+        if (sws_isSupportedInput(pix_fmt) && sws_isSupportedOutput(pix_fmt) &&
+            !(desc->flags & AV_PIX_FMT_FLAG_PAL) &&
+            (ret = ff_add_format(&formats, pix_fmt)) < 0)
+            return ret;
+    }
+
+    return ff_set_common_formats(ctx, formats);
+}
+
+static int complete_rendition(ScaleLadderContext *s, int i)
+{
+    if (!s->pending[i])
+        return 0;
+
+    s->pending[i] = 0;
+    return sws_scale_frame_complete(s->renditions[i].sws);
+}
+
+static int scale_renditions(AVFilterContext *ctx, AVFrame *in)
+{
+    ScaleLadderContext *s = ctx->priv;
+    int ret = 0;
+
+    // a closed output still has to be computed if others are scaled from it
+    memset(s->needed, 0, s->nb_renditions * sizeof(*s->needed));
+    for (int i = s->nb_renditions - 1; i >= 0; i--) {
+        const Rendition *r = &s->renditions[i];
+
+        if (!ff_outlink_get_status(ctx->outputs[i]))
+            s->needed[i] = 1;
+        if (s->needed[i] && r->src >= 0)
+            s->needed[r->src] = 1;
+    }
+
+    for (int i = 0; i < s->nb_renditions; i++) {
+        AVFilterLink *outlink = ctx->outputs[i];
+        const Rendition *r = &s->renditions[i];
+        AVFrame *out;
+
+        if (!s->needed[i])
+            continue;
+
+        // renditions scaled from different sources are computed concurrently
+        if (r->src >= 0) {
+            ret = complete_rendition(s, r->src);
+            if (ret < 0)
+                break;
+        }
+
+        out = ff_get_video_buffer(outlink, outlink->w, outlink->h);
+        if (!out) {
+            ret = AVERROR(ENOMEM);
+            break;
+        }
+        s->frames[i] = out;
+
+        ret = av_frame_copy_props(out, in);
+        if (ret < 0)
+            break;
+        out->width  = outlink->w;
+        out->height = outlink->h;
+        out->sample_aspect_ratio = outlink->sample_aspect_ratio;
+
+        ret = sws_scale_frame_submit(r->sws, out, r->src < 0 ? in : s->frames[r->src]);
+        if (ret < 0)
+            break;
+        s->pending[i] = 1;
+    }
+
+    for (int i = 0; i < s->nb_renditions; i++) {
+        int err = complete_rendition(s, i);
+        if (err < 0 && ret >= 0)
+            ret = err;
+    }
+
+    for (int i = 0; i < s->nb_renditions; i++) {
+        AVFrame *out = s->frames[i];
+
+        s->frames[i] = NULL;
+        if (!out)
+            continue;
+        if (ret < 0 || ff_outlink_get_status(ctx->outputs[i])) {
+            av_frame_free(&out);
+            continue;
+        }
+        ret = ff_filter_frame(ctx->outputs[i], out);
+    }
+
+    return ret;
+}
+
+static int activate(AVFilterContext *ctx)
+{
+    AVFilterLink *inlink = ctx->inputs[0];
+    int status, ret, nb_eofs = 0;
+    AVFrame *in;
+    int64_t pts;
+
+    for (int i = 0; i < ctx->nb_outputs; i++)
+        nb_eofs += ff_outlink_get_status(ctx->outputs[i]) == AVERROR_EOF;
+
+    if (nb_eofs == ctx->nb_outputs) {
+        ff_inlink_set_status(inlink, AVERROR_EOF);
+        return 0;
+    }
+
+    ret = ff_inlink_consume_frame(inlink, &in);
+    if (ret < 0)
+        return ret;
+    if (ret > 0) {
+        if (in->width != inlink->w || in->height != inlink->h ||
+            in->format != inlink->format) {
+            av_log(ctx, AV_LOG_ERROR, "Input frame properties changed\n");
+            av_frame_free(&in);
+            return AVERROR(EINVAL);
+        }
+
+        ret = scale_renditions(ctx, in);
+        av_frame_free(&in);
+        if (ret < 0)
+            return ret;
+    }
+
+    if (ff_inlink_acknowledge_status(inlink, &status, &pts)) {
+        for (int i = 0; i < ctx->nb_outputs; i++) {
+            if (ff_outlink_get_status(ctx->outputs[i]))
+                continue;
+            ff_outlink_set_status(ctx->outputs[i], status, pts);
+        }
+        return 0;
+    }
+
+    for (int i = 0; i < ctx->nb_outputs; i++) {
+        if (ff_outlink_get_status(ctx->outputs[i]))
+            continue;
+
+        if (ff_outlink_frame_wanted(ctx->outputs[i])) {
+            ff_inlink_request_frame(inlink);
+            return 0;
+        }
+    }
+
+    return FFERROR_NOT_READY;
+}
+
+#define OFFSET(x) offsetof(ScaleLadderContext, x)
+#define FLAGS AV_OPT_FLAG_VIDEO_PARAM | AV_OPT_FLAG_FILTERING_PARAM
+
+static const AVOption scale_ladder_options[] = {
+    { "sizes",   "set the output sizes, separated by '|'", OFFSET(sizes_str), AV_OPT_TYPE_STRING, { .str = NULL },      0, 0, FLAGS },
+    { "flags",   "set the scaler flags",                   OFFSET(flags_str), AV_OPT_TYPE_STRING, { .str = "bicubic" }, 0, 0, FLAGS },
+    { "cascade", "scale renditions from larger ones",      OFFSET(cascade),   AV_OPT_TYPE_BOOL,   { .i64 = 1 },         0, 1, FLAGS },
+    { "cascade_ratio", "set the minimum size ratio to scale a rendition from a larger one", OFFSET(cascade_ratio), AV_OPT_TYPE_DOUBLE, { .dbl = 2 }, 1, 16, FLAGS },
+    { NULL }
+};
+
+AVFILTER_DEFINE_CLASS(scale_ladder);
+
+static const AVFilterPad scale_ladder_inputs[] = {
+    {
+        .name = "default",
+        .type = AVMEDIA_TYPE_VIDEO,
+    },
+};
+
+const AVFilter ff_vf_scale_ladder = {
+    .name          = "scale_ladder",
+    .description   = NULL_IF_CONFIG_SMALL("Scale the input video to several sizes."),
+    .priv_size     = sizeof(ScaleLadderContext),
+    .priv_class    = &scale_ladder_class,
+    .init          = init,
+    .uninit        = uninit,
+    .activate      = activate,
+    FILTER_INPUTS(scale_ladder_inputs),
+    .outputs       = NULL,
+    FILTER_QUERY_FUNC(query_formats),
+    .flags         = AVFILTER_FLAG_DYNAMIC_OUTPUTS,
+};
@@ -30,25 +30,18 @@
 #include "libavutil/imgutils.h"
 #include "libavutil/internal.h"
 #include "libavutil/intreadwrite.h"
+#include "libavutil/mem.h"
+#include "libavutil/mem_internal.h"
 #include "libavutil/opt.h"
 #include "libavutil/pixdesc.h"
 
 #include "avfilter.h"
 #include "colorspace.h"
+#include "colorspacedsp.h"
 #include "filters.h"
+#include "tonemapdsp.h"
 #include "video.h"
 
-enum TonemapAlgorithm {
-    TONEMAP_NONE,
-    TONEMAP_LINEAR,
-    TONEMAP_GAMMA,
-    TONEMAP_CLIP,
-    TONEMAP_REINHARD,
-    TONEMAP_HABLE,
-    TONEMAP_MOBIUS,
-    TONEMAP_MAX,
-};
-
 typedef struct TonemapContext {
     const AVClass *class;
 
@@ -56,8 +49,41 @@ typedef struct TonemapContext {
     double param;
     double desat;
     double peak;
+    enum AVColorTransferCharacteristic trc;
+    enum AVColorSpace spc;
+    enum AVColorPrimaries prm;
+    enum AVColorRange rng;
 
     const AVLumaCoefficients *coeffs;
+
+    TonemapDSPContext dsp;
+
+    /* YUV input and output, converted through the internal RGB format of
+     * colorspacedsp */
+    int yuv;
+    ColorSpaceDSPContext csp_dsp;
+    yuv2rgb_fn yuv2rgb;
+    rgb2yuv_fn rgb2yuv;
+    enum AVColorTransferCharacteristic in_trc, out_trc;
+    enum AVColorSpace in_spc, out_spc;
+    enum AVColorPrimaries in_prm, out_prm;
+    enum AVColorRange in_rng, out_rng;
+    float lumacoeffs[3];
+    float out_lumacoeffs[3];
+    int in_hlg, out_hlg;
+    float in_scale, out_scale;
+    DECLARE_ALIGNED(16, int16_t, yuv2rgb_coeffs)[3][3][8];
+    DECLARE_ALIGNED(16, int16_t, rgb2yuv_coeffs)[3][3][8];
+    DECLARE_ALIGNED(16, int16_t, yuv_offset)[2 /* in, out */][8];
+    float lrgb2lrgb[3][3];
+    float *lin_lut;
+    int16_t *delin_lut;
+
+    /* per-job scratch: two rows of internal RGB and one row of linear RGB */
+    uint8_t *scratch;
+    size_t scratch_size;
+    ptrdiff_t rgb_stride, lin_stride;
+    int nb_jobs;
 } TonemapContext;
 
 static av_cold int init(AVFilterContext *ctx)
@@ -82,98 +108,250 @@ static av_cold int init(AVFilterContext *ctx)
     if (isnan(s->param))
         s->param = 1.0f;
 
+    ff_tonemapdsp_init(&s->dsp);
+
     return 0;
 }
 
-static float hable(float in)
+static av_cold void uninit(AVFilterContext *ctx)
 {
-    float a = 0.15f, b = 0.50f, c = 0.10f, d = 0.20f, e = 0.02f, f = 0.30f;
-    return (in * (in * a + b * c) + d * e) / (in * (in * a + b) + d * f) - e / f;
+    TonemapContext *s = ctx->priv;
+
+    av_freep(&s->lin_lut);
+    av_freep(&s->delin_lut);
+    av_freep(&s->scratch);
 }
 
-static float mobius(float in, float j, double peak)
+static int config_input(AVFilterLink *inlink)
 {
-    float a, b;
+    AVFilterContext *ctx = inlink->dst;
+    TonemapContext *s = ctx->priv;
+    const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get(inlink->format);
+
+    s->yuv = !(desc->flags & AV_PIX_FMT_FLAG_RGB);
+    if (!s->yuv)
+        return 0;
+
+    ff_colorspacedsp_init(&s->csp_dsp);
+    s->yuv2rgb = s->csp_dsp.yuv2rgb[(desc->comp[0].depth - 8) >> 1]
+                                   [desc->log2_chroma_h + desc->log2_chroma_w];
+    s->rgb2yuv = s->csp_dsp.rgb2yuv[(desc->comp[0].depth - 8) >> 1]
+                                   [desc->log2_chroma_h + desc->log2_chroma_w];
+    /* force the coefficients to be computed for the first frame */
+    s->in_trc = AVCOL_TRC_NB;
+
+    s->rgb_stride   = FFALIGN(inlink->w, 16);
+    s->lin_stride   = FFALIGN(inlink->w, 16);
+    s->scratch_size = 3 * 2 * s->rgb_stride * sizeof(int16_t) +
+                      3 * s->lin_stride * sizeof(float);
+    s->nb_jobs      = ff_filter_get_nb_threads(ctx);
+
+    uninit(ctx);
+    s->scratch   = av_calloc(s->nb_jobs, s->scratch_size);
+    s->lin_lut   = av_malloc_array(TONEMAP_LUT_SIZE, sizeof(*s->lin_lut));
+    s->delin_lut = av_calloc(TONEMAP_LUT_SIZE + 1, sizeof(*s->delin_lut));
+    if (!s->scratch || !s->lin_lut || !s->delin_lut)
+        return AVERROR(ENOMEM);
 
-    if (in <= j)
-        return in;
+    return 0;
+}
 
-    a = -j * j * (peak - 1.0f) / (j * j - 2.0f * j + peak);
-    b = (j * j - 2.0f * j * peak + peak) / FFMAX(peak - 1.0f, 1e-6);
+static int get_range_off(int *off, int *y_rng, int *uv_rng,
+                         enum AVColorRange rng, int depth)
+{
+    switch (rng) {
+    case AVCOL_RANGE_UNSPECIFIED:
+    case AVCOL_RANGE_MPEG:
+        *off = 16 << (depth - 8);
+        *y_rng = 219 << (depth - 8);
+        *uv_rng = 224 << (depth - 8);
+        break;
+    case AVCOL_RANGE_JPEG:
+        *off = 0;
+        *y_rng = *uv_rng = (256 << (depth - 8)) - 1;
+        break;
+    default:
+        return AVERROR(EINVAL);
+    }
 
-    return (b * b + 2.0f * b * j + j * j) / (b - a) * (in + a) / (in + b);
+    return 0;
 }
 
-#define MIX(x,y,a) (x) * (1 - (a)) + (y) * (a)
-static void tonemap(TonemapContext *s, AVFrame *out, const AVFrame *in,
-                    const AVPixFmtDescriptor *desc, int x, int y, double peak)
+/* scale of the linear light of a transfer function relative to the reference
+ * white, which is 1.0 in the tonemapping curves */
+static double trc_scale(enum AVColorTransferCharacteristic trc)
 {
-    int map[3] = { desc->comp[0].plane, desc->comp[1].plane, desc->comp[2].plane };
-    const float *r_in = (const float *)(in->data[map[0]] + x * desc->comp[map[0]].step + y * in->linesize[map[0]]);
-    const float *g_in = (const float *)(in->data[map[1]] + x * desc->comp[map[1]].step + y * in->linesize[map[1]]);
-    const float *b_in = (const float *)(in->data[map[2]] + x * desc->comp[map[2]].step + y * in->linesize[map[2]]);
-    float *r_out = (float *)(out->data[map[0]] + x * desc->comp[map[0]].step + y * out->linesize[map[0]]);
-    float *g_out = (float *)(out->data[map[1]] + x * desc->comp[map[1]].step + y * out->linesize[map[1]]);
-    float *b_out = (float *)(out->data[map[2]] + x * desc->comp[map[2]].step + y * out->linesize[map[2]]);
-    float sig, sig_orig;
-
-    /* load values */
-    *r_out = *r_in;
-    *g_out = *g_in;
-    *b_out = *b_in;
-
-    /* desaturate to prevent unnatural colors */
-    if (s->desat > 0) {
-        float luma = av_q2d(s->coeffs->cr) * *r_in + av_q2d(s->coeffs->cg) * *g_in + av_q2d(s->coeffs->cb) * *b_in;
-        float overbright = FFMAX(luma - s->desat, 1e-6) / FFMAX(luma, 1e-6);
-        *r_out = MIX(*r_in, luma, overbright);
-        *g_out = MIX(*g_in, luma, overbright);
-        *b_out = MIX(*b_in, luma, overbright);
+    switch (trc) {
+    case AVCOL_TRC_SMPTE2084:    return 1.0 / REFERENCE_WHITE;
+    case AVCOL_TRC_ARIB_STD_B67: return 1000.0 / REFERENCE_WHITE;
+    default:                     return 1.0;
     }
+}
 
-    /* pick the brightest component, reducing the value range as necessary
-     * to keep the entire signal in range and preventing discoloration due to
-     * out-of-bounds clipping */
-    sig = FFMAX(FFMAX3(*r_out, *g_out, *b_out), 1e-6);
-    sig_orig = sig;
+static int is_hdr(enum AVColorTransferCharacteristic trc)
+{
+    return trc == AVCOL_TRC_SMPTE2084 || trc == AVCOL_TRC_ARIB_STD_B67;
+}
 
-    switch(s->tonemap) {
-    default:
-    case TONEMAP_NONE:
-        // do nothing
-        break;
-    case TONEMAP_LINEAR:
-        sig = sig * s->param / peak;
-        break;
-    case TONEMAP_GAMMA:
-        sig = sig > 0.05f ? pow(sig / peak, 1.0f / s->param)
-                          : sig * pow(0.05f / peak, 1.0f / s->param) / 0.05f;
-        break;
-    case TONEMAP_CLIP:
-        sig = av_clipf(sig * s->param, 0, 1.0f);
-        break;
-    case TONEMAP_HABLE:
-        sig = hable(sig) / hable(peak);
-        break;
-    case TONEMAP_REINHARD:
-        sig = sig / (sig + s->param) * (peak + s->param) / peak;
-        break;
-    case TONEMAP_MOBIUS:
-        sig = mobius(sig, s->param, peak);
-        break;
+/* system gamma of the BT.2100 HLG reference OOTF for the nominal
+ * 1000 cd/m^2 display assumed by trc_scale() */
+#define HLG_GAMMA 1.2f
+
+/* HLG scene light, already multiplied by scale, to display light */
+static void hlg_ootf(float *lin[3], int w, const float coeffs[3], float scale)
+{
+    for (int x = 0; x < w; x++) {
+        const float ys = (coeffs[0] * lin[0][x] + coeffs[1] * lin[1][x] +
+                          coeffs[2] * lin[2][x]) / scale;
+        const float f  = powf(FFMAX(ys, 0.0f), HLG_GAMMA - 1.0f);
+
+        for (int i = 0; i < 3; i++)
+            lin[i][x] *= f;
+    }
+}
+
+/* Display light to HLG scene light still multiplied by scale, after
+ * converting it with the primaries matrix m */
+static void hlg_inverse_ootf(float *lin[3], int w, const float m[3][3],
+                             const float coeffs[3], float scale)
+{
+    for (int x = 0; x < w; x++) {
+        const float r = lin[0][x], g = lin[1][x], b = lin[2][x];
+        float rgb[3], yd, f;
+
+        for (int i = 0; i < 3; i++)
+            rgb[i] = m[i][0] * r + m[i][1] * g + m[i][2] * b;
+        yd = (coeffs[0] * rgb[0] + coeffs[1] * rgb[1] + coeffs[2] * rgb[2]) / scale;
+        f  = yd > 0.0f ? powf(yd, (1.0f - HLG_GAMMA) / HLG_GAMMA) : 0.0f;
+        for (int i = 0; i < 3; i++)
+            lin[i][x] = rgb[i] * f;
+    }
+}
+
+static int setup_yuv(AVFilterContext *ctx, const AVFrame *in, const AVFrame *out)
+{
+    TonemapContext *s = ctx->priv;
+    const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get(in->format);
+    const int depth = desc->comp[0].depth;
+    const AVLumaCoefficients *in_luma, *out_luma;
+    const AVColorPrimariesDesc *in_prim, *out_prim;
+    av_csp_trc_function linearize, delinearize;
+    double rgb2yuv[3][3], yuv2rgb[3][3], rgb2rgb[3][3];
+    double in_scale, out_scale;
+    int off, y_rng, uv_rng, ret;
+
+    s->in_trc  = in->color_trc;
+    s->in_spc  = in->colorspace;
+    s->in_prm  = in->color_primaries;
+    s->in_rng  = in->color_range;
+    s->out_trc = out->color_trc;
+    s->out_spc = out->colorspace;
+    s->out_prm = out->color_primaries;
+    s->out_rng = out->color_range;
+
+    linearize   = av_csp_trc_func_inv_from_id(s->in_trc);
+    delinearize = av_csp_trc_func_from_id(s->out_trc);
+    if (!linearize || !delinearize) {
+        av_log(ctx, AV_LOG_ERROR, "Unsupported transfer %s -> %s\n",
+               av_color_transfer_name(s->in_trc),
+               av_color_transfer_name(s->out_trc));
+        goto fail;
+    }
+
+    /* untagged matrix and primaries follow the transfer function */
+#define DEFAULT_SPC(spc, trc) ((spc) == AVCOL_SPC_UNSPECIFIED ? \
+    (is_hdr(trc) ? AVCOL_SPC_BT2020_NCL : AVCOL_SPC_BT709) : (spc))
+#define DEFAULT_PRM(prm, trc) ((prm) == AVCOL_PRI_UNSPECIFIED ? \
+    (is_hdr(trc) ? AVCOL_PRI_BT2020 : AVCOL_PRI_BT709) : (prm))
+    in_luma  = av_csp_luma_coeffs_from_avcsp(DEFAULT_SPC(s->in_spc, s->in_trc));
+    out_luma = av_csp_luma_coeffs_from_avcsp(DEFAULT_SPC(s->out_spc, s->out_trc));
+    in_prim  = av_csp_primaries_desc_from_id(DEFAULT_PRM(s->in_prm, s->in_trc));
+    out_prim = av_csp_primaries_desc_from_id(DEFAULT_PRM(s->out_prm, s->out_trc));
+    if (!in_luma || !out_luma || !in_prim || !out_prim) {
+        av_log(ctx, AV_LOG_ERROR, "Unsupported colorspace %s/%s -> %s/%s\n",
+               av_color_space_name(s->in_spc), av_color_primaries_name(s->in_prm),
+               av_color_space_name(s->out_spc), av_color_primaries_name(s->out_prm));
+        goto fail;
+    }
+
+    ret = get_range_off(&off, &y_rng, &uv_rng, s->in_rng, depth);
+    if (ret < 0)
+        goto fail;
+    for (int n = 0; n < 8; n++)
+        s->yuv_offset[0][n] = off;
+    ff_fill_rgb2yuv_table(in_luma, rgb2yuv);
+    ff_matrix_invert_3x3(rgb2yuv, yuv2rgb);
+    for (int n = 0; n < 3; n++) {
+        for (int m = 0, rng = y_rng; m < 3; m++, rng = uv_rng) {
+            s->yuv2rgb_coeffs[n][m][0] = lrint(28672 * (1 << (depth - 1)) * yuv2rgb[n][m] / rng);
+            for (int o = 1; o < 8; o++)
+                s->yuv2rgb_coeffs[n][m][o] = s->yuv2rgb_coeffs[n][m][0];
+        }
+    }
+    s->lumacoeffs[0] = av_q2d(in_luma->cr);
+    s->lumacoeffs[1] = av_q2d(in_luma->cg);
+    s->lumacoeffs[2] = av_q2d(in_luma->cb);
+    s->out_lumacoeffs[0] = av_q2d(out_luma->cr);
+    s->out_lumacoeffs[1] = av_q2d(out_luma->cg);
+    s->out_lumacoeffs[2] = av_q2d(out_luma->cb);
+
+    ret = get_range_off(&off, &y_rng, &uv_rng, s->out_rng, depth);
+    if (ret < 0)
+        goto fail;
+    for (int n = 0; n < 8; n++)
+        s->yuv_offset[1][n] = off;
+    ff_fill_rgb2yuv_table(out_luma, rgb2yuv);
+    for (int n = 0, rng = y_rng; n < 3; n++, rng = uv_rng) {
+        for (int m = 0; m < 3; m++) {
+            s->rgb2yuv_coeffs[n][m][0] = lrint((1 << (29 - depth)) * rng * rgb2yuv[n][m] / 28672);
+            for (int o = 1; o < 8; o++)
+                s->rgb2yuv_coeffs[n][m][o] = s->rgb2yuv_coeffs[n][m][0];
+        }
+    }
+
+    if (in_prim != out_prim) {
+        double rgb2xyz[3][3], xyz2rgb[3][3];
+
+        ff_fill_rgb2xyz_table(&out_prim->prim, &out_prim->wp, rgb2xyz);
+        ff_matrix_invert_3x3(rgb2xyz, xyz2rgb);
+        ff_fill_rgb2xyz_table(&in_prim->prim, &in_prim->wp, rgb2xyz);
+        ff_matrix_mul_3x3(rgb2rgb, rgb2xyz, xyz2rgb);
+    } else {
+        memset(rgb2rgb, 0, sizeof(rgb2rgb));
+        rgb2rgb[0][0] = rgb2rgb[1][1] = rgb2rgb[2][2] = 1.0;
     }
+    for (int m = 0; m < 3; m++)
+        for (int n = 0; n < 3; n++)
+            s->lrgb2lrgb[m][n] = rgb2rgb[m][n];
+
+    in_scale  = trc_scale(s->in_trc);
+    out_scale = trc_scale(s->out_trc);
+    s->in_scale  = in_scale;
+    s->out_scale = out_scale;
+    s->in_hlg  = s->in_trc  == AVCOL_TRC_ARIB_STD_B67;
+    s->out_hlg = s->out_trc == AVCOL_TRC_ARIB_STD_B67;
+    for (int n = 0; n < TONEMAP_LUT_SIZE; n++) {
+        double v = (n - 2048.0) / 28672.0, l, d;
+
+        l = v < 0 ? -linearize(-v) : linearize(v);
+        s->lin_lut[n] = l * in_scale;
+
+        d = v < 0 ? -delinearize(-v / out_scale) : delinearize(v / out_scale);
+        s->delin_lut[n] = av_clip_int16(lrint(d * 28672.0));
+    }
+
+    return 0;
 
-    /* apply the computed scale factor to the color,
-     * linearly to prevent discoloration */
-    *r_out *= sig / sig_orig;
-    *g_out *= sig / sig_orig;
-    *b_out *= sig / sig_orig;
+fail:
+    /* retry with the next frame */
+    s->in_trc = AVCOL_TRC_NB;
+    return AVERROR(EINVAL);
 }
 
 typedef struct ThreadData {
     AVFrame *in, *out;
     const AVPixFmtDescriptor *desc;
-    double peak;
+    TonemapParams params;
 } ThreadData;
 
 static int tonemap_slice(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs)
@@ -183,13 +361,86 @@ static int tonemap_slice(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs
     AVFrame *in = td->in;
     AVFrame *out = td->out;
     const AVPixFmtDescriptor *desc = td->desc;
+    const int map[3] = { desc->comp[0].plane, desc->comp[1].plane, desc->comp[2].plane };
     const int slice_start = (in->height * jobnr) / nb_jobs;
     const int slice_end = (in->height * (jobnr+1)) / nb_jobs;
-    double peak = td->peak;
 
-    for (int y = slice_start; y < slice_end; y++)
-        for (int x = 0; x < out->width; x++)
-            tonemap(s, out, in, desc, x, y, peak);
+    for (int y = slice_start; y < slice_end; y++) {
+        float *src[3], *dst[3];
+
+        for (int i = 0; i < 3; i++) {
+            src[i] = (float *)(in->data[map[i]]  + y * in->linesize[map[i]]);
+            dst[i] = (float *)(out->data[map[i]] + y * out->linesize[map[i]]);
+        }
+        s->dsp.tonemap[s->tonemap](dst, src, out->width, &td->params);
+    }
+
+    return 0;
+}
+
+static int tonemap_yuv_slice(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs)
+{
+    static const float identity[3][3] = { { 1, 0, 0 }, { 0, 1, 0 }, { 0, 0, 1 } };
+    TonemapContext *s = ctx->priv;
+    ThreadData *td = arg;
+    AVFrame *in = td->in;
+    AVFrame *out = td->out;
+    const int ss_h = td->desc->log2_chroma_h;
+    const int h_in = (in->height + 1) >> 1;
+    const int slice_start = 2 * ((h_in * jobnr) / nb_jobs);
+    const int slice_end = FFMIN(2 * ((h_in * (jobnr+1)) / nb_jobs), in->height);
+    uint8_t *scratch = s->scratch + jobnr * s->scratch_size;
+    int16_t *rgb[3];
+    float *lin[3];
+
+    for (int i = 0; i < 3; i++) {
+        rgb[i] = (int16_t *)scratch + 2 * i * s->rgb_stride;
+        lin[i] = (float *)(scratch + 3 * 2 * s->rgb_stride * sizeof(int16_t)) +
+                 i * s->lin_stride;
+    }
+
+    /* two rows at a time so that the data stays in cache, and so that the
+     * chroma of 4:2:0 is converted in one go */
+    for (int y = slice_start; y < slice_end; y += 2) {
+        ptrdiff_t in_linesize[3]  = { in->linesize[0],  in->linesize[1],  in->linesize[2]  };
+        ptrdiff_t out_linesize[3] = { out->linesize[0], out->linesize[1], out->linesize[2] };
+        uint8_t *in_data[3], *out_data[3];
+        int h = FFMIN(slice_end - y, 2);
+
+        for (int i = 0; i < 3; i++) {
+            in_data[i]  = in->data[i]  + (i ? y >> ss_h : y) * in_linesize[i];
+            out_data[i] = out->data[i] + (i ? y >> ss_h : y) * out_linesize[i];
+        }
+        /* the 4:2:0 functions always work on pairs of rows, so let them
+         * process the last odd row twice in place */
+        if (h == 1 && ss_h) {
+            in_linesize[0] = out_linesize[0] = 0;
+            h = 2;
+        }
+
+        s->yuv2rgb(rgb, s->rgb_stride, in_data, in_linesize, in->width, h,
+                   s->yuv2rgb_coeffs, s->yuv_offset[0]);
+        for (int n = 0; n < h; n++) {
+            int16_t *row[3] = { rgb[0] + n * s->rgb_stride,
+                                rgb[1] + n * s->rgb_stride,
+                                rgb[2] + n * s->rgb_stride };
+
+            for (int i = 0; i < 3; i++)
+                s->dsp.linearize(lin[i], row[i], in->width, s->lin_lut);
+            if (s->in_hlg)
+                hlg_ootf(lin, in->width, s->lumacoeffs, s->in_scale);
+            s->dsp.tonemap[s->tonemap](lin, lin, in->width, &td->params);
+            if (s->out_hlg) {
+                hlg_inverse_ootf(lin, in->width, s->lrgb2lrgb, s->out_lumacoeffs,
+                                 s->out_scale);
+                s->dsp.delinearize(row, lin, in->width, identity, s->delin_lut);
+            } else {
+                s->dsp.delinearize(row, lin, in->width, s->lrgb2lrgb, s->delin_lut);
+            }
+        }
+        s->rgb2yuv(out_data, out_linesize, rgb, s->rgb_stride, in->width, h,
+                   s->rgb2yuv_coeffs, s->yuv_offset[1]);
+    }
 
     return 0;
 }
@@ -224,6 +475,50 @@ static int filter_frame(AVFilterLink *link, AVFrame *in)
         return ret;
     }
 
+    /* read peak from side data if not passed in */
+    if (!peak) {
+        peak = ff_determine_signal_peak(in);
+        av_log(s, AV_LOG_DEBUG, "Computed signal peak: %f\n", peak);
+    }
+
+    td.out = out;
+    td.in = in;
+    td.desc = desc;
+
+    if (s->yuv) {
+        if (s->trc != -1)
+            out->color_trc = s->trc;
+        if (s->spc != -1)
+            out->colorspace = s->spc;
+        if (s->prm != -1)
+            out->color_primaries = s->prm;
+        if (s->rng != -1)
+            out->color_range = s->rng;
+
+        if (in->color_trc        != s->in_trc  || in->colorspace       != s->in_spc  ||
+            in->color_primaries  != s->in_prm  || in->color_range      != s->in_rng  ||
+            out->color_trc       != s->out_trc || out->colorspace      != s->out_spc ||
+            out->color_primaries != s->out_prm || out->color_range     != s->out_rng) {
+            ret = setup_yuv(ctx, in, out);
+            if (ret < 0) {
+                av_frame_free(&in);
+                av_frame_free(&out);
+                return ret;
+            }
+        }
+
+        ff_tonemap_params_init(&td.params, s->tonemap, s->param, s->desat, peak,
+                               s->lumacoeffs);
+        ff_filter_execute(ctx, tonemap_yuv_slice, &td, NULL,
+                          FFMIN((in->height + 1) >> 1, s->nb_jobs));
+
+        av_frame_free(&in);
+
+        ff_update_hdr_metadata(out, peak);
+
+        return ff_filter_frame(outlink, out);
+    }
+
     /* input and output transfer will be linear */
     if (in->color_trc == AVCOL_TRC_UNSPECIFIED) {
         av_log(s, AV_LOG_WARNING, "Untagged transfer, assuming linear light\n");
@@ -231,12 +526,6 @@ static int filter_frame(AVFilterLink *link, AVFrame *in)
     } else if (in->color_trc != AVCOL_TRC_LINEAR)
         av_log(s, AV_LOG_WARNING, "Tonemapping works on linear light only\n");
 
-    /* read peak from side data if not passed in */
-    if (!peak) {
-        peak = ff_determine_signal_peak(in);
-        av_log(s, AV_LOG_DEBUG, "Computed signal peak: %f\n", peak);
-    }
-
     /* load original color space even if pixel format is RGB to compute overbrights */
     s->coeffs = av_csp_luma_coeffs_from_avcsp(in->colorspace);
     if (s->desat > 0 && (in->colorspace == AVCOL_SPC_UNSPECIFIED || !s->coeffs)) {
@@ -250,10 +539,13 @@ static int filter_frame(AVFilterLink *link, AVFrame *in)
     }
 
     /* do the tone map */
-    td.out = out;
-    td.in = in;
-    td.desc = desc;
-    td.peak = peak;
+    if (s->desat > 0) {
+        s->lumacoeffs[0] = av_q2d(s->coeffs->cr);
+        s->lumacoeffs[1] = av_q2d(s->coeffs->cg);
+        s->lumacoeffs[2] = av_q2d(s->coeffs->cb);
+    }
+    ff_tonemap_params_init(&td.params, s->tonemap, s->param, s->desat, peak,
+                           s->lumacoeffs);
     ff_filter_execute(ctx, tonemap_slice, &td, NULL,
                       FFMIN(in->height, ff_filter_get_nb_threads(ctx)));
 
@@ -289,9 +581,29 @@ static const AVOption tonemap_options[] = {
     {     "reinhard", 0, 0, AV_OPT_TYPE_CONST, {.i64 = TONEMAP_REINHARD},          0, 0, FLAGS, .unit = "tonemap" },
     {     "hable",    0, 0, AV_OPT_TYPE_CONST, {.i64 = TONEMAP_HABLE},             0, 0, FLAGS, .unit = "tonemap" },
     {     "mobius",   0, 0, AV_OPT_TYPE_CONST, {.i64 = TONEMAP_MOBIUS},            0, 0, FLAGS, .unit = "tonemap" },
+    {     "bt2390",   0, 0, AV_OPT_TYPE_CONST, {.i64 = TONEMAP_BT2390},            0, 0, FLAGS, .unit = "tonemap" },
     { "param",        "tonemap parameter", OFFSET(param), AV_OPT_TYPE_DOUBLE, {.dbl = NAN}, DBL_MIN, DBL_MAX, FLAGS },
     { "desat",        "desaturation strength", OFFSET(desat), AV_OPT_TYPE_DOUBLE, {.dbl = 2}, 0, DBL_MAX, FLAGS },
     { "peak",         "signal peak override", OFFSET(peak), AV_OPT_TYPE_DOUBLE, {.dbl = 0}, 0, DBL_MAX, FLAGS },
+    { "transfer",     "set output transfer characteristic", OFFSET(trc), AV_OPT_TYPE_INT, {.i64 = AVCOL_TRC_BT709}, -1, INT_MAX, FLAGS, .unit = "transfer" },
+    { "t",            "set output transfer characteristic", OFFSET(trc), AV_OPT_TYPE_INT, {.i64 = AVCOL_TRC_BT709}, -1, INT_MAX, FLAGS, .unit = "transfer" },
+    {     "bt709",    0, 0, AV_OPT_TYPE_CONST, {.i64 = AVCOL_TRC_BT709},           0, 0, FLAGS, .unit = "transfer" },
+    {     "bt2020",   0, 0, AV_OPT_TYPE_CONST, {.i64 = AVCOL_TRC_BT2020_10},       0, 0, FLAGS, .unit = "transfer" },
+    {     "srgb",     0, 0, AV_OPT_TYPE_CONST, {.i64 = AVCOL_TRC_IEC61966_2_1},    0, 0, FLAGS, .unit = "transfer" },
+    { "matrix",       "set output colorspace matrix", OFFSET(spc), AV_OPT_TYPE_INT, {.i64 = -1}, -1, INT_MAX, FLAGS, .unit = "matrix" },
+    { "m",            "set output colorspace matrix", OFFSET(spc), AV_OPT_TYPE_INT, {.i64 = -1}, -1, INT_MAX, FLAGS, .unit = "matrix" },
+    {     "bt709",    0, 0, AV_OPT_TYPE_CONST, {.i64 = AVCOL_SPC_BT709},           0, 0, FLAGS, .unit = "matrix" },
+    {     "bt2020",   0, 0, AV_OPT_TYPE_CONST, {.i64 = AVCOL_SPC_BT2020_NCL},      0, 0, FLAGS, .unit = "matrix" },
+    { "primaries",    "set output color primaries", OFFSET(prm), AV_OPT_TYPE_INT, {.i64 = -1}, -1, INT_MAX, FLAGS, .unit = "primaries" },
+    { "p",            "set output color primaries", OFFSET(prm), AV_OPT_TYPE_INT, {.i64 = -1}, -1, INT_MAX, FLAGS, .unit = "primaries" },
+    {     "bt709",    0, 0, AV_OPT_TYPE_CONST, {.i64 = AVCOL_PRI_BT709},           0, 0, FLAGS, .unit = "primaries" },
+    {     "bt2020",   0, 0, AV_OPT_TYPE_CONST, {.i64 = AVCOL_PRI_BT2020},          0, 0, FLAGS, .unit = "primaries" },
+    { "range",        "set output color range", OFFSET(rng), AV_OPT_TYPE_INT, {.i64 = -1}, -1, INT_MAX, FLAGS, .unit = "range" },
+    { "r",            "set output color range", OFFSET(rng), AV_OPT_TYPE_INT, {.i64 = -1}, -1, INT_MAX, FLAGS, .unit = "range" },
+    {     "tv",       0, 0, AV_OPT_TYPE_CONST, {.i64 = AVCOL_RANGE_MPEG},          0, 0, FLAGS, .unit = "range" },
+    {     "pc",       0, 0, AV_OPT_TYPE_CONST, {.i64 = AVCOL_RANGE_JPEG},          0, 0, FLAGS, .unit = "range" },
+    {     "limited",  0, 0, AV_OPT_TYPE_CONST, {.i64 = AVCOL_RANGE_MPEG},          0, 0, FLAGS, .unit = "range" },
+    {     "full",     0, 0, AV_OPT_TYPE_CONST, {.i64 = AVCOL_RANGE_JPEG},          0, 0, FLAGS, .unit = "range" },
     { NULL }
 };
 
@@ -302,6 +614,7 @@ static const AVFilterPad tonemap_inputs[] = {
         .name         = "default",
         .type         = AVMEDIA_TYPE_VIDEO,
         .filter_frame = filter_frame,
+        .config_props = config_input,
     },
 };
 
@@ -309,10 +622,15 @@ const AVFilter ff_vf_tonemap = {
     .name            = "tonemap",
     .description     = NULL_IF_CONFIG_SMALL("Conversion to/from different dynamic ranges."),
     .init            = init,
+    .uninit          = uninit,
     .priv_size       = sizeof(TonemapContext),
     .priv_class      = &tonemap_class,
     FILTER_INPUTS(tonemap_inputs),
     FILTER_OUTPUTS(ff_video_default_filterpad),
-    FILTER_PIXFMTS(AV_PIX_FMT_GBRPF32, AV_PIX_FMT_GBRAPF32),
+    FILTER_PIXFMTS(AV_PIX_FMT_GBRPF32, AV_PIX_FMT_GBRAPF32,
+                   AV_PIX_FMT_YUV420P,   AV_PIX_FMT_YUV422P,   AV_PIX_FMT_YUV444P,
+                   AV_PIX_FMT_YUV420P10, AV_PIX_FMT_YUV422P10, AV_PIX_FMT_YUV444P10,
+                   AV_PIX_FMT_YUV420P12, AV_PIX_FMT_YUV422P12, AV_PIX_FMT_YUV444P12),
     .flags           = AVFILTER_FLAG_SLICE_THREADS,
+    .flags_internal  = FF_FILTER_FLAG_FRAME_THREADS,
 };
@@ -414,4 +414,5 @@ const AVFilter ff_vf_transpose = {
     FILTER_OUTPUTS(avfilter_vf_transpose_outputs),
     FILTER_QUERY_FUNC(query_formats),
     .flags         = AVFILTER_FLAG_SLICE_THREADS,
+    .flags_internal = FF_FILTER_FLAG_FRAME_THREADS,
 };
@@ -26,6 +26,8 @@
 #include "libavutil/buffer.h"
 #include "libavutil/cpu.h"
 #include "libavutil/hwcontext.h"
+#include "libavutil/imgutils_internal.h"
+#include "libavutil/pixdesc.h"
 #include "libavutil/pixfmt.h"
 
 #include "avfilter.h"
@@ -46,30 +48,14 @@ AVFrame *ff_null_get_video_buffer(AVFilterLink *link, int w, int h)
     return ff_get_video_buffer(link->dst->outputs[0], w, h);
 }
 
-AVFrame *ff_default_get_video_buffer2(AVFilterLink *link, int w, int h, int align)
+static AVFrame *frame_pool_get_video(AVFilterLink *link, int w, int h, int align)
 {
     FilterLinkInternal *const li = ff_link_internal(link);
-    AVFrame *frame = NULL;
     int pool_width = 0;
     int pool_height = 0;
     int pool_align = 0;
     enum AVPixelFormat pool_format = AV_PIX_FMT_NONE;
 
-    if (li->l.hw_frames_ctx &&
-        ((AVHWFramesContext*)li->l.hw_frames_ctx->data)->format == link->format) {
-        int ret;
-        frame = av_frame_alloc();
-
-        if (!frame)
-            return NULL;
-
-        ret = av_hwframe_get_buffer(li->l.hw_frames_ctx, frame, 0);
-        if (ret < 0)
-            av_frame_free(&frame);
-
-        return frame;
-    }
-
     if (!li->frame_pool) {
         li->frame_pool = ff_frame_pool_video_init(CONFIG_MEMORY_POISONING
                                                      ? NULL
@@ -97,7 +83,68 @@ AVFrame *ff_default_get_video_buffer2(AVFilterLink *link, int w, int h, int alig
         }
     }
 
-    frame = ff_frame_pool_get(li->frame_pool);
+    return ff_frame_pool_get(li->frame_pool);
+}
+
+static AVFrame *graph_get_video_buffer(AVFilterLink *link, int w, int h, int align)
+{
+    AVFilterGraph *graph = link->src->graph;
+    const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get(link->format);
+    AVFrame *frame = av_frame_alloc();
+
+    if (!frame)
+        return NULL;
+
+    frame->format = link->format;
+    frame->width  = w;
+    frame->height = h;
+
+    if (graph->get_video_buffer(graph, frame, align) < 0)
+        goto fail;
+
+    if (desc->flags & AV_PIX_FMT_FLAG_PAL) {
+        enum AVPixelFormat format =
+            link->format == AV_PIX_FMT_PAL8 ? AV_PIX_FMT_BGR8 : link->format;
+
+        if (!frame->data[1] ||
+            avpriv_set_systematic_pal2((uint32_t *)frame->data[1], format) < 0)
+            goto fail;
+    }
+
+    return frame;
+
+fail:
+    av_frame_free(&frame);
+    return NULL;
+}
+
+AVFrame *ff_default_get_video_buffer2(AVFilterLink *link, int w, int h, int align)
+{
+    FilterLinkInternal *const li = ff_link_internal(link);
+    AVFrame *frame = NULL;
+
+    if (li->l.hw_frames_ctx &&
+        ((AVHWFramesContext*)li->l.hw_frames_ctx->data)->format == link->format) {
+        int ret;
+        frame = av_frame_alloc();
+
+        if (!frame)
+            return NULL;
+
+        ret = av_hwframe_get_buffer(li->l.hw_frames_ctx, frame, 0);
+        if (ret < 0)
+            av_frame_free(&frame);
+
+        return frame;
+    }
+
+    if (link->src->graph->get_video_buffer) {
+        frame = graph_get_video_buffer(link, w, h, align);
+    } else {
+        ff_graph_buffer_lock(link->src->graph);
+        frame = frame_pool_get_video(link, w, h, align);
+        ff_graph_buffer_unlock(link->src->graph);
+    }
     if (!frame)
         return NULL;
 
@@ -119,7 +166,7 @@ AVFrame *ff_get_video_buffer(AVFilterLink *link, int w, int h)
 
     FF_TPRINTF_START(NULL, get_video_buffer); ff_tlog_link(NULL, link, 1);
 
-    if (link->dstpad->get_buffer.video)
+    if (link->dstpad->get_buffer.video && !ff_link_default_buffer(link))
         ret = link->dstpad->get_buffer.video(link, w, h);
 
     if (!ret)
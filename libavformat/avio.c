@@ -412,6 +412,7 @@ fail:
 int ffio_fdopen(AVIOContext **sp, URLContext *h)
 {
     AVIOContext *s;
+    AVBufferRef *mapping = NULL;
     uint8_t *buffer = NULL;
     int buffer_size, max_packet_size;
 
@@ -426,17 +427,28 @@ int ffio_fdopen(AVIOContext **sp, URLContext *h)
             return AVERROR(EINVAL);
         buffer_size *= 2;
     }
-    buffer = av_malloc(buffer_size);
-    if (!buffer)
-        return AVERROR(ENOMEM);
+    /* a mapped input is read in place, the buffer then points into it */
+    if (!(h->flags & AVIO_FLAG_WRITE) && !h->is_streamed &&
+        ffurl_get_mapping(h, &mapping) >= 0) {
+        buffer      = mapping->data;
+        buffer_size = FFMIN(buffer_size, mapping->size);
+    } else {
+        buffer = av_malloc(buffer_size);
+        if (!buffer)
+            return AVERROR(ENOMEM);
+    }
 
     *sp = avio_alloc_context(buffer, buffer_size, h->flags & AVIO_FLAG_WRITE, h,
                              ffurl_read2, ffurl_write2, ffurl_seek2);
     if (!*sp) {
-        av_freep(&buffer);
+        if (mapping)
+            av_buffer_unref(&mapping);
+        else
+            av_freep(&buffer);
         return AVERROR(ENOMEM);
     }
     s = *sp;
+    ffiocontext(s)->mapping = mapping;
     if (h->protocol_whitelist) {
         s->protocol_whitelist = av_strdup(h->protocol_whitelist);
         if (!s->protocol_whitelist) {
@@ -626,6 +638,9 @@ int avio_close(AVIOContext *s)
     h         = s->opaque;
     s->opaque = NULL;
 
+    if (ctx->mapping)
+        s->buffer = NULL;
+    av_buffer_unref(&ctx->mapping);
     av_freep(&s->buffer);
     if (s->write_flag)
         av_log(s, AV_LOG_VERBOSE,
@@ -844,6 +859,27 @@ int ffurl_get_short_seek(void *urlcontext)
     return h->prot->url_get_short_seek(h);
 }
 
+int ffurl_get_mapping(URLContext *h, AVBufferRef **buf)
+{
+    if (!h || !h->prot || !h->prot->url_get_mapping)
+        return AVERROR(ENOSYS);
+    return h->prot->url_get_mapping(h, buf);
+}
+
+int ffurl_flush(URLContext *h)
+{
+    if (!h || !h->prot || !h->prot->url_flush)
+        return 0;
+    return h->prot->url_flush(h);
+}
+
+int ffurl_map_range(URLContext *h, int64_t pos, int size, AVBufferRef **buf)
+{
+    if (!h || !h->prot || !h->prot->url_map_range)
+        return AVERROR(ENOSYS);
+    return h->prot->url_map_range(h, pos, size, buf);
+}
+
 int ffurl_shutdown(URLContext *h, int flags)
 {
     if (!h || !h->prot || !h->prot->url_shutdown)
@@ -21,6 +21,7 @@
 
 #include "avio.h"
 
+#include "libavutil/buffer.h"
 #include "libavutil/log.h"
 
 extern const AVClass ff_avio_class;
@@ -76,6 +77,18 @@ typedef struct FFIOContext {
      * is updated each time a successful writeout ends up further position-wise
      */
     int64_t written_output_size;
+
+    /**
+     * Read-only mapping of the whole input, if the protocol provides one.
+     * The buffer is then a window into the mapping and is never written to.
+     */
+    AVBufferRef *mapping;
+
+    /**
+     * Set if the demuxer does not write to the packets it gets from
+     * av_get_packet(), which may then reference the mapping.
+     */
+    int readonly_packets;
 } FFIOContext;
 
 static av_always_inline FFIOContext *ffiocontext(AVIOContext *ctx)
@@ -119,6 +132,16 @@ void ffio_init_write_context(FFIOContext *s, uint8_t *buffer, int buffer_size);
  */
 int ffio_read_indirect(AVIOContext *s, unsigned char *buf, int size, const unsigned char **data);
 
+/**
+ * Read size bytes from a mapped AVIOContext as a mapping of their own,
+ * without copying. The data is followed by zeroed padding.
+ *
+ * @param buf set to a read-only reference to the data read
+ * @return number of bytes read, AVERROR(ENOSYS) if the input is not mapped
+ *         or size is too small to be worth mapping, or another AVERROR
+ */
+int ffio_read_mapped(AVIOContext *s, AVBufferRef **buf, int size);
+
 void ffio_fill(AVIOContext *s, int b, int64_t count);
 
 static av_always_inline void ffio_wfourcc(AVIOContext *pb, const uint8_t *s)
@@ -31,10 +31,17 @@
 #include "avio.h"
 #include "avio_internal.h"
 #include "internal.h"
+#include "url.h"
 #include <stdarg.h>
 
 #define IO_BUFFER_SIZE 32768
 
+/* Largest part of a mapped input used as the buffer at once */
+#define MAP_WINDOW_SIZE (1 << 30)
+
+/* Smallest packet read from a mapped input without copying */
+#define MAP_PACKET_MIN_SIZE (64 << 10)
+
 /**
  * Do seeks within this distance ahead of the current buffer by skipping
  * data instead of calling the protocol seek function, for seekable
@@ -224,6 +231,11 @@ void avio_flush(AVIOContext *s)
 {
     int seekback = s->write_flag ? FFMIN(0, s->buf_ptr - s->buf_ptr_max) : 0;
     flush_buffer(s);
+    if (s->write_flag && !s->error) {
+        int ret = ffurl_flush(ffio_geturlcontext(s));
+        if (ret < 0)
+            s->error = ret;
+    }
     if (seekback)
         avio_seek(s, seekback, SEEK_CUR);
 }
@@ -274,6 +286,11 @@ int64_t avio_seek(AVIOContext *s, int64_t offset, int whence)
         offset1 >= 0 && offset1 <= (s->write_flag ? s->buf_ptr_max - s->buffer : buffer_size)) {
         /* can do the seek inside the buffer */
         s->buf_ptr = s->buffer + offset1;
+    } else if (ctx->mapping && offset <= (int64_t)ctx->mapping->size) {
+        /* just move the window, the protocol position is never used */
+        s->buf_end =
+        s->buf_ptr = s->buffer;
+        s->pos = offset;
     } else if ((!(s->seekable & AVIO_SEEKABLE_NORMAL) ||
                offset1 <= buffer_size + short_seek) &&
                !s->write_flag && offset1 >= 0 &&
@@ -525,6 +542,33 @@ static void fill_buffer(AVIOContext *s)
     if (s->eof_reached)
         return;
 
+    if (ctx->mapping) {
+        /* move the window forward, keeping the unread data in it */
+        int64_t size  = ctx->mapping->size;
+        int64_t start = s->pos - (s->buf_end - s->buf_ptr);
+
+        if (s->pos >= size) {
+            s->eof_reached = 1;
+            return;
+        }
+        if (s->update_checksum && s->buf_end > s->checksum_ptr)
+            s->checksum = s->update_checksum(s->checksum, s->checksum_ptr,
+                                             s->buf_end - s->checksum_ptr);
+        if (s->pos - start >= MAP_WINDOW_SIZE)
+            start = s->pos;
+        len = FFMIN(size - start, MAP_WINDOW_SIZE);
+
+        s->buffer       =
+        s->buf_ptr      = ctx->mapping->data + start;
+        s->buffer_size  = len;
+        s->buf_end      = s->buffer + len;
+        s->checksum_ptr = s->buffer + (s->pos - start);
+        ctx->bytes_read += start + len - s->pos;
+        s->bytes_read   = ctx->bytes_read;
+        s->pos          = start + len;
+        return;
+    }
+
     if (s->update_checksum && dst == s->buffer) {
         if (s->buf_end > s->checksum_ptr)
             s->checksum = s->update_checksum(s->checksum, s->checksum_ptr,
@@ -617,7 +661,8 @@ int avio_read(AVIOContext *s, unsigned char *buf, int size)
     while (size > 0) {
         len = FFMIN(s->buf_end - s->buf_ptr, size);
         if (len == 0 || s->write_flag) {
-            if((s->direct || size > s->buffer_size) && !s->update_checksum && s->read_packet) {
+            if((s->direct || size > s->buffer_size) && !s->update_checksum && s->read_packet &&
+               !ffiocontext(s)->mapping) {
                 // bypass the buffer and read data directly into buf
                 len = read_packet_wrapper(s, buf, size);
                 if (len == AVERROR_EOF) {
@@ -671,16 +716,61 @@ int ffio_read_size(AVIOContext *s, unsigned char *buf, int size)
 
 int ffio_read_indirect(AVIOContext *s, unsigned char *buf, int size, const unsigned char **data)
 {
+    FFIOContext *const ctx = ffiocontext(s);
+    int64_t pos;
+
     if (s->buf_end - s->buf_ptr >= size && !s->write_flag) {
         *data = s->buf_ptr;
         s->buf_ptr += size;
         return size;
+    } else if (ctx->mapping && size >= 0 && (pos = avio_tell(s)) >= 0 &&
+               pos <= (int64_t)ctx->mapping->size - size) {
+        /* across the end of the window */
+        int64_t ret = avio_skip(s, size);
+        if (ret < 0)
+            return ret;
+        *data = ctx->mapping->data + pos;
+        return size;
     } else {
         *data = buf;
         return avio_read(s, buf, size);
     }
 }
 
+int ffio_read_mapped(AVIOContext *s, AVBufferRef **buf, int size)
+{
+    FFIOContext *const ctx = ffiocontext(s);
+    AVBufferRef *ref;
+    int64_t pos, ret;
+
+    /* small packets are cheaper to copy than to map */
+    if (!ctx->mapping || size < MAP_PACKET_MIN_SIZE)
+        return AVERROR(ENOSYS);
+
+    pos = avio_tell(s);
+    if (pos < 0)
+        return pos;
+    if (pos >= (int64_t)ctx->mapping->size) {
+        s->eof_reached = 1;
+        return AVERROR_EOF;
+    }
+    size = FFMIN(size, (int64_t)ctx->mapping->size - pos);
+
+    /* the packet gets a mapping of its own, as the data following it in
+     * the mapping of the whole input cannot serve as zeroed padding */
+    ret = ffurl_map_range(ffio_geturlcontext(s), pos, size, &ref);
+    if (ret < 0)
+        return ret;
+
+    ret = avio_skip(s, size);
+    if (ret < 0) {
+        av_buffer_unref(&ref);
+        return ret;
+    }
+    *buf = ref;
+    return size;
+}
+
 int avio_read_partial(AVIOContext *s, unsigned char *buf, int size)
 {
     int len;
@@ -1087,6 +1177,11 @@ int ffio_limit(AVIOContext *s, int size)
 static int set_buf_size(AVIOContext *s, int buf_size)
 {
     uint8_t *buffer;
+
+    /* the window into the mapping is large enough */
+    if (ffiocontext(s)->mapping)
+        return 0;
+
     buffer = av_malloc(buf_size);
     if (!buffer)
         return AVERROR(ENOMEM);
@@ -1105,6 +1200,9 @@ int ffio_realloc_buf(AVIOContext *s, int buf_size)
     uint8_t *buffer;
     int data_size;
 
+    if (ffiocontext(s)->mapping)
+        return 0;
+
     if (!s->buffer_size)
         return set_buf_size(s, buf_size);
 
@@ -1157,6 +1255,16 @@ int ffio_rewind_with_probe_data(AVIOContext *s, unsigned char **bufp, int buf_si
         return AVERROR(EINVAL);
     }
 
+    /* the probe data is still in the mapping */
+    if (ffiocontext(s)->mapping) {
+        av_freep(bufp);
+        s->buf_end =
+        s->buf_ptr = s->buffer;
+        s->pos = 0;
+        s->eof_reached = 0;
+        return 0;
+    }
+
     buffer_size = s->buf_end - s->buffer;
 
     /* the buffers must touch or overlap */
@@ -30,6 +30,7 @@
 #include "avio_internal.h"
 #include "dash.h"
 #include "demux.h"
+#include "segment_prefetch.h"
 #include "url.h"
 
 #define INITIAL_BUFFER_SIZE 32768
@@ -80,6 +81,8 @@ struct representation {
     char *url_template;
     FFIOContext pb;
     AVIOContext *input;
+    /* current fragment, read from the prefetch pool instead of input */
+    PrefetchedSegment *prefetched;
     AVFormatContext *parent;
     AVFormatContext *ctx;
     int stream_index;
@@ -154,6 +157,10 @@ typedef struct DASHContext {
     AVDictionary *avio_opts;
     int max_url_size;
     char *cenc_decryption_key;
+    int prefetch_segments;
+    int prefetch_connections;
+    int64_t prefetch_max_size;
+    SegmentPrefetch *prefetch;
 
     /* Flags for init section*/
     int is_init_section_common_video;
@@ -348,6 +355,14 @@ static void free_timelines_list(struct representation *pls)
     pls->n_timelines = 0;
 }
 
+static void close_input(struct representation *pls)
+{
+    DASHContext *c = pls->parent->priv_data;
+
+    ff_format_io_close(pls->parent, &pls->input);
+    ff_segment_prefetch_release(c->prefetch, &pls->prefetched);
+}
+
 static void free_representation(struct representation *pls)
 {
     free_fragment_list(pls);
@@ -356,7 +371,7 @@ static void free_representation(struct representation *pls)
     free_fragment(&pls->init_section);
     av_freep(&pls->init_sec_buf);
     av_freep(&pls->pb.pub.buffer);
-    ff_format_io_close(pls->parent, &pls->input);
+    close_input(pls);
     if (pls->ctx) {
         pls->ctx->pb = NULL;
         avformat_close_input(&pls->ctx);
@@ -1668,19 +1683,138 @@ static struct fragment *get_current_fragment(struct representation *pls)
 static int read_from_url(struct representation *pls, struct fragment *seg,
                          uint8_t *buf, int buf_size)
 {
+    DASHContext *c = pls->parent->priv_data;
     int ret;
 
     /* limit read if the fragment was only a part of a file */
     if (seg->size >= 0)
         buf_size = FFMIN(buf_size, pls->cur_seg_size - pls->cur_seg_offset);
 
-    ret = avio_read(pls->input, buf, buf_size);
+    if (pls->prefetched)
+        ret = ff_segment_prefetch_read(c->prefetch, pls->prefetched, buf, buf_size);
+    else
+        ret = avio_read(pls->input, buf, buf_size);
     if (ret > 0)
         pls->cur_seg_offset += ret;
 
     return ret;
 }
 
+/* Byte ranges of fragments without initialization section are read
+ * through seek_data(), which needs an actual input. */
+static int use_prefetch(DASHContext *c, struct representation *pls)
+{
+    return c->prefetch && !(pls->n_fragments && !pls->init_sec_data_len);
+}
+
+static void prefetch_fragment(DASHContext *c, const char *url,
+                              int64_t offset, int64_t size)
+{
+    AVDictionary *opts = NULL;
+
+    if (av_dict_copy(&opts, c->avio_opts, 0) < 0)
+        goto end;
+    if (size >= 0) {
+        av_dict_set_int(&opts, "offset", offset, 0);
+        av_dict_set_int(&opts, "end_offset", offset + size, 0);
+    }
+    ff_segment_prefetch_add(c->prefetch, url, offset, size, opts);
+end:
+    av_dict_free(&opts);
+}
+
+/* Queue the downloads of the fragments following the current one */
+static void prefetch_fragments(DASHContext *c, struct representation *pls)
+{
+    char *url, *tmp;
+
+    if (!use_prefetch(c, pls))
+        return;
+
+    url = av_malloc(c->max_url_size);
+    tmp = av_malloc(c->max_url_size);
+    if (!url || !tmp)
+        goto end;
+
+    for (int i = 1; i <= c->prefetch_segments; i++) {
+        int64_t seq_no = pls->cur_seq_no + i;
+        int64_t offset = 0, size = -1;
+
+        if (pls->n_fragments) {
+            const struct fragment *frag;
+
+            if (seq_no >= pls->n_fragments)
+                break;
+            frag = pls->fragments[seq_no];
+            offset = frag->url_offset;
+            size   = frag->size;
+            ff_make_absolute_url(url, c->max_url_size, c->base_url, frag->url);
+        } else if (!c->is_live && pls->url_template && seq_no <= pls->last_seq_no) {
+            ff_dash_fill_tmpl_params(tmp, c->max_url_size, pls->url_template, 0, seq_no, 0,
+                                     get_segment_start_time_based_on_timeline(pls, seq_no));
+            ff_make_absolute_url(url, c->max_url_size, c->base_url, tmp);
+        } else {
+            break;
+        }
+        if (!ishttp(url))
+            break;
+
+        prefetch_fragment(c, url, offset, size);
+    }
+
+end:
+    av_free(url);
+    av_free(tmp);
+}
+
+static void prefetch_init_sections(DASHContext *c, struct representation **reps,
+                                   int n_reps, int is_common)
+{
+    char *url;
+
+    if (!c->prefetch)
+        return;
+
+    url = av_malloc(c->max_url_size);
+    if (!url)
+        return;
+    for (int i = 0; i < (is_common ? FFMIN(n_reps, 1) : n_reps); i++) {
+        const struct fragment *init_section = reps[i]->init_section;
+
+        if (!init_section)
+            continue;
+        ff_make_absolute_url(url, c->max_url_size, c->base_url, init_section->url);
+        if (ishttp(url))
+            prefetch_fragment(c, url, init_section->url_offset, init_section->size);
+    }
+    av_free(url);
+}
+
+/* Take a fragment out of the prefetch pool, if it was downloaded ahead */
+static int open_prefetched(DASHContext *c, struct representation *pls, struct fragment *seg)
+{
+    char *url;
+
+    if (!c->prefetch || (seg != pls->init_section && !use_prefetch(c, pls)))
+        return 0;
+
+    url = av_malloc(c->max_url_size);
+    if (!url)
+        return 0;
+    ff_make_absolute_url(url, c->max_url_size, c->base_url, seg->url);
+    pls->prefetched = ff_segment_prefetch_take(c->prefetch, url, seg->url_offset, seg->size);
+    if (pls->prefetched)
+        av_log(pls->parent, AV_LOG_VERBOSE, "DASH prefetched url '%s', offset %"PRId64"\n",
+               url, seg->url_offset);
+    av_free(url);
+    if (!pls->prefetched)
+        return 0;
+
+    pls->cur_seg_offset = 0;
+    pls->cur_seg_size = seg->size;
+    return 1;
+}
+
 static int open_input(DASHContext *c, struct representation *pls, struct fragment *seg)
 {
     AVDictionary *opts = NULL;
@@ -1724,16 +1858,18 @@ static int update_init_section(struct representation *pls)
     if (!pls->init_section || pls->init_sec_buf)
         return 0;
 
-    ret = open_input(c, pls, pls->init_section);
-    if (ret < 0) {
-        av_log(pls->parent, AV_LOG_WARNING,
-               "Failed to open an initialization section\n");
-        return ret;
+    if (!open_prefetched(c, pls, pls->init_section)) {
+        ret = open_input(c, pls, pls->init_section);
+        if (ret < 0) {
+            av_log(pls->parent, AV_LOG_WARNING,
+                   "Failed to open an initialization section\n");
+            return ret;
+        }
     }
 
     if (pls->init_section->size >= 0)
         sec_size = pls->init_section->size;
-    else if ((urlsize = avio_size(pls->input)) >= 0)
+    else if (!pls->prefetched && (urlsize = avio_size(pls->input)) >= 0)
         sec_size = urlsize;
     else
         sec_size = max_init_section_size;
@@ -1748,7 +1884,7 @@ static int update_init_section(struct representation *pls)
 
     ret = read_from_url(pls, pls->init_section, pls->init_sec_buf,
                         pls->init_sec_buf_size);
-    ff_format_io_close(pls->parent, &pls->input);
+    close_input(pls);
 
     if (ret < 0)
         return ret;
@@ -1776,7 +1912,7 @@ static int read_data(void *opaque, uint8_t *buf, int buf_size)
     DASHContext *c = v->parent->priv_data;
 
 restart:
-    if (!v->input) {
+    if (!v->input && !v->prefetched) {
         free_fragment(&v->cur_seg);
         v->cur_seg = get_current_fragment(v);
         if (!v->cur_seg) {
@@ -1789,7 +1925,10 @@ restart:
         if (ret)
             goto end;
 
-        ret = open_input(c, v, v->cur_seg);
+        if (open_prefetched(c, v, v->cur_seg))
+            ret = 0;
+        else
+            ret = open_input(c, v, v->cur_seg);
         if (ret < 0) {
             if (ff_check_interrupt(c->interrupt_callback)) {
                 ret = AVERROR_EXIT;
@@ -1799,6 +1938,7 @@ restart:
             v->cur_seq_no++;
             goto restart;
         }
+        prefetch_fragments(c, v);
     }
 
     if (v->init_sec_buf_read_offset < v->init_sec_data_len) {
@@ -2039,6 +2179,21 @@ static int dash_read_header(AVFormatContext *s)
 
     if(c->n_videos)
         c->is_init_section_common_video = is_common_init_section_exist(c->videos, c->n_videos);
+    if(c->n_audios)
+        c->is_init_section_common_audio = is_common_init_section_exist(c->audios, c->n_audios);
+    if (c->n_subtitles)
+        c->is_init_section_common_subtitle = is_common_init_section_exist(c->subtitles, c->n_subtitles);
+
+    if (c->prefetch_segments > 0) {
+        ret = ff_segment_prefetch_alloc(&c->prefetch, s, c->prefetch_connections,
+                                        c->prefetch_max_size);
+        if (ret < 0 && ret != AVERROR(ENOSYS))
+            return ret;
+        /* The initialization sections are read one after the other below */
+        prefetch_init_sections(c, c->videos, c->n_videos, c->is_init_section_common_video);
+        prefetch_init_sections(c, c->audios, c->n_audios, c->is_init_section_common_audio);
+        prefetch_init_sections(c, c->subtitles, c->n_subtitles, c->is_init_section_common_subtitle);
+    }
 
     /* Open the demuxer for video and audio components if available */
     for (i = 0; i < c->n_videos; i++) {
@@ -2056,9 +2211,6 @@ static int dash_read_header(AVFormatContext *s)
         ++stream_index;
     }
 
-    if(c->n_audios)
-        c->is_init_section_common_audio = is_common_init_section_exist(c->audios, c->n_audios);
-
     for (i = 0; i < c->n_audios; i++) {
         rep = c->audios[i];
         if (i > 0 && c->is_init_section_common_audio) {
@@ -2074,9 +2226,6 @@ static int dash_read_header(AVFormatContext *s)
         ++stream_index;
     }
 
-    if (c->n_subtitles)
-        c->is_init_section_common_subtitle = is_common_init_section_exist(c->subtitles, c->n_subtitles);
-
     for (i = 0; i < c->n_subtitles; i++) {
         rep = c->subtitles[i];
         if (i > 0 && c->is_init_section_common_subtitle) {
@@ -2147,7 +2296,7 @@ static void recheck_discard_flags(AVFormatContext *s, struct representation **p,
             av_log(s, AV_LOG_INFO, "Now receiving stream_index %d\n", pls->stream_index);
         } else if (!needed && pls->ctx) {
             close_demux_for_component(pls);
-            ff_format_io_close(pls->parent, &pls->input);
+            close_input(pls);
             av_log(s, AV_LOG_INFO, "No longer receiving stream_index %d\n", pls->stream_index);
         }
     }
@@ -2209,7 +2358,7 @@ static int dash_read_packet(AVFormatContext *s, AVPacket *pkt)
             cur->cur_seg_offset = 0;
             cur->init_sec_buf_read_offset = 0;
             cur->is_restart_needed = 0;
-            ff_format_io_close(cur->parent, &cur->input);
+            close_input(cur);
             ret = reopen_demux_for_component(s, cur);
         }
     }
@@ -2222,6 +2371,7 @@ static int dash_close(AVFormatContext *s)
     free_audio_list(c);
     free_video_list(c);
     free_subtitle_list(c);
+    ff_segment_prefetch_free(&c->prefetch);
     av_dict_free(&c->avio_opts);
     av_freep(&c->base_url);
     return 0;
@@ -2247,7 +2397,7 @@ static int dash_seek(AVFormatContext *s, struct representation *pls, int64_t see
         return av_seek_frame(pls->ctx, -1, seek_pos_msec * 1000, flags);
     }
 
-    ff_format_io_close(pls->parent, &pls->input);
+    close_input(pls);
 
     // find the nearest fragment
     if (pls->n_timelines > 0 && pls->fragment_timescale > 0) {
@@ -2302,6 +2452,8 @@ static int dash_read_seek(AVFormatContext *s, int stream_index, int64_t timestam
     if ((flags & AVSEEK_FLAG_BYTE) || c->is_live)
         return AVERROR(ENOSYS);
 
+    ff_segment_prefetch_flush(c->prefetch);
+
     /* Seek in discarded streams with dry_run=1 to avoid reopening them */
     for (i = 0; i < c->n_videos; i++) {
         if (!ret)
@@ -2346,6 +2498,12 @@ static const AVOption dash_options[] = {
         {.str = "aac,m4a,m4s,m4v,mov,mp4,webm,ts"},
         INT_MIN, INT_MAX, FLAGS},
     { "cenc_decryption_key", "Media decryption key (hex)", OFFSET(cenc_decryption_key), AV_OPT_TYPE_STRING, {.str = NULL}, INT_MIN, INT_MAX, .flags = FLAGS },
+    {"prefetch_segments", "Number of segments to download ahead of the one being read",
+        OFFSET(prefetch_segments), AV_OPT_TYPE_INT, {.i64 = 0}, 0, 64, FLAGS},
+    {"prefetch_connections", "Maximum number of segments downloaded at the same time",
+        OFFSET(prefetch_connections), AV_OPT_TYPE_INT, {.i64 = 4}, 1, 32, FLAGS},
+    {"prefetch_max_size", "Maximum amount of data downloaded ahead",
+        OFFSET(prefetch_max_size), AV_OPT_TYPE_INT64, {.i64 = 64 << 20}, 1 << 20, INT64_MAX, FLAGS},
     {NULL}
 };
 
@@ -301,6 +301,9 @@ int avformat_open_input(AVFormatContext **ps, const char *filename,
     if (s->pb)
         ff_id3v2_read_dict(s->pb, &si->id3v2_meta, ID3v2_DEFAULT_MAGIC, &id3v2_extra_meta);
 
+    if (s->pb && ffifmt(s->iformat)->flags_internal & FF_INFMT_FLAG_READONLY_PACKETS)
+        ffiocontext(s->pb)->readonly_packets = 1;
+
     if (ffifmt(s->iformat)->read_header)
         if ((ret = ffifmt(s->iformat)->read_header(s)) < 0) {
             if (ffifmt(s->iformat)->flags_internal & FF_INFMT_FLAG_INIT_CLEANUP)
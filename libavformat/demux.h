@@ -34,6 +34,13 @@ struct AVDeviceInfoList;
  */
 #define FF_INFMT_FLAG_INIT_CLEANUP                             (1 << 0)
 
+/**
+ * The demuxer does not write to the data of the packets returned by
+ * av_get_packet() without making them writable first, so that these can
+ * reference a memory mapped input instead of a copy of it.
+ */
+#define FF_INFMT_FLAG_READONLY_PACKETS                         (1 << 1)
+
 typedef struct FFInputFormat {
     /**
      * The public AVInputFormat. See avformat.h for it.
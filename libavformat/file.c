@@ -19,6 +19,8 @@
  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
  */
 
+#define _DEFAULT_SOURCE /* Needed for MAP_ANONYMOUS */
+
 #include "config_components.h"
 
 #include "libavutil/avstring.h"
@@ -26,6 +28,7 @@
 #include "libavutil/internal.h"
 #include "libavutil/mem.h"
 #include "libavutil/opt.h"
+#include "libavcodec/defs.h"
 #include "avio.h"
 #if HAVE_DIRENT_H
 #include <dirent.h>
@@ -37,8 +40,12 @@
 #if HAVE_UNISTD_H
 #include <unistd.h>
 #endif
+#if HAVE_MMAP
+#include <sys/mman.h>
+#endif
 #include <sys/stat.h>
 #include <stdlib.h>
+#include "file_aio.h"
 #include "os_support.h"
 #include "url.h"
 
@@ -96,6 +103,13 @@ typedef struct FileContext {
     int blocksize;
     int follow;
     int seekable;
+    int aio;
+    int aio_depth;
+    int aio_block_size;
+    int direct;
+    FileAIO *aio_ctx;
+    int use_mmap;
+    AVBufferRef *map;
 #if HAVE_DIRENT_H
     DIR *dir;
 #endif
@@ -106,6 +120,11 @@ static const AVOption file_options[] = {
     { "blocksize", "set I/O operation maximum block size", offsetof(FileContext, blocksize), AV_OPT_TYPE_INT, { .i64 = INT_MAX }, 1, INT_MAX, AV_OPT_FLAG_ENCODING_PARAM },
     { "follow", "Follow a file as it is being written", offsetof(FileContext, follow), AV_OPT_TYPE_INT, { .i64 = 0 }, 0, 1, AV_OPT_FLAG_DECODING_PARAM },
     { "seekable", "Sets if the file is seekable", offsetof(FileContext, seekable), AV_OPT_TYPE_INT, { .i64 = -1 }, -1, 0, AV_OPT_FLAG_DECODING_PARAM | AV_OPT_FLAG_ENCODING_PARAM },
+    { "aio", "read ahead or write behind asynchronously", offsetof(FileContext, aio), AV_OPT_TYPE_BOOL, { .i64 = 0 }, 0, 1, AV_OPT_FLAG_DECODING_PARAM | AV_OPT_FLAG_ENCODING_PARAM },
+    { "aio_depth", "set the number of asynchronous requests in flight", offsetof(FileContext, aio_depth), AV_OPT_TYPE_INT, { .i64 = 8 }, 1, 64, AV_OPT_FLAG_DECODING_PARAM | AV_OPT_FLAG_ENCODING_PARAM },
+    { "aio_block_size", "set the size of an asynchronous request", offsetof(FileContext, aio_block_size), AV_OPT_TYPE_INT, { .i64 = 1 << 18 }, FILE_AIO_ALIGN, 1 << 26, AV_OPT_FLAG_DECODING_PARAM | AV_OPT_FLAG_ENCODING_PARAM },
+    { "direct", "bypass the page cache when reading asynchronously", offsetof(FileContext, direct), AV_OPT_TYPE_BOOL, { .i64 = 0 }, 0, 1, AV_OPT_FLAG_DECODING_PARAM },
+    { "mmap", "read the file through a memory mapping", offsetof(FileContext, use_mmap), AV_OPT_TYPE_BOOL, { .i64 = 0 }, 0, 1, AV_OPT_FLAG_DECODING_PARAM },
     { NULL }
 };
 
@@ -141,6 +160,8 @@ static int file_read(URLContext *h, unsigned char *buf, int size)
     FileContext *c = h->priv_data;
     int ret;
     size = FFMIN(size, c->blocksize);
+    if (c->aio_ctx)
+        return ff_file_aio_read(c->aio_ctx, buf, size);
     ret = read(c->fd, buf, size);
     if (ret == 0 && c->follow)
         return AVERROR(EAGAIN);
@@ -154,10 +175,22 @@ static int file_write(URLContext *h, const unsigned char *buf, int size)
     FileContext *c = h->priv_data;
     int ret;
     size = FFMIN(size, c->blocksize);
+    if (c->aio_ctx) {
+        ret = ff_file_aio_write(c->aio_ctx, buf, size);
+        return ret < 0 ? ret : size;
+    }
     ret = write(c->fd, buf, size);
     return (ret == -1) ? AVERROR(errno) : ret;
 }
 
+/* Called by avio_flush(), after which the data must be visible to other
+ * readers of the file, e.g. in ff_format_shift_data(). */
+static int file_flush(URLContext *h)
+{
+    FileContext *c = h->priv_data;
+    return c->aio_ctx ? ff_file_aio_flush(c->aio_ctx) : 0;
+}
+
 static int file_get_handle(URLContext *h)
 {
     FileContext *c = h->priv_data;
@@ -221,7 +254,11 @@ static int fd_dup(URLContext *h, int oldfd)
 static int file_close(URLContext *h)
 {
     FileContext *c = h->priv_data;
+    int aio_ret = ff_file_aio_close(&c->aio_ctx);
     int ret = close(c->fd);
+    av_buffer_unref(&c->map);
+    if (aio_ret < 0)
+        return aio_ret;
     return (ret == -1) ? AVERROR(errno) : 0;
 }
 
@@ -231,12 +268,33 @@ static int64_t file_seek(URLContext *h, int64_t pos, int whence)
     FileContext *c = h->priv_data;
     int64_t ret;
 
+    if (c->aio_ctx && (whence == AVSEEK_SIZE || whence == SEEK_END)) {
+        /* the size must include the writes still in flight */
+        ret = ff_file_aio_flush(c->aio_ctx);
+        if (ret < 0)
+            return ret;
+    }
+
     if (whence == AVSEEK_SIZE) {
         struct stat st;
         ret = fstat(c->fd, &st);
         return ret < 0 ? AVERROR(errno) : (S_ISFIFO(st.st_mode) ? 0 : st.st_size);
     }
 
+    if (c->aio_ctx) {
+        if (whence == SEEK_CUR) {
+            pos += ff_file_aio_tell(c->aio_ctx);
+        } else if (whence == SEEK_END) {
+            struct stat st;
+            if (fstat(c->fd, &st) < 0)
+                return AVERROR(errno);
+            pos += st.st_size;
+        }
+        if (pos < 0)
+            return AVERROR(EINVAL);
+        return ff_file_aio_seek(c->aio_ctx, pos);
+    }
+
     ret = lseek(c->fd, pos, whence);
 
     return ret < 0 ? AVERROR(errno) : ret;
@@ -280,6 +338,111 @@ static int file_move(URLContext *h_src, URLContext *h_dst)
     return 0;
 }
 
+#if HAVE_MMAP && defined(MAP_ANONYMOUS)
+static void file_unmap(void *opaque, uint8_t *data)
+{
+    munmap(data, (size_t)(uintptr_t)opaque);
+}
+
+/* data may start anywhere in the first page of the mapping */
+static void file_unmap_range(void *opaque, uint8_t *data)
+{
+    const size_t page = sysconf(_SC_PAGESIZE);
+
+    munmap(data - (uintptr_t)data % page, (size_t)(uintptr_t)opaque);
+}
+#endif
+
+static int file_map(URLContext *h, int64_t size)
+{
+#if HAVE_MMAP && defined(MAP_ANONYMOUS)
+    FileContext *c = h->priv_data;
+    size_t len;
+    uint8_t *map;
+    int ret;
+
+    if (size > SIZE_MAX - AV_INPUT_BUFFER_PADDING_SIZE)
+        return AVERROR(ENOMEM);
+    len = size + AV_INPUT_BUFFER_PADDING_SIZE;
+
+    /* Map the file over zeroed anonymous memory, so that the padding after
+     * its end can be read even when the file ends on a page boundary. */
+    map = mmap(NULL, len, PROT_READ, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (map == MAP_FAILED)
+        return AVERROR(errno);
+    if (mmap(map, size, PROT_READ, MAP_SHARED | MAP_FIXED, c->fd, 0) == MAP_FAILED) {
+        ret = AVERROR(errno);
+        munmap(map, len);
+        return ret;
+    }
+
+    c->map = av_buffer_create(map, size, file_unmap, (void *)(uintptr_t)len,
+                              AV_BUFFER_FLAG_READONLY);
+    if (!c->map) {
+        munmap(map, len);
+        return AVERROR(ENOMEM);
+    }
+    return 0;
+#else
+    return AVERROR(ENOSYS);
+#endif
+}
+
+static int file_get_mapping(URLContext *h, AVBufferRef **buf)
+{
+    FileContext *c = h->priv_data;
+
+    if (!c->map)
+        return AVERROR(ENOSYS);
+    *buf = av_buffer_ref(c->map);
+    return *buf ? 0 : AVERROR(ENOMEM);
+}
+
+static int file_map_range(URLContext *h, int64_t pos, int size, AVBufferRef **buf)
+{
+#if HAVE_MMAP && defined(MAP_ANONYMOUS)
+    FileContext *c = h->priv_data;
+    const int64_t page = sysconf(_SC_PAGESIZE);
+    int64_t start, file_len;
+    size_t len, skip;
+    uint8_t *map, *data;
+
+    if (!c->map || page <= 0 || pos < 0 || size < 0 ||
+        pos > (int64_t)c->map->size - size)
+        return AVERROR(ENOSYS);
+
+    start    = pos - pos % page;
+    skip     = pos - start;
+    len      = skip + size + AV_INPUT_BUFFER_PADDING_SIZE;
+    file_len = FFMIN((int64_t)len, (int64_t)c->map->size - start);
+
+    /* A private mapping of its own, so that the padding can be zeroed;
+     * this only copies the last page or two. Past the end of the file, the
+     * zeroed anonymous memory below it is used like in file_map(). */
+    map = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (map == MAP_FAILED)
+        return AVERROR(errno);
+    if (mmap(map, file_len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED,
+             c->fd, start) == MAP_FAILED) {
+        int ret = AVERROR(errno);
+        munmap(map, len);
+        return ret;
+    }
+    data = map + skip;
+    memset(data + size, 0, AV_INPUT_BUFFER_PADDING_SIZE);
+
+    *buf = av_buffer_create(data, size, file_unmap_range, (void *)(uintptr_t)len,
+                            AV_BUFFER_FLAG_READONLY);
+    if (!*buf) {
+        munmap(map, len);
+        return AVERROR(ENOMEM);
+    }
+    return 0;
+#else
+    return AVERROR(ENOSYS);
+#endif
+}
+
 static int file_open(URLContext *h, const char *filename, int flags)
 {
     FileContext *c = h->priv_data;
@@ -303,7 +466,23 @@ static int file_open(URLContext *h, const char *filename, int flags)
 #ifdef O_BINARY
     access |= O_BINARY;
 #endif
-    fd = avpriv_open(filename, access, 0666);
+    /* asynchronous I/O is only done for sequential reading or writing */
+    if (c->aio && ((flags & AVIO_FLAG_READ_WRITE) == AVIO_FLAG_READ_WRITE || c->follow))
+        c->aio = 0;
+    fd = -1;
+#ifdef O_DIRECT
+    /* only the aligned asynchronous reads can bypass the page cache */
+    if (c->aio && c->direct && !(flags & AVIO_FLAG_WRITE)) {
+        fd = avpriv_open(filename, access | O_DIRECT, 0666);
+        if (fd == -1)
+            av_log(h, AV_LOG_WARNING, "Direct I/O not supported: %s\n",
+                   av_err2str(AVERROR(errno)));
+    }
+#endif
+    if (fd == -1) {
+        c->direct = 0;
+        fd = avpriv_open(filename, access, 0666);
+    }
     if (fd == -1)
         return AVERROR(errno);
     c->fd = fd;
@@ -318,6 +497,34 @@ static int file_open(URLContext *h, const char *filename, int flags)
     if (c->seekable >= 0)
         h->is_streamed = !c->seekable;
 
+    if (c->use_mmap && !(flags & AVIO_FLAG_WRITE) && !c->follow && !h->is_streamed &&
+        !fstat(fd, &st) && S_ISREG(st.st_mode) && st.st_size > 0) {
+        int ret = file_map(h, st.st_size);
+        if (ret < 0)
+            av_log(h, AV_LOG_WARNING, "Memory mapping not available: %s\n",
+                   av_err2str(ret));
+    }
+
+    if (c->aio && !c->map && !h->is_streamed && !fstat(fd, &st) &&
+        (S_ISREG(st.st_mode) || S_ISBLK(st.st_mode))) {
+        int ret = ff_file_aio_open(&c->aio_ctx, h, fd, !!(flags & AVIO_FLAG_WRITE),
+                                   c->aio_depth, c->aio_block_size, c->direct);
+        if (ret < 0)
+            av_log(h, AV_LOG_WARNING, "Asynchronous I/O not available: %s\n",
+                   av_err2str(ret));
+        else if (!(flags & AVIO_FLAG_WRITE))
+            /* let the AVIOContext refill its buffer in larger chunks */
+            h->max_packet_size = 262144;
+    }
+    if (c->direct && !c->aio_ctx) {
+        /* the plain reads are not aligned */
+        close(fd);
+        c->direct = 0;
+        c->fd = fd = avpriv_open(filename, access, 0666);
+        if (fd == -1)
+            return AVERROR(errno);
+    }
+
     return 0;
 }
 
@@ -413,6 +620,9 @@ const URLProtocol ff_file_protocol = {
     .url_seek            = file_seek,
     .url_close           = file_close,
     .url_get_file_handle = file_get_handle,
+    .url_get_mapping     = file_get_mapping,
+    .url_map_range       = file_map_range,
+    .url_flush           = file_flush,
     .url_check           = file_check,
     .url_delete          = file_delete,
     .url_move            = file_move,
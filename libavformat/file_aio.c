@@ -0,0 +1,622 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#define _DEFAULT_SOURCE /* Needed for syscall() and MAP_POPULATE */
+
+#include "config.h"
+
+#include <errno.h>
+#include <string.h>
+#include <sys/stat.h>
+#if HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+
+#if HAVE_LINUX_IO_URING_H
+#include <stdatomic.h>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#endif
+
+#include "libavutil/common.h"
+#include "libavutil/error.h"
+#include "libavutil/log.h"
+#include "libavutil/mem.h"
+#include "libavutil/thread.h"
+
+#include "file_aio.h"
+
+#define FILE_AIO_THREAD HAVE_PTHREADS
+
+enum BlockState {
+    BLOCK_IDLE,
+    BLOCK_PENDING,
+    BLOCK_DONE,
+};
+
+typedef struct FileAIOBlock {
+    uint8_t *data;
+    int64_t  pos;               ///< file offset of the block
+    int      size;              ///< number of bytes to read or write
+    int      result;            ///< bytes transferred or negative error code
+    enum BlockState state;
+    int      write;
+#if HAVE_LINUX_IO_URING_H
+    struct iovec iov;
+#endif
+} FileAIOBlock;
+
+#if HAVE_LINUX_IO_URING_H
+typedef struct IOURing {
+    int fd;
+    void  *sq_ring, *cq_ring;
+    size_t sq_ring_size, cq_ring_size;
+    struct io_uring_sqe *sqes;
+    size_t sqes_size;
+    unsigned *sq_head, *sq_tail, *sq_mask, *sq_array;
+    unsigned *cq_head, *cq_tail, *cq_mask;
+    struct io_uring_cqe *cqes;
+} IOURing;
+#endif
+
+struct FileAIO {
+    void *logctx;
+    int fd;
+    int write;
+    int direct;
+    int depth;
+    int block_size;
+    uint8_t *buf;
+    FileAIOBlock *blocks;
+
+    int head;                   ///< oldest block in use
+    int nb_blocks;              ///< number of blocks in use
+    int64_t pos;                ///< logical position
+    int64_t next_pos;           ///< file offset of the next block to read
+    int64_t restart_pos;        ///< position the read-ahead was last started at
+    int fill;                   ///< bytes written to the current block
+    int error;                  ///< first write error
+
+#if HAVE_LINUX_IO_URING_H
+    int use_uring;
+    IOURing ring;
+#endif
+#if FILE_AIO_THREAD
+    pthread_t thread;
+    int thread_started;
+    AVMutex mutex;
+    AVCond  cond;               ///< signals new requests to the thread
+    AVCond  done_cond;          ///< signals completed requests
+    int *queue;                 ///< block indices waiting for the thread
+    int queue_head, queue_len;
+    int exit;
+#endif
+};
+
+static int block_io(int fd, FileAIOBlock *b)
+{
+    int done = 0;
+
+    /* the positioned calls leave the file offset alone */
+    while (done < b->size) {
+        ssize_t ret = b->write ? pwrite(fd, b->data + done, b->size - done, b->pos + done)
+                               : pread (fd, b->data + done, b->size - done, b->pos + done);
+        if (ret < 0) {
+            if (errno == EINTR)
+                continue;
+            return done ? done : AVERROR(errno);
+        }
+        if (!ret)
+            break;
+        done += ret;
+        /* reads may stop early at the end of the file, writes may not */
+        if (!b->write)
+            break;
+    }
+    return done;
+}
+
+#if HAVE_LINUX_IO_URING_H
+static int uring_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags)
+{
+    int ret;
+
+    do {
+        ret = syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, NULL, 0);
+    } while (ret < 0 && errno == EINTR);
+    return ret < 0 ? AVERROR(errno) : ret;
+}
+
+static void uring_free(IOURing *r)
+{
+    if (r->sqes)
+        munmap(r->sqes, r->sqes_size);
+    if (r->cq_ring && r->cq_ring != r->sq_ring)
+        munmap(r->cq_ring, r->cq_ring_size);
+    if (r->sq_ring)
+        munmap(r->sq_ring, r->sq_ring_size);
+    if (r->fd >= 0)
+        close(r->fd);
+    memset(r, 0, sizeof(*r));
+    r->fd = -1;
+}
+
+static int uring_init(IOURing *r, unsigned entries)
+{
+    struct io_uring_params p = { 0 };
+    uint8_t *sq, *cq;
+
+    r->fd = syscall(__NR_io_uring_setup, entries, &p);
+    if (r->fd < 0)
+        return AVERROR(errno);
+
+    r->sq_ring_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    r->cq_ring_size = p.cq_off.cqes  + p.cq_entries * sizeof(struct io_uring_cqe);
+    if (p.features & IORING_FEAT_SINGLE_MMAP)
+        r->sq_ring_size = r->cq_ring_size = FFMAX(r->sq_ring_size, r->cq_ring_size);
+    r->sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+
+    r->sq_ring = mmap(NULL, r->sq_ring_size, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQ_RING);
+    if (r->sq_ring == MAP_FAILED) {
+        r->sq_ring = NULL;
+        goto fail;
+    }
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        r->cq_ring = r->sq_ring;
+    } else {
+        r->cq_ring = mmap(NULL, r->cq_ring_size, PROT_READ | PROT_WRITE,
+                          MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_CQ_RING);
+        if (r->cq_ring == MAP_FAILED) {
+            r->cq_ring = NULL;
+            goto fail;
+        }
+    }
+    r->sqes = mmap(NULL, r->sqes_size, PROT_READ | PROT_WRITE,
+                   MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQES);
+    if (r->sqes == MAP_FAILED) {
+        r->sqes = NULL;
+        goto fail;
+    }
+
+    sq = r->sq_ring;
+    cq = r->cq_ring;
+    r->sq_head  = (unsigned *)(sq + p.sq_off.head);
+    r->sq_tail  = (unsigned *)(sq + p.sq_off.tail);
+    r->sq_mask  = (unsigned *)(sq + p.sq_off.ring_mask);
+    r->sq_array = (unsigned *)(sq + p.sq_off.array);
+    r->cq_head  = (unsigned *)(cq + p.cq_off.head);
+    r->cq_tail  = (unsigned *)(cq + p.cq_off.tail);
+    r->cq_mask  = (unsigned *)(cq + p.cq_off.ring_mask);
+    r->cqes     = (struct io_uring_cqe *)(cq + p.cq_off.cqes);
+    return 0;
+fail:
+    {
+        int err = AVERROR(errno);
+        uring_free(r);
+        return err;
+    }
+}
+
+static void uring_submit(FileAIO *a, int idx)
+{
+    IOURing *r = &a->ring;
+    FileAIOBlock *b = &a->blocks[idx];
+    /* only this thread writes the tail, the kernel reads it */
+    unsigned tail = *r->sq_tail, i = tail & *r->sq_mask;
+    struct io_uring_sqe *sqe = &r->sqes[i];
+    int ret;
+
+    b->iov.iov_base = b->data;
+    b->iov.iov_len  = b->size;
+
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode    = b->write ? IORING_OP_WRITEV : IORING_OP_READV;
+    sqe->fd        = a->fd;
+    sqe->off       = b->pos;
+    sqe->addr      = (uintptr_t)&b->iov;
+    sqe->len       = 1;
+    sqe->user_data = idx;
+    r->sq_array[i] = i;
+    atomic_store_explicit((_Atomic unsigned *)r->sq_tail, tail + 1, memory_order_release);
+
+    ret = uring_enter(r->fd, 1, 0, 0);
+    if (ret < 0) {
+        /* nothing was consumed, take the entry back and do the I/O here */
+        atomic_store_explicit((_Atomic unsigned *)r->sq_tail, tail, memory_order_release);
+        b->result = block_io(a->fd, b);
+        b->state  = BLOCK_DONE;
+    }
+}
+
+/* Reap completions until block idx is done. */
+static void uring_wait(FileAIO *a, int idx)
+{
+    IOURing *r = &a->ring;
+
+    while (a->blocks[idx].state == BLOCK_PENDING) {
+        unsigned head = *r->cq_head;
+        unsigned tail = atomic_load_explicit((_Atomic unsigned *)r->cq_tail,
+                                             memory_order_acquire);
+        if (head == tail) {
+            int ret = uring_enter(r->fd, 0, 1, IORING_ENTER_GETEVENTS);
+            if (ret < 0) {
+                /* cannot wait for the kernel anymore, do the I/O again here */
+                FileAIOBlock *b = &a->blocks[idx];
+                av_log(a->logctx, AV_LOG_ERROR, "io_uring_enter() failed: %s\n",
+                       av_err2str(ret));
+                b->result = block_io(a->fd, b);
+                b->state  = BLOCK_DONE;
+            }
+            continue;
+        }
+        for (; head != tail; head++) {
+            const struct io_uring_cqe *cqe = &r->cqes[head & *r->cq_mask];
+            FileAIOBlock *b = &a->blocks[cqe->user_data];
+
+            b->result = cqe->res < 0 ? AVERROR(-cqe->res) : cqe->res;
+            b->state  = BLOCK_DONE;
+        }
+        atomic_store_explicit((_Atomic unsigned *)r->cq_head, head, memory_order_release);
+    }
+}
+#endif
+
+#if FILE_AIO_THREAD
+static void *aio_thread(void *arg)
+{
+    FileAIO *a = arg;
+
+    ff_thread_setname("file-aio");
+
+    ff_mutex_lock(&a->mutex);
+    while (1) {
+        FileAIOBlock *b;
+        int idx, result;
+
+        while (!a->queue_len && !a->exit)
+            ff_cond_wait(&a->cond, &a->mutex);
+        if (!a->queue_len)
+            break;
+        idx = a->queue[a->queue_head];
+        b   = &a->blocks[idx];
+        ff_mutex_unlock(&a->mutex);
+
+        result = block_io(a->fd, b);
+
+        ff_mutex_lock(&a->mutex);
+        b->result = result;
+        b->state  = BLOCK_DONE;
+        a->queue_head = (a->queue_head + 1) % a->depth;
+        a->queue_len--;
+        ff_cond_broadcast(&a->done_cond);
+    }
+    ff_mutex_unlock(&a->mutex);
+    return NULL;
+}
+#endif
+
+static void block_wait(FileAIO *a, int idx)
+{
+    FileAIOBlock *b = &a->blocks[idx];
+
+#if HAVE_LINUX_IO_URING_H
+    if (a->use_uring) {
+        uring_wait(a, idx);
+        goto done;
+    }
+#endif
+#if FILE_AIO_THREAD
+    ff_mutex_lock(&a->mutex);
+    while (b->state == BLOCK_PENDING)
+        ff_cond_wait(&a->done_cond, &a->mutex);
+    ff_mutex_unlock(&a->mutex);
+#endif
+#if HAVE_LINUX_IO_URING_H
+done:
+#endif
+    if (b->state == BLOCK_DONE && b->write) {
+        if (b->result >= 0 && b->result < b->size)
+            b->result = AVERROR(EIO);
+        if (b->result < 0 && !a->error)
+            a->error = b->result;
+    }
+    b->state = b->write ? BLOCK_IDLE : b->state;
+}
+
+static void block_submit(FileAIO *a, int idx, int64_t pos, int size)
+{
+    FileAIOBlock *b = &a->blocks[idx];
+
+    /* the kernel or the thread may still use the buffer */
+    block_wait(a, idx);
+
+    b->pos    = pos;
+    b->size   = size;
+    b->result = 0;
+    b->state  = BLOCK_PENDING;
+    b->write  = a->write;
+
+#if HAVE_LINUX_IO_URING_H
+    if (a->use_uring) {
+        uring_submit(a, idx);
+        return;
+    }
+#endif
+#if FILE_AIO_THREAD
+    ff_mutex_lock(&a->mutex);
+    a->queue[(a->queue_head + a->queue_len) % a->depth] = idx;
+    a->queue_len++;
+    ff_cond_signal(&a->cond);
+    ff_mutex_unlock(&a->mutex);
+#endif
+}
+
+static void wait_all(FileAIO *a)
+{
+    for (int i = 0; i < a->depth; i++)
+        block_wait(a, i);
+}
+
+int ff_file_aio_open(FileAIO **pa, void *logctx, int fd, int write,
+                     int depth, int block_size, int direct)
+{
+#if HAVE_LINUX_IO_URING_H || FILE_AIO_THREAD
+    FileAIO *a;
+    int ret;
+
+    a = av_mallocz(sizeof(*a));
+    if (!a)
+        return AVERROR(ENOMEM);
+
+    a->logctx     = logctx;
+    a->fd         = fd;
+    a->write      = write;
+    a->direct     = direct;
+    a->depth      = FFMAX(depth, 1);
+    a->block_size = FFALIGN(FFMAX(block_size, 1), FILE_AIO_ALIGN);
+#if HAVE_LINUX_IO_URING_H
+    a->ring.fd    = -1;
+#endif
+
+    a->blocks = av_calloc(a->depth, sizeof(*a->blocks));
+    /* direct I/O needs buffers aligned to the logical block size */
+    a->buf    = av_malloc((size_t)a->depth * a->block_size + FILE_AIO_ALIGN);
+    if (!a->blocks || !a->buf) {
+        ret = AVERROR(ENOMEM);
+        goto fail;
+    }
+    for (int i = 0; i < a->depth; i++)
+        a->blocks[i].data = (uint8_t *)FFALIGN((uintptr_t)a->buf, FILE_AIO_ALIGN) +
+                            (size_t)i * a->block_size;
+
+#if HAVE_LINUX_IO_URING_H
+    ret = uring_init(&a->ring, a->depth);
+    if (ret >= 0) {
+        a->use_uring = 1;
+        *pa = a;
+        return 0;
+    }
+    av_log(logctx, AV_LOG_VERBOSE, "io_uring not available (%s), "
+           "using a thread\n", av_err2str(ret));
+#endif
+#if FILE_AIO_THREAD
+    a->queue = av_calloc(a->depth, sizeof(*a->queue));
+    if (!a->queue) {
+        ret = AVERROR(ENOMEM);
+        goto fail;
+    }
+    if ((ret = ff_mutex_init(&a->mutex, NULL))) {
+        ret = AVERROR(ret);
+        goto fail;
+    }
+    if ((ret = ff_cond_init(&a->cond, NULL))) {
+        ff_mutex_destroy(&a->mutex);
+        ret = AVERROR(ret);
+        goto fail;
+    }
+    if ((ret = ff_cond_init(&a->done_cond, NULL))) {
+        ff_cond_destroy(&a->cond);
+        ff_mutex_destroy(&a->mutex);
+        ret = AVERROR(ret);
+        goto fail;
+    }
+    if ((ret = pthread_create(&a->thread, NULL, aio_thread, a))) {
+        ff_cond_destroy(&a->done_cond);
+        ff_cond_destroy(&a->cond);
+        ff_mutex_destroy(&a->mutex);
+        ret = AVERROR(ret);
+        goto fail;
+    }
+    a->thread_started = 1;
+    *pa = a;
+    return 0;
+#else
+    ret = AVERROR(ENOSYS);
+#endif
+fail:
+#if FILE_AIO_THREAD
+    av_freep(&a->queue);
+#endif
+    av_freep(&a->blocks);
+    av_freep(&a->buf);
+    av_freep(&a);
+    return ret;
+#else
+    return AVERROR(ENOSYS);
+#endif
+}
+
+/* Drop the read-ahead and start reading again at the current position. */
+static void read_restart(FileAIO *a)
+{
+    a->nb_blocks   = 0;
+    a->next_pos    = a->direct ? a->pos & ~(int64_t)(FILE_AIO_ALIGN - 1) : a->pos;
+    a->restart_pos = a->pos;
+}
+
+int ff_file_aio_read(FileAIO *a, uint8_t *buf, int size)
+{
+    while (1) {
+        FileAIOBlock *b;
+        int64_t off;
+
+        /* keep depth blocks in flight */
+        while (a->nb_blocks < a->depth) {
+            block_submit(a, (a->head + a->nb_blocks) % a->depth,
+                         a->next_pos, a->block_size);
+            a->next_pos += a->block_size;
+            a->nb_blocks++;
+        }
+
+        b = &a->blocks[a->head];
+        block_wait(a, a->head);
+        if (b->result < 0) {
+            int err = b->result;
+            read_restart(a);
+            return err;
+        }
+
+        off = a->pos - b->pos;
+        if (off < b->result) {
+            int len = FFMIN(size, b->result - off);
+
+            memcpy(buf, b->data + off, len);
+            a->pos += len;
+            if (a->pos == b->pos + b->size) {
+                a->head = (a->head + 1) % a->depth;
+                a->nb_blocks--;
+            }
+            return len;
+        }
+
+        /* A short block is either the end of the file or a short read, the
+         * blocks after it do not follow it then. Read again from here and
+         * only stop if that read is short again. */
+        if (a->restart_pos == a->pos)
+            return AVERROR_EOF;
+        read_restart(a);
+    }
+}
+
+int ff_file_aio_write(FileAIO *a, const uint8_t *buf, int size)
+{
+    int done = 0;
+
+    while (done < size) {
+        FileAIOBlock *b = &a->blocks[a->head];
+        int len;
+
+        if (!a->fill)
+            block_wait(a, a->head);
+        if (a->error)
+            return a->error;
+
+        len = FFMIN(size - done, a->block_size - a->fill);
+        memcpy(b->data + a->fill, buf + done, len);
+        a->fill += len;
+        done    += len;
+        if (a->fill == a->block_size) {
+            block_submit(a, a->head, a->pos, a->fill);
+            a->head  = (a->head + 1) % a->depth;
+            a->pos  += a->fill;
+            a->fill  = 0;
+        }
+    }
+    return size;
+}
+
+int ff_file_aio_flush(FileAIO *a)
+{
+    if (a->write && a->fill) {
+        block_submit(a, a->head, a->pos, a->fill);
+        a->head  = (a->head + 1) % a->depth;
+        a->pos  += a->fill;
+        a->fill  = 0;
+    }
+    wait_all(a);
+    return a->error;
+}
+
+int64_t ff_file_aio_tell(const FileAIO *a)
+{
+    return a->pos + a->fill;
+}
+
+int64_t ff_file_aio_seek(FileAIO *a, int64_t pos)
+{
+    if (a->write) {
+        int ret = ff_file_aio_flush(a);
+        if (ret < 0)
+            return ret;
+        a->pos = pos;
+        return pos;
+    }
+
+    /* keep the blocks at and after pos */
+    while (a->nb_blocks) {
+        const FileAIOBlock *b = &a->blocks[a->head];
+
+        if (pos < b->pos)
+            break;
+        if (pos < b->pos + b->size) {
+            a->pos = pos;
+            return pos;
+        }
+        a->head = (a->head + 1) % a->depth;
+        a->nb_blocks--;
+    }
+    a->pos = pos;
+    read_restart(a);
+    return pos;
+}
+
+int ff_file_aio_close(FileAIO **pa)
+{
+    FileAIO *a = *pa;
+    int ret;
+
+    if (!a)
+        return 0;
+
+    ret = ff_file_aio_flush(a);
+
+#if HAVE_LINUX_IO_URING_H
+    if (a->use_uring)
+        uring_free(&a->ring);
+#endif
+#if FILE_AIO_THREAD
+    if (a->thread_started) {
+        ff_mutex_lock(&a->mutex);
+        a->exit = 1;
+        ff_cond_signal(&a->cond);
+        ff_mutex_unlock(&a->mutex);
+        pthread_join(a->thread, NULL);
+        ff_cond_destroy(&a->done_cond);
+        ff_cond_destroy(&a->cond);
+        ff_mutex_destroy(&a->mutex);
+    }
+    av_freep(&a->queue);
+#endif
+    av_freep(&a->blocks);
+    av_freep(&a->buf);
+    av_freep(pa);
+    return ret;
+}
@@ -0,0 +1,76 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef AVFORMAT_FILE_AIO_H
+#define AVFORMAT_FILE_AIO_H
+
+#include <stdint.h>
+
+/**
+ * @file
+ * Asynchronous read-ahead and write-behind for the file protocol.
+ *
+ * A file is accessed through a ring of fixed size blocks, up to depth of
+ * which are in flight at the same time. The I/O is done with io_uring
+ * where available, by a worker thread otherwise.
+ */
+
+typedef struct FileAIO FileAIO;
+
+/* Offset and size alignment of direct I/O */
+#define FILE_AIO_ALIGN 4096
+
+/**
+ * Start asynchronous I/O on an open file.
+ *
+ * @param fd         file descriptor, which stays owned by the caller
+ * @param write      1 for sequential writing, 0 for reading
+ * @param depth      maximum number of blocks in flight
+ * @param block_size size of a block, rounded up to FILE_AIO_ALIGN
+ * @param direct     fd was opened with O_DIRECT
+ * @return 0 on success, AVERROR(ENOSYS) if not supported on this build,
+ *         another negative error code on failure
+ */
+int ff_file_aio_open(FileAIO **pa, void *logctx, int fd, int write,
+                     int depth, int block_size, int direct);
+
+int ff_file_aio_read(FileAIO *a, uint8_t *buf, int size);
+
+int ff_file_aio_write(FileAIO *a, const uint8_t *buf, int size);
+
+/**
+ * Seek to an absolute position. Blocks read ahead of the new position are
+ * kept, pending writes are completed first.
+ */
+int64_t ff_file_aio_seek(FileAIO *a, int64_t pos);
+
+int64_t ff_file_aio_tell(const FileAIO *a);
+
+/**
+ * Wait for all the pending writes to complete.
+ * @return 0 or the first write error
+ */
+int ff_file_aio_flush(FileAIO *a);
+
+/**
+ * Complete all the pending I/O and free the context.
+ * @return 0 or the first write error
+ */
+int ff_file_aio_close(FileAIO **pa);
+
+#endif /* AVFORMAT_FILE_AIO_H */
@@ -44,6 +44,7 @@
 #include "internal.h"
 #include "avio_internal.h"
 #include "id3v2.h"
+#include "segment_prefetch.h"
 #include "url.h"
 
 #include "hls_sample_encryption.h"
@@ -107,6 +108,8 @@ struct playlist {
     int input_read_done;
     AVIOContext *input_next;
     int input_next_requested;
+    /* current segment, read from the prefetch pool instead of input */
+    PrefetchedSegment *prefetched;
     AVFormatContext *parent;
     int index;
     AVFormatContext *ctx;
@@ -229,6 +232,10 @@ typedef struct HLSContext {
     int http_multiple;
     int http_seekable;
     int seg_max_retry;
+    int prefetch_segments;
+    int prefetch_connections;
+    int64_t prefetch_max_size;
+    SegmentPrefetch *prefetch;
     AVIOContext *playlist_pb;
     HLSCryptoContext  crypto_ctx;
 } HLSContext;
@@ -281,6 +288,7 @@ static void free_playlist_list(HLSContext *c)
         pls->input_read_done = 0;
         ff_format_io_close(c->ctx, &pls->input_next);
         pls->input_next_requested = 0;
+        ff_segment_prefetch_release(c->prefetch, &pls->prefetched);
         if (pls->ctx) {
             pls->ctx->pb = NULL;
             avformat_close_input(&pls->ctx);
@@ -1115,13 +1123,17 @@ static struct segment *next_segment(struct playlist *pls)
 static int read_from_url(struct playlist *pls, struct segment *seg,
                          uint8_t *buf, int buf_size)
 {
+    HLSContext *c = pls->parent->priv_data;
     int ret;
 
      /* limit read if the segment was only a part of a file */
     if (seg->size >= 0)
         buf_size = FFMIN(buf_size, seg->size - pls->cur_seg_offset);
 
-    ret = avio_read(pls->input, buf, buf_size);
+    if (pls->prefetched)
+        ret = ff_segment_prefetch_read(c->prefetch, pls->prefetched, buf, buf_size);
+    else
+        ret = avio_read(pls->input, buf, buf_size);
     if (ret > 0)
         pls->cur_seg_offset += ret;
 
@@ -1329,6 +1341,144 @@ static void intercept_id3(struct playlist *pls, uint8_t *buf,
         pls->is_id3_timestamped = (pls->id3_mpegts_timestamp != AV_NOPTS_VALUE);
 }
 
+static void set_crypto_url(struct playlist *pls, struct segment *seg,
+                           char *url, size_t url_size, AVDictionary **opts)
+{
+    char iv[33], key[33];
+
+    ff_data_to_hex(iv, seg->iv, sizeof(seg->iv), 0);
+    ff_data_to_hex(key, pls->key, sizeof(pls->key), 0);
+    if (strstr(seg->url, "://"))
+        snprintf(url, url_size, "crypto+%s", seg->url);
+    else
+        snprintf(url, url_size, "crypto:%s", seg->url);
+
+    av_dict_set(opts, "key", key, 0);
+    av_dict_set(opts, "iv", iv, 0);
+}
+
+static PrefetchedSegment *prefetch_take(HLSContext *c, const char *url,
+                                        int64_t offset, int64_t size)
+{
+    if (!c->prefetch)
+        return NULL;
+    return ff_segment_prefetch_take(c->prefetch, url, offset, size);
+}
+
+static int prefetch_add(HLSContext *c, const char *url, int64_t offset,
+                        int64_t size, const AVDictionary *seg_opts)
+{
+    AVDictionary *opts = NULL;
+    int ret;
+
+    if ((ret = av_dict_copy(&opts, c->avio_opts, 0)) >= 0 &&
+        (ret = av_dict_copy(&opts, seg_opts, 0)) >= 0)
+        ret = ff_segment_prefetch_add(c->prefetch, url, offset, size, opts);
+    av_dict_free(&opts);
+    return ret;
+}
+
+static void prefetch_segment(HLSContext *c, struct playlist *pls, struct segment *seg)
+{
+    AVDictionary *opts = NULL;
+    char url[MAX_URL_SIZE];
+
+    if (seg->size >= 0) {
+        av_dict_set_int(&opts, "offset", seg->url_offset, 0);
+        av_dict_set_int(&opts, "end_offset", seg->url_offset + seg->size, 0);
+    }
+    if (seg->key_type == KEY_AES_128)
+        set_crypto_url(pls, seg, url, sizeof(url), &opts);
+    else
+        av_strlcpy(url, seg->url, sizeof(url));
+
+    prefetch_add(c, url, seg->url_offset, seg->size, opts);
+    av_dict_free(&opts);
+}
+
+/* Queue the downloads of count segments starting at the current one plus
+ * start, along with their initialization sections and keys. */
+static void prefetch_segments(HLSContext *c, struct playlist *pls, int start, int count)
+{
+    struct segment *init_section = pls->cur_init_section;
+
+    if (!c->prefetch)
+        return;
+
+    for (int i = start; i < start + count; i++) {
+        int64_t n = pls->cur_seq_no - pls->start_seq_no + i;
+        struct segment *seg;
+
+        if (n < 0 || n >= pls->n_segments)
+            break;
+        seg = pls->segments[n];
+        if (!av_strstart(seg->url, "http", NULL))
+            break;
+
+        if (seg->init_section && seg->init_section != init_section) {
+            init_section = seg->init_section;
+            if (av_strstart(init_section->url, "http", NULL))
+                prefetch_segment(c, pls, init_section);
+        }
+        if (seg->key_type != KEY_NONE && strcmp(seg->key, pls->key_url)) {
+            if (av_strstart(seg->key, "http", NULL))
+                prefetch_add(c, seg->key, 0, -1, NULL);
+            /* The request depends on the key, which is not read yet */
+            if (seg->key_type == KEY_AES_128)
+                break;
+        }
+        prefetch_segment(c, pls, seg);
+    }
+}
+
+/* Take a segment out of the prefetch pool, if it was downloaded ahead */
+static int open_prefetched(HLSContext *c, struct playlist *pls, struct segment *seg)
+{
+    char url[MAX_URL_SIZE];
+
+    if (!c->prefetch)
+        return 0;
+
+    if (seg->key_type == KEY_AES_128) {
+        AVDictionary *opts = NULL;
+
+        if (strcmp(seg->key, pls->key_url))
+            return 0;
+        set_crypto_url(pls, seg, url, sizeof(url), &opts);
+        av_dict_free(&opts);
+    } else {
+        av_strlcpy(url, seg->url, sizeof(url));
+    }
+
+    pls->prefetched = ff_segment_prefetch_take(c->prefetch, url, seg->url_offset, seg->size);
+    if (!pls->prefetched)
+        return 0;
+
+    av_log(pls->parent, AV_LOG_VERBOSE, "HLS prefetched url '%s', offset %"PRId64", playlist %d\n",
+           seg->url, seg->url_offset, pls->index);
+    pls->cur_seg_offset = 0;
+    return 1;
+}
+
+static int read_key(HLSContext *c, struct playlist *pls, struct segment *seg,
+                    AVDictionary *opts)
+{
+    PrefetchedSegment *prefetched = prefetch_take(c, seg->key, 0, -1);
+    AVIOContext *pb = NULL;
+    int ret;
+
+    if (prefetched) {
+        ret = ff_segment_prefetch_read(c->prefetch, prefetched, pls->key, sizeof(pls->key));
+        ff_segment_prefetch_release(c->prefetch, &prefetched);
+    } else if ((ret = open_url(pls->parent, &pb, seg->key, &c->avio_opts, opts, NULL)) == 0) {
+        ret = avio_read(pb, pls->key, sizeof(pls->key));
+        ff_format_io_close(pls->parent, &pb);
+    } else {
+        return ret;
+    }
+    return ret == sizeof(pls->key) ? 0 : AVERROR_INVALIDDATA;
+}
+
 static int open_input(HLSContext *c, struct playlist *pls, struct segment *seg, AVIOContext **in)
 {
     AVDictionary *opts = NULL;
@@ -1350,15 +1500,11 @@ static int open_input(HLSContext *c, struct playlist *pls, struct segment *seg,
 
     if (seg->key_type == KEY_AES_128 || seg->key_type == KEY_SAMPLE_AES) {
         if (strcmp(seg->key, pls->key_url)) {
-            AVIOContext *pb = NULL;
-            if (open_url(pls->parent, &pb, seg->key, &c->avio_opts, opts, NULL) == 0) {
-                ret = avio_read(pb, pls->key, sizeof(pls->key));
-                if (ret != sizeof(pls->key)) {
-                    av_log(pls->parent, AV_LOG_ERROR, "Unable to read key file %s\n",
-                           seg->key);
-                }
-                ff_format_io_close(pls->parent, &pb);
-            } else {
+            ret = read_key(c, pls, seg, opts);
+            if (ret == AVERROR_INVALIDDATA) {
+                av_log(pls->parent, AV_LOG_ERROR, "Unable to read key file %s\n",
+                       seg->key);
+            } else if (ret < 0) {
                 av_log(pls->parent, AV_LOG_ERROR, "Unable to open key file %s\n",
                        seg->key);
             }
@@ -1367,16 +1513,8 @@ static int open_input(HLSContext *c, struct playlist *pls, struct segment *seg,
     }
 
     if (seg->key_type == KEY_AES_128) {
-        char iv[33], key[33], url[MAX_URL_SIZE];
-        ff_data_to_hex(iv, seg->iv, sizeof(seg->iv), 0);
-        ff_data_to_hex(key, pls->key, sizeof(pls->key), 0);
-        if (strstr(seg->url, "://"))
-            snprintf(url, sizeof(url), "crypto+%s", seg->url);
-        else
-            snprintf(url, sizeof(url), "crypto:%s", seg->url);
-
-        av_dict_set(&opts, "key", key, 0);
-        av_dict_set(&opts, "iv", iv, 0);
+        char url[MAX_URL_SIZE];
+        set_crypto_url(pls, seg, url, sizeof(url), &opts);
 
         ret = open_url(pls->parent, in, url, &c->avio_opts, opts, &is_http);
         if (ret < 0) {
@@ -1428,17 +1566,19 @@ static int update_init_section(struct playlist *pls, struct segment *seg)
     if (!seg->init_section)
         return 0;
 
-    ret = open_input(c, pls, seg->init_section, &pls->input);
-    if (ret < 0) {
-        av_log(pls->parent, AV_LOG_WARNING,
-               "Failed to open an initialization section in playlist %d\n",
-               pls->index);
-        return ret;
+    if (!open_prefetched(c, pls, seg->init_section)) {
+        ret = open_input(c, pls, seg->init_section, &pls->input);
+        if (ret < 0) {
+            av_log(pls->parent, AV_LOG_WARNING,
+                   "Failed to open an initialization section in playlist %d\n",
+                   pls->index);
+            return ret;
+        }
     }
 
     if (seg->init_section->size >= 0)
         sec_size = seg->init_section->size;
-    else if ((urlsize = avio_size(pls->input)) >= 0)
+    else if (!pls->prefetched && (urlsize = avio_size(pls->input)) >= 0)
         sec_size = urlsize;
     else
         sec_size = max_init_section_size;
@@ -1453,7 +1593,10 @@ static int update_init_section(struct playlist *pls, struct segment *seg)
 
     ret = read_from_url(pls, seg->init_section, pls->init_sec_buf,
                         pls->init_sec_buf_size);
-    ff_format_io_close(pls->parent, &pls->input);
+    if (pls->prefetched)
+        ff_segment_prefetch_release(c->prefetch, &pls->prefetched);
+    else
+        ff_format_io_close(pls->parent, &pls->input);
 
     if (ret < 0)
         return ret;
@@ -1536,7 +1679,7 @@ restart:
     if (!v->needed)
         return AVERROR_EOF;
 
-    if (!v->input || (c->http_persistent && v->input_read_done)) {
+    if ((!v->input && !v->prefetched) || (c->http_persistent && v->input_read_done)) {
         int64_t reload_interval;
 
         /* Check that the playlist is still needed before opening a new
@@ -1612,6 +1755,8 @@ reload:
             v->cur_seg_offset = 0;
             v->input_next_requested = 0;
             ret = 0;
+        } else if (open_prefetched(c, v, seg)) {
+            ret = 0;
         } else {
             ret = open_input(c, v, seg, &v->input);
         }
@@ -1634,9 +1779,10 @@ reload:
         }
         segment_retries = 0;
         just_opened = 1;
+        prefetch_segments(c, v, 1, c->prefetch_segments);
     }
 
-    if (c->http_multiple == -1) {
+    if (c->http_multiple == -1 && v->input) {
         uint8_t *http_version_opt = NULL;
         int r = av_opt_get(v->input, "http_version", AV_OPT_SEARCH_CHILDREN, &http_version_opt);
         if (r >= 0) {
@@ -1646,7 +1792,7 @@ reload:
     }
 
     seg = next_segment(v);
-    if (c->http_multiple == 1 && !v->input_next_requested &&
+    if (c->http_multiple == 1 && !v->input_next_requested && !c->prefetch &&
         seg && seg->key_type == KEY_NONE && av_strstart(seg->url, "http", NULL)) {
         ret = open_input(c, v, seg, &v->input_next);
         if (ret < 0) {
@@ -1679,6 +1825,7 @@ reload:
 
         return ret;
     }
+    ff_segment_prefetch_release(c->prefetch, &v->prefetched);
     if (c->http_persistent &&
         seg->key_type == KEY_NONE && av_strstart(seg->url, "http", NULL)) {
         v->input_read_done = 1;
@@ -1966,6 +2113,7 @@ static int hls_close(AVFormatContext *s)
     free_playlist_list(c);
     free_variant_list(c);
     free_rendition_list(c);
+    ff_segment_prefetch_free(&c->prefetch);
 
     if (c->crypto_ctx.aes_ctx)
         av_free(c->crypto_ctx.aes_ctx);
@@ -1997,6 +2145,13 @@ static int hls_read_header(AVFormatContext *s)
        the range header */
     av_dict_set_int(&c->avio_opts, "seekable", c->http_seekable, 0);
 
+    if (c->prefetch_segments > 0) {
+        ret = ff_segment_prefetch_alloc(&c->prefetch, s, c->prefetch_connections,
+                                        c->prefetch_max_size);
+        if (ret < 0 && ret != AVERROR(ENOSYS))
+            return ret;
+    }
+
     if ((ret = parse_playlist(c, s->url, NULL, s->pb)) < 0)
         return ret;
 
@@ -2068,6 +2223,8 @@ static int hls_read_header(AVFormatContext *s)
 
         pls->cur_seq_no = select_cur_seq_no(c, pls);
         highest_cur_seq_no = FFMAX(highest_cur_seq_no, pls->cur_seq_no);
+        /* The first segments of all the playlists are read below */
+        prefetch_segments(c, pls, 0, 1);
     }
 
     /* Open the demuxer for each playlist */
@@ -2134,6 +2291,7 @@ static int hls_read_header(AVFormatContext *s)
             ff_format_io_close(pls->parent, &pls->input_next);
             pls->input_next = NULL;
             pls->input_next_requested = 0;
+            ff_segment_prefetch_release(c->prefetch, &pls->prefetched);
             pls->cur_seg_offset = 0;
             pls->cur_init_section = NULL;
             /* Reset EOF flag */
@@ -2296,6 +2454,7 @@ static int recheck_discard_flags(AVFormatContext *s, int first)
             pls->input_read_done = 0;
             ff_format_io_close(pls->parent, &pls->input_next);
             pls->input_next_requested = 0;
+            ff_segment_prefetch_release(c->prefetch, &pls->prefetched);
             pls->needed = 0;
             changed = 1;
             av_log(s, AV_LOG_INFO, "No longer receiving playlist %d\n", i);
@@ -2544,6 +2703,7 @@ static int hls_read_seek(AVFormatContext *s, int stream_index,
     seek_pls->cur_seq_no = seq_no;
     seek_pls->seek_stream_index = stream_subdemuxer_index;
 
+    ff_segment_prefetch_flush(c->prefetch);
     for (i = 0; i < c->n_playlists; i++) {
         /* Reset reading */
         struct playlist *pls = c->playlists[i];
@@ -2552,6 +2712,7 @@ static int hls_read_seek(AVFormatContext *s, int stream_index,
         pls->input_read_done = 0;
         ff_format_io_close(pls->parent, &pls->input_next);
         pls->input_next_requested = 0;
+        ff_segment_prefetch_release(c->prefetch, &pls->prefetched);
         av_packet_unref(pls->pkt);
         pb->eof_reached = 0;
         /* Clear any buffered data */
@@ -2646,6 +2807,12 @@ static const AVOption hls_options[] = {
         OFFSET(seg_format_opts), AV_OPT_TYPE_DICT, {.str = NULL}, 0, 0, FLAGS},
     {"seg_max_retry", "Maximum number of times to reload a segment on error.",
      OFFSET(seg_max_retry), AV_OPT_TYPE_INT, {.i64 = 0}, 0, INT_MAX, FLAGS},
+    {"prefetch_segments", "Number of segments to download ahead of the one being read",
+        OFFSET(prefetch_segments), AV_OPT_TYPE_INT, {.i64 = 0}, 0, 64, FLAGS},
+    {"prefetch_connections", "Maximum number of segments downloaded at the same time",
+        OFFSET(prefetch_connections), AV_OPT_TYPE_INT, {.i64 = 4}, 1, 32, FLAGS},
+    {"prefetch_max_size", "Maximum amount of data downloaded ahead",
+        OFFSET(prefetch_max_size), AV_OPT_TYPE_INT64, {.i64 = 64 << 20}, 1 << 20, INT64_MAX, FLAGS},
     {NULL}
 };
 
@@ -36,6 +36,7 @@
 #include "libavutil/opt.h"
 #include "libavutil/time.h"
 #include "libavutil/parseutils.h"
+#include "libavutil/thread.h"
 
 #include "avformat.h"
 #include "http.h"
@@ -58,6 +59,7 @@
 #define HTTP_SINGLE   1
 #define HTTP_MUTLI    2
 #define MAX_DATE_LEN  19
+#define POOL_MAX_CONNECTIONS 32
 #define WHITESPACES " \n\t\r"
 typedef enum {
     LOWER_PROTO,
@@ -143,8 +145,33 @@ typedef struct HTTPContext {
     unsigned int retry_after;
     int reconnect_max_retries;
     int reconnect_delay_total_max;
+    int connection_pool;
+    int pool_max_idle;
+    int pool_idle_timeout;
+    /* Pool key of the connection, set if it can be given back to the pool. */
+    char *pool_key;
+    /* Size of the reply body from Content-Length, otherwise -1. */
+    uint64_t content_length;
+    /* Offset of the end of the reply body if known, otherwise -1. */
+    uint64_t body_end;
+    /* Idle timeout announced by the server in the Keep-Alive header. */
+    int keep_alive_timeout;
 } HTTPContext;
 
+typedef struct PooledConnection {
+    char *key;
+    URLContext *hd;
+    int64_t expiry;
+} PooledConnection;
+
+/* Connections shared by all the HTTP contexts, oldest first. */
+static struct {
+    AVMutex mutex;
+    PooledConnection conns[POOL_MAX_CONNECTIONS];
+    int nb_conns;
+    unsigned nb_opened, nb_reused, nb_discarded, nb_evicted;
+} pool = { .mutex = AV_MUTEX_INITIALIZER };
+
 #define OFFSET(x) offsetof(HTTPContext, x)
 #define D AV_OPT_FLAG_DECODING_PARAM
 #define E AV_OPT_FLAG_ENCODING_PARAM
@@ -188,6 +215,9 @@ static const AVOption options[] = {
     { "resource", "The resource requested by a client", OFFSET(resource), AV_OPT_TYPE_STRING, { .str = NULL }, 0, 0, E },
     { "reply_code", "The http status code to return to a client", OFFSET(reply_code), AV_OPT_TYPE_INT, { .i64 = 200}, INT_MIN, 599, E},
     { "short_seek_size", "Threshold to favor readahead over seek.", OFFSET(short_seek_size), AV_OPT_TYPE_INT, { .i64 = 0 }, 0, INT_MAX, D },
+    { "connection_pool", "keep idle connections in a pool shared by all the HTTP contexts", OFFSET(connection_pool), AV_OPT_TYPE_BOOL, { .i64 = 0 }, 0, 1, D | E },
+    { "pool_max_idle", "max number of idle connections kept in the pool per server", OFFSET(pool_max_idle), AV_OPT_TYPE_INT, { .i64 = 4 }, 0, POOL_MAX_CONNECTIONS, D | E },
+    { "pool_idle_timeout", "time in seconds after which idle connections in the pool are closed", OFFSET(pool_idle_timeout), AV_OPT_TYPE_INT, { .i64 = 10 }, 1, INT_MAX / 1000000, D | E },
     { NULL }
 };
 
@@ -207,6 +237,138 @@ void ff_http_init_auth_state(URLContext *dest, const URLContext *src)
            sizeof(HTTPAuthState));
 }
 
+/* Return 1 if there is data to read on the connection or it failed. */
+static int http_pool_poll(URLContext *hd)
+{
+    struct pollfd p = { .fd = ffurl_get_file_handle(hd), .events = POLLIN };
+
+    return p.fd < 0 || poll(&p, 1, 0) != 0;
+}
+
+static PooledConnection http_pool_remove(int i)
+{
+    PooledConnection c = pool.conns[i];
+
+    pool.nb_conns--;
+    memmove(&pool.conns[i], &pool.conns[i + 1],
+            (pool.nb_conns - i) * sizeof(*pool.conns));
+    return c;
+}
+
+static void http_pool_close(PooledConnection *c)
+{
+    ffurl_closep(&c->hd);
+    av_freep(&c->key);
+}
+
+/**
+ * Take a connection to the given lower protocol URL out of the pool,
+ * closing the connections found expired on the way.
+ */
+static URLContext *http_pool_get(URLContext *h, const char *key,
+                                 AVDictionary *options)
+{
+    PooledConnection conn = { 0 }, stale[POOL_MAX_CONNECTIONS];
+    AVDictionaryEntry *e;
+    URLContext *hd;
+    int64_t now = av_gettime_relative();
+    int nb_stale = 0;
+
+    ff_mutex_lock(&pool.mutex);
+    for (int i = pool.nb_conns - 1; i >= 0; i--) {
+        PooledConnection *c = &pool.conns[i];
+        /* Idle connections have nothing to read unless they were closed. */
+        if (c->expiry <= now || http_pool_poll(c->hd))
+            stale[nb_stale++] = http_pool_remove(i);
+    }
+    /* Take the most recently used connection. */
+    for (int i = pool.nb_conns - 1; i >= 0; i--) {
+        if (!strcmp(pool.conns[i].key, key)) {
+            conn = http_pool_remove(i);
+            pool.nb_reused++;
+            break;
+        }
+    }
+    pool.nb_discarded += nb_stale;
+    ff_mutex_unlock(&pool.mutex);
+
+    for (int i = 0; i < nb_stale; i++)
+        http_pool_close(&stale[i]);
+
+    if (!conn.hd)
+        return NULL;
+    av_freep(&conn.key);
+
+    hd = conn.hd;
+    hd->interrupt_callback = h->interrupt_callback;
+    av_log(h, AV_LOG_DEBUG, "Reusing connection to %s\n", key);
+    /* Apply the I/O timeout the connection would have been opened with. */
+    hd->rw_timeout = h->rw_timeout;
+    if ((e = av_dict_get(options, "timeout", NULL, 0)) && strtol(e->value, NULL, 10) >= 0)
+        hd->rw_timeout = strtol(e->value, NULL, 10);
+    return hd;
+}
+
+/**
+ * Give the connection back to the pool if the server keeps it open and the
+ * reply has been read completely.
+ *
+ * @return 1 if the connection was put in the pool
+ */
+static int http_pool_put(URLContext *h)
+{
+    HTTPContext *s = h->priv_data;
+    PooledConnection conn = { 0 }, evicted[POOL_MAX_CONNECTIONS + 1];
+    int64_t timeout = s->pool_idle_timeout;
+    int nb_evicted = 0, nb_same = 0;
+
+    if (!s->pool_key || !s->hd || s->willclose || !s->pool_max_idle ||
+        s->buf_ptr != s->buf_end || !s->end_header)
+        return 0;
+    if (s->chunksize != UINT64_MAX ? !s->chunkend : s->off != s->body_end)
+        return 0;
+    if (s->keep_alive_timeout > 0)
+        timeout = FFMIN(timeout, s->keep_alive_timeout - 1);
+    if (timeout <= 0 || !(conn.key = av_strdup(s->pool_key)))
+        return 0;
+
+    ff_mutex_lock(&pool.mutex);
+    for (int i = pool.nb_conns - 1; i >= 0; i--) {
+        if (strcmp(pool.conns[i].key, conn.key) || ++nb_same < s->pool_max_idle)
+            continue;
+        evicted[nb_evicted++] = http_pool_remove(i);
+    }
+    if (pool.nb_conns == POOL_MAX_CONNECTIONS)
+        evicted[nb_evicted++] = http_pool_remove(0);
+    pool.nb_evicted += nb_evicted;
+
+    s->hd->interrupt_callback = (AVIOInterruptCB){ 0 };
+    conn.hd     = s->hd;
+    conn.expiry = av_gettime_relative() + timeout * 1000000;
+    pool.conns[pool.nb_conns++] = conn;
+    ff_mutex_unlock(&pool.mutex);
+
+    s->hd = NULL;
+    for (int i = 0; i < nb_evicted; i++)
+        http_pool_close(&evicted[i]);
+    return 1;
+}
+
+void ff_http_pool_deinit(void)
+{
+    ff_mutex_lock(&pool.mutex);
+    while (pool.nb_conns) {
+        PooledConnection c = http_pool_remove(0);
+        http_pool_close(&c);
+    }
+    if (pool.nb_opened)
+        av_log(NULL, AV_LOG_VERBOSE, "HTTP connection pool: %u connections "
+               "opened, %u reused, %u discarded, %u evicted\n", pool.nb_opened,
+               pool.nb_reused, pool.nb_discarded, pool.nb_evicted);
+    pool.nb_opened = pool.nb_reused = pool.nb_discarded = pool.nb_evicted = 0;
+    ff_mutex_unlock(&pool.mutex);
+}
+
 static int http_open_cnx_internal(URLContext *h, AVDictionary **options)
 {
     const char *path, *proxy_path, *lower_proto = "tcp", *local_path;
@@ -272,16 +434,45 @@ static int http_open_cnx_internal(URLContext *h, AVDictionary **options)
 
     ff_url_join(buf, sizeof(buf), lower_proto, NULL, hostname, port, NULL);
 
+    /* TLS connections are not pooled, as the interrupt callback of the
+     * underlying TCP connection could not be updated when reusing them. */
+    av_freep(&s->pool_key);
+    if (s->connection_pool && !strcmp(lower_proto, "tcp")) {
+        if (!(s->pool_key = av_strdup(buf))) {
+            err = AVERROR(ENOMEM);
+            goto end;
+        }
+    }
+
     if (!s->hd) {
+        uint64_t off = s->off;
+
+        if (s->pool_key && (s->hd = http_pool_get(h, buf, *options))) {
+            err = http_connect(h, path, local_path, hoststr, auth, proxyauth);
+            /* The server may have closed the connection just before the
+             * request was sent, retry on a new one. */
+            if (err != AVERROR_EOF && err != AVERROR(EPIPE) &&
+                err != AVERROR(ECONNRESET))
+                goto end;
+            av_log(h, AV_LOG_VERBOSE, "Reused connection was closed, reconnecting\n");
+            ffurl_closep(&s->hd);
+            s->off = off;
+        }
         err = ffurl_open_whitelist(&s->hd, buf, AVIO_FLAG_READ_WRITE,
                                    &h->interrupt_callback, options,
                                    h->protocol_whitelist, h->protocol_blacklist, h);
+        if (err >= 0 && s->pool_key) {
+            ff_mutex_lock(&pool.mutex);
+            pool.nb_opened++;
+            ff_mutex_unlock(&pool.mutex);
+        }
     }
+    if (err >= 0)
+        err = http_connect(h, path, local_path, hoststr, auth, proxyauth);
 
 end:
     freeenv_utf8(env_http_proxy);
-    return err < 0 ? err : http_connect(
-        h, path, local_path, hoststr, auth, proxyauth);
+    return err;
 }
 
 static int http_should_reconnect(HTTPContext *s, int err)
@@ -510,8 +701,12 @@ int ff_http_do_new_request2(URLContext *h, const char *uri, AVDictionary **opts)
             return ret;
     }
 
-    if (s->willclose)
-        return AVERROR_EOF;
+    if (s->willclose) {
+        if (!s->pool_key)
+            return AVERROR_EOF;
+        /* Continue on a new connection. */
+        ffurl_closep(&s->hd);
+    }
 
     s->end_chunked_post = 0;
     s->chunkend      = 0;
@@ -756,6 +951,7 @@ bail_out:
         av_dict_free(&s->cookie_dict);
         av_dict_free(&s->redirect_cache);
         av_freep(&s->new_location);
+        av_freep(&s->pool_key);
         av_freep(&s->uri);
     }
     return ret;
@@ -1207,9 +1403,10 @@ static int process_line(URLContext *h, char *line, int line_count, int *parsed_h
         if (!av_strcasecmp(tag, "Location")) {
             if ((ret = parse_location(s, p)) < 0)
                 return ret;
-        } else if (!av_strcasecmp(tag, "Content-Length") &&
-                   s->filesize == UINT64_MAX) {
-            s->filesize = strtoull(p, NULL, 10);
+        } else if (!av_strcasecmp(tag, "Content-Length")) {
+            s->content_length = strtoull(p, NULL, 10);
+            if (s->filesize == UINT64_MAX)
+                s->filesize = s->content_length;
         } else if (!av_strcasecmp(tag, "Content-Range")) {
             parse_content_range(h, p);
         } else if (!av_strcasecmp(tag, "Accept-Ranges") &&
@@ -1229,6 +1426,10 @@ static int process_line(URLContext *h, char *line, int line_count, int *parsed_h
         } else if (!av_strcasecmp(tag, "Connection")) {
             if (!strcmp(p, "close"))
                 s->willclose = 1;
+        } else if (!av_strcasecmp(tag, "Keep-Alive")) {
+            const char *timeout = av_stristr(p, "timeout=");
+            if (timeout)
+                s->keep_alive_timeout = strtol(timeout + 8, NULL, 10);
         } else if (!av_strcasecmp(tag, "Server")) {
             if (!av_strcasecmp(p, "AkamaiGHost")) {
                 s->is_akamai = 1;
@@ -1380,6 +1581,8 @@ static int http_read_header(URLContext *h)
     s->expires = 0;
     s->chunksize = UINT64_MAX;
     s->filesize_from_content_range = UINT64_MAX;
+    s->content_length = UINT64_MAX;
+    s->keep_alive_timeout = 0;
 
     for (;;) {
         int parsed_http_code = 0;
@@ -1415,6 +1618,13 @@ static int http_read_header(URLContext *h)
     if (s->seekable == -1 && s->is_mediagateway && s->filesize == 2000000000)
         h->is_streamed = 1; /* we can in fact _not_ seek */
 
+    s->body_end = UINT64_MAX;
+    if (s->http_code == 204 || s->http_code == 304 ||
+        (s->method && !av_strcasecmp(s->method, "HEAD")))
+        s->body_end = s->off;
+    else if (s->content_length != UINT64_MAX)
+        s->body_end = s->off + s->content_length;
+
     // add any new cookies into the existing cookie string
     cookie_string(s->cookie_dict, &s->cookies);
     av_dict_free(&s->cookie_dict);
@@ -1532,7 +1742,8 @@ static int http_connect(URLContext *h, const char *path, const char *local_path,
         av_bprintf(&request, "Expect: 100-continue\r\n");
 
     if (!has_header(s->headers, "\r\nConnection: "))
-        av_bprintf(&request, "Connection: %s\r\n", s->multiple_requests ? "keep-alive" : "close");
+        av_bprintf(&request, "Connection: %s\r\n",
+                   s->multiple_requests || s->pool_key ? "keep-alive" : "close");
 
     if (!has_header(s->headers, "\r\nHost: "))
         av_bprintf(&request, "Host: %s\r\n", hoststr);
@@ -1637,7 +1848,7 @@ static int http_buf_read(URLContext *h, uint8_t *buf, int size)
                    "Chunked encoding data size: %"PRIu64"\n",
                     s->chunksize);
 
-            if (!s->chunksize && s->multiple_requests) {
+            if (!s->chunksize && (s->multiple_requests || s->pool_key)) {
                 http_get_line(s, line, sizeof(line)); // read empty chunk
                 s->chunkend = 1;
                 return 0;
@@ -1904,6 +2115,33 @@ static int http_write(URLContext *h, const uint8_t *buf, int size)
     return size;
 }
 
+/* Read the reply to a chunked post, so that the connection can be reused. */
+static int http_read_reply(URLContext *h)
+{
+    HTTPContext *s = h->priv_data;
+    uint8_t buf[1024];
+    int ret;
+
+    if ((ret = http_read_header(h)) < 0)
+        return ret;
+    if (s->chunksize != UINT64_MAX) {
+        while ((ret = http_buf_read(h, buf, sizeof(buf))) > 0)
+            ;
+        return ret == AVERROR_EOF ? 0 : ret;
+    }
+    /* A body delimited by the end of the connection is not read. */
+    if (s->body_end == UINT64_MAX) {
+        s->willclose = 1;
+        return 0;
+    }
+    while (s->off < s->body_end) {
+        ret = http_buf_read(h, buf, FFMIN(sizeof(buf), s->body_end - s->off));
+        if (ret <= 0)
+            return ret < 0 ? ret : AVERROR(EIO);
+    }
+    return 0;
+}
+
 static int http_shutdown(URLContext *h, int flags)
 {
     int ret = 0;
@@ -1915,8 +2153,16 @@ static int http_shutdown(URLContext *h, int flags)
         ((flags & AVIO_FLAG_READ) && s->chunked_post && s->listen)) {
         ret = ffurl_write(s->hd, footer, sizeof(footer) - 1);
         ret = ret > 0 ? 0 : ret;
-        /* flush the receive buffer when it is write only mode */
-        if (!(flags & AVIO_FLAG_READ)) {
+        /* if the connection can be reused, read the whole reply so that it
+         * can be given back to the pool, otherwise flush the receive buffer
+         * when it is write only mode */
+        if (s->pool_key && !(flags & AVIO_FLAG_READ)) {
+            if (ret >= 0 && (ret = http_read_reply(h)) < 0) {
+                av_log(h, AV_LOG_ERROR, "Request for %s failed: %s\n",
+                       s->location, av_err2str(ret));
+                s->willclose = 1;
+            }
+        } else if (!(flags & AVIO_FLAG_READ)) {
             char buf[1024];
             int read_ret;
             s->hd->flags |= AVIO_FLAG_NONBLOCK;
@@ -1947,8 +2193,9 @@ static int http_close(URLContext *h)
         /* Close the write direction by sending the end of chunked encoding. */
         ret = http_shutdown(h, h->flags);
 
-    if (s->hd)
+    if (s->hd && !http_pool_put(h))
         ffurl_closep(&s->hd);
+    av_freep(&s->pool_key);
     av_dict_free(&s->chained_options);
     av_dict_free(&s->cookie_dict);
     av_dict_free(&s->redirect_cache);
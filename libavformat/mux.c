@@ -35,6 +35,7 @@
 #include "libavutil/frame.h"
 #include "libavutil/internal.h"
 #include "libavutil/mathematics.h"
+#include "libavutil/trace.h"
 
 /**
  * @file
@@ -1281,15 +1282,18 @@ int av_interleaved_write_frame(AVFormatContext *s, AVPacket *pkt)
 {
     int ret;
 
+    av_trace_begin("av_interleaved_write_frame");
     if (pkt) {
         ret = write_packets_common(s, pkt, 1/*interleaved*/);
         if (ret < 0)
             av_packet_unref(pkt);
-        return ret;
     } else {
         av_log(s, AV_LOG_TRACE, "av_interleaved_write_frame FLUSH\n");
-        return interleaved_write_packet(s, ffformatcontext(s)->parse_pkt, 1/*flush*/, 0);
+        ret = interleaved_write_packet(s, ffformatcontext(s)->parse_pkt, 1/*flush*/, 0);
     }
+    av_trace_end("av_interleaved_write_frame");
+
+    return ret;
 }
 
 int av_write_trailer(AVFormatContext *s)
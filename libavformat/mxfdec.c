@@ -595,12 +595,16 @@ static int mxf_get_d10_aes3_packet(AVIOContext *pb, AVStream *st, AVPacket *pkt,
 {
     const uint8_t *buf_ptr, *end_ptr;
     uint8_t *data_ptr;
+    int ret;
 
     if (length > 61444) /* worst case PAL 1920 samples 8 channels */
         return AVERROR_INVALIDDATA;
     length = av_get_packet(pb, pkt, length);
     if (length < 0)
         return length;
+    ret = av_packet_make_writable(pkt);
+    if (ret < 0)
+        return ret;
     data_ptr = pkt->data;
     end_ptr = pkt->data + length;
     buf_ptr = pkt->data + 4; /* skip SMPTE 331M header */
@@ -636,6 +640,7 @@ static int mxf_decrypt_triplet(AVFormatContext *s, AVPacket *pkt, KLVPacket *klv
     uint8_t tmpbuf[16];
     int index;
     int body_sid;
+    int ret;
 
     if (!mxf->aesc && s->key && s->keylen == 16) {
         mxf->aesc = av_aes_alloc();
@@ -684,6 +689,9 @@ static int mxf_decrypt_triplet(AVFormatContext *s, AVPacket *pkt, KLVPacket *klv
     else if (size < plaintext_size)
         return AVERROR_INVALIDDATA;
     size -= plaintext_size;
+    ret = av_packet_make_writable(pkt);
+    if (ret < 0)
+        return ret;
     if (mxf->aesc)
         av_aes_crypt(mxf->aesc, &pkt->data[plaintext_size],
                      &pkt->data[plaintext_size], size >> 4, ivec, 1);
@@ -4289,7 +4297,7 @@ const FFInputFormat ff_mxf_demuxer = {
     .p.flags        = AVFMT_SEEK_TO_PTS | AVFMT_NOGENSEARCH,
     .p.priv_class   = &demuxer_class,
     .priv_data_size = sizeof(MXFContext),
-    .flags_internal = FF_INFMT_FLAG_INIT_CLEANUP,
+    .flags_internal = FF_INFMT_FLAG_INIT_CLEANUP | FF_INFMT_FLAG_READONLY_PACKETS,
     .read_probe     = mxf_probe,
     .read_header    = mxf_read_header,
     .read_packet    = mxf_read_packet,
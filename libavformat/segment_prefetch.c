@@ -0,0 +1,559 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include <string.h>
+
+#include "config.h"
+#include "config_components.h"
+#include "libavutil/avstring.h"
+#include "libavutil/error.h"
+#include "libavutil/fifo.h"
+#include "libavutil/log.h"
+#include "libavutil/mem.h"
+#include "libavutil/thread.h"
+#include "avio_internal.h"
+#include "http.h"
+#include "internal.h"
+#include "segment_prefetch.h"
+#include "url.h"
+
+#if HAVE_PTHREADS
+
+#define CHUNK_SIZE (64 * 1024)
+
+enum SegmentState {
+    SEGMENT_QUEUED,
+    SEGMENT_RUNNING,
+    SEGMENT_DONE,
+};
+
+struct PrefetchedSegment {
+    char *url;
+    int64_t offset;
+    int64_t size;
+    AVDictionary *opts;
+
+    enum SegmentState state;
+    int taken;
+    /* Released while running, freed by the worker when it is done */
+    int released;
+    /* AVERROR_EOF once downloaded completely */
+    int error;
+    int64_t downloaded;
+    AVFifo *fifo;
+
+    PrefetchedSegment *next;
+};
+
+typedef struct PrefetchWorker {
+    SegmentPrefetch *p;
+    pthread_t thread;
+    /* Connection kept alive between downloads */
+    AVIOContext *pb;
+    char *pb_url;
+    uint8_t *buf;
+} PrefetchWorker;
+
+struct SegmentPrefetch {
+    AVFormatContext *s;
+    AVIOInterruptCB interrupt_cb;
+
+    PrefetchWorker *workers;
+    int nb_workers;
+
+    AVMutex mutex;
+    /* Signaled when there is a segment to download or memory to fill */
+    AVCond cond;
+    /* Signaled when a download made progress */
+    AVCond data_cond;
+    int abort;
+
+    PrefetchedSegment *segments;
+    int64_t buffered;
+    int64_t max_size;
+
+    int nb_downloaded;
+    int nb_taken;
+    int nb_reused;
+};
+
+static void segment_free(PrefetchedSegment **pseg)
+{
+    PrefetchedSegment *seg = *pseg;
+
+    if (!seg)
+        return;
+    av_freep(&seg->url);
+    av_dict_free(&seg->opts);
+    av_fifo_freep2(&seg->fifo);
+    av_freep(pseg);
+}
+
+/* Remove a segment from the list and free it, with the mutex held */
+static void segment_remove(SegmentPrefetch *p, PrefetchedSegment *seg)
+{
+    PrefetchedSegment **pseg = &p->segments;
+
+    while (*pseg != seg)
+        pseg = &(*pseg)->next;
+    *pseg = seg->next;
+
+    p->buffered -= av_fifo_can_read(seg->fifo);
+    segment_free(&seg);
+    ff_cond_broadcast(&p->cond);
+}
+
+static PrefetchedSegment *segment_find(SegmentPrefetch *p, const char *url,
+                                       int64_t offset, int64_t size)
+{
+    for (PrefetchedSegment *seg = p->segments; seg; seg = seg->next)
+        if (!seg->taken && seg->offset == offset && seg->size == size &&
+            !strcmp(seg->url, url))
+            return seg;
+    return NULL;
+}
+
+static int prefetch_interrupt_cb(void *opaque)
+{
+    SegmentPrefetch *p = opaque;
+
+    return p->abort || ff_check_interrupt(&p->s->interrupt_callback);
+}
+
+static int same_server(const char *url1, const char *url2)
+{
+    char proto1[16], proto2[16], host1[1024], host2[1024];
+    int port1, port2;
+
+    av_url_split(proto1, sizeof(proto1), NULL, 0, host1, sizeof(host1),
+                 &port1, NULL, 0, url1);
+    av_url_split(proto2, sizeof(proto2), NULL, 0, host2, sizeof(host2),
+                 &port2, NULL, 0, url2);
+    return !strcmp(proto1, proto2) && !strcmp(host1, host2) && port1 == port2;
+}
+
+/* Open a segment, reusing the connection of the previous one if possible.
+ * Returns 1 if the connection was reused. */
+static int open_segment(PrefetchWorker *w, PrefetchedSegment *seg)
+{
+    SegmentPrefetch *p = w->p;
+    AVFormatContext *s = p->s;
+    AVDictionary *opts = NULL;
+    int ret;
+
+    if (w->pb && !same_server(w->pb_url, seg->url))
+        avio_closep(&w->pb);
+
+    if ((ret = av_dict_copy(&opts, seg->opts, 0)) < 0)
+        return ret;
+
+#if CONFIG_HTTP_PROTOCOL
+    if (w->pb) {
+        URLContext *uc = ffio_geturlcontext(w->pb);
+
+        w->pb->eof_reached = 0;
+        ret = ff_http_do_new_request2(uc, seg->url, &opts);
+        if (ret >= 0) {
+            av_dict_free(&opts);
+            return 1;
+        }
+        avio_closep(&w->pb);
+        av_dict_free(&opts);
+        if ((ret = av_dict_copy(&opts, seg->opts, 0)) < 0)
+            return ret;
+    }
+#endif
+
+    av_dict_set(&opts, "multiple_requests", "1", 0);
+    ret = ffio_open_whitelist(&w->pb, seg->url, AVIO_FLAG_READ, &p->interrupt_cb,
+                              &opts, s->protocol_whitelist, s->protocol_blacklist);
+    if (ret >= 0) {
+        av_free(w->pb_url);
+        if (!(w->pb_url = av_strdup(seg->url))) {
+            avio_closep(&w->pb);
+            ret = AVERROR(ENOMEM);
+        }
+    }
+    av_dict_free(&opts);
+    return ret;
+}
+
+static void download_segment(PrefetchWorker *w, PrefetchedSegment *seg)
+{
+    SegmentPrefetch *p = w->p;
+    int reused, ret;
+
+    ret = reused = open_segment(w, seg);
+    while (ret >= 0) {
+        int len = CHUNK_SIZE;
+
+        ff_mutex_lock(&p->mutex);
+        /* A segment being read is not held back by the others, as its
+         * reader may be what keeps them from being read, only by its own
+         * unread data. */
+        while (!seg->released && !p->abort &&
+               (seg->taken ? av_fifo_can_read(seg->fifo) >= p->max_size
+                           : p->buffered >= p->max_size))
+            ff_cond_wait(&p->cond, &p->mutex);
+        ret = seg->released || p->abort ? AVERROR_EXIT : 0;
+        ff_mutex_unlock(&p->mutex);
+        if (ret < 0)
+            break;
+
+        if (seg->size >= 0)
+            len = FFMIN(len, seg->size - seg->downloaded);
+        if (!len) {
+            ret = AVERROR_EOF;
+            break;
+        }
+
+        ret = avio_read(w->pb, w->buf, len);
+        if (ret <= 0) {
+            ret = ret ? ret : AVERROR_EOF;
+            break;
+        }
+
+        ff_mutex_lock(&p->mutex);
+        len = ret;
+        ret = av_fifo_write(seg->fifo, w->buf, len);
+        if (ret >= 0) {
+            seg->downloaded += len;
+            p->buffered     += len;
+            ff_cond_broadcast(&p->data_cond);
+        }
+        ff_mutex_unlock(&p->mutex);
+    }
+
+    /* Only a connection whose response was read completely can be reused */
+    if (ret != AVERROR_EOF || !av_strstart(seg->url, "http", NULL))
+        avio_closep(&w->pb);
+    if (ret != AVERROR_EOF && ret != AVERROR_EXIT)
+        av_log(p->s, AV_LOG_VERBOSE, "Failed to prefetch '%s': %s\n",
+               seg->url, av_err2str(ret));
+
+    ff_mutex_lock(&p->mutex);
+    seg->error = ret;
+    seg->state = SEGMENT_DONE;
+    p->nb_downloaded += ret == AVERROR_EOF;
+    p->nb_reused     += reused > 0;
+    if (seg->released)
+        segment_remove(p, seg);
+    ff_cond_broadcast(&p->data_cond);
+    ff_mutex_unlock(&p->mutex);
+}
+
+static void *prefetch_worker(void *arg)
+{
+    PrefetchWorker *w = arg;
+    SegmentPrefetch *p = w->p;
+
+    ff_mutex_lock(&p->mutex);
+    while (!p->abort) {
+        PrefetchedSegment *seg = NULL;
+
+        if (p->buffered < p->max_size)
+            for (seg = p->segments; seg && seg->state != SEGMENT_QUEUED; seg = seg->next);
+        if (!seg) {
+            ff_cond_wait(&p->cond, &p->mutex);
+            continue;
+        }
+        seg->state = SEGMENT_RUNNING;
+        ff_mutex_unlock(&p->mutex);
+
+        download_segment(w, seg);
+
+        ff_mutex_lock(&p->mutex);
+    }
+    ff_mutex_unlock(&p->mutex);
+
+    avio_closep(&w->pb);
+    return NULL;
+}
+
+int ff_segment_prefetch_alloc(SegmentPrefetch **pp, AVFormatContext *s,
+                              int nb_connections, int64_t max_size)
+{
+    SegmentPrefetch *p;
+    int ret;
+
+    /* The downloads are opened with the protocols directly, which would
+     * bypass the custom I/O, authentication or cookies of the caller. */
+    if (!ff_format_io_open_is_default(s)) {
+        av_log(s, AV_LOG_WARNING, "Segment prefetching is disabled with a custom io_open callback\n");
+        return AVERROR(ENOSYS);
+    }
+
+    p = av_mallocz(sizeof(*p));
+    if (!p)
+        return AVERROR(ENOMEM);
+    p->s        = s;
+    p->max_size = max_size;
+    p->interrupt_cb.callback = prefetch_interrupt_cb;
+    p->interrupt_cb.opaque   = p;
+
+    p->workers = av_calloc(nb_connections, sizeof(*p->workers));
+    if (!p->workers) {
+        av_free(p);
+        return AVERROR(ENOMEM);
+    }
+    for (int i = 0; i < nb_connections; i++) {
+        p->workers[i].p   = p;
+        p->workers[i].buf = av_malloc(CHUNK_SIZE);
+        if (!p->workers[i].buf) {
+            ret = ENOMEM;
+            goto fail;
+        }
+    }
+
+    if ((ret = ff_mutex_init(&p->mutex, NULL)))
+        goto fail;
+    if ((ret = ff_cond_init(&p->cond, NULL))) {
+        ff_mutex_destroy(&p->mutex);
+        goto fail;
+    }
+    if ((ret = ff_cond_init(&p->data_cond, NULL))) {
+        ff_cond_destroy(&p->cond);
+        ff_mutex_destroy(&p->mutex);
+        goto fail;
+    }
+
+    for (; p->nb_workers < nb_connections; p->nb_workers++) {
+        PrefetchWorker *w = &p->workers[p->nb_workers];
+
+        if ((ret = pthread_create(&w->thread, NULL, prefetch_worker, w))) {
+            ret = AVERROR(ret);
+            ff_segment_prefetch_free(&p);
+            return ret;
+        }
+    }
+
+    *pp = p;
+    return 0;
+
+fail:
+    for (int i = 0; i < nb_connections; i++)
+        av_free(p->workers[i].buf);
+    av_free(p->workers);
+    av_free(p);
+    return AVERROR(ret);
+}
+
+void ff_segment_prefetch_free(SegmentPrefetch **pp)
+{
+    SegmentPrefetch *p = *pp;
+
+    if (!p)
+        return;
+
+    ff_mutex_lock(&p->mutex);
+    p->abort = 1;
+    ff_cond_broadcast(&p->cond);
+    ff_mutex_unlock(&p->mutex);
+
+    for (int i = 0; i < p->nb_workers; i++)
+        pthread_join(p->workers[i].thread, NULL);
+
+    av_log(p->s, AV_LOG_VERBOSE, "%d segments prefetched, %d of them used, "
+           "%d connections reused\n", p->nb_downloaded, p->nb_taken, p->nb_reused);
+
+    while (p->segments) {
+        PrefetchedSegment *seg = p->segments;
+        p->segments = seg->next;
+        segment_free(&seg);
+    }
+    for (int i = 0; i < p->nb_workers; i++) {
+        av_free(p->workers[i].buf);
+        av_free(p->workers[i].pb_url);
+    }
+    av_free(p->workers);
+
+    ff_cond_destroy(&p->data_cond);
+    ff_cond_destroy(&p->cond);
+    ff_mutex_destroy(&p->mutex);
+    av_freep(pp);
+}
+
+int ff_segment_prefetch_add(SegmentPrefetch *p, const char *url,
+                            int64_t offset, int64_t size,
+                            const AVDictionary *opts)
+{
+    PrefetchedSegment *seg, **pseg;
+    int ret = 0;
+
+    ff_mutex_lock(&p->mutex);
+    if (segment_find(p, url, offset, size))
+        goto end;
+
+    seg = av_mallocz(sizeof(*seg));
+    if (!seg) {
+        ret = AVERROR(ENOMEM);
+        goto end;
+    }
+    seg->offset = offset;
+    seg->size   = size;
+    seg->url    = av_strdup(url);
+    seg->fifo   = av_fifo_alloc2(CHUNK_SIZE, 1, AV_FIFO_FLAG_AUTO_GROW);
+    if (!seg->url || !seg->fifo ||
+        (ret = av_dict_copy(&seg->opts, opts, 0)) < 0) {
+        segment_free(&seg);
+        ret = ret < 0 ? ret : AVERROR(ENOMEM);
+        goto end;
+    }
+    /* The download waits before a chunk would take the segment over
+     * max_size, see download_segment() */
+    av_fifo_auto_grow_limit(seg->fifo, FFMIN(p->max_size, SIZE_MAX - CHUNK_SIZE) + CHUNK_SIZE);
+
+    for (pseg = &p->segments; *pseg; pseg = &(*pseg)->next);
+    *pseg = seg;
+    ff_cond_signal(&p->cond);
+
+end:
+    ff_mutex_unlock(&p->mutex);
+    return ret;
+}
+
+PrefetchedSegment *ff_segment_prefetch_take(SegmentPrefetch *p, const char *url,
+                                            int64_t offset, int64_t size)
+{
+    PrefetchedSegment *seg;
+
+    ff_mutex_lock(&p->mutex);
+    seg = segment_find(p, url, offset, size);
+    if (seg && (seg->state == SEGMENT_QUEUED ||
+                (seg->state == SEGMENT_DONE && seg->error != AVERROR_EOF))) {
+        segment_remove(p, seg);
+        seg = NULL;
+    }
+    if (seg) {
+        seg->taken = 1;
+        p->nb_taken++;
+        ff_cond_broadcast(&p->cond);
+    }
+    ff_mutex_unlock(&p->mutex);
+
+    return seg;
+}
+
+int ff_segment_prefetch_read(SegmentPrefetch *p, PrefetchedSegment *seg,
+                             uint8_t *buf, int size)
+{
+    int ret = 0;
+
+    ff_mutex_lock(&p->mutex);
+    while (ret < size) {
+        size_t len = FFMIN(av_fifo_can_read(seg->fifo), size - ret);
+
+        if (len) {
+            av_fifo_read(seg->fifo, buf + ret, len);
+            p->buffered -= len;
+            ret         += len;
+            ff_cond_broadcast(&p->cond);
+        } else if (seg->state == SEGMENT_DONE) {
+            break;
+        } else {
+            ff_cond_wait(&p->data_cond, &p->mutex);
+        }
+    }
+    if (!ret)
+        ret = seg->error;
+    ff_mutex_unlock(&p->mutex);
+
+    return ret;
+}
+
+void ff_segment_prefetch_release(SegmentPrefetch *p, PrefetchedSegment **pseg)
+{
+    PrefetchedSegment *seg = *pseg;
+
+    if (!seg)
+        return;
+
+    ff_mutex_lock(&p->mutex);
+    if (seg->state == SEGMENT_RUNNING) {
+        seg->released = 1;
+        ff_cond_broadcast(&p->cond);
+    } else {
+        segment_remove(p, seg);
+    }
+    ff_mutex_unlock(&p->mutex);
+    *pseg = NULL;
+}
+
+void ff_segment_prefetch_flush(SegmentPrefetch *p)
+{
+    PrefetchedSegment *seg, *next;
+
+    if (!p)
+        return;
+
+    ff_mutex_lock(&p->mutex);
+    for (seg = p->segments; seg; seg = next) {
+        next = seg->next;
+        if (seg->taken)
+            continue;
+        if (seg->state == SEGMENT_RUNNING) {
+            seg->released = 1;
+            ff_cond_broadcast(&p->cond);
+        } else {
+            segment_remove(p, seg);
+        }
+    }
+    ff_mutex_unlock(&p->mutex);
+}
+
+#else
+
+int ff_segment_prefetch_alloc(SegmentPrefetch **pp, AVFormatContext *s,
+                              int nb_connections, int64_t max_size)
+{
+    av_log(s, AV_LOG_WARNING, "Segment prefetching is not supported on this build\n");
+    return AVERROR(ENOSYS);
+}
+
+void ff_segment_prefetch_free(SegmentPrefetch **pp)
+{
+}
+
+int ff_segment_prefetch_add(SegmentPrefetch *p, const char *url,
+                            int64_t offset, int64_t size,
+                            const AVDictionary *opts)
+{
+    return AVERROR(ENOSYS);
+}
+
+PrefetchedSegment *ff_segment_prefetch_take(SegmentPrefetch *p, const char *url,
+                                            int64_t offset, int64_t size)
+{
+    return NULL;
+}
+
+int ff_segment_prefetch_read(SegmentPrefetch *p, PrefetchedSegment *seg,
+                             uint8_t *buf, int size)
+{
+    return AVERROR(ENOSYS);
+}
+
+void ff_segment_prefetch_release(SegmentPrefetch *p, PrefetchedSegment **pseg)
+{
+}
+
+void ff_segment_prefetch_flush(SegmentPrefetch *p)
+{
+}
+
+#endif /* HAVE_PTHREADS */
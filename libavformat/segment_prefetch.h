@@ -0,0 +1,107 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef AVFORMAT_SEGMENT_PREFETCH_H
+#define AVFORMAT_SEGMENT_PREFETCH_H
+
+#include <stdint.h>
+
+#include "libavutil/dict.h"
+#include "avformat.h"
+
+/**
+ * @file
+ * Download the segments of adaptive streaming demuxers ahead of time.
+ *
+ * Queued segments are downloaded in order into memory by a pool of worker
+ * threads, each with its own connection, which is kept alive between
+ * downloads where the protocol allows it. The demuxer takes a segment out
+ * of the pool when it gets to it and reads it while the download is still
+ * in progress. The downloads are opened with the protocols directly, so
+ * prefetching is only available while the io_open callback of the demuxer
+ * is the default one.
+ */
+
+typedef struct SegmentPrefetch SegmentPrefetch;
+typedef struct PrefetchedSegment PrefetchedSegment;
+
+/**
+ * Start the worker threads.
+ *
+ * @param s              demuxer, whose interrupt callback and protocol
+ *                       whitelists apply to the downloads
+ * @param nb_connections number of segments downloaded at the same time
+ * @param max_size       maximum amount of downloaded data kept in memory
+ * @return 0 on success, AVERROR(ENOSYS) if not supported on this build or
+ *         with the io_open callback of s, which is logged, another negative
+ *         error code on failure
+ */
+int ff_segment_prefetch_alloc(SegmentPrefetch **pp, AVFormatContext *s,
+                              int nb_connections, int64_t max_size);
+
+/**
+ * Stop the downloads and free the pool. All the segments taken out of it
+ * must have been released.
+ */
+void ff_segment_prefetch_free(SegmentPrefetch **pp);
+
+/**
+ * Queue the download of a segment, unless it is queued already.
+ *
+ * @param url    URL of the segment
+ * @param offset byte offset of the segment in the URL, which is requested
+ *               through the options
+ * @param size   size of the segment, -1 for the rest of the URL
+ * @param opts   options to open the URL with
+ */
+int ff_segment_prefetch_add(SegmentPrefetch *p, const char *url,
+                            int64_t offset, int64_t size,
+                            const AVDictionary *opts);
+
+/**
+ * Take a segment out of the pool to read it.
+ *
+ * @return the segment, or NULL if it was not queued, its download did not
+ *         start yet or failed, in which case the caller has to open it
+ *         itself
+ */
+PrefetchedSegment *ff_segment_prefetch_take(SegmentPrefetch *p, const char *url,
+                                            int64_t offset, int64_t size);
+
+/**
+ * Read from a segment taken out of the pool, waiting for the download
+ * as needed.
+ *
+ * @return the number of bytes read, which is less than size only at the
+ *         end of the segment, AVERROR_EOF or the download error once all
+ *         the data has been read
+ */
+int ff_segment_prefetch_read(SegmentPrefetch *p, PrefetchedSegment *seg,
+                             uint8_t *buf, int size);
+
+/**
+ * Give a segment taken out of the pool back, stopping its download.
+ */
+void ff_segment_prefetch_release(SegmentPrefetch *p, PrefetchedSegment **pseg);
+
+/**
+ * Drop all the queued segments which were not taken, e.g. after a seek.
+ */
+void ff_segment_prefetch_flush(SegmentPrefetch *p);
+
+#endif /* AVFORMAT_SEGMENT_PREFETCH_H */
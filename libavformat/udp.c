@@ -26,6 +26,7 @@
 
 #define _DEFAULT_SOURCE
 #define _BSD_SOURCE     /* Needed for using struct ip_mreq with recent glibc */
+#define _GNU_SOURCE     /* Needed for recvmmsg() and sendmmsg() */
 
 #include "avformat.h"
 #include "libavutil/avassert.h"
@@ -59,6 +60,10 @@
 #define IPPROTO_UDPLITE                                  136
 #endif
 
+#if HAVE_RECVMMSG || HAVE_SENDMMSG
+#include <netinet/udp.h>
+#endif
+
 #if HAVE_W32THREADS
 #undef HAVE_PTHREAD_CANCEL
 #define HAVE_PTHREAD_CANCEL 1
@@ -77,6 +82,16 @@
 #define UDP_RX_BUF_SIZE 393216
 #define UDP_MAX_PKT_SIZE 65536
 #define UDP_HEADER_SIZE 8
+/* kernel limits of a segmentation offloaded (GSO) send */
+#define UDP_GSO_MAX_SEGS 64
+#define UDP_GSO_MAX_SIZE (65535 - UDP_HEADER_SIZE - 20)
+
+#if HAVE_RECVMMSG || HAVE_SENDMMSG
+typedef union UDPControl {
+    char buf[CMSG_SPACE(sizeof(int))];
+    struct cmsghdr align;
+} UDPControl;
+#endif
 
 typedef struct UDPContext {
     const AVClass *class;
@@ -115,6 +130,27 @@ typedef struct UDPContext {
     char *sources;
     char *block;
     IPSourceFilters filters;
+
+    /* Batched I/O, up to batch datagrams per recvmmsg()/sendmmsg() call */
+    int batch;
+    int batch_delay;
+    int gro;
+    int gso;
+#if HAVE_RECVMMSG || HAVE_SENDMMSG
+    uint8_t *batch_buf;
+    int batch_buf_size;
+    struct mmsghdr *msgs;
+    struct iovec *iovs;
+    struct sockaddr_storage *batch_addrs;
+    UDPControl *batch_control;
+    int nb_msgs;                ///< number of messages received in the last batch
+    int next_msg;               ///< next received message to return
+    int next_off;               ///< offset of the next segment in next_msg
+    int gro_size;               ///< segment size of next_msg
+    int tx_nb;                  ///< number of queued datagrams
+    int tx_len;                 ///< total size of the queued datagrams
+    int64_t tx_deadline;        ///< time by which the queued datagrams are sent
+#endif
 } UDPContext;
 
 #define OFFSET(x) offsetof(UDPContext, x)
@@ -139,6 +175,10 @@ static const AVOption options[] = {
     { "timeout",        "set raise error timeout, in microseconds (only in read mode)",OFFSET(timeout),         AV_OPT_TYPE_INT,  {.i64 = 0}, 0, INT_MAX, D },
     { "sources",        "Source list",                                     OFFSET(sources),        AV_OPT_TYPE_STRING, { .str = NULL },               .flags = D|E },
     { "block",          "Block list",                                      OFFSET(block),          AV_OPT_TYPE_STRING, { .str = NULL },               .flags = D|E },
+    { "batch",          "Number of datagrams per system call, 0 disables batching", OFFSET(batch), AV_OPT_TYPE_INT,    { .i64 = 0 },      0, 1024,    .flags = D|E },
+    { "batch_delay",    "Maximum time to hold queued datagrams back, in microseconds (batch output only)", OFFSET(batch_delay), AV_OPT_TYPE_INT, { .i64 = 1000 }, 0, INT_MAX, E },
+    { "gro",            "Receive coalesced datagrams (batch mode only)",   OFFSET(gro),            AV_OPT_TYPE_BOOL,   { .i64 = 0 },      0, 1,       D },
+    { "gso",            "Send segmentation offloaded datagrams (batch mode only)", OFFSET(gso),    AV_OPT_TYPE_BOOL,   { .i64 = 0 },      0, 1,       E },
     { NULL }
 };
 
@@ -478,7 +518,258 @@ static int udp_get_file_handle(URLContext *h)
     return s->udp_fd;
 }
 
+#if HAVE_RECVMMSG || HAVE_SENDMMSG
+static void udp_batch_free(UDPContext *s)
+{
+    av_freep(&s->batch_buf);
+    av_freep(&s->msgs);
+    av_freep(&s->iovs);
+    av_freep(&s->batch_addrs);
+    av_freep(&s->batch_control);
+}
+
+static int udp_batch_alloc(URLContext *h, int is_output)
+{
+    UDPContext *s = h->priv_data;
+    int slot_size = 0;
+
+    if (is_output) {
+        /* datagrams are queued back to back, as needed for GSO */
+        s->batch_buf_size = FFMAX((int64_t)s->batch * FFMAX(s->pkt_size, 0),
+                                  sizeof(s->tmp));
+    } else {
+        /* a GRO message may hold up to 64 KB of coalesced datagrams */
+        slot_size = s->gro || s->pkt_size <= 0 ? UDP_MAX_PKT_SIZE : s->pkt_size;
+        s->batch_buf_size = s->batch * slot_size;
+    }
+
+    s->batch_buf     = av_malloc(s->batch_buf_size);
+    s->msgs          = av_calloc(s->batch, sizeof(*s->msgs));
+    s->iovs          = av_calloc(s->batch, sizeof(*s->iovs));
+    s->batch_addrs   = av_calloc(s->batch, sizeof(*s->batch_addrs));
+    s->batch_control = av_calloc(s->batch, sizeof(*s->batch_control));
+    if (!s->batch_buf || !s->msgs || !s->iovs || !s->batch_addrs || !s->batch_control) {
+        udp_batch_free(s);
+        return AVERROR(ENOMEM);
+    }
+
+    for (int i = 0; i < s->batch; i++) {
+        struct msghdr *hdr = &s->msgs[i].msg_hdr;
+
+        hdr->msg_iov    = &s->iovs[i];
+        hdr->msg_iovlen = 1;
+        if (!is_output) {
+            s->iovs[i].iov_base = s->batch_buf + i * slot_size;
+            s->iovs[i].iov_len  = slot_size;
+            hdr->msg_name       = &s->batch_addrs[i];
+        }
+    }
+    return 0;
+}
+#endif
+
+#if HAVE_RECVMMSG
+/**
+ * Receive up to batch datagrams with a single system call.
+ * @return the number of received messages or a negative error code
+ */
+static int udp_recv_batch(UDPContext *s, int flags)
+{
+    int ret;
+
+    for (int i = 0; i < s->batch; i++) {
+        struct msghdr *hdr = &s->msgs[i].msg_hdr;
+
+        hdr->msg_namelen    = sizeof(s->batch_addrs[i]);
+        hdr->msg_control    = s->gro ? s->batch_control[i].buf : NULL;
+        hdr->msg_controllen = s->gro ? sizeof(s->batch_control[i].buf) : 0;
+        hdr->msg_flags      = 0;
+    }
+
+    ret = recvmmsg(s->udp_fd, s->msgs, s->batch, flags, NULL);
+    if (ret < 0)
+        return ff_neterrno();
+
+    s->nb_msgs  = ret;
+    s->next_msg = 0;
+    s->next_off = 0;
+    return ret;
+}
+
+/**
+ * Return the next datagram of the last received batch, splitting messages
+ * coalesced by GRO back into the original datagrams.
+ * @return the size of the datagram, or AVERROR(EAGAIN) if the batch is
+ *         exhausted
+ */
+static int udp_next_datagram(URLContext *h, const uint8_t **data)
+{
+    UDPContext *s = h->priv_data;
+
+    while (s->next_msg < s->nb_msgs) {
+        const struct mmsghdr *msg = &s->msgs[s->next_msg];
+        int len;
+
+        if (!s->next_off) {
+            if (ff_ip_check_source_lists(msg->msg_hdr.msg_name, &s->filters)) {
+                s->next_msg++;
+                continue;
+            }
+            if (msg->msg_hdr.msg_flags & MSG_TRUNC)
+                av_log(h, AV_LOG_WARNING, "Part of datagram lost due to insufficient pkt_size\n");
+
+            s->gro_size = msg->msg_len;
+#ifdef UDP_GRO
+            for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg->msg_hdr); cmsg;
+                 cmsg = CMSG_NXTHDR((struct msghdr *)&msg->msg_hdr, cmsg)) {
+                if (cmsg->cmsg_level == SOL_UDP && cmsg->cmsg_type == UDP_GRO) {
+                    int gro_size;
+                    memcpy(&gro_size, CMSG_DATA(cmsg), sizeof(gro_size));
+                    if (gro_size > 0)
+                        s->gro_size = gro_size;
+                }
+            }
+#endif
+        }
+
+        *data = (const uint8_t *)s->iovs[s->next_msg].iov_base + s->next_off;
+        len   = FFMIN(msg->msg_len - s->next_off, s->gro_size);
+
+        s->next_off += len;
+        if (s->next_off >= msg->msg_len) {
+            s->next_msg++;
+            s->next_off = 0;
+        }
+        return len;
+    }
+    return AVERROR(EAGAIN);
+}
+#endif
+
+#if HAVE_SENDMMSG
+static int udp_tx_max(const UDPContext *s)
+{
+    return s->gso ? FFMIN(s->batch, UDP_GSO_MAX_SEGS) : s->batch;
+}
+
+/**
+ * Check whether a datagram of the given size can be added to the queued
+ * ones.
+ */
+static int udp_tx_fits(const UDPContext *s, int size)
+{
+    if (s->tx_nb >= udp_tx_max(s) || s->tx_len + size > s->batch_buf_size)
+        return 0;
+    /* GSO cuts a single buffer into segments of the size of the first one,
+     * only the last segment may be shorter */
+    if (s->gso && s->tx_nb)
+        return size <= s->iovs[0].iov_len &&
+               s->tx_len == s->tx_nb * s->iovs[0].iov_len &&
+               s->tx_len + size <= UDP_GSO_MAX_SIZE;
+    return 1;
+}
+
+/**
+ * Queue a datagram of the given size, udp_tx_fits() must have been checked.
+ * @return the location to write the datagram to
+ */
+static uint8_t *udp_tx_append(UDPContext *s, int size)
+{
+    uint8_t *dst = s->batch_buf + s->tx_len;
+
+    s->iovs[s->tx_nb].iov_base = dst;
+    s->iovs[s->tx_nb].iov_len  = size;
+    s->tx_nb++;
+    s->tx_len += size;
+    return dst;
+}
+
+/**
+ * Send all the queued datagrams, with a single GSO message or with as few
+ * sendmmsg() calls as possible.
+ */
+static int udp_tx_flush(UDPContext *s)
+{
+    int nb = s->tx_nb, sent = 0, ret = 0;
+
+    for (int i = 0; i < nb; i++) {
+        struct msghdr *hdr = &s->msgs[i].msg_hdr;
+
+        hdr->msg_name       = s->is_connected ? NULL : &s->dest_addr;
+        hdr->msg_namelen    = s->is_connected ? 0 : s->dest_addr_len;
+        hdr->msg_iov        = &s->iovs[i];
+        hdr->msg_control    = NULL;
+        hdr->msg_controllen = 0;
+    }
+
+#ifdef UDP_SEGMENT
+    if (s->gso && nb > 1) {
+        struct msghdr *hdr = &s->msgs[0].msg_hdr;
+        struct iovec iov = { .iov_base = s->batch_buf, .iov_len = s->tx_len };
+        struct cmsghdr *cmsg;
+        uint16_t gso_size = s->iovs[0].iov_len;
+
+        hdr->msg_iov        = &iov;
+        hdr->msg_control    = s->batch_control[0].buf;
+        hdr->msg_controllen = sizeof(s->batch_control[0].buf);
+        cmsg = CMSG_FIRSTHDR(hdr);
+        cmsg->cmsg_level = SOL_UDP;
+        cmsg->cmsg_type  = UDP_SEGMENT;
+        cmsg->cmsg_len   = CMSG_LEN(sizeof(gso_size));
+        memcpy(CMSG_DATA(cmsg), &gso_size, sizeof(gso_size));
+        hdr->msg_controllen = CMSG_SPACE(sizeof(gso_size));
+
+        while ((ret = sendmsg(s->udp_fd, hdr, 0)) < 0) {
+            ret = ff_neterrno();
+            if (ret != AVERROR(EAGAIN) && ret != AVERROR(EINTR))
+                break;
+        }
+        nb = 0;
+    }
+#endif
+
+    while (sent < nb) {
+        ret = sendmmsg(s->udp_fd, s->msgs + sent, nb - sent, 0);
+        if (ret < 0) {
+            ret = ff_neterrno();
+            if (ret != AVERROR(EAGAIN) && ret != AVERROR(EINTR))
+                break;
+            continue;
+        }
+        sent += ret;
+    }
+
+    s->tx_nb  = 0;
+    s->tx_len = 0;
+    return FFMIN(ret, 0);
+}
+#endif
+
 #if HAVE_PTHREAD_CANCEL
+static int udp_fifo_put(URLContext *h, const uint8_t *data, int len)
+{
+    UDPContext *s = h->priv_data;
+    uint8_t tmp[4];
+
+    if (av_fifo_can_write(s->fifo) < len + 4) {
+        /* No Space left */
+        if (s->overrun_nonfatal) {
+            av_log(h, AV_LOG_WARNING, "Circular buffer overrun. "
+                    "Surviving due to overrun_nonfatal option\n");
+            return 0;
+        } else {
+            av_log(h, AV_LOG_ERROR, "Circular buffer overrun. "
+                    "To avoid, increase fifo_size URL option. "
+                    "To survive in such case, use overrun_nonfatal option\n");
+            return AVERROR(EIO);
+        }
+    }
+    AV_WL32(tmp, len);
+    av_fifo_write(s->fifo, tmp, 4);
+    av_fifo_write(s->fifo, data, len);
+    return 0;
+}
+
 static void *circular_buffer_task_rx( void *_URLContext)
 {
     URLContext *h = _URLContext;
@@ -495,7 +786,7 @@ static void *circular_buffer_task_rx( void *_URLContext)
         goto end;
     }
     while(1) {
-        int len;
+        int len, ret;
         struct sockaddr_storage addr;
         socklen_t addr_len = sizeof(addr);
 
@@ -504,7 +795,13 @@ static void *circular_buffer_task_rx( void *_URLContext)
            see "General Information" / "Thread Cancelation Overview"
            in Single Unix. */
         pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, &old_cancelstate);
-        len = recvfrom(s->udp_fd, s->tmp+4, sizeof(s->tmp)-4, 0, (struct sockaddr *)&addr, &addr_len);
+#if HAVE_RECVMMSG
+        if (s->batch) {
+            /* wait for one datagram and take all the others already queued */
+            len = udp_recv_batch(s, MSG_WAITFORONE);
+        } else
+#endif
+        len = recvfrom(s->udp_fd, s->tmp, sizeof(s->tmp), 0, (struct sockaddr *)&addr, &addr_len);
         pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, &old_cancelstate);
         pthread_mutex_lock(&s->mutex);
         if (len < 0) {
@@ -514,25 +811,26 @@ static void *circular_buffer_task_rx( void *_URLContext)
             }
             continue;
         }
-        if (ff_ip_check_source_lists(&addr, &s->filters))
-            continue;
-        AV_WL32(s->tmp, len);
+#if HAVE_RECVMMSG
+        if (s->batch) {
+            const uint8_t *data;
 
-        if (av_fifo_can_write(s->fifo) < len + 4) {
-            /* No Space left */
-            if (s->overrun_nonfatal) {
-                av_log(h, AV_LOG_WARNING, "Circular buffer overrun. "
-                        "Surviving due to overrun_nonfatal option\n");
-                continue;
-            } else {
-                av_log(h, AV_LOG_ERROR, "Circular buffer overrun. "
-                        "To avoid, increase fifo_size URL option. "
-                        "To survive in such case, use overrun_nonfatal option\n");
-                s->circular_buffer_error = AVERROR(EIO);
-                goto end;
+            while ((len = udp_next_datagram(h, &data)) >= 0) {
+                if ((ret = udp_fifo_put(h, data, len)) < 0) {
+                    s->circular_buffer_error = ret;
+                    goto end;
+                }
             }
+            pthread_cond_signal(&s->cond);
+            continue;
+        }
+#endif
+        if (ff_ip_check_source_lists(&addr, &s->filters))
+            continue;
+        if ((ret = udp_fifo_put(h, s->tmp, len)) < 0) {
+            s->circular_buffer_error = ret;
+            goto end;
         }
-        av_fifo_write(s->fifo, s->tmp, len + 4);
         pthread_cond_signal(&s->cond);
     }
 
@@ -550,7 +848,7 @@ static void *circular_buffer_task_tx( void *_URLContext)
     int64_t start_timestamp = av_gettime_relative();
     int64_t sent_bits = 0;
     int64_t burst_interval = s->bitrate ? (s->burst_bits * 1000000 / s->bitrate) : 0;
-    int64_t max_delay = s->bitrate ?  ((int64_t)h->max_packet_size * 8 * 1000000 / s->bitrate + 1) : 0;
+    int64_t max_delay = s->bitrate ?  ((int64_t)h->max_packet_size * FFMAX(s->batch, 1) * 8 * 1000000 / s->bitrate + 1) : 0;
 
     ff_thread_setname("udp-tx");
 
@@ -583,6 +881,21 @@ static void *circular_buffer_task_tx( void *_URLContext)
         av_assert0(len >= 0);
         av_assert0(len <= sizeof(s->tmp));
 
+#if HAVE_SENDMMSG
+        if (s->batch) {
+            /* send all the datagrams already queued that fit in one batch */
+            av_fifo_read(s->fifo, udp_tx_append(s, len), len);
+            while (av_fifo_can_read(s->fifo) >= 4) {
+                av_fifo_peek(s->fifo, tmp, 4, 0);
+                len = AV_RL32(tmp);
+                if (!udp_tx_fits(s, len))
+                    break;
+                av_fifo_drain2(s->fifo, 4);
+                av_fifo_read(s->fifo, udp_tx_append(s, len), len);
+            }
+            len = s->tx_len;
+        } else
+#endif
         av_fifo_read(s->fifo, s->tmp, len);
 
         pthread_mutex_unlock(&s->mutex);
@@ -607,6 +920,20 @@ static void *circular_buffer_task_tx( void *_URLContext)
             target_timestamp = start_timestamp + sent_bits * 1000000 / s->bitrate;
         }
 
+#if HAVE_SENDMMSG
+        if (s->batch) {
+            int ret = udp_tx_flush(s);
+            if (ret < 0) {
+                pthread_mutex_lock(&s->mutex);
+                s->circular_buffer_error = ret;
+                pthread_mutex_unlock(&s->mutex);
+                return NULL;
+            }
+            pthread_mutex_lock(&s->mutex);
+            continue;
+        }
+#endif
+
         p = s->tmp;
         while (len) {
             int ret;
@@ -755,6 +1082,14 @@ static int udp_open(URLContext *h, const char *uri, int flags)
             s->timeout = strtol(buf, NULL, 10);
         if (is_output && av_find_info_tag(buf, sizeof(buf), "broadcast", p))
             s->is_broadcast = strtol(buf, NULL, 10);
+        if (av_find_info_tag(buf, sizeof(buf), "batch", p))
+            s->batch = av_clip(strtol(buf, NULL, 10), 0, 1024);
+        if (is_output && av_find_info_tag(buf, sizeof(buf), "batch_delay", p))
+            s->batch_delay = strtol(buf, NULL, 10);
+        if (av_find_info_tag(buf, sizeof(buf), "gro", p))
+            s->gro = strtol(buf, NULL, 10);
+        if (av_find_info_tag(buf, sizeof(buf), "gso", p))
+            s->gso = strtol(buf, NULL, 10);
     }
     /* handling needed to support options picking from both AVOption and URL */
     s->circular_buffer_size *= 188;
@@ -919,6 +1254,41 @@ static int udp_open(URLContext *h, const char *uri, int flags)
         }
     }
 
+    if (s->batch && !(is_output ? HAVE_SENDMMSG : HAVE_RECVMMSG)) {
+        av_log(h, AV_LOG_WARNING,
+               "'batch' option was set but it is not supported "
+               "on this build (%s support is required)\n",
+               is_output ? "sendmmsg()" : "recvmmsg()");
+        s->batch = 0;
+    }
+#if HAVE_RECVMMSG || HAVE_SENDMMSG
+    if (s->batch) {
+        int one = 1, zero = 0;
+
+        /* check that the kernel supports the requested offloads */
+        if (is_output && s->gso) {
+#ifdef UDP_SEGMENT
+            if (setsockopt(udp_fd, SOL_UDP, UDP_SEGMENT, &zero, sizeof(zero)) < 0)
+#endif
+            {
+                av_log(h, AV_LOG_WARNING, "UDP segmentation offload not available\n");
+                s->gso = 0;
+            }
+        }
+        if (!is_output && s->gro) {
+#ifdef UDP_GRO
+            if (setsockopt(udp_fd, SOL_UDP, UDP_GRO, &one, sizeof(one)) < 0)
+#endif
+            {
+                av_log(h, AV_LOG_WARNING, "UDP receive offload not available\n");
+                s->gro = 0;
+            }
+        }
+        if ((ret = udp_batch_alloc(h, is_output)) < 0)
+            goto fail;
+    }
+#endif
+
     s->udp_fd = udp_fd;
 
 #if HAVE_PTHREAD_CANCEL
@@ -973,6 +1343,9 @@ static int udp_open(URLContext *h, const char *uri, int flags)
     if (udp_fd >= 0)
         closesocket(udp_fd);
     av_fifo_freep2(&s->fifo);
+#if HAVE_RECVMMSG || HAVE_SENDMMSG
+    udp_batch_free(s);
+#endif
     ff_ip_reset_filters(&s->filters);
     return ret;
 }
@@ -1038,6 +1411,29 @@ static int udp_read(URLContext *h, uint8_t *buf, int size)
     }
 #endif
 
+#if HAVE_RECVMMSG
+    if (s->batch) {
+        const uint8_t *data;
+
+        while ((ret = udp_next_datagram(h, &data)) == AVERROR(EAGAIN)) {
+            if (!(h->flags & AVIO_FLAG_NONBLOCK)) {
+                ret = ff_network_wait_fd(s->udp_fd, 0);
+                if (ret < 0)
+                    return ret;
+            }
+            ret = udp_recv_batch(s, 0);
+            if (ret < 0)
+                return ret;
+        }
+        if (ret > size) {
+            av_log(h, AV_LOG_WARNING, "Part of datagram lost due to insufficient buffer size\n");
+            ret = size;
+        }
+        memcpy(buf, data, ret);
+        return ret;
+    }
+#endif
+
     if (!(h->flags & AVIO_FLAG_NONBLOCK)) {
         ret = ff_network_wait_fd(s->udp_fd, 0);
         if (ret < 0)
@@ -1084,6 +1480,25 @@ static int udp_write(URLContext *h, const uint8_t *buf, int size)
         pthread_mutex_unlock(&s->mutex);
         return size;
     }
+#endif
+#if HAVE_SENDMMSG
+    if (s->batch) {
+        int64_t now = av_gettime_relative();
+
+        /* queue the datagram and send the batch once it is full, or once
+         * the first queued datagram has waited for batch_delay */
+        if (!udp_tx_fits(s, size) && (ret = udp_tx_flush(s)) < 0)
+            return ret;
+        if (udp_tx_fits(s, size)) {
+            if (!s->tx_nb)
+                s->tx_deadline = now + s->batch_delay;
+            memcpy(udp_tx_append(s, size), buf, size);
+            if ((s->tx_nb >= udp_tx_max(s) || now >= s->tx_deadline) &&
+                (ret = udp_tx_flush(s)) < 0)
+                return ret;
+            return size;
+        }
+    }
 #endif
     if (!(h->flags & AVIO_FLAG_NONBLOCK)) {
         ret = ff_network_wait_fd(s->udp_fd, 1);
@@ -1139,9 +1554,16 @@ static int udp_close(URLContext *h)
         pthread_mutex_destroy(&s->mutex);
         pthread_cond_destroy(&s->cond);
     }
+#endif
+#if HAVE_SENDMMSG
+    if (s->batch && !(h->flags & AVIO_FLAG_READ))
+        udp_tx_flush(s);
 #endif
     closesocket(s->udp_fd);
     av_fifo_freep2(&s->fifo);
+#if HAVE_RECVMMSG || HAVE_SENDMMSG
+    udp_batch_free(s);
+#endif
     ff_ip_reset_filters(&s->filters);
     return 0;
 }
@@ -26,6 +26,7 @@
 
 #include "avio.h"
 
+#include "libavutil/buffer.h"
 #include "libavutil/dict.h"
 #include "libavutil/log.h"
 
@@ -83,6 +84,9 @@ typedef struct URLProtocol {
     int (*url_get_multi_file_handle)(URLContext *h, int **handles,
                                      int *numhandles);
     int (*url_get_short_seek)(URLContext *h);
+    int (*url_get_mapping)(URLContext *h, AVBufferRef **buf);
+    int (*url_map_range)(URLContext *h, int64_t pos, int size, AVBufferRef **buf);
+    int (*url_flush)(URLContext *h);
     int (*url_shutdown)(URLContext *h, int flags);
     const AVClass *priv_data_class;
     int priv_data_size;
@@ -263,6 +267,30 @@ int ffurl_get_multi_file_handle(URLContext *h, int **handles, int *numhandles);
  */
 int ffurl_get_short_seek(void *urlcontext);
 
+/**
+ * Return a reference to a read-only memory mapping of the whole resource.
+ * The mapping is followed by AV_INPUT_BUFFER_PADDING_SIZE readable bytes.
+ *
+ * @return 0 on success, AVERROR(ENOSYS) if the resource is not mapped
+ */
+int ffurl_get_mapping(URLContext *h, AVBufferRef **buf);
+
+/**
+ * Return a read-only memory mapping of size bytes of the resource at pos,
+ * followed by AV_INPUT_BUFFER_PADDING_SIZE zeroed bytes.
+ *
+ * @return 0 on success, AVERROR(ENOSYS) if the resource cannot be mapped
+ */
+int ffurl_map_range(URLContext *h, int64_t pos, int size, AVBufferRef **buf);
+
+/**
+ * Wait until the data written so far is visible to other readers of the
+ * resource, for protocols which complete writes asynchronously.
+ *
+ * @return 0 on success or if not needed, a negative error code otherwise
+ */
+int ffurl_flush(URLContext *h);
+
 /**
  * Signal the URLContext that we are done reading or writing the stream.
  *
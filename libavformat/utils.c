@@ -22,6 +22,7 @@
 #include <stdint.h>
 
 #include "config.h"
+#include "config_components.h"
 
 #include "libavutil/avstring.h"
 #include "libavutil/bprint.h"
@@ -33,6 +34,7 @@
 
 #include "avformat.h"
 #include "avio_internal.h"
+#include "http.h"
 #include "internal.h"
 #if CONFIG_NETWORK
 #include "network.h"
@@ -101,6 +103,19 @@ FF_ENABLE_DEPRECATION_WARNINGS
 #endif
     pkt->pos  = avio_tell(s);
 
+    if (ffiocontext(s)->readonly_packets && size > 0) {
+        int ret = ffio_read_mapped(s, &pkt->buf, size);
+        if (ret != AVERROR(ENOSYS)) {
+            if (ret < 0)
+                return ret;
+            pkt->data = pkt->buf->data;
+            pkt->size = ret;
+            if (ret < size)
+                pkt->flags |= AV_PKT_FLAG_CORRUPT;
+            return ret;
+        }
+    }
+
     return append_packet_chunked(s, pkt, size);
 }
 
@@ -562,6 +577,9 @@ int avformat_network_init(void)
 
 int avformat_network_deinit(void)
 {
+#if CONFIG_HTTP_PROTOCOL
+    ff_http_pool_deinit();
+#endif
 #if CONFIG_NETWORK
     ff_network_close();
     ff_tls_deinit();
@@ -32,6 +32,8 @@
 #include "attributes.h"
 #include "cpu.h"
 #include "cpu_internal.h"
+#include "error.h"
+#include "log.h"
 #include "opt.h"
 #include "common.h"
 
@@ -53,6 +55,16 @@
 #include <sys/auxv.h>
 #endif
 
+#if HAVE_SCHED_GETAFFINITY && defined(CPU_SET) && defined(__linux__)
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/syscall.h>
+#define NUMA_BIND_SUPPORTED 1
+#else
+#define NUMA_BIND_SUPPORTED 0
+#endif
+
 static atomic_int cpu_flags = -1;
 static atomic_int cpu_count = -1;
 
@@ -271,6 +283,119 @@ void av_cpu_force_count(int count)
     atomic_store_explicit(&cpu_count, count, memory_order_relaxed);
 }
 
+#if NUMA_BIND_SUPPORTED
+#define MAX_NUMA_NODES 64
+#define MASK_BITS      (8 * sizeof(unsigned long))
+
+// values for set_mempolicy(), from linux/mempolicy.h
+#define MPOL_PREFERRED      1
+#define MPOL_PREFERRED_MANY 5
+
+/**
+ * Parse a list in the format used by sysfs ("0-3,8,10-11") into a bit mask.
+ */
+static int parse_id_list(const char *str, unsigned long *mask, int max_id)
+{
+    const char *p = str;
+
+    while (*p && *p != '\n') {
+        char *end;
+        long first, last;
+
+        first = strtol(p, &end, 10);
+        if (end == p || first < 0)
+            return AVERROR(EINVAL);
+        last = first;
+
+        if (*end == '-') {
+            p    = end + 1;
+            last = strtol(p, &end, 10);
+            if (end == p || last < first)
+                return AVERROR(EINVAL);
+        }
+        if (last >= max_id)
+            return AVERROR(EINVAL);
+
+        for (long id = first; id <= last; id++)
+            mask[id / MASK_BITS] |= 1UL << (id % MASK_BITS);
+
+        p = end;
+        if (*p == ',')
+            p++;
+        else if (*p && *p != '\n')
+            return AVERROR(EINVAL);
+    }
+
+    return 0;
+}
+
+static int node_add_cpus(int node, cpu_set_t *cpus)
+{
+    unsigned long mask[CPU_SETSIZE / MASK_BITS] = { 0 };
+    char path[64], buf[4096];
+    FILE *f;
+    int ret;
+
+    snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", node);
+    f = fopen(path, "r");
+    if (!f)
+        return errno == ENOENT ? AVERROR(EINVAL) : AVERROR(errno);
+    if (!fgets(buf, sizeof(buf), f))
+        buf[0] = 0;
+    fclose(f);
+
+    ret = parse_id_list(buf, mask, CPU_SETSIZE);
+    if (ret < 0)
+        return ret;
+
+    for (int i = 0; i < CPU_SETSIZE; i++)
+        if (mask[i / MASK_BITS] & (1UL << (i % MASK_BITS)))
+            CPU_SET(i, cpus);
+
+    return 0;
+}
+#endif
+
+int av_cpu_bind_numa_nodes(const char *nodes)
+{
+#if NUMA_BIND_SUPPORTED
+    unsigned long nodemask[MAX_NUMA_NODES / MASK_BITS] = { 0 };
+    cpu_set_t cpus;
+    int nb_nodes = 0, ret;
+
+    ret = parse_id_list(nodes, nodemask, MAX_NUMA_NODES);
+    if (ret < 0)
+        return ret;
+
+    CPU_ZERO(&cpus);
+    for (int i = 0; i < MAX_NUMA_NODES; i++) {
+        if (!(nodemask[i / MASK_BITS] & (1UL << (i % MASK_BITS))))
+            continue;
+        ret = node_add_cpus(i, &cpus);
+        if (ret < 0)
+            return ret;
+        nb_nodes++;
+    }
+    if (!CPU_COUNT(&cpus))
+        return AVERROR(EINVAL);
+
+    if (sched_setaffinity(0, sizeof(cpus), &cpus))
+        return AVERROR(errno);
+
+#ifdef SYS_set_mempolicy
+    // the kernel expects maxnode to be one more than the number of bits
+    if (syscall(SYS_set_mempolicy, nb_nodes > 1 ? MPOL_PREFERRED_MANY : MPOL_PREFERRED,
+                nodemask, MAX_NUMA_NODES + 1L))
+        av_log(NULL, AV_LOG_VERBOSE, "Could not set the memory policy for "
+               "NUMA nodes %s: %s\n", nodes, av_err2str(AVERROR(errno)));
+#endif
+
+    return 0;
+#else
+    return AVERROR(ENOSYS);
+#endif
+}
+
 size_t av_cpu_max_align(void)
 {
 #if ARCH_MIPS
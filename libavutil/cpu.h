@@ -131,6 +131,24 @@ int av_cpu_count(void);
  */
 void av_cpu_force_count(int count);
 
+/**
+ * Restrict the calling thread to the CPUs of the given NUMA nodes, and make
+ * the memory it touches first be preferably allocated on those nodes.
+ *
+ * Threads created afterwards by the calling thread inherit both settings, and
+ * av_cpu_count() called from it only counts the CPUs of the selected nodes.
+ *
+ * Currently only supported on Linux, where the node topology is read from
+ * sysfs. Failure to set the memory policy (e.g. because it is forbidden in a
+ * container) is not considered an error.
+ *
+ * @param nodes list of node indices and ranges, e.g. "0", "1,3" or "0-1"
+ * @return 0 on success, AVERROR(EINVAL) if nodes is malformed or refers to
+ *         a node without CPUs, AVERROR(ENOSYS) if not supported on this
+ *         platform, another negative error code on failure
+ */
+int av_cpu_bind_numa_nodes(const char *nodes);
+
 /**
  * Get the maximum data alignment that may be required by FFmpeg.
  *
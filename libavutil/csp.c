@@ -298,3 +298,128 @@ av_csp_trc_function av_csp_trc_func_from_id(enum AVColorTransferCharacteristic t
         return NULL;
     return func;
 }
+
+static double trc_bt709_inv(double E)
+{
+    const double a = BT709_alpha;
+    const double b = BT709_beta;
+
+    return (0.0 > E) ? 0.0
+         : (4.5 * b > E) ? E / 4.5
+         :                 pow((E + (a - 1.0)) / a, 1.0 / 0.45);
+}
+
+static double trc_gamma22_inv(double E)
+{
+    return (0.0 > E) ? 0.0 : pow(E, 2.2);
+}
+
+static double trc_gamma28_inv(double E)
+{
+    return (0.0 > E) ? 0.0 : pow(E, 2.8);
+}
+
+static double trc_smpte240M_inv(double E)
+{
+    const double a = 1.1115;
+    const double b = 0.0228;
+
+    return (0.0 > E) ? 0.0
+         : (4.0 * b > E) ? E / 4.0
+         :                 pow((E + (a - 1.0)) / a, 1.0 / 0.45);
+}
+
+static double trc_log_inv(double E)
+{
+    return (0.0 >= E) ? 0.0 : pow(10.0, 2.0 * (E - 1.0));
+}
+
+static double trc_log_sqrt_inv(double E)
+{
+    return (0.0 >= E) ? 0.0 : pow(10.0, 2.5 * (E - 1.0));
+}
+
+static double trc_iec61966_2_4_inv(double E)
+{
+    const double a = BT709_alpha;
+    const double b = BT709_beta;
+
+    return (-4.5 * b >= E) ? -pow((-E + (a - 1.0)) / a, 1.0 / 0.45)
+         : ( 4.5 * b >  E) ? E / 4.5
+         :                   pow(( E + (a - 1.0)) / a, 1.0 / 0.45);
+}
+
+static double trc_bt1361_inv(double E)
+{
+    const double a = BT709_alpha;
+    const double b = BT709_beta;
+
+    return (-4.5 * 0.0045 >= E) ? -pow((-4.0 * E - (a - 1.0)) / a, 1.0 / 0.45) / 4.0
+         : ( 4.5 * b      >  E) ? E / 4.5
+         :                        pow((E + (a - 1.0)) / a, 1.0 / 0.45);
+}
+
+static double trc_iec61966_2_1_inv(double E)
+{
+    const double a = 1.055;
+    const double b = 0.0031308;
+
+    return (0.0 > E) ? 0.0
+         : (12.92 * b > E) ? E / 12.92
+         :                   pow((E + (a - 1.0)) / a, 2.4);
+}
+
+static double trc_smpte_st2084_inv(double E)
+{
+    const double c1 =         3424.0 / 4096.0; // c3-c2 + 1
+    const double c2 =  32.0 * 2413.0 / 4096.0;
+    const double c3 =  32.0 * 2392.0 / 4096.0;
+    const double m  = 128.0 * 2523.0 / 4096.0;
+    const double n  =  0.25 * 2610.0 / 4096.0;
+    const double Em = (0.0 > E) ? 0.0 : pow(E, 1.0 / m);
+
+    return (c1 > Em) ? 0.0
+         :             10000.0 * pow((Em - c1) / (c2 - c3 * Em), 1.0 / n);
+}
+
+static double trc_smpte_st428_1_inv(double E)
+{
+    return (0.0 > E) ? 0.0 : 52.37 / 48.0 * pow(E, 2.6);
+}
+
+static double trc_arib_std_b67_inv(double E)
+{
+    const double a = 0.17883277;
+    const double b = 0.28466892;
+    const double c = 0.55991073;
+
+    return (0.0 > E) ? 0.0
+         : (0.5 >= E) ? E * E / 3.0
+         :              (exp((E - c) / a) + b) / 12.0;
+}
+
+static const av_csp_trc_function trc_inv_funcs[AVCOL_TRC_NB] = {
+    [AVCOL_TRC_BT709] = trc_bt709_inv,
+    [AVCOL_TRC_GAMMA22] = trc_gamma22_inv,
+    [AVCOL_TRC_GAMMA28] = trc_gamma28_inv,
+    [AVCOL_TRC_SMPTE170M] = trc_bt709_inv,
+    [AVCOL_TRC_SMPTE240M] = trc_smpte240M_inv,
+    [AVCOL_TRC_LINEAR] = trc_linear,
+    [AVCOL_TRC_LOG] = trc_log_inv,
+    [AVCOL_TRC_LOG_SQRT] = trc_log_sqrt_inv,
+    [AVCOL_TRC_IEC61966_2_4] = trc_iec61966_2_4_inv,
+    [AVCOL_TRC_BT1361_ECG] = trc_bt1361_inv,
+    [AVCOL_TRC_IEC61966_2_1] = trc_iec61966_2_1_inv,
+    [AVCOL_TRC_BT2020_10] = trc_bt709_inv,
+    [AVCOL_TRC_BT2020_12] = trc_bt709_inv,
+    [AVCOL_TRC_SMPTE2084] = trc_smpte_st2084_inv,
+    [AVCOL_TRC_SMPTE428] = trc_smpte_st428_1_inv,
+    [AVCOL_TRC_ARIB_STD_B67] = trc_arib_std_b67_inv,
+};
+
+av_csp_trc_function av_csp_trc_func_inv_from_id(enum AVColorTransferCharacteristic trc)
+{
+    if (trc >= AVCOL_TRC_NB)
+        return NULL;
+    return trc_inv_funcs[trc];
+}
@@ -143,6 +143,19 @@ double av_csp_approximate_trc_gamma(enum AVColorTransferCharacteristic trc);
  */
 av_csp_trc_function av_csp_trc_func_from_id(enum AVColorTransferCharacteristic trc);
 
+/**
+ * Determine the inverse of the function returned by av_csp_trc_func_from_id(),
+ * converting a non-linear signal back to linear light.
+ *
+ * The linear values use the same scale as the input of the forward function,
+ * e.g. cd/m^2 for AVCOL_TRC_SMPTE2084.
+ *
+ * @return Will return pointer to the function matching the
+ *         supplied Transfer Characteristic. If unspecified will
+ *         return NULL:
+ */
+av_csp_trc_function av_csp_trc_func_inv_from_id(enum AVColorTransferCharacteristic trc);
+
 /**
  * @}
  */
@@ -20,7 +20,9 @@
 
 #include "config.h"
 
+#include <stdatomic.h>
 #include <stdbool.h>
+#include <stddef.h>
 
 #include "mem.h"
 #include "thread.h"
@@ -43,9 +45,21 @@
 
 #endif //!HAVE_THREADS
 
+/**
+ * Tasks sorted by priority, highest first.
+ */
+typedef struct TaskQueue {
+    AVMutex lock;
+    AVTask *head;
+    AVTask *tail;
+} TaskQueue;
+
 typedef struct ThreadInfo {
     AVExecutor *e;
     ExecutorThread thread;
+    // tasks are added to the queues of all workers in turn, and a worker
+    // takes the highest priority task at the head of any of them
+    TaskQueue queue;
 } ThreadInfo;
 
 struct AVExecutor {
@@ -56,43 +70,104 @@ struct AVExecutor {
     ThreadInfo *threads;
     uint8_t *local_contexts;
 
+    // only used to put idle workers to sleep and to wake them up
     AVMutex lock;
     AVCond cond;
-    int die;
+    atomic_int die;
+    atomic_uint nb_sleeping;
+    // incremented whenever a task is added or a wakeup requested
+    atomic_uint generation;
 
-    AVTask *tasks;
+    atomic_uint next_queue;
 };
 
-static AVTask* remove_task(AVTask **prev, AVTask *t)
+static void add_task(const AVTaskCallbacks *cb, TaskQueue *q, AVTask *t)
 {
-    *prev  = t->next;
-    t->next = NULL;
-    return t;
-}
+    AVTask **prev;
+
+    // the common case of tasks added in order of priority does not need a scan
+    if (!q->head || cb->priority_higher(q->tail, t)) {
+        prev    = q->head ? &q->tail->next : &q->head;
+        q->tail = t;
+    } else {
+        for (prev = &q->head; cb->priority_higher(*prev, t); prev = &(*prev)->next)
+            /* nothing */;
+    }
 
-static void add_task(AVTask **prev, AVTask *t)
-{
     t->next = *prev;
     *prev   = t;
 }
 
-static int run_one_task(AVExecutor *e, void *lc)
+// returns the link to the first task that is ready to run, or to NULL
+static AVTask** find_task(const AVTaskCallbacks *cb, TaskQueue *q)
 {
-    AVTaskCallbacks *cb = &e->cb;
-    AVTask **prev;
+    AVTask **prev = &q->head;
 
-    for (prev = &e->tasks; *prev && !cb->ready(*prev, cb->user_data); prev = &(*prev)->next)
-        /* nothing */;
-    if (*prev) {
-        AVTask *t = remove_task(prev, *prev);
-        if (e->thread_count > 0)
-            ff_mutex_unlock(&e->lock);
+    if (cb->ready) {
+        while (*prev && !cb->ready(*prev, cb->user_data))
+            prev = &(*prev)->next;
+    }
+    return prev;
+}
+
+static AVTask* remove_task(TaskQueue *q, AVTask **prev)
+{
+    AVTask *t = *prev;
+
+    if (t == q->tail)
+        q->tail = prev == &q->head ? NULL :
+                  (AVTask*)((char*)prev - offsetof(AVTask, next));
+    *prev   = t->next;
+    t->next = NULL;
+    return t;
+}
+
+static int run_one_task(AVExecutor *e, int idx, void *lc)
+{
+    AVTaskCallbacks *cb = &e->cb;
+    TaskQueue *best_q   = NULL;
+    AVTask **best       = NULL;
+    AVTask *t;
+
+    if (!e->thread_count) {
+        best_q = &e->threads[0].queue;
+        best   = find_task(cb, best_q);
+        if (!*best)
+            return 0;
+        t = remove_task(best_q, best);
         cb->run(t, lc, cb->user_data);
-        if (e->thread_count > 0)
-            ff_mutex_lock(&e->lock);
         return 1;
     }
-    return 0;
+
+    // Take the highest priority ready task of all the queues, and our own on
+    // a tie. The queue of the best task so far stays locked, so that the
+    // task cannot be taken while the others are compared to it; the queues
+    // are locked in index order to avoid deadlocks.
+    for (int i = 0; i < e->thread_count; i++) {
+        TaskQueue *q = &e->threads[i].queue;
+        AVTask **prev;
+
+        ff_mutex_lock(&q->lock);
+        prev = find_task(cb, q);
+        if (*prev && (!best || cb->priority_higher(*prev, *best) ||
+                      (i == idx && !cb->priority_higher(*best, *prev)))) {
+            if (best_q)
+                ff_mutex_unlock(&best_q->lock);
+            best_q = q;
+            best   = prev;
+        } else {
+            ff_mutex_unlock(&q->lock);
+        }
+    }
+
+    if (!best)
+        return 0;
+
+    t = remove_task(best_q, best);
+    ff_mutex_unlock(&best_q->lock);
+
+    cb->run(t, lc, cb->user_data);
+    return 1;
 }
 
 #if HAVE_THREADS
@@ -100,18 +175,23 @@ static void *executor_worker_task(void *data)
 {
     ThreadInfo *ti = (ThreadInfo*)data;
     AVExecutor *e  = ti->e;
-    void *lc       = e->local_contexts + (ti - e->threads) * e->cb.local_context_size;
+    const int idx  = ti - e->threads;
+    void *lc       = e->local_contexts + idx * e->cb.local_context_size;
+
+    while (!atomic_load(&e->die)) {
+        unsigned generation = atomic_load(&e->generation);
 
-    ff_mutex_lock(&e->lock);
-    while (1) {
-        if (e->die) break;
+        if (run_one_task(e, idx, lc))
+            continue;
 
-        if (!run_one_task(e, lc)) {
-            //no task in one loop
+        // no task in one loop, sleep until a task is added after the scan
+        ff_mutex_lock(&e->lock);
+        atomic_fetch_add(&e->nb_sleeping, 1);
+        while (!atomic_load(&e->die) && atomic_load(&e->generation) == generation)
             ff_cond_wait(&e->cond, &e->lock);
-        }
+        atomic_fetch_sub(&e->nb_sleeping, 1);
+        ff_mutex_unlock(&e->lock);
     }
-    ff_mutex_unlock(&e->lock);
     return NULL;
 }
 #endif
@@ -121,13 +201,17 @@ static void executor_free(AVExecutor *e, const int has_lock, const int has_cond)
     if (e->thread_count) {
         //signal die
         ff_mutex_lock(&e->lock);
-        e->die = 1;
+        atomic_store(&e->die, 1);
         ff_cond_broadcast(&e->cond);
         ff_mutex_unlock(&e->lock);
 
         for (int i = 0; i < e->thread_count; i++)
             executor_thread_join(e->threads[i].thread, NULL);
     }
+    if (e->threads) {
+        for (int i = 0; i < e->thread_count; i++)
+            ff_mutex_destroy(&e->threads[i].queue.lock);
+    }
     if (has_cond)
         ff_cond_destroy(&e->cond);
     if (has_lock)
@@ -143,13 +227,17 @@ AVExecutor* av_executor_alloc(const AVTaskCallbacks *cb, int thread_count)
 {
     AVExecutor *e;
     int has_lock = 0, has_cond = 0;
-    if (!cb || !cb->user_data || !cb->ready || !cb->run || !cb->priority_higher)
+    if (!cb || !cb->user_data || !cb->run || !cb->priority_higher)
         return NULL;
 
     e = av_mallocz(sizeof(*e));
     if (!e)
         return NULL;
     e->cb = *cb;
+    atomic_init(&e->die, 0);
+    atomic_init(&e->nb_sleeping, 0);
+    atomic_init(&e->generation, 0);
+    atomic_init(&e->next_queue, 0);
 
     e->local_contexts = av_calloc(FFMAX(thread_count, 1), e->cb.local_context_size);
     if (!e->local_contexts)
@@ -168,11 +256,23 @@ AVExecutor* av_executor_alloc(const AVTaskCallbacks *cb, int thread_count)
     if (!has_lock || !has_cond)
         goto free_executor;
 
+    // all the queues must exist before any worker looks for tasks to steal
+    for (int i = 0; i < thread_count; i++) {
+        if (ff_mutex_init(&e->threads[i].queue.lock, NULL)) {
+            for (int j = 0; j < i; j++)
+                ff_mutex_destroy(&e->threads[j].queue.lock);
+            goto free_executor;
+        }
+    }
+
     for (/* nothing */; e->thread_count < thread_count; e->thread_count++) {
         ThreadInfo *ti = e->threads + e->thread_count;
         ti->e = e;
-        if (executor_thread_create(&ti->thread, NULL, executor_worker_task, ti))
+        if (executor_thread_create(&ti->thread, NULL, executor_worker_task, ti)) {
+            for (int i = e->thread_count; i < thread_count; i++)
+                ff_mutex_destroy(&e->threads[i].queue.lock);
             goto free_executor;
+        }
     }
     return e;
 
@@ -195,18 +295,27 @@ void av_executor_free(AVExecutor **executor)
 void av_executor_execute(AVExecutor *e, AVTask *t)
 {
     AVTaskCallbacks *cb = &e->cb;
-    AVTask **prev;
 
-    if (e->thread_count)
-        ff_mutex_lock(&e->lock);
-    if (t) {
-        for (prev = &e->tasks; *prev && cb->priority_higher(*prev, t); prev = &(*prev)->next)
-            /* nothing */;
-        add_task(prev, t);
-    }
     if (e->thread_count) {
-        ff_cond_signal(&e->cond);
-        ff_mutex_unlock(&e->lock);
+        if (t) {
+            unsigned idx = atomic_fetch_add_explicit(&e->next_queue, 1, memory_order_relaxed);
+            TaskQueue *q = &e->threads[idx % e->thread_count].queue;
+
+            ff_mutex_lock(&q->lock);
+            add_task(cb, q, t);
+            ff_mutex_unlock(&q->lock);
+        }
+
+        // a worker going to sleep either sees the new generation, or is
+        // counted in nb_sleeping here
+        atomic_fetch_add(&e->generation, 1);
+        if (atomic_load(&e->nb_sleeping)) {
+            ff_mutex_lock(&e->lock);
+            ff_cond_signal(&e->cond);
+            ff_mutex_unlock(&e->lock);
+        }
+    } else if (t) {
+        add_task(cb, &e->threads[0].queue, t);
     }
 
     if (!e->thread_count || !HAVE_THREADS) {
@@ -214,7 +323,7 @@ void av_executor_execute(AVExecutor *e, AVTask *t)
             return;
         e->recursive = true;
         // We are running in a single-threaded environment, so we must handle all tasks ourselves
-        while (run_one_task(e, e->local_contexts))
+        while (run_one_task(e, 0, e->local_contexts))
             /* nothing */;
         e->recursive = false;
     }
@@ -36,7 +36,10 @@ typedef struct AVTaskCallbacks {
     // return 1 if a's priority > b's priority
     int (*priority_higher)(const AVTask *a, const AVTask *b);
 
-    // task is ready for run
+    // task is ready for run, may be NULL if every task is ready when it is
+    // added; tasks with dependencies should then count their unfinished
+    // dependencies and only be added once the count drops to zero, which
+    // saves scanning the queued tasks for a ready one
     int (*ready)(const AVTask *t, void *user_data);
 
     // run the task
@@ -59,6 +62,11 @@ void av_executor_free(AVExecutor **e);
 
 /**
  * Add task to executor
+ *
+ * Every worker thread has its own queue, sorted by priority. Tasks are added
+ * to the queues in turn, and a worker runs the highest priority ready task
+ * found at the head of any of the queues.
+ *
  * @param e pointer to executor
  * @param t pointer to task. If NULL, it will wakeup one work thread
  */
@@ -17,11 +17,13 @@
  */
 
 #include <stdatomic.h>
+#include "buffer.h"
 #include "cpu.h"
 #include "internal.h"
 #include "slicethread.h"
 #include "mem.h"
 #include "thread.h"
+#include "threadpool.h"
 #include "avassert.h"
 
 #define MAX_AUTO_THREADS 16
@@ -52,6 +54,10 @@ struct AVSliceThread {
     void            *priv;
     void            (*worker_func)(void *priv, int jobnr, int threadnr, int nb_jobs, int nb_threads);
     void            (*main_func)(void *priv);
+    void            (*thread_init)(void *priv);
+
+    /* if set, jobs run on this pool and there are no workers of our own */
+    AVBufferRef     *pool;
 };
 
 static int run_jobs(AVSliceThread *ctx)
@@ -73,6 +79,9 @@ static void *attribute_align_arg thread_worker(void *v)
     WorkerContext *w = v;
     AVSliceThread *ctx = w->ctx;
 
+    if (ctx->thread_init)
+        ctx->thread_init(ctx->priv);
+
     pthread_mutex_lock(&w->mutex);
     pthread_cond_signal(&w->cond);
 
@@ -95,10 +104,11 @@ static void *attribute_align_arg thread_worker(void *v)
     }
 }
 
-int avpriv_slicethread_create(AVSliceThread **pctx, void *priv,
-                              void (*worker_func)(void *priv, int jobnr, int threadnr, int nb_jobs, int nb_threads),
-                              void (*main_func)(void *priv),
-                              int nb_threads)
+int avpriv_slicethread_create2(AVSliceThread **pctx, void *priv,
+                               void (*worker_func)(void *priv, int jobnr, int threadnr, int nb_jobs, int nb_threads),
+                               void (*main_func)(void *priv),
+                               void (*thread_init)(void *priv),
+                               int nb_threads)
 {
     AVSliceThread *ctx;
     int nb_workers, i;
@@ -129,6 +139,7 @@ int avpriv_slicethread_create(AVSliceThread **pctx, void *priv,
     ctx->priv        = priv;
     ctx->worker_func = worker_func;
     ctx->main_func   = main_func;
+    ctx->thread_init = thread_init;
     ctx->nb_threads  = nb_threads;
     ctx->nb_active_threads = 0;
     ctx->nb_jobs     = 0;
@@ -187,11 +198,55 @@ int avpriv_slicethread_create(AVSliceThread **pctx, void *priv,
     return nb_threads;
 }
 
+int avpriv_slicethread_create(AVSliceThread **pctx, void *priv,
+                              void (*worker_func)(void *priv, int jobnr, int threadnr, int nb_jobs, int nb_threads),
+                              void (*main_func)(void *priv),
+                              int nb_threads)
+{
+    return avpriv_slicethread_create2(pctx, priv, worker_func, main_func,
+                                      NULL, nb_threads);
+}
+
+int avpriv_slicethread_create_pool(AVSliceThread **pctx, void *priv,
+                                   void (*worker_func)(void *priv, int jobnr, int threadnr, int nb_jobs, int nb_threads),
+                                   AVBufferRef *pool, int nb_threads)
+{
+    AVSliceThread *ctx;
+    int max_threads = av_threadpool_get_nb_threads(pool) + 1;
+
+    av_assert0(nb_threads >= 0);
+    if (!nb_threads || nb_threads > max_threads)
+        nb_threads = max_threads;
+
+    *pctx = ctx = av_mallocz(sizeof(*ctx));
+    if (!ctx)
+        return AVERROR(ENOMEM);
+
+    ctx->pool = av_buffer_ref(pool);
+    if (!ctx->pool) {
+        av_freep(pctx);
+        return AVERROR(ENOMEM);
+    }
+
+    ctx->priv        = priv;
+    ctx->worker_func = worker_func;
+    ctx->nb_threads  = nb_threads;
+
+    return nb_threads;
+}
+
 void avpriv_slicethread_execute(AVSliceThread *ctx, int nb_jobs, int execute_main)
 {
     int nb_workers, i, is_last = 0;
 
     av_assert0(nb_jobs > 0);
+
+    if (ctx->pool) {
+        av_threadpool_execute(ctx->pool, ctx->worker_func, ctx->priv,
+                              nb_jobs, ctx->nb_threads, 0);
+        return;
+    }
+
     ctx->nb_jobs           = nb_jobs;
     ctx->nb_active_threads = FFMIN(nb_jobs, ctx->nb_threads);
     atomic_store_explicit(&ctx->first_job, 0, memory_order_relaxed);
@@ -231,6 +286,12 @@ void avpriv_slicethread_free(AVSliceThread **pctx)
         return;
 
     ctx = *pctx;
+    if (ctx->pool) {
+        av_buffer_unref(&ctx->pool);
+        av_freep(pctx);
+        return;
+    }
+
     nb_workers = ctx->nb_threads;
     if (!ctx->main_func)
         nb_workers--;
@@ -268,6 +329,24 @@ int avpriv_slicethread_create(AVSliceThread **pctx, void *priv,
     return AVERROR(ENOSYS);
 }
 
+int avpriv_slicethread_create2(AVSliceThread **pctx, void *priv,
+                               void (*worker_func)(void *priv, int jobnr, int threadnr, int nb_jobs, int nb_threads),
+                               void (*main_func)(void *priv),
+                               void (*thread_init)(void *priv),
+                               int nb_threads)
+{
+    *pctx = NULL;
+    return AVERROR(ENOSYS);
+}
+
+int avpriv_slicethread_create_pool(AVSliceThread **pctx, void *priv,
+                                   void (*worker_func)(void *priv, int jobnr, int threadnr, int nb_jobs, int nb_threads),
+                                   AVBufferRef *pool, int nb_threads)
+{
+    *pctx = NULL;
+    return AVERROR(ENOSYS);
+}
+
 void avpriv_slicethread_execute(AVSliceThread *ctx, int nb_jobs, int execute_main)
 {
     av_assert0(0);
@@ -19,6 +19,8 @@
 #ifndef AVUTIL_SLICETHREAD_H
 #define AVUTIL_SLICETHREAD_H
 
+struct AVBufferRef;
+
 typedef struct AVSliceThread AVSliceThread;
 
 /**
@@ -35,6 +37,32 @@ int avpriv_slicethread_create(AVSliceThread **pctx, void *priv,
                               void (*main_func)(void *priv),
                               int nb_threads);
 
+/**
+ * Same as avpriv_slicethread_create(), with an additional callback.
+ * @param thread_init callback function called once from each worker thread
+ *                    when it starts, before running any job, may be NULL
+ */
+int avpriv_slicethread_create2(AVSliceThread **pctx, void *priv,
+                               void (*worker_func)(void *priv, int jobnr, int threadnr, int nb_jobs, int nb_threads),
+                               void (*main_func)(void *priv),
+                               void (*thread_init)(void *priv),
+                               int nb_threads);
+
+/**
+ * Create a slice threading context running its jobs on a shared thread pool
+ * instead of threads of its own, see libavutil/threadpool.h.
+ * @param pctx slice threading context returned here
+ * @param priv private pointer to be passed to callback function
+ * @param worker_func callback function to be executed
+ * @param pool thread pool, the context keeps its own reference to it
+ * @param nb_threads maximum number of threads, including the calling one,
+ *                   0 for as many as the pool allows, must be >= 0
+ * @return return number of threads or negative AVERROR on failure
+ */
+int avpriv_slicethread_create_pool(AVSliceThread **pctx, void *priv,
+                                   void (*worker_func)(void *priv, int jobnr, int threadnr, int nb_jobs, int nb_threads),
+                                   struct AVBufferRef *pool, int nb_threads);
+
 /**
  * Execute slice threading.
  * @param ctx slice threading context
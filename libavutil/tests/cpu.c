@@ -16,16 +16,24 @@
  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
  */
 
+#ifndef _GNU_SOURCE
+# define _GNU_SOURCE
+#endif
 #include <stdio.h>
 
 #include "config.h"
 
 #include "libavutil/cpu.h"
 #include "libavutil/avstring.h"
+#include "libavutil/error.h"
 
 #if HAVE_UNISTD_H
 #include <unistd.h>
 #endif
+#if HAVE_SCHED_GETAFFINITY && defined(__linux__)
+#include <sched.h>
+#include <stdlib.h>
+#endif
 #if !HAVE_GETOPT
 #include "compat/getopt.c"
 #endif
@@ -112,6 +120,71 @@ static void print_cpu_flags(int cpu_flags, const char *type)
     printf("\n");
 }
 
+#if HAVE_SCHED_GETAFFINITY && defined(__linux__) && defined(CPU_SET)
+/**
+ * Bind to NUMA node 0 and check that the affinity is the set of its CPUs
+ * which the process may run on. Skipped without NUMA information in sysfs.
+ */
+static int test_numa_bind(void)
+{
+    cpu_set_t node_cpus, orig, cpus;
+    char buf[4096];
+    const char *p = buf;
+    FILE *f;
+    int ret;
+
+    f = fopen("/sys/devices/system/node/node0/cpulist", "r");
+    if (!f)
+        return 0;
+    if (!fgets(buf, sizeof(buf), f))
+        buf[0] = 0;
+    fclose(f);
+
+    CPU_ZERO(&node_cpus);
+    while (*p && *p != '\n') {
+        char *end;
+        long first = strtol(p, &end, 10), last = first;
+
+        if (*end == '-')
+            last = strtol(end + 1, &end, 10);
+        for (long i = first; i <= last && i < CPU_SETSIZE; i++)
+            CPU_SET(i, &node_cpus);
+        p = *end == ',' ? end + 1 : end;
+    }
+
+    if (sched_getaffinity(0, sizeof(orig), &orig))
+        return 0;
+
+    ret = av_cpu_bind_numa_nodes("0");
+    if (ret < 0) {
+        fprintf(stderr, "Could not bind to NUMA node 0: %s\n", av_err2str(ret));
+        return 1;
+    }
+    if (sched_getaffinity(0, sizeof(cpus), &cpus)) {
+        ret = 1;
+        goto end;
+    }
+
+    for (int i = 0; i < CPU_SETSIZE; i++) {
+        if (CPU_ISSET(i, &cpus) && !CPU_ISSET(i, &node_cpus)) {
+            fprintf(stderr, "CPU %d is not on NUMA node 0\n", i);
+            ret = 1;
+        } else if (!CPU_ISSET(i, &cpus) && CPU_ISSET(i, &node_cpus) && CPU_ISSET(i, &orig)) {
+            fprintf(stderr, "CPU %d of NUMA node 0 is missing\n", i);
+            ret = 1;
+        }
+    }
+
+end:
+    sched_setaffinity(0, sizeof(orig), &orig);
+    return ret;
+}
+#else
+static int test_numa_bind(void)
+{
+    return 0;
+}
+#endif
 
 int main(int argc, char **argv)
 {
@@ -132,6 +205,17 @@ int main(int argc, char **argv)
     if (cpu_flags_raw < 0)
         return 1;
 
+    for (i = 0; i < 4; i++) {
+        static const char *const bad_nodes[] = { "", "x", "1-0", "0,,1" };
+        if (av_cpu_bind_numa_nodes(bad_nodes[i]) >= 0) {
+            fprintf(stderr, "Accepted invalid NUMA node list '%s'\n", bad_nodes[i]);
+            return 5;
+        }
+    }
+
+    if (test_numa_bind())
+        return 6;
+
     for (;;) {
         int c = getopt(argc, argv, "c:t:");
         if (c == -1)
@@ -0,0 +1,108 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include <stdatomic.h>
+#include <stdio.h>
+
+#include "libavutil/executor.h"
+#include "libavutil/time.h"
+
+#define NB_TASKS 16
+
+typedef struct Task {
+    AVTask task;
+    int priority;
+    // if set, the task runs until the flag is set
+    atomic_int *wait;
+} Task;
+
+static atomic_int started, finished, release_first, release_second;
+static int order[NB_TASKS];
+
+static int priority_higher(const AVTask *a, const AVTask *b)
+{
+    return ((const Task *)a)->priority > ((const Task *)b)->priority;
+}
+
+static int run(AVTask *t, void *local_context, void *user_data)
+{
+    Task *task = (Task *)t;
+
+    if (task->wait) {
+        atomic_fetch_add(&started, 1);
+        while (!atomic_load(task->wait))
+            av_usleep(1000);
+        return 0;
+    }
+
+    order[atomic_fetch_add(&finished, 1)] = task->priority;
+    return 0;
+}
+
+static void wait_for(atomic_int *counter, int value)
+{
+    while (atomic_load(counter) < value)
+        av_usleep(1000);
+}
+
+int main(void)
+{
+    static const int priorities[NB_TASKS] = {
+        3, 14, 7, 0, 11, 9, 15, 2, 5, 12, 1, 8, 13, 6, 10, 4,
+    };
+    Task blockers[2] = {
+        { .priority = NB_TASKS, .wait = &release_second },
+        { .priority = NB_TASKS, .wait = &release_first  },
+    };
+    Task tasks[NB_TASKS];
+    int user_data;
+    AVTaskCallbacks cb = {
+        .user_data       = &user_data,
+        .priority_higher = priority_higher,
+        .run             = run,
+    };
+    AVExecutor *e = av_executor_alloc(&cb, 2);
+    int ret = 0;
+
+    if (!e)
+        return 1;
+
+    // Keep both workers busy while the tasks are spread over both queues.
+    // Then one worker alone has to run them all, following the priorities
+    // across the queues.
+    for (int i = 0; i < 2; i++) {
+        av_executor_execute(e, &blockers[i].task);
+        wait_for(&started, i + 1);
+    }
+    for (int i = 0; i < NB_TASKS; i++) {
+        tasks[i] = (Task){ .priority = priorities[i] };
+        av_executor_execute(e, &tasks[i].task);
+    }
+
+    atomic_store(&release_first, 1);
+    wait_for(&finished, NB_TASKS);
+    atomic_store(&release_second, 1);
+    av_executor_free(&e);
+
+    for (int i = 0; i < NB_TASKS; i++) {
+        printf("%d%s", order[i], i + 1 < NB_TASKS ? " " : "\n");
+        if (order[i] != NB_TASKS - 1 - i)
+            ret = 1;
+    }
+    return ret;
+}
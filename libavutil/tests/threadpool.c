@@ -0,0 +1,129 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include <stdatomic.h>
+#include <stdio.h>
+
+#include "libavutil/buffer.h"
+#include "libavutil/thread.h"
+#include "libavutil/threadpool.h"
+
+#define NB_SUBMITTERS 4
+#define NB_BATCHES    200
+#define MAX_JOBS      32
+#define MAX_THREADS   8
+
+typedef struct BatchState {
+    AVBufferRef *pool;
+    int          depth;
+    atomic_int   runs[MAX_JOBS];
+    atomic_int   busy[MAX_THREADS];
+    atomic_int   errors;
+} BatchState;
+
+static int run_batch(AVBufferRef *pool, int nb_jobs, int nb_threads, int depth);
+
+static void job(void *arg, int jobnr, int threadnr, int nb_jobs, int nb_threads)
+{
+    BatchState *s = arg;
+
+    if (threadnr < 0 || threadnr >= nb_threads || nb_threads > MAX_THREADS) {
+        atomic_fetch_add(&s->errors, 1);
+        return;
+    }
+    // no other job of this batch may be running with the same threadnr
+    if (atomic_fetch_add(&s->busy[threadnr], 1))
+        atomic_fetch_add(&s->errors, 1);
+
+    atomic_fetch_add(&s->runs[jobnr], 1);
+
+    // jobs may submit work to the pool they are running on
+    if (s->depth < 2 && !(jobnr % 3))
+        if (run_batch(s->pool, 1 + jobnr % 7, 0, s->depth + 1) < 0)
+            atomic_fetch_add(&s->errors, 1);
+
+    atomic_fetch_sub(&s->busy[threadnr], 1);
+}
+
+static int run_batch(AVBufferRef *pool, int nb_jobs, int nb_threads, int depth)
+{
+    BatchState s = { .pool = pool, .depth = depth };
+    int max_threads = nb_threads ? nb_threads : av_threadpool_get_nb_threads(pool) + 1;
+    int ret;
+
+    ret = av_threadpool_execute(pool, job, &s, nb_jobs, nb_threads, depth);
+    if (ret < 1 || ret > max_threads)
+        return -1;
+
+    for (int i = 0; i < nb_jobs; i++)
+        if (atomic_load(&s.runs[i]) != 1)
+            return -1;
+    return atomic_load(&s.errors) ? -1 : 0;
+}
+
+typedef struct Submitter {
+    pthread_t    thread;
+    AVBufferRef *pool;
+    int          idx;
+    int          ret;
+} Submitter;
+
+static void *submitter_thread(void *arg)
+{
+    Submitter *s = arg;
+
+    for (int i = 0; i < NB_BATCHES && !s->ret; i++) {
+        int nb_jobs    = 1 + (i * 7 + s->idx) % MAX_JOBS;
+        int nb_threads = (i + s->idx) % MAX_THREADS;
+
+        s->ret = run_batch(s->pool, nb_jobs, nb_threads, 0);
+    }
+
+    return NULL;
+}
+
+int main(void)
+{
+    Submitter submitters[NB_SUBMITTERS];
+    AVBufferRef *pool;
+    int ret = 0;
+
+    pool = av_threadpool_alloc(3);
+    if (!pool)
+        return 1;
+    printf("pool threads: %d\n", av_threadpool_get_nb_threads(pool));
+
+    for (int i = 0; i < NB_SUBMITTERS; i++) {
+        submitters[i].pool = av_buffer_ref(pool);
+        submitters[i].idx  = i;
+        submitters[i].ret  = 0;
+        if (!submitters[i].pool ||
+            pthread_create(&submitters[i].thread, NULL, submitter_thread, &submitters[i]))
+            return 1;
+    }
+    av_buffer_unref(&pool);
+
+    for (int i = 0; i < NB_SUBMITTERS; i++) {
+        pthread_join(submitters[i].thread, NULL);
+        av_buffer_unref(&submitters[i].pool);
+        printf("submitter %d: %s\n", i, submitters[i].ret ? "failed" : "ok");
+        ret |= submitters[i].ret;
+    }
+
+    return !!ret;
+}
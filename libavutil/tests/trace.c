@@ -0,0 +1,122 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "libavutil/error.h"
+#include "libavutil/thread.h"
+#include "libavutil/trace.h"
+
+#define RING_SIZE     16
+#define NB_WORKERS    4
+#define MAX_TIDS      8
+
+static void *worker(void *arg)
+{
+    int nb_iterations = *(int *)arg;
+
+    // exit with a span left open
+    if (!nb_iterations)
+        av_trace_begin("unbalanced");
+
+    for (int i = 0; i < nb_iterations; i++) {
+        av_trace_begin("outer");
+        av_trace_begin("inner");
+        av_trace_end("inner");
+        av_trace_end("outer");
+    }
+    return NULL;
+}
+
+int main(int argc, char **argv)
+{
+    const char *filename = argc > 1 ? argv[1] : "trace.json";
+    int begin[MAX_TIDS] = { 0 }, end[MAX_TIDS] = { 0 };
+    char line[256];
+    FILE *f;
+    int ret;
+
+    // not recorded
+    av_trace_begin("before start");
+    av_trace_end("before start");
+
+    ret = av_trace_start(RING_SIZE);
+    if (ret < 0) {
+        printf("av_trace_start: %s\n", av_err2str(ret));
+        return 1;
+    }
+
+    av_trace_begin("main");
+
+    // one after the other, so that all of them record into the same ring;
+    // the first one wraps around it, the events of the others all fit
+    for (int i = 0; i < NB_WORKERS; i++) {
+        static int nb_iterations[NB_WORKERS] = { 20, 1, 0, 1 };
+        pthread_t thread;
+
+        if (pthread_create(&thread, NULL, worker, &nb_iterations[i]))
+            return 1;
+        pthread_join(thread, NULL);
+    }
+
+    av_trace_end("main");
+    av_trace_stop();
+
+    // not recorded either
+    av_trace_begin("after stop");
+    av_trace_end("after stop");
+
+    ret = av_trace_write_json(filename);
+    if (ret < 0) {
+        printf("av_trace_write_json: %s\n", av_err2str(ret));
+        return 1;
+    }
+
+    f = fopen(filename, "r");
+    if (!f)
+        return 1;
+    while (fgets(line, sizeof(line), f)) {
+        const char *ph = strstr(line, "\"ph\":\"");
+        const char *tid_str = strstr(line, "\"tid\":");
+        int tid;
+
+        if (!ph || !tid_str)
+            continue;
+        if (strstr(line, "before start") || strstr(line, "after stop")) {
+            printf("unexpected event: %s", line);
+            return 1;
+        }
+
+        tid = atoi(tid_str + 6);
+        if (tid < 0 || tid >= MAX_TIDS)
+            return 1;
+        if (ph[6] == 'B')
+            begin[tid]++;
+        else if (ph[6] == 'E')
+            end[tid]++;
+    }
+    fclose(f);
+
+    for (int i = 0; i < MAX_TIDS; i++)
+        if (begin[i] || end[i])
+            printf("tid %d: %d begin, %d end\n", i, begin[i], end[i]);
+
+    return 0;
+}
@@ -0,0 +1,239 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include "config.h"
+
+#include <stdatomic.h>
+
+#include "avassert.h"
+#include "buffer.h"
+#include "cpu.h"
+#include "executor.h"
+#include "macros.h"
+#include "mem.h"
+#include "thread.h"
+#include "threadpool.h"
+
+typedef struct ThreadPool {
+    AVExecutor *executor;
+    int         nb_threads;
+
+    /* signalled when a batch is complete and when no runner is queued */
+    AVMutex     lock;
+    AVCond      cond;
+
+    /* runners submitted to the executor which have not returned yet */
+    atomic_uint nb_queued;
+} ThreadPool;
+
+struct Batch;
+
+/**
+ * One worker's share of a batch: runs jobs of the batch until there are none
+ * left. A runner may only get to run after the submitting thread finished all
+ * the jobs by itself, so batches are refcounted.
+ */
+typedef struct Runner {
+    AVTask        task;
+    struct Batch *batch;
+    int           threadnr;
+} Runner;
+
+typedef struct Batch {
+    AVThreadPoolJobFunc func;
+    void *arg;
+    int   nb_jobs;
+    int   nb_threads;
+    int   priority;
+
+    atomic_int  next_job;
+    atomic_int  nb_done;
+    atomic_uint refcount;
+
+    Runner runners[];
+} Batch;
+
+static void batch_unref(Batch *b)
+{
+    if (atomic_fetch_sub_explicit(&b->refcount, 1, memory_order_acq_rel) == 1)
+        av_free(b);
+}
+
+static void batch_run(ThreadPool *p, Batch *b, int threadnr)
+{
+    int jobnr, nb_done = 0;
+
+    while ((jobnr = atomic_fetch_add_explicit(&b->next_job, 1, memory_order_relaxed)) < b->nb_jobs) {
+        b->func(b->arg, jobnr, threadnr, b->nb_jobs, b->nb_threads);
+        nb_done++;
+    }
+
+    if (nb_done &&
+        atomic_fetch_add_explicit(&b->nb_done, nb_done, memory_order_acq_rel) + nb_done == b->nb_jobs) {
+        ff_mutex_lock(&p->lock);
+        ff_cond_broadcast(&p->cond);
+        ff_mutex_unlock(&p->lock);
+    }
+}
+
+static int runner_priority_higher(const AVTask *a, const AVTask *b)
+{
+    // FIFO among batches of equal priority
+    return ((const Runner*)a)->batch->priority >= ((const Runner*)b)->batch->priority;
+}
+
+static int runner_run(AVTask *t, void *local_context, void *user_data)
+{
+    ThreadPool *p = user_data;
+    Runner     *r = (Runner*)t;
+
+    batch_run(p, r->batch, r->threadnr);
+    batch_unref(r->batch);
+
+    if (atomic_fetch_sub_explicit(&p->nb_queued, 1, memory_order_acq_rel) == 1) {
+        ff_mutex_lock(&p->lock);
+        ff_cond_broadcast(&p->cond);
+        ff_mutex_unlock(&p->lock);
+    }
+
+    return 0;
+}
+
+static void pool_free(void *opaque, uint8_t *data)
+{
+    ThreadPool *p = (ThreadPool*)data;
+
+    // av_executor_free() drops queued tasks, so let the workers go through
+    // the runners of batches completed by their submitters first
+    ff_mutex_lock(&p->lock);
+    while (atomic_load(&p->nb_queued))
+        ff_cond_wait(&p->cond, &p->lock);
+    ff_mutex_unlock(&p->lock);
+
+    av_executor_free(&p->executor);
+    ff_cond_destroy(&p->cond);
+    ff_mutex_destroy(&p->lock);
+    av_free(p);
+}
+
+AVBufferRef *av_threadpool_alloc(int nb_threads)
+{
+    AVTaskCallbacks cb = {
+        .priority_higher = runner_priority_higher,
+        .run             = runner_run,
+    };
+    AVBufferRef *buf;
+    ThreadPool *p;
+
+    if (nb_threads < 0)
+        return NULL;
+    if (!nb_threads)
+        nb_threads = av_cpu_count();
+    if (!HAVE_THREADS)
+        nb_threads = 0;
+
+    p = av_mallocz(sizeof(*p));
+    if (!p)
+        return NULL;
+
+    if (ff_mutex_init(&p->lock, NULL)) {
+        av_free(p);
+        return NULL;
+    }
+    if (ff_cond_init(&p->cond, NULL)) {
+        ff_mutex_destroy(&p->lock);
+        av_free(p);
+        return NULL;
+    }
+    atomic_init(&p->nb_queued, 0);
+
+    cb.user_data  = p;
+    p->nb_threads = nb_threads;
+    if (nb_threads) {
+        p->executor = av_executor_alloc(&cb, nb_threads);
+        if (!p->executor)
+            goto fail;
+    }
+
+    buf = av_buffer_create((uint8_t*)p, sizeof(*p), pool_free, NULL, 0);
+    if (!buf)
+        goto fail;
+
+    return buf;
+fail:
+    av_executor_free(&p->executor);
+    ff_cond_destroy(&p->cond);
+    ff_mutex_destroy(&p->lock);
+    av_free(p);
+    return NULL;
+}
+
+int av_threadpool_get_nb_threads(const AVBufferRef *pool)
+{
+    const ThreadPool *p = (const ThreadPool*)pool->data;
+    return p->nb_threads;
+}
+
+int av_threadpool_execute(AVBufferRef *pool, AVThreadPoolJobFunc func,
+                          void *arg, int nb_jobs, int nb_threads, int priority)
+{
+    ThreadPool *p = (ThreadPool*)pool->data;
+    Batch *b = NULL;
+
+    av_assert0(nb_jobs > 0 && nb_threads >= 0);
+
+    if (!nb_threads || nb_threads > p->nb_threads + 1)
+        nb_threads = p->nb_threads + 1;
+    nb_threads = FFMIN(nb_threads, nb_jobs);
+
+    if (nb_threads > 1)
+        b = av_mallocz(sizeof(*b) + (nb_threads - 1) * sizeof(*b->runners));
+    if (!b) {
+        for (int i = 0; i < nb_jobs; i++)
+            func(arg, i, 0, nb_jobs, 1);
+        return 1;
+    }
+
+    b->func       = func;
+    b->arg        = arg;
+    b->nb_jobs    = nb_jobs;
+    b->nb_threads = nb_threads;
+    b->priority   = priority;
+    atomic_init(&b->next_job, 0);
+    atomic_init(&b->nb_done,  0);
+    atomic_init(&b->refcount, nb_threads);
+
+    atomic_fetch_add_explicit(&p->nb_queued, nb_threads - 1, memory_order_relaxed);
+    for (int i = 0; i < nb_threads - 1; i++) {
+        Runner *r   = &b->runners[i];
+        r->batch    = b;
+        r->threadnr = i + 1;
+        av_executor_execute(p->executor, &r->task);
+    }
+
+    batch_run(p, b, 0);
+
+    ff_mutex_lock(&p->lock);
+    while (atomic_load_explicit(&b->nb_done, memory_order_acquire) < nb_jobs)
+        ff_cond_wait(&p->cond, &p->lock);
+    ff_mutex_unlock(&p->lock);
+
+    batch_unref(b);
+
+    return nb_threads;
+}
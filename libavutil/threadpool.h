@@ -0,0 +1,103 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/**
+ * @file
+ * @ingroup lavu_threadpool
+ * Shared worker thread pool
+ */
+
+#ifndef AVUTIL_THREADPOOL_H
+#define AVUTIL_THREADPOOL_H
+
+#include "buffer.h"
+
+/**
+ * @defgroup lavu_threadpool Thread pool
+ * @ingroup lavu_data
+ *
+ * A fixed set of worker threads that may be shared by any number of codec,
+ * filtergraph and scaling contexts, so that the number of threads of a
+ * process stays bounded however many of those are in use.
+ *
+ * A pool is refcounted through AVBufferRef: every context it is attached to
+ * holds a reference, and the threads exit once the last one is released.
+ *
+ * Work is submitted as batches of independent jobs. The submitting thread
+ * always takes part in running the jobs of its own batch, so a batch
+ * completes even when all workers are busy, and a job may itself submit
+ * batches to the same pool.
+ *
+ * @{
+ */
+
+/**
+ * Function called for each job of a batch.
+ *
+ * @param arg        opaque pointer passed to av_threadpool_execute()
+ * @param jobnr      index of the job, in the range [0, nb_jobs)
+ * @param threadnr   index of the thread running the job, in the range
+ *                   [0, nb_threads); no two jobs of the same batch with the
+ *                   same threadnr run at the same time
+ * @param nb_jobs    number of jobs in the batch
+ * @param nb_threads number of threads working on the batch
+ */
+typedef void (*AVThreadPoolJobFunc)(void *arg, int jobnr, int threadnr,
+                                    int nb_jobs, int nb_threads);
+
+/**
+ * Allocate a thread pool.
+ *
+ * On systems where threads inherit the CPU affinity of their creator (e.g.
+ * Linux), the workers run on the CPUs allowed for the calling thread.
+ *
+ * @param nb_threads number of worker threads, 0 to use one per CPU
+ * @return a reference to the new pool, NULL on failure
+ */
+AVBufferRef *av_threadpool_alloc(int nb_threads);
+
+/**
+ * @return the number of worker threads of the pool
+ */
+int av_threadpool_get_nb_threads(const AVBufferRef *pool);
+
+/**
+ * Run nb_jobs calls of func and wait for all of them to return.
+ *
+ * Batches with a higher priority are served first by the workers; batches
+ * of equal priority are served in submission order.
+ *
+ * @param pool       a reference to the pool
+ * @param func       function to call for each job
+ * @param arg        opaque pointer passed to func
+ * @param nb_jobs    number of jobs, must be > 0
+ * @param nb_threads maximum number of threads working on this batch,
+ *                   including the calling thread; 0 for as many as possible
+ * @param priority   priority of this batch
+ * @return the number of threads the jobs were split between; if the batch
+ *         could not be submitted, e.g. on allocation failure, all jobs are
+ *         run on the calling thread and 1 is returned
+ */
+int av_threadpool_execute(AVBufferRef *pool, AVThreadPoolJobFunc func,
+                          void *arg, int nb_jobs, int nb_threads, int priority);
+
+/**
+ * @}
+ */
+
+#endif /* AVUTIL_THREADPOOL_H */
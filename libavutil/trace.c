@@ -0,0 +1,267 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include "config.h"
+
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#if HAVE_PTHREADS
+#include <pthread.h>
+#endif
+
+#include "common.h"
+#include "error.h"
+#include "file_open.h"
+#include "mem.h"
+#include "time.h"
+#include "trace.h"
+
+typedef struct TraceEvent {
+    const char *name;
+    int64_t     ts;
+    int         tid;
+    int         begin;
+} TraceEvent;
+
+/**
+ * Events of one thread. Rings are never freed, but the ring of a thread that
+ * exited is taken over by the next thread needing one, so there are never
+ * more rings than threads alive at once. Each thread gets an id of its own
+ * though, stored with its events, so that the events of the previous owner
+ * still in the ring remain on their own track, including spans it left open.
+ */
+typedef struct TraceRing {
+    struct TraceRing *next;
+
+    // set while a thread records into this ring
+    atomic_int  in_use;
+    // id of the thread recording into this ring
+    int         tid;
+
+    TraceEvent *events;
+    // always a power of two
+    unsigned    nb_events;
+    // number of events written so far, only modified by the recording thread
+    atomic_uint pos;
+} TraceRing;
+
+static atomic_int       trace_running = 0;
+static atomic_int       trace_nb_events = 0;
+static atomic_int       trace_next_tid = 1;
+static atomic_uintptr_t trace_rings = 0;
+
+#if HAVE_PTHREADS
+static pthread_once_t trace_once = PTHREAD_ONCE_INIT;
+static pthread_key_t  trace_key;
+static int            trace_key_ret;
+
+static void ring_release(void *opaque)
+{
+    TraceRing *r = opaque;
+    atomic_store_explicit(&r->in_use, 0, memory_order_release);
+}
+
+static void trace_init(void)
+{
+    trace_key_ret = pthread_key_create(&trace_key, ring_release);
+}
+
+static TraceRing *ring_acquire(void)
+{
+    TraceRing *r;
+    uintptr_t head;
+    int nb_events;
+
+    for (r = (TraceRing*)atomic_load(&trace_rings); r; r = r->next) {
+        int expected = 0;
+        if (atomic_compare_exchange_strong(&r->in_use, &expected, 1)) {
+            r->tid = atomic_fetch_add(&trace_next_tid, 1);
+            return r;
+        }
+    }
+
+    nb_events = atomic_load(&trace_nb_events);
+    r = av_mallocz(sizeof(*r));
+    if (!r)
+        return NULL;
+    r->events = av_malloc_array(nb_events, sizeof(*r->events));
+    if (!r->events) {
+        av_free(r);
+        return NULL;
+    }
+    r->nb_events = nb_events;
+    r->tid       = atomic_fetch_add(&trace_next_tid, 1);
+    atomic_init(&r->in_use, 1);
+    atomic_init(&r->pos, 0);
+
+    head = atomic_load(&trace_rings);
+    do {
+        r->next = (TraceRing*)head;
+    } while (!atomic_compare_exchange_weak(&trace_rings, &head, (uintptr_t)r));
+    return r;
+}
+
+static void trace_record(const char *name, int begin)
+{
+    TraceRing *r;
+    TraceEvent *ev;
+    unsigned pos;
+
+    if (!atomic_load_explicit(&trace_running, memory_order_relaxed))
+        return;
+
+    r = pthread_getspecific(trace_key);
+    if (!r) {
+        r = ring_acquire();
+        if (!r || pthread_setspecific(trace_key, r)) {
+            if (r)
+                ring_release(r);
+            return;
+        }
+    }
+
+    pos = atomic_load_explicit(&r->pos, memory_order_relaxed);
+    ev  = &r->events[pos & (r->nb_events - 1)];
+    ev->name  = name;
+    ev->ts    = av_gettime_relative();
+    ev->tid   = r->tid;
+    ev->begin = begin;
+    atomic_store_explicit(&r->pos, pos + 1, memory_order_release);
+}
+
+int av_trace_start(int nb_events)
+{
+    unsigned size = 1;
+
+    if (nb_events <= 0 || nb_events > INT_MAX / 2)
+        return AVERROR(EINVAL);
+
+    pthread_once(&trace_once, trace_init);
+    if (trace_key_ret)
+        return AVERROR(trace_key_ret);
+
+    while (size < nb_events)
+        size <<= 1;
+    atomic_store(&trace_nb_events, size);
+    atomic_store(&trace_running, 1);
+    return 0;
+}
+#else
+static void trace_record(const char *name, int begin)
+{
+}
+
+int av_trace_start(int nb_events)
+{
+    return AVERROR(ENOSYS);
+}
+#endif
+
+void av_trace_stop(void)
+{
+    atomic_store(&trace_running, 0);
+}
+
+void av_trace_begin(const char *name)
+{
+    trace_record(name, 1);
+}
+
+void av_trace_end(const char *name)
+{
+    trace_record(name, 0);
+}
+
+static void write_string(FILE *f, const char *str)
+{
+    fputc('"', f);
+    for (; *str; str++) {
+        if (*str == '"' || *str == '\\')
+            fprintf(f, "\\%c", *str);
+        else if ((unsigned char)*str < 0x20)
+            fprintf(f, "\\u%04x", *str);
+        else
+            fputc(*str, f);
+    }
+    fputc('"', f);
+}
+
+static void write_ring(FILE *f, TraceRing *r, TraceEvent *events, int *first)
+{
+    unsigned start, end, valid;
+
+    end   = atomic_load_explicit(&r->pos, memory_order_acquire);
+    start = end > r->nb_events ? end - r->nb_events : 0;
+    for (unsigned i = start; i != end; i++)
+        events[i - start] = r->events[i & (r->nb_events - 1)];
+
+    // skip the events the recording thread, if any, may have overwritten
+    // while they were being copied
+    atomic_thread_fence(memory_order_acquire);
+    if (atomic_load_explicit(&r->in_use, memory_order_relaxed)) {
+        valid = atomic_load_explicit(&r->pos, memory_order_relaxed);
+        valid = valid >= r->nb_events ? valid - r->nb_events + 1 : 0;
+    } else
+        valid = start;
+
+    for (unsigned i = FFMAX(start, valid); i < end; i++) {
+        const TraceEvent *ev = &events[i - start];
+
+        fputs(*first ? "\n" : ",\n", f);
+        *first = 0;
+
+        fputs("{\"name\":", f);
+        write_string(f, ev->name);
+        fprintf(f, ",\"ph\":\"%c\",\"ts\":%"PRId64",\"pid\":0,\"tid\":%d}",
+                ev->begin ? 'B' : 'E', ev->ts, ev->tid);
+    }
+}
+
+int av_trace_write_json(const char *filename)
+{
+    TraceEvent *events = NULL;
+    unsigned max_events = 0;
+    int first = 1, ret = 0;
+    FILE *f;
+
+    f = avpriv_fopen_utf8(filename, "w");
+    if (!f)
+        return AVERROR(errno);
+
+    fputs("{\"traceEvents\":[", f);
+    for (TraceRing *r = (TraceRing*)atomic_load(&trace_rings); r; r = r->next) {
+        if (r->nb_events > max_events) {
+            av_freep(&events);
+            events = av_malloc_array(r->nb_events, sizeof(*events));
+            if (!events) {
+                ret = AVERROR(ENOMEM);
+                break;
+            }
+            max_events = r->nb_events;
+        }
+        write_ring(f, r, events, &first);
+    }
+    fputs("\n],\"displayTimeUnit\":\"ms\"}\n", f);
+
+    av_free(events);
+    if (fclose(f) && !ret)
+        ret = AVERROR(errno);
+    return ret;
+}
@@ -0,0 +1,88 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/**
+ * @file
+ * @ingroup lavu_trace
+ * Timing spans
+ */
+
+#ifndef AVUTIL_TRACE_H
+#define AVUTIL_TRACE_H
+
+/**
+ * @defgroup lavu_trace Tracing
+ * @ingroup lavu_misc
+ *
+ * Record when the threads of a process enter and leave named spans of code,
+ * e.g. decoding a packet or waiting for a queue, and write them out in the
+ * Chrome trace event format, which can be loaded into Perfetto or
+ * chrome://tracing.
+ *
+ * Each thread records its events in its own ring buffer without taking any
+ * lock, keeping only the most recent ones. While tracing is stopped, which
+ * is the default, a span costs a function call and an atomic load.
+ *
+ * @{
+ */
+
+/**
+ * Start recording events.
+ *
+ * @param nb_events number of most recent events kept for each thread; only
+ *                  applies to threads recording their first event afterwards
+ * @return 0 on success, a negative AVERROR code on failure, in particular
+ *         AVERROR(ENOSYS) if tracing is not supported on this system
+ */
+int av_trace_start(int nb_events);
+
+/**
+ * Stop recording events. Those recorded so far are kept.
+ */
+void av_trace_stop(void);
+
+/**
+ * Mark the beginning of a span in the calling thread. Spans of a thread
+ * must be properly nested.
+ *
+ * @param name name of the span; the string must stay valid as long as the
+ *             process may call av_trace_write_json(), e.g. a literal
+ */
+void av_trace_begin(const char *name);
+
+/**
+ * Mark the end of the innermost span begun in the calling thread.
+ *
+ * @param name the name passed to the matching av_trace_begin()
+ */
+void av_trace_end(const char *name);
+
+/**
+ * Write all the recorded events as a Chrome trace event JSON file. May be
+ * called while other threads are recording, though events recorded in the
+ * meantime may then be missing.
+ *
+ * @return 0 on success, a negative AVERROR code on failure
+ */
+int av_trace_write_json(const char *filename);
+
+/**
+ * @}
+ */
+
+#endif /* AVUTIL_TRACE_H */
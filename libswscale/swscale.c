@@ -31,6 +31,7 @@
 #include "libavutil/mem.h"
 #include "libavutil/mem_internal.h"
 #include "libavutil/pixdesc.h"
+#include "libavutil/trace.h"
 #include "config.h"
 #include "swscale_internal.h"
 #include "swscale.h"
@@ -829,36 +830,67 @@ static int scale_internal(SwsContext *c,
                           uint8_t *const dstSlice[], const int dstStride[],
                           int dstSliceY, int dstSliceH);
 
+static int scale_threaded(SwsContext *c,
+                          const uint8_t * const src[], const int srcStride[],
+                          uint8_t * const dst[], const int dstStride[],
+                          int dstSliceY, int dstSliceH);
+
+/**
+ * Run one step of a cascaded scaler. Complete input frames are scaled with
+ * the slice threads of the step, if it has any.
+ */
+static int scale_step(SwsContext *c,
+                      const uint8_t * const srcSlice[], const int srcStride[],
+                      int srcSliceY, int srcSliceH,
+                      uint8_t * const dstSlice[], const int dstStride[],
+                      int dstSliceY, int dstSliceH)
+{
+    int ret;
+
+    if (!c->nb_slice_ctx)
+        return scale_internal(c, srcSlice, srcStride, srcSliceY, srcSliceH,
+                              dstSlice, dstStride, dstSliceY, dstSliceH);
+
+    if (srcSliceY == 0 && srcSliceH == c->srcH)
+        return scale_threaded(c, srcSlice, srcStride, dstSlice, dstStride,
+                              dstSliceY, dstSliceH);
+
+    ret = scale_internal(c->slice_ctx[0], srcSlice, srcStride, srcSliceY, srcSliceH,
+                         dstSlice, dstStride, dstSliceY, dstSliceH);
+    c->dstY = c->slice_ctx[0]->dstY;
+    return ret;
+}
+
 static int scale_gamma(SwsContext *c,
                        const uint8_t * const srcSlice[], const int srcStride[],
                        int srcSliceY, int srcSliceH,
                        uint8_t * const dstSlice[], const int dstStride[],
                        int dstSliceY, int dstSliceH)
 {
-    int ret = scale_internal(c->cascaded_context[0],
-                             srcSlice, srcStride, srcSliceY, srcSliceH,
-                             c->cascaded_tmp, c->cascaded_tmpStride, 0, c->srcH);
+    int ret = scale_step(c->cascaded_context[0],
+                         srcSlice, srcStride, srcSliceY, srcSliceH,
+                         c->cascaded_tmp, c->cascaded_tmpStride, 0, c->srcH);
 
     if (ret < 0)
         return ret;
 
     if (c->cascaded_context[2])
-        ret = scale_internal(c->cascaded_context[1], (const uint8_t * const *)c->cascaded_tmp,
-                             c->cascaded_tmpStride, srcSliceY, srcSliceH,
-                             c->cascaded1_tmp, c->cascaded1_tmpStride, 0, c->dstH);
+        ret = scale_step(c->cascaded_context[1], (const uint8_t * const *)c->cascaded_tmp,
+                         c->cascaded_tmpStride, srcSliceY, srcSliceH,
+                         c->cascaded1_tmp, c->cascaded1_tmpStride, 0, c->dstH);
     else
-        ret = scale_internal(c->cascaded_context[1], (const uint8_t * const *)c->cascaded_tmp,
-                             c->cascaded_tmpStride, srcSliceY, srcSliceH,
-                             dstSlice, dstStride, dstSliceY, dstSliceH);
+        ret = scale_step(c->cascaded_context[1], (const uint8_t * const *)c->cascaded_tmp,
+                         c->cascaded_tmpStride, srcSliceY, srcSliceH,
+                         dstSlice, dstStride, dstSliceY, dstSliceH);
 
     if (ret < 0)
         return ret;
 
     if (c->cascaded_context[2]) {
-        ret = scale_internal(c->cascaded_context[2], (const uint8_t * const *)c->cascaded1_tmp,
-                             c->cascaded1_tmpStride, c->cascaded_context[1]->dstY - ret,
-                             c->cascaded_context[1]->dstY,
-                             dstSlice, dstStride, dstSliceY, dstSliceH);
+        ret = scale_step(c->cascaded_context[2], (const uint8_t * const *)c->cascaded1_tmp,
+                         c->cascaded1_tmpStride, c->cascaded_context[1]->dstY - ret,
+                         c->cascaded_context[1]->dstY,
+                         dstSlice, dstStride, dstSliceY, dstSliceH);
     }
     return ret;
 }
@@ -869,16 +901,16 @@ static int scale_cascaded(SwsContext *c,
                           uint8_t * const dstSlice[], const int dstStride[],
                           int dstSliceY, int dstSliceH)
 {
-    int ret = scale_internal(c->cascaded_context[0],
-                             srcSlice, srcStride, srcSliceY, srcSliceH,
-                             c->cascaded_tmp, c->cascaded_tmpStride,
-                             0, c->cascaded_context[0]->dstH);
+    int ret = scale_step(c->cascaded_context[0],
+                         srcSlice, srcStride, srcSliceY, srcSliceH,
+                         c->cascaded_tmp, c->cascaded_tmpStride,
+                         0, c->cascaded_context[0]->dstH);
     if (ret < 0)
         return ret;
-    ret = scale_internal(c->cascaded_context[1],
-                         (const uint8_t * const * )c->cascaded_tmp, c->cascaded_tmpStride,
-                         0, c->cascaded_context[0]->dstH,
-                         dstSlice, dstStride, dstSliceY, dstSliceH);
+    ret = scale_step(c->cascaded_context[1],
+                     (const uint8_t * const * )c->cascaded_tmp, c->cascaded_tmpStride,
+                     0, c->cascaded_context[0]->dstH,
+                     dstSlice, dstStride, dstSliceY, dstSliceH);
     return ret;
 }
 
@@ -983,7 +1015,8 @@ static int scale_internal(SwsContext *c,
         src2[0] = base;
     }
 
-    if (c->srcXYZ && !(c->dstXYZ && c->srcW==c->dstW && c->srcH==c->dstH)) {
+    if (c->srcXYZ && !(c->dstXYZ && c->srcW==c->dstW && c->srcH==c->dstH) &&
+        !(c->parent && c->parent->src_xyz_converted)) {
         uint8_t *base;
 
         av_fast_malloc(&c->xyz_scratch, &c->xyz_scratch_allocated,
@@ -1154,24 +1187,18 @@ int sws_receive_slice(struct SwsContext *c, unsigned int slice_start,
     }
 
     if (c->slicethread) {
-        int nb_jobs = c->slice_ctx[0]->dither == SWS_DITHER_ED ? 1 : c->nb_slice_ctx;
-        int ret = 0;
-
-        c->dst_slice_start  = slice_start;
-        c->dst_slice_height = slice_height;
+        int ret;
 
-        avpriv_slicethread_execute(c->slicethread, nb_jobs, 0);
-
-        for (int i = 0; i < c->nb_slice_ctx; i++) {
-            if (c->slice_err[i] < 0) {
-                ret = c->slice_err[i];
-                break;
-            }
+        for (int i = 0; i < FF_ARRAY_ELEMS(dst); i++) {
+            const int vshift = (i == 1 || i == 2) ? c->slice_ctx[0]->chrDstVSubSample : 0;
+            ptrdiff_t offset = c->frame_dst->linesize[i] * (ptrdiff_t)(slice_start >> vshift);
+            dst[i] = FF_PTR_ADD(c->frame_dst->data[i], offset);
         }
 
-        memset(c->slice_err, 0, c->nb_slice_ctx * sizeof(*c->slice_err));
-
-        return ret;
+        ret = scale_threaded(c, (const uint8_t * const *)c->frame_src->data,
+                             c->frame_src->linesize, dst, c->frame_dst->linesize,
+                             slice_start, slice_height);
+        return FFMIN(ret, 0);
     }
 
     for (int i = 0; i < FF_ARRAY_ELEMS(dst); i++) {
@@ -1192,15 +1219,161 @@ int sws_scale_frame(struct SwsContext *c, AVFrame *dst, const AVFrame *src)
     if (ret < 0)
         return ret;
 
+    av_trace_begin("sws_scale_frame");
     ret = sws_send_slice(c, 0, src->height);
     if (ret >= 0)
         ret = sws_receive_slice(c, 0, dst->height);
+    av_trace_end("sws_scale_frame");
+
+    sws_frame_end(c);
+
+    return ret;
+}
+
+static int scale_submitted(SwsContext *c)
+{
+    int ret = sws_send_slice(c, 0, c->frame_src->height);
+    if (ret >= 0)
+        ret = sws_receive_slice(c, 0, c->frame_dst->height);
 
     sws_frame_end(c);
 
     return ret;
 }
 
+#if HAVE_THREADS
+enum AsyncState {
+    ASYNC_IDLE,
+    ASYNC_PENDING,
+    ASYNC_DONE,
+    ASYNC_EXIT,
+};
+
+static void *async_worker(void *arg)
+{
+    SwsContext *c = arg;
+
+    pthread_mutex_lock(&c->async_lock);
+    while (1) {
+        int ret;
+
+        while (c->async_state == ASYNC_IDLE || c->async_state == ASYNC_DONE)
+            pthread_cond_wait(&c->async_cond, &c->async_lock);
+        if (c->async_state == ASYNC_EXIT)
+            break;
+        pthread_mutex_unlock(&c->async_lock);
+
+        av_trace_begin("sws_scale_frame_submit");
+        ret = scale_submitted(c);
+        av_trace_end("sws_scale_frame_submit");
+
+        pthread_mutex_lock(&c->async_lock);
+        c->async_ret   = ret;
+        c->async_state = ASYNC_DONE;
+        pthread_cond_broadcast(&c->async_cond);
+    }
+    pthread_mutex_unlock(&c->async_lock);
+
+    return NULL;
+}
+
+static int async_init(SwsContext *c)
+{
+    int ret;
+
+    ret = pthread_mutex_init(&c->async_lock, NULL);
+    if (ret)
+        return AVERROR(ret);
+    ret = pthread_cond_init(&c->async_cond, NULL);
+    if (ret) {
+        pthread_mutex_destroy(&c->async_lock);
+        return AVERROR(ret);
+    }
+
+    c->async_state = ASYNC_IDLE;
+    ret = pthread_create(&c->async_thread, NULL, async_worker, c);
+    if (ret) {
+        pthread_cond_destroy(&c->async_cond);
+        pthread_mutex_destroy(&c->async_lock);
+        return AVERROR(ret);
+    }
+
+    c->async_thread_started = 1;
+    return 0;
+}
+#endif
+
+void ff_sws_async_uninit(SwsContext *c)
+{
+#if HAVE_THREADS
+    if (!c->async_thread_started)
+        return;
+
+    pthread_mutex_lock(&c->async_lock);
+    while (c->async_state == ASYNC_PENDING)
+        pthread_cond_wait(&c->async_cond, &c->async_lock);
+    c->async_state = ASYNC_EXIT;
+    pthread_cond_broadcast(&c->async_cond);
+    pthread_mutex_unlock(&c->async_lock);
+
+    pthread_join(c->async_thread, NULL);
+    pthread_cond_destroy(&c->async_cond);
+    pthread_mutex_destroy(&c->async_lock);
+    c->async_thread_started = 0;
+#endif
+}
+
+int sws_scale_frame_submit(struct SwsContext *c, AVFrame *dst, const AVFrame *src)
+{
+    int ret;
+
+    if (c->async_pending)
+        return AVERROR(EAGAIN);
+
+    ret = sws_frame_start(c, dst, src);
+    if (ret < 0)
+        return ret;
+
+#if HAVE_THREADS
+    // without a thread of its own, the frame is scaled right away below
+    if (!c->async_thread_started && async_init(c) < 0)
+        av_log(c, AV_LOG_WARNING, "Could not start a scaling thread, scaling synchronously\n");
+
+    if (c->async_thread_started) {
+        pthread_mutex_lock(&c->async_lock);
+        c->async_state = ASYNC_PENDING;
+        pthread_cond_broadcast(&c->async_cond);
+        pthread_mutex_unlock(&c->async_lock);
+
+        c->async_pending = 1;
+        return 0;
+    }
+#endif
+
+    c->async_ret     = scale_submitted(c);
+    c->async_pending = 1;
+    return 0;
+}
+
+int sws_scale_frame_complete(struct SwsContext *c)
+{
+    if (!c->async_pending)
+        return AVERROR(EINVAL);
+
+#if HAVE_THREADS
+    if (c->async_thread_started) {
+        pthread_mutex_lock(&c->async_lock);
+        while (c->async_state != ASYNC_DONE)
+            pthread_cond_wait(&c->async_cond, &c->async_lock);
+        c->async_state = ASYNC_IDLE;
+        pthread_mutex_unlock(&c->async_lock);
+    }
+#endif
+
+    c->async_pending = 0;
+    return c->async_ret;
+}
+
 /**
  * swscale wrapper, so we don't need to export the SwsContext.
  * Assumes planar YUV to be in YUV order instead of YVU.
@@ -1211,11 +1384,106 @@ int attribute_align_arg sws_scale(struct SwsContext *c,
                                   int srcSliceH, uint8_t *const dst[],
                                   const int dstStride[])
 {
-    if (c->nb_slice_ctx)
-        c = c->slice_ctx[0];
+    int ret;
+
+    av_trace_begin("sws_scale");
+    if (c->nb_slice_ctx && srcSliceY == 0 && srcSliceH == c->srcH) {
+        // complete frames are scaled by all the slice threads
+        ret = scale_threaded(c, srcSlice, srcStride, dst, dstStride, 0, c->dstH);
+    } else {
+        if (c->nb_slice_ctx)
+            c = c->slice_ctx[0];
+
+        ret = scale_internal(c, srcSlice, srcStride, srcSliceY, srcSliceH,
+                             dst, dstStride, 0, c->dstH);
+    }
+    av_trace_end("sws_scale");
 
-    return scale_internal(c, srcSlice, srcStride, srcSliceY, srcSliceH,
-                          dst, dstStride, 0, c->dstH);
+    return ret;
+}
+
+/**
+ * Scale a complete input frame into the destination rows
+ * [dstSliceY, dstSliceY + dstSliceH) with the slice threads of c.
+ * dst points to row dstSliceY.
+ *
+ * @return dstSliceH on success, a negative AVERROR code on failure
+ */
+static int scale_threaded(SwsContext *c,
+                          const uint8_t * const src[], const int srcStride[],
+                          uint8_t * const dst[], const int dstStride[],
+                          int dstSliceY, int dstSliceH)
+{
+    const SwsContext *c0 = c->slice_ctx[0];
+    int ret = 0;
+
+    if (!srcStride || !dstStride || !dst || !src) {
+        av_log(c, AV_LOG_ERROR, "One of the input parameters to sws_scale() is NULL, please check the calling code\n");
+        return AVERROR(EINVAL);
+    }
+
+    for (int i = 0; i < 4; i++) {
+        c->thread_src[i]        = src[i];
+        c->thread_src_stride[i] = srcStride[i];
+        c->thread_dst[i]        = dst[i];
+        c->thread_dst_stride[i] = dstStride[i];
+    }
+    c->dst_slice_start  = dstSliceY;
+    c->dst_slice_height = dstSliceH;
+
+    /* Convert XYZ input once, with all threads, rather than all of it in
+     * each slice context. */
+    if (c->nb_slice_ctx > 1 && srcStride[0] > 0 && c0->srcXYZ &&
+        !(c0->dstXYZ && c0->srcW == c0->dstW && c0->srcH == c0->dstH)) {
+        av_fast_malloc(&c->xyz_scratch, &c->xyz_scratch_allocated,
+                       srcStride[0] * (size_t)c0->srcH + 32);
+        if (!c->xyz_scratch)
+            return AVERROR(ENOMEM);
+
+        c->thread_xyz = 1;
+        avpriv_slicethread_execute(c->slicethread, c->nb_slice_ctx, 0);
+        c->thread_xyz = 0;
+
+        c->thread_src[0]     = c->xyz_scratch;
+        c->src_xyz_converted = 1;
+    }
+
+    // error diffusion dither needs a single slice context
+    if (c->nb_slice_ctx == 1)
+        ff_sws_slice_worker(c, 0, 0, 1, 1);
+    else
+        avpriv_slicethread_execute(c->slicethread, c->nb_slice_ctx, 0);
+
+    c->src_xyz_converted = 0;
+
+    for (int i = 0; i < c->nb_slice_ctx; i++) {
+        if (c->slice_err[i] < 0) {
+            ret = c->slice_err[i];
+            break;
+        }
+    }
+
+    memset(c->slice_err, 0, c->nb_slice_ctx * sizeof(*c->slice_err));
+
+    if (ret < 0)
+        return ret;
+
+    c->dstY = dstSliceY + dstSliceH;
+    return dstSliceH;
+}
+
+static void xyz_slice_worker(SwsContext *parent, SwsContext *c,
+                             int jobnr, int nb_jobs)
+{
+    const ptrdiff_t stride = parent->thread_src_stride[0];
+    const int band  = (c->srcH + nb_jobs - 1) / nb_jobs;
+    const int start = jobnr * band;
+    const int end   = FFMIN(start + band, c->srcH);
+
+    if (end > start)
+        xyz12Torgb48(c, (uint16_t *)(parent->xyz_scratch + start * stride),
+                     (const uint16_t *)(parent->thread_src[0] + start * stride),
+                     stride / 2, end - start);
 }
 
 void ff_sws_slice_worker(void *priv, int jobnr, int threadnr,
@@ -1230,20 +1498,24 @@ void ff_sws_slice_worker(void *priv, int jobnr, int threadnr,
     const int slice_end    = FFMIN((jobnr + 1) * slice_height, parent->dst_slice_height);
     int err = 0;
 
+    if (parent->thread_xyz) {
+        xyz_slice_worker(parent, c, jobnr, nb_jobs);
+        return;
+    }
+
     if (slice_end > slice_start) {
         uint8_t *dst[4] = { NULL };
 
-        for (int i = 0; i < FF_ARRAY_ELEMS(dst) && parent->frame_dst->data[i]; i++) {
+        for (int i = 0; i < FF_ARRAY_ELEMS(dst) && parent->thread_dst[i]; i++) {
             const int vshift = (i == 1 || i == 2) ? c->chrDstVSubSample : 0;
-            const ptrdiff_t offset = parent->frame_dst->linesize[i] *
-                (ptrdiff_t)((slice_start + parent->dst_slice_start) >> vshift);
+            const ptrdiff_t offset = parent->thread_dst_stride[i] *
+                (ptrdiff_t)(slice_start >> vshift);
 
-            dst[i] = parent->frame_dst->data[i] + offset;
+            dst[i] = parent->thread_dst[i] + offset;
         }
 
-        err = scale_internal(c, (const uint8_t * const *)parent->frame_src->data,
-                             parent->frame_src->linesize, 0, c->srcH,
-                             dst, parent->frame_dst->linesize,
+        err = scale_internal(c, parent->thread_src, parent->thread_src_stride, 0, c->srcH,
+                             dst, parent->thread_dst_stride,
                              parent->dst_slice_start + slice_start, slice_end - slice_start);
     }
 
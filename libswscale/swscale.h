@@ -187,6 +187,20 @@ struct SwsContext *sws_alloc_context(void);
 av_warn_unused_result
 int sws_init_context(struct SwsContext *sws_context, SwsFilter *srcFilter, SwsFilter *dstFilter);
 
+/**
+ * Run the slice threads of sws_context on a shared thread pool allocated with
+ * av_threadpool_alloc(), instead of on threads created for this context. The
+ * "threads" option then is the maximum number of threads working for this
+ * context at once, 0 meaning as many as the pool has.
+ *
+ * Must be called before sws_init_context().
+ *
+ * @param pool the pool to use, the context creates its own reference to it;
+ *             NULL to go back to threads of its own
+ * @return zero on success, a negative AVERROR code on failure
+ */
+int sws_set_thread_pool(struct SwsContext *sws_context, AVBufferRef *pool);
+
 /**
  * Free the swscaler context swsContext.
  * If swsContext is NULL, then does nothing.
@@ -267,6 +281,36 @@ int sws_scale(struct SwsContext *c, const uint8_t *const srcSlice[],
  */
 int sws_scale_frame(struct SwsContext *c, AVFrame *dst, const AVFrame *src);
 
+/**
+ * Start scaling src into dst like sws_scale_frame(), without waiting for the
+ * output. The frame is scaled on a thread of the scaling context, so that the
+ * caller can e.g. submit frames to other scaling contexts meanwhile.
+ * sws_scale_frame_complete() must be called before the context is used for
+ * anything else. If no thread can be started, the frame is scaled before this
+ * function returns.
+ *
+ * References to src and dst are retained until sws_scale_frame_complete()
+ * returns, dst must not be accessed before that.
+ *
+ * @param c   The scaling context
+ * @param dst The destination frame, see sws_frame_start().
+ * @param src The source frame.
+ *
+ * @return 0 on success, AVERROR(EAGAIN) if a frame was submitted and not
+ *         completed yet, another negative AVERROR code on failure
+ */
+int sws_scale_frame_submit(struct SwsContext *c, AVFrame *dst, const AVFrame *src);
+
+/**
+ * Wait for the frame submitted with sws_scale_frame_submit() to be scaled.
+ *
+ * @param c   The scaling context
+ *
+ * @return 0 on success, AVERROR(EINVAL) if no frame was submitted, another
+ *         negative AVERROR code if scaling the frame failed
+ */
+int sws_scale_frame_complete(struct SwsContext *c);
+
 /**
  * Initialize the scaling process for a given pair of source/destination frames.
  * Must be called before any calls to sws_send_slice() and sws_receive_slice().
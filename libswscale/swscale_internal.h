@@ -34,6 +34,7 @@
 #include "libavutil/pixfmt.h"
 #include "libavutil/pixdesc.h"
 #include "libavutil/slicethread.h"
+#include "libavutil/thread.h"
 #if HAVE_ALTIVEC
 #include "libavutil/ppc/util_altivec.h"
 #endif
@@ -305,6 +306,7 @@ typedef struct SwsContext {
     struct SwsContext *parent;
 
     AVSliceThread      *slicethread;
+    AVBufferRef        *thread_pool;
     struct SwsContext **slice_ctx;
     int                *slice_err;
     int              nb_slice_ctx;
@@ -682,6 +684,29 @@ typedef struct SwsContext {
     atomic_int   data_unaligned_warned;
 
     Half2FloatTables *h2f_tables;
+
+    /* Fields below are placed after the ones accessed from x86 inline asm,
+     * so that their offsets do not change. */
+
+    // values passed to the current threaded scaling call, along with
+    // dst_slice_start and dst_slice_height
+    const uint8_t *thread_src[4];
+    int            thread_src_stride[4];
+    uint8_t       *thread_dst[4];      ///< pointers to row dst_slice_start
+    int            thread_dst_stride[4];
+    int            thread_xyz;         ///< the jobs convert the XYZ input to xyz_scratch
+    int            src_xyz_converted;  ///< the slice contexts scale from xyz_scratch
+
+    // sws_scale_frame_submit() state
+    int             async_pending;
+    int             async_ret;
+#if HAVE_THREADS
+    pthread_t       async_thread;
+    pthread_mutex_t async_lock;
+    pthread_cond_t  async_cond;
+    int             async_state;
+    int             async_thread_started;
+#endif
 } SwsContext;
 //FIXME check init (where 0)
 
@@ -1138,6 +1163,8 @@ void ff_init_vscale_pfn(SwsContext *c, yuv2planar1_fn yuv2plane1, yuv2planarX_fn
 void ff_sws_slice_worker(void *priv, int jobnr, int threadnr,
                          int nb_jobs, int nb_threads);
 
+void ff_sws_async_uninit(SwsContext *c);
+
 //number of extra lines to process
 #define MAX_LINES_AHEAD 4
 
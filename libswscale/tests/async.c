@@ -0,0 +1,264 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/*
+ * Check that frames scaled with sws_scale_frame_submit() match the output of
+ * sws_scale_frame(), single- and multi-threaded, including the cascaded and
+ * XYZ input paths. With -bench <nb_frames>, time both APIs on two contexts.
+ */
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "libavutil/common.h"
+#include "libavutil/error.h"
+#include "libavutil/frame.h"
+#include "libavutil/imgutils.h"
+#include "libavutil/lfg.h"
+#include "libavutil/opt.h"
+#include "libavutil/pixdesc.h"
+#include "libavutil/time.h"
+
+#include "libswscale/swscale.h"
+
+#define NB_THREADS 4
+
+static const struct {
+    enum AVPixelFormat src_fmt;
+    int src_w, src_h;
+    enum AVPixelFormat dst_fmt;
+    int dst_w, dst_h;
+    int gamma;
+} tests[] = {
+    { AV_PIX_FMT_YUV420P, 352, 288, AV_PIX_FMT_RGB24,   176, 144, 0 },
+    { AV_PIX_FMT_YUV420P, 352, 288, AV_PIX_FMT_YUV420P, 640, 480, 1 },
+    { AV_PIX_FMT_RGB24,   352, 288, AV_PIX_FMT_YUV444P, 200, 150, 1 },
+    { AV_PIX_FMT_XYZ12LE, 352, 288, AV_PIX_FMT_YUV420P, 352, 288, 0 },
+    { AV_PIX_FMT_XYZ12LE, 352, 288, AV_PIX_FMT_RGB48LE, 176, 144, 0 },
+};
+
+static struct SwsContext *alloc_sws(int test, int nb_threads)
+{
+    struct SwsContext *c = sws_alloc_context();
+    if (!c)
+        return NULL;
+
+    av_opt_set_int(c, "srcw",       tests[test].src_w,   0);
+    av_opt_set_int(c, "srch",       tests[test].src_h,   0);
+    av_opt_set_int(c, "src_format", tests[test].src_fmt, 0);
+    av_opt_set_int(c, "dstw",       tests[test].dst_w,   0);
+    av_opt_set_int(c, "dsth",       tests[test].dst_h,   0);
+    av_opt_set_int(c, "dst_format", tests[test].dst_fmt, 0);
+    av_opt_set_int(c, "sws_flags",  SWS_BICUBIC | SWS_ACCURATE_RND | SWS_BITEXACT, 0);
+    av_opt_set_int(c, "gamma",      tests[test].gamma,   0);
+    av_opt_set_int(c, "threads",    nb_threads,          0);
+
+    if (sws_init_context(c, NULL, NULL) < 0)
+        sws_freeContext(c), c = NULL;
+
+    return c;
+}
+
+static AVFrame *alloc_frame(enum AVPixelFormat fmt, int w, int h)
+{
+    AVFrame *f = av_frame_alloc();
+    if (!f)
+        return NULL;
+
+    f->format = fmt;
+    f->width  = w;
+    f->height = h;
+    if (av_frame_get_buffer(f, 0) < 0)
+        av_frame_free(&f);
+
+    return f;
+}
+
+static void fill_frame(AVFrame *f, AVLFG *lfg)
+{
+    const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get(f->format);
+
+    for (int p = 0; p < 4 && f->data[p]; p++) {
+        int h = p == 1 || p == 2 ? AV_CEIL_RSHIFT(f->height, desc->log2_chroma_h)
+                                 : f->height;
+        for (int y = 0; y < h; y++)
+            for (int x = 0; x < f->linesize[p]; x++)
+                f->data[p][y * f->linesize[p] + x] = av_lfg_get(lfg);
+    }
+}
+
+static int frames_equal(const AVFrame *a, const AVFrame *b)
+{
+    const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get(a->format);
+    int bytes[4];
+
+    av_image_fill_linesizes(bytes, a->format, a->width);
+    for (int p = 0; p < 4 && a->data[p]; p++) {
+        int h = p == 1 || p == 2 ? AV_CEIL_RSHIFT(a->height, desc->log2_chroma_h)
+                                 : a->height;
+        for (int y = 0; y < h; y++)
+            if (memcmp(a->data[p] + y * a->linesize[p],
+                       b->data[p] + y * b->linesize[p], bytes[p]))
+                return 0;
+    }
+
+    return 1;
+}
+
+static int run_test(int test, AVLFG *lfg)
+{
+    struct SwsContext *ref = NULL, *sync = NULL, *async[2] = { NULL };
+    AVFrame *src[2] = { NULL }, *dst_ref[2] = { NULL };
+    AVFrame *dst_sync[2] = { NULL }, *dst_async[2] = { NULL };
+    int ret = AVERROR(ENOMEM);
+
+    ref      = alloc_sws(test, 1);
+    sync     = alloc_sws(test, NB_THREADS);
+    async[0] = alloc_sws(test, NB_THREADS);
+    async[1] = alloc_sws(test, NB_THREADS);
+    if (!ref || !sync || !async[0] || !async[1])
+        goto end;
+
+    for (int i = 0; i < 2; i++) {
+        src[i]       = alloc_frame(tests[test].src_fmt, tests[test].src_w, tests[test].src_h);
+        dst_ref[i]   = alloc_frame(tests[test].dst_fmt, tests[test].dst_w, tests[test].dst_h);
+        dst_sync[i]  = alloc_frame(tests[test].dst_fmt, tests[test].dst_w, tests[test].dst_h);
+        dst_async[i] = alloc_frame(tests[test].dst_fmt, tests[test].dst_w, tests[test].dst_h);
+        if (!src[i] || !dst_ref[i] || !dst_sync[i] || !dst_async[i])
+            goto end;
+        fill_frame(src[i], lfg);
+    }
+
+    for (int i = 0; i < 2; i++) {
+        if ((ret = sws_scale_frame(ref,  dst_ref[i],  src[i])) < 0 ||
+            (ret = sws_scale_frame(sync, dst_sync[i], src[i])) < 0)
+            goto end;
+    }
+
+    // both frames in flight at the same time, on two contexts
+    for (int i = 0; i < 2; i++)
+        if ((ret = sws_scale_frame_submit(async[i], dst_async[i], src[i])) < 0)
+            goto end;
+    for (int i = 0; i < 2; i++)
+        if ((ret = sws_scale_frame_complete(async[i])) < 0)
+            goto end;
+
+    printf("%s %dx%d -> %s %dx%d%s:",
+           av_get_pix_fmt_name(tests[test].src_fmt), tests[test].src_w, tests[test].src_h,
+           av_get_pix_fmt_name(tests[test].dst_fmt), tests[test].dst_w, tests[test].dst_h,
+           tests[test].gamma ? " gamma" : "");
+    ret = 0;
+    for (int i = 0; i < 2; i++) {
+        if (!frames_equal(dst_ref[i], dst_sync[i])) {
+            printf(" threaded output %d differs", i);
+            ret = 1;
+        }
+        if (!frames_equal(dst_sync[i], dst_async[i])) {
+            printf(" async output %d differs", i);
+            ret = 1;
+        }
+    }
+    printf("%s\n", ret ? "" : " ok");
+
+end:
+    for (int i = 0; i < 2; i++) {
+        av_frame_free(&src[i]);
+        av_frame_free(&dst_ref[i]);
+        av_frame_free(&dst_sync[i]);
+        av_frame_free(&dst_async[i]);
+        sws_freeContext(async[i]);
+    }
+    sws_freeContext(ref);
+    sws_freeContext(sync);
+    if (ret < 0)
+        fprintf(stderr, "test %d failed: %s\n", test, av_err2str(ret));
+    return ret;
+}
+
+static int bench(int test, int nb_frames, AVLFG *lfg)
+{
+    struct SwsContext *c[2] = { NULL };
+    AVFrame *src[2] = { NULL }, *dst[2] = { NULL };
+    int64_t t_sync, t_async;
+    int ret = AVERROR(ENOMEM);
+
+    for (int i = 0; i < 2; i++) {
+        c[i]   = alloc_sws(test, NB_THREADS);
+        src[i] = alloc_frame(tests[test].src_fmt, tests[test].src_w, tests[test].src_h);
+        dst[i] = alloc_frame(tests[test].dst_fmt, tests[test].dst_w, tests[test].dst_h);
+        if (!c[i] || !src[i] || !dst[i])
+            goto end;
+        fill_frame(src[i], lfg);
+    }
+
+    t_sync = av_gettime_relative();
+    for (int n = 0; n < nb_frames; n++)
+        for (int i = 0; i < 2; i++)
+            if ((ret = sws_scale_frame(c[i], dst[i], src[i])) < 0)
+                goto end;
+    t_sync = av_gettime_relative() - t_sync;
+
+    t_async = av_gettime_relative();
+    for (int n = 0; n < nb_frames; n++) {
+        for (int i = 0; i < 2; i++)
+            if ((ret = sws_scale_frame_submit(c[i], dst[i], src[i])) < 0)
+                goto end;
+        for (int i = 0; i < 2; i++)
+            if ((ret = sws_scale_frame_complete(c[i])) < 0)
+                goto end;
+    }
+    t_async = av_gettime_relative() - t_async;
+
+    printf("test %d: sync %"PRId64" us, async %"PRId64" us, speedup %.2f\n",
+           test, t_sync / nb_frames, t_async / nb_frames,
+           (double)t_sync / FFMAX(t_async, 1));
+
+end:
+    for (int i = 0; i < 2; i++) {
+        av_frame_free(&src[i]);
+        av_frame_free(&dst[i]);
+        sws_freeContext(c[i]);
+    }
+    return ret;
+}
+
+int main(int argc, char **argv)
+{
+    int nb_frames = 0;
+    int ret = 0;
+    AVLFG lfg;
+
+    if (argc == 3 && !strcmp(argv[1], "-bench")) {
+        nb_frames = atoi(argv[2]);
+    } else if (argc != 1) {
+        fprintf(stderr, "usage: %s [-bench <nb_frames>]\n", argv[0]);
+        return 1;
+    }
+
+    av_lfg_init(&lfg, 0xff);
+
+    for (int i = 0; i < FF_ARRAY_ELEMS(tests); i++) {
+        int err = nb_frames ? bench(i, nb_frames, &lfg) : run_test(i, &lfg);
+        if (err)
+            ret = 1;
+    }
+
+    return ret;
+}
@@ -39,6 +39,7 @@
 
 #include "libavutil/attributes.h"
 #include "libavutil/avassert.h"
+#include "libavutil/buffer.h"
 #include "libavutil/cpu.h"
 #include "libavutil/emms.h"
 #include "libavutil/imgutils.h"
@@ -50,6 +51,7 @@
 #include "libavutil/pixdesc.h"
 #include "libavutil/slicethread.h"
 #include "libavutil/thread.h"
+#include "libavutil/threadpool.h"
 #include "libavutil/aarch64/cpu.h"
 #include "libavutil/ppc/cpu.h"
 #include "libavutil/x86/asm.h"
@@ -298,6 +300,49 @@ static SwsContext *alloc_set_opts(int srcW, int srcH, enum AVPixelFormat srcForm
     return c;
 }
 
+/**
+ * Allocate one step of a cascaded scaler, without initializing it. The steps
+ * use as many threads as the scaler they are part of, from its thread pool.
+ */
+static SwsContext *alloc_cascaded(SwsContext *c,
+                                  int srcW, int srcH, enum AVPixelFormat srcFormat,
+                                  int dstW, int dstH, enum AVPixelFormat dstFormat,
+                                  int flags, const double *param)
+{
+    const SwsContext *top = c->parent ? c->parent : c;
+    SwsContext *c2 = alloc_set_opts(srcW, srcH, srcFormat,
+                                    dstW, dstH, dstFormat, flags, param);
+    if (!c2)
+        return NULL;
+
+    c2->nb_threads = top->nb_threads;
+    if (av_buffer_replace(&c2->thread_pool, top->thread_pool) < 0) {
+        sws_freeContext(c2);
+        return NULL;
+    }
+
+    return c2;
+}
+
+static SwsContext *get_cascaded(SwsContext *c,
+                                int srcW, int srcH, enum AVPixelFormat srcFormat,
+                                int dstW, int dstH, enum AVPixelFormat dstFormat,
+                                int flags, SwsFilter *srcFilter,
+                                SwsFilter *dstFilter, const double *param)
+{
+    SwsContext *c2 = alloc_cascaded(c, srcW, srcH, srcFormat,
+                                    dstW, dstH, dstFormat, flags, param);
+    if (!c2)
+        return NULL;
+
+    if (sws_init_context(c2, srcFilter, dstFilter) < 0) {
+        sws_freeContext(c2);
+        return NULL;
+    }
+
+    return c2;
+}
+
 int ff_shuffle_filter_coefficients(SwsContext *c, int *filterPos,
                                    int filterSize, int16_t *filter,
                                    int dstW)
@@ -1038,11 +1083,21 @@ int sws_setColorspaceDetails(struct SwsContext *c, const int inv_table[4],
     if (c->nb_slice_ctx) {
         int parent_ret = 0;
         for (int i = 0; i < c->nb_slice_ctx; i++) {
+            const int cascaded = !!c->slice_ctx[i]->cascaded_context[0];
             int ret = sws_setColorspaceDetails(c->slice_ctx[i], inv_table,
                                                srcRange, table, dstRange,
                                                brightness, contrast, saturation);
             if (ret < 0)
                 parent_ret = ret;
+
+            /* The first slice context now scales in several threaded steps,
+             * which the other ones would only duplicate. */
+            if (i == 0 && !cascaded && c->slice_ctx[0]->cascaded_context[0]) {
+                for (int j = 1; j < c->nb_slice_ctx; j++)
+                    sws_freeContext(c->slice_ctx[j]);
+                c->nb_slice_ctx = 1;
+                break;
+            }
         }
 
         return parent_ret;
@@ -1138,7 +1193,7 @@ int sws_setColorspaceDetails(struct SwsContext *c, const int inv_table[4],
             if (ret < 0)
                 return ret;
 
-            c->cascaded_context[0] = alloc_set_opts(srcW, srcH, c->srcFormat,
+            c->cascaded_context[0] = alloc_cascaded(c, srcW, srcH, c->srcFormat,
                                                     tmp_width, tmp_height, tmp_format,
                                                     c->flags, c->param);
             if (!c->cascaded_context[0])
@@ -1153,7 +1208,7 @@ int sws_setColorspaceDetails(struct SwsContext *c, const int inv_table[4],
                                      srcRange, table, dstRange,
                                      brightness, contrast, saturation);
 
-            c->cascaded_context[1] = alloc_set_opts(tmp_width, tmp_height, tmp_format,
+            c->cascaded_context[1] = alloc_cascaded(c, tmp_width, tmp_height, tmp_format,
                                                     dstW, dstH, c->dstFormat,
                                                     c->flags, c->param);
             if (!c->cascaded_context[1])
@@ -1618,13 +1673,16 @@ static av_cold int sws_init_single_context(SwsContext *c, SwsFilter *srcFilter,
         if (ret < 0)
             return ret;
 
-        c->cascaded_context[0] = sws_getContext(srcW, srcH, srcFormat,
-                                                srcW, srcH, tmpFmt,
-                                                flags, NULL, NULL, c->param);
+        c->cascaded_context[0] = get_cascaded(c, srcW, srcH, srcFormat,
+                                              srcW, srcH, tmpFmt,
+                                              flags, NULL, NULL, c->param);
         if (!c->cascaded_context[0]) {
             return AVERROR(ENOMEM);
         }
 
+        /* The gamma conversion is done in place on the input lines, which
+         * overlapping slices would convert more than once, so this step is
+         * not threaded. */
         c->cascaded_context[1] = sws_getContext(srcW, srcH, tmpFmt,
                                                 dstW, dstH, tmpFmt,
                                                 flags, srcFilter, dstFilter, c->param);
@@ -1656,9 +1714,9 @@ static av_cold int sws_init_single_context(SwsContext *c, SwsFilter *srcFilter,
             if (ret < 0)
                 return ret;
 
-            c->cascaded_context[2] = sws_getContext(dstW, dstH, tmpFmt,
-                                                dstW, dstH, dstFormat,
-                                                flags, NULL, NULL, c->param);
+            c->cascaded_context[2] = get_cascaded(c, dstW, dstH, tmpFmt,
+                                                  dstW, dstH, dstFormat,
+                                                  flags, NULL, NULL, c->param);
             if (!c->cascaded_context[2])
                 return AVERROR(ENOMEM);
         }
@@ -1676,15 +1734,16 @@ static av_cold int sws_init_single_context(SwsContext *c, SwsFilter *srcFilter,
             if (ret < 0)
                 return ret;
 
+            // demosaicing treats slice edges as picture edges, so it is not threaded
             c->cascaded_context[0] = sws_getContext(srcW, srcH, srcFormat,
                                                     srcW, srcH, tmpFormat,
                                                     flags, srcFilter, NULL, c->param);
             if (!c->cascaded_context[0])
                 return AVERROR(ENOMEM);
 
-            c->cascaded_context[1] = sws_getContext(srcW, srcH, tmpFormat,
-                                                    dstW, dstH, dstFormat,
-                                                    flags, NULL, dstFilter, c->param);
+            c->cascaded_context[1] = get_cascaded(c, srcW, srcH, tmpFormat,
+                                                  dstW, dstH, dstFormat,
+                                                  flags, NULL, dstFilter, c->param);
             if (!c->cascaded_context[1])
                 return AVERROR(ENOMEM);
             return 0;
@@ -1719,7 +1778,7 @@ static av_cold int sws_init_single_context(SwsContext *c, SwsFilter *srcFilter,
                 if (ret < 0)
                     return ret;
 
-                c->cascaded_context[0] = alloc_set_opts(srcW, srcH, srcFormat,
+                c->cascaded_context[0] = alloc_cascaded(c, srcW, srcH, srcFormat,
                                                         srcW, srcH, tmpFormat,
                                                         flags, c->param);
                 if (!c->cascaded_context[0])
@@ -1729,7 +1788,7 @@ static av_cold int sws_init_single_context(SwsContext *c, SwsFilter *srcFilter,
                 if (ret < 0)
                     return ret;
 
-                c->cascaded_context[1] = alloc_set_opts(srcW, srcH, tmpFormat,
+                c->cascaded_context[1] = alloc_cascaded(c, srcW, srcH, tmpFormat,
                                                         dstW, dstH, dstFormat,
                                                         flags, c->param);
                 if (!c->cascaded_context[1])
@@ -2001,15 +2060,15 @@ fail: // FIXME replace things by appropriate error codes
         if (ret < 0)
             return ret;
 
-        c->cascaded_context[0] = sws_getContext(srcW, srcH, srcFormat,
-                                                tmpW, tmpH, tmpFormat,
-                                                flags, srcFilter, NULL, c->param);
+        c->cascaded_context[0] = get_cascaded(c, srcW, srcH, srcFormat,
+                                              tmpW, tmpH, tmpFormat,
+                                              flags, srcFilter, NULL, c->param);
         if (!c->cascaded_context[0])
             return AVERROR(ENOMEM);
 
-        c->cascaded_context[1] = sws_getContext(tmpW, tmpH, tmpFormat,
-                                                dstW, dstH, dstFormat,
-                                                flags, NULL, dstFilter, c->param);
+        c->cascaded_context[1] = get_cascaded(c, tmpW, tmpH, tmpFormat,
+                                              dstW, dstH, dstFormat,
+                                              flags, NULL, dstFilter, c->param);
         if (!c->cascaded_context[1])
             return AVERROR(ENOMEM);
         return 0;
@@ -2022,8 +2081,30 @@ static int context_init_threaded(SwsContext *c,
 {
     int ret;
 
-    ret = avpriv_slicethread_create(&c->slicethread, (void*)c,
-                                    ff_sws_slice_worker, NULL, c->nb_threads);
+    /* Without a pool from the caller, use one of our own, so that the steps
+     * of a cascaded scaler share its workers instead of each starting
+     * nb_threads threads. The calling thread runs jobs as well. */
+    if (!c->thread_pool) {
+        int nb_threads = c->nb_threads;
+
+        if (!nb_threads) {
+            int nb_cpus = av_cpu_count();
+            nb_threads = nb_cpus > 1 ? FFMIN(nb_cpus + 1, 16) : 1;
+        }
+        if (nb_threads == 1) {
+            c->nb_threads = 1;
+            return 0;
+        }
+
+        c->thread_pool = av_threadpool_alloc(nb_threads - 1);
+        if (!c->thread_pool)
+            return AVERROR(ENOMEM);
+        c->nb_threads = nb_threads;
+    }
+
+    ret = avpriv_slicethread_create_pool(&c->slicethread, (void*)c,
+                                         ff_sws_slice_worker, c->thread_pool,
+                                         c->nb_threads);
     if (ret == AVERROR(ENOSYS)) {
         c->nb_threads = 1;
         return 0;
@@ -2060,11 +2141,20 @@ static int context_init_threaded(SwsContext *c,
                    "Error-diffusion dither is in use, scaling will be single-threaded.");
             break;
         }
+
+        // each step of a cascaded scaler is threaded on its own
+        if (c->slice_ctx[i]->cascaded_context[0])
+            break;
     }
 
     return 0;
 }
 
+int sws_set_thread_pool(SwsContext *c, AVBufferRef *pool)
+{
+    return av_buffer_replace(&c->thread_pool, pool);
+}
+
 av_cold int sws_init_context(SwsContext *c, SwsFilter *srcFilter,
                              SwsFilter *dstFilter)
 {
@@ -2435,12 +2525,15 @@ void sws_freeContext(SwsContext *c)
     if (!c)
         return;
 
+    ff_sws_async_uninit(c);
+
     for (i = 0; i < c->nb_slice_ctx; i++)
         sws_freeContext(c->slice_ctx[i]);
     av_freep(&c->slice_ctx);
     av_freep(&c->slice_err);
 
     avpriv_slicethread_free(&c->slicethread);
+    av_buffer_unref(&c->thread_pool);
 
     for (i = 0; i < 4; i++)
         av_freep(&c->dither_error[i]);
@@ -0,0 +1,253 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/*
+ * Frame threading latency test.
+ * Encodes a few frames with FFV1, then decodes them with frame threading the
+ * way a live client does: sending one packet and taking every frame available
+ * before sending the next one. The latency of a frame is the number of packets
+ * sent after its own before it was returned, and must not exceed
+ * thread_count - 1, or max_frame_delay when that is set.
+ */
+
+#include "libavcodec/avcodec.h"
+#include "libavutil/adler32.h"
+#include "libavutil/common.h"
+#include "libavutil/error.h"
+#include "libavutil/frame.h"
+#include "libavutil/log.h"
+
+#define NB_FRAMES   24
+#define NB_THREADS  4
+#define WIDTH       64
+#define HEIGHT      48
+
+static AVPacket *packets[NB_FRAMES];
+static int nb_packets;
+static AVCodecParameters *par;
+
+static int encode_frames(void)
+{
+    const AVCodec *enc = avcodec_find_encoder(AV_CODEC_ID_FFV1);
+    AVCodecContext *ctx = NULL;
+    AVFrame *frame = NULL;
+    int ret;
+
+    ctx   = avcodec_alloc_context3(enc);
+    frame = av_frame_alloc();
+    if (!ctx || !frame) {
+        ret = AVERROR(ENOMEM);
+        goto end;
+    }
+
+    ctx->width     = WIDTH;
+    ctx->height    = HEIGHT;
+    ctx->pix_fmt   = AV_PIX_FMT_YUV420P;
+    ctx->time_base = (AVRational){ 1, 25 };
+
+    ret = avcodec_open2(ctx, enc, NULL);
+    if (ret < 0)
+        goto end;
+
+    ret = avcodec_parameters_from_context(par, ctx);
+    if (ret < 0)
+        goto end;
+
+    frame->format = ctx->pix_fmt;
+    frame->width  = ctx->width;
+    frame->height = ctx->height;
+    ret = av_frame_get_buffer(frame, 0);
+    if (ret < 0)
+        goto end;
+
+    for (int i = 0; i <= NB_FRAMES; i++) {
+        if (i < NB_FRAMES) {
+            ret = av_frame_make_writable(frame);
+            if (ret < 0)
+                goto end;
+            for (int p = 0; p < 3; p++) {
+                int w = p ? WIDTH  / 2 : WIDTH;
+                int h = p ? HEIGHT / 2 : HEIGHT;
+                for (int y = 0; y < h; y++)
+                    for (int x = 0; x < w; x++)
+                        frame->data[p][y * frame->linesize[p] + x] = x * (p + 1) + y * i + i * 3;
+            }
+            frame->pts = i;
+        }
+
+        ret = avcodec_send_frame(ctx, i < NB_FRAMES ? frame : NULL);
+        if (ret < 0)
+            goto end;
+
+        while (1) {
+            AVPacket *pkt = av_packet_alloc();
+            if (!pkt) {
+                ret = AVERROR(ENOMEM);
+                goto end;
+            }
+            ret = avcodec_receive_packet(ctx, pkt);
+            if (ret < 0) {
+                av_packet_free(&pkt);
+                break;
+            }
+            if (nb_packets == NB_FRAMES) {
+                av_packet_free(&pkt);
+                ret = AVERROR_BUG;
+                goto end;
+            }
+            packets[nb_packets++] = pkt;
+        }
+        if (ret != AVERROR(EAGAIN) && ret != AVERROR_EOF)
+            goto end;
+    }
+    ret = nb_packets == NB_FRAMES ? 0 : AVERROR_BUG;
+
+end:
+    av_frame_free(&frame);
+    avcodec_free_context(&ctx);
+    return ret;
+}
+
+static uint32_t frame_checksum(const AVFrame *frame)
+{
+    uint32_t crc = 0;
+
+    for (int p = 0; p < 3; p++) {
+        int w = p ? frame->width  / 2 : frame->width;
+        int h = p ? frame->height / 2 : frame->height;
+        for (int y = 0; y < h; y++)
+            crc = av_adler32_update(crc, frame->data[p] + y * frame->linesize[p], w);
+    }
+    return crc;
+}
+
+/**
+ * Decode all packets with the given max_frame_delay, and return the highest
+ * latency of any frame in *latency.
+ */
+static int decode_frames(int max_frame_delay, uint32_t *checksums, int *latency)
+{
+    const AVCodec *dec = avcodec_find_decoder(AV_CODEC_ID_FFV1);
+    AVCodecContext *ctx = NULL;
+    AVFrame *frame = NULL;
+    int nb_sent = 0, nb_received = 0;
+    int ret;
+
+    *latency = 0;
+
+    ctx   = avcodec_alloc_context3(dec);
+    frame = av_frame_alloc();
+    if (!ctx || !frame) {
+        ret = AVERROR(ENOMEM);
+        goto end;
+    }
+
+    ret = avcodec_parameters_to_context(ctx, par);
+    if (ret < 0)
+        goto end;
+
+    ctx->thread_count    = NB_THREADS;
+    ctx->thread_type     = FF_THREAD_FRAME;
+    ctx->max_frame_delay = max_frame_delay;
+
+    ret = avcodec_open2(ctx, dec, NULL);
+    if (ret < 0)
+        goto end;
+
+    while (nb_received < NB_FRAMES) {
+        ret = avcodec_send_packet(ctx, nb_sent < NB_FRAMES ? packets[nb_sent] : NULL);
+        if (ret < 0)
+            goto end;
+        nb_sent++;
+
+        while ((ret = avcodec_receive_frame(ctx, frame)) >= 0) {
+            uint32_t crc = frame_checksum(frame);
+
+            if (nb_received == NB_FRAMES) {
+                ret = AVERROR_BUG;
+                goto end;
+            }
+            if (checksums[nb_received] && checksums[nb_received] != crc) {
+                av_log(NULL, AV_LOG_ERROR, "frame %d differs\n", nb_received);
+                ret = AVERROR_BUG;
+                goto end;
+            }
+            checksums[nb_received] = crc;
+
+            // packets sent after this frame's before it came out, not
+            // counting the flush packet
+            *latency = FFMAX(*latency, FFMIN(nb_sent, NB_FRAMES) - 1 - nb_received);
+            nb_received++;
+            av_frame_unref(frame);
+        }
+        if (ret != AVERROR(EAGAIN) && ret != AVERROR_EOF)
+            goto end;
+        if (ret == AVERROR_EOF)
+            break;
+    }
+    ret = nb_received == NB_FRAMES ? 0 : AVERROR_BUG;
+
+end:
+    av_frame_free(&frame);
+    avcodec_free_context(&ctx);
+    return ret;
+}
+
+int main(void)
+{
+    static const int delays[] = { -1, 0, 1, 2 };
+    uint32_t checksums[NB_FRAMES] = { 0 };
+    int ret;
+
+    par = avcodec_parameters_alloc();
+    if (!par)
+        return 1;
+
+    ret = encode_frames();
+    if (ret < 0) {
+        av_log(NULL, AV_LOG_ERROR, "Encoding failed: %s\n", av_err2str(ret));
+        return 1;
+    }
+
+    for (int i = 0; i < FF_ARRAY_ELEMS(delays); i++) {
+        int latency, bound = delays[i] < 0 ? NB_THREADS - 1 : delays[i];
+
+        ret = decode_frames(delays[i], checksums, &latency);
+        if (ret < 0) {
+            av_log(NULL, AV_LOG_ERROR, "Decoding with max_frame_delay %d failed: %s\n",
+                   delays[i], av_err2str(ret));
+            return 1;
+        }
+
+        // without a bound the latency is always that of a full pipeline,
+        // otherwise it depends on how fast the threads are
+        if (delays[i] < 0)
+            printf("max_frame_delay %2d: latency %d frames\n", delays[i], latency);
+        else
+            printf("max_frame_delay %2d: latency at most %d frames: %s\n",
+                   delays[i], bound, latency <= bound ? "ok" : "failed");
+        if (latency > bound)
+            return 1;
+    }
+
+    for (int i = 0; i < nb_packets; i++)
+        av_packet_free(&packets[i]);
+    avcodec_parameters_free(&par);
+
+    return 0;
+}
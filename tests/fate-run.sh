@@ -285,6 +285,25 @@ stream_demux(){
         run ffprobe${PROGSUF}${EXECSUF} -bitexact $ffprobe_opts $tsrcfile || return
 }
 
+# Demux a file written from the given inputs with and without memory
+# mapping it, the output must be the same.
+mmap_demux(){
+    src_opts=$1
+    enc_fmt=$2
+    enc_opt=$3
+    dec_opt=$4
+    encfile="${outdir}/${test}.${enc_fmt}"
+    readfile="${outdir}/${test}.read"
+    mmapfile="${outdir}/${test}.mmap"
+    test $keep -ge 1 || cleanfiles="$cleanfiles $encfile $readfile $mmapfile"
+    tencfile=$(target_path $encfile)
+    ffmpeg $DEC_OPTS $src_opts $ENC_OPTS $enc_opt $FLAGS -f $enc_fmt -y $tencfile || return
+    ffmpeg $DEC_OPTS $dec_opt -i $tencfile $ENC_OPTS $FLAGS -c copy -f framecrc - > $readfile || return
+    ffmpeg $DEC_OPTS -mmap 1 $dec_opt -i $tencfile $ENC_OPTS $FLAGS -c copy -f framecrc - > $mmapfile || return
+    cmp $readfile $mmapfile || return
+    cat $mmapfile
+}
+
 stream_remux(){
     src_fmt=$1
     srcfile=$2
@@ -3,6 +3,11 @@ fate-api-flac: $(APITESTSDIR)/api-flac-test$(EXESUF)
 fate-api-flac: CMD = run $(APITESTSDIR)/api-flac-test$(EXESUF)
 fate-api-flac: CMP = null
 
+# the latencies only apply with frame threading
+FATE_API_THREADS-$(call ALLYES, FFV1_ENCODER FFV1_DECODER) += fate-api-frame-delay
+fate-api-frame-delay: $(APITESTSDIR)/api-frame-delay-test$(EXESUF)
+fate-api-frame-delay: CMD = run $(APITESTSDIR)/api-frame-delay-test$(EXESUF)
+
 FATE_API_SAMPLES_LIBAVFORMAT-$(call DEMDEC, FLV, FLV) += fate-api-band
 fate-api-band: $(APITESTSDIR)/api-band-test$(EXESUF)
 fate-api-band: CMD = run $(APITESTSDIR)/api-band-test$(EXESUF) $(TARGET_SAMPLES)/mpeg4/resize_down-up.h263
@@ -33,6 +38,7 @@ ifdef SAMPLES
     FATE_API_SAMPLES += $(FATE_API_SAMPLES-yes)
 endif
 
+FATE_API_LIBAVCODEC-$(HAVE_THREADS) += $(FATE_API_THREADS-yes)
 FATE_API-$(CONFIG_AVCODEC) += $(FATE_API_LIBAVCODEC-yes)
 FATE_API-$(CONFIG_AVFORMAT) += $(FATE_API_LIBAVFORMAT-yes)
 FATE_API = $(FATE_API-yes)
@@ -124,9 +124,10 @@ FATE_FILTER-$(call FILTERFRAMECRC, FRAMERATE TESTSRC2 FORMAT SCALE) += fate-filt
 fate-filter-framerate-12bit-up: CMD = framecrc -lavfi testsrc2=r=50:d=1,format=pix_fmts=yuv422p12le,scale,framerate=fps=60,scale -t 1 -pix_fmt yuv422p12le
 fate-filter-framerate-12bit-down: CMD = framecrc -lavfi testsrc2=r=60:d=1,format=pix_fmts=yuv422p12le,scale,framerate=fps=50,scale -t 1 -pix_fmt yuv422p12le
 
-FATE_FILTER-$(call FILTERFRAMECRC, MINTERPOLATE TESTSRC2) += fate-filter-minterpolate-up fate-filter-minterpolate-down
+FATE_FILTER-$(call FILTERFRAMECRC, MINTERPOLATE TESTSRC2) += fate-filter-minterpolate-up fate-filter-minterpolate-down fate-filter-minterpolate-pyr
 fate-filter-minterpolate-up: CMD = framecrc -lavfi testsrc2=r=2:d=10,minterpolate=fps=10 -t 1
 fate-filter-minterpolate-down: CMD = framecrc -lavfi testsrc2=r=2:d=10,minterpolate=fps=1 -t 1
+fate-filter-minterpolate-pyr: CMD = framecrc -lavfi testsrc2=r=2:d=10,minterpolate=fps=10:me=pyr:me_mode=bidir -t 1
 
 FATE_FILTER_VSYNTH_PGMYUV-$(CONFIG_BOXBLUR_FILTER) += fate-filter-boxblur
 fate-filter-boxblur: CMD = framecrc -c:v pgmyuv -i $(SRC) -vf boxblur=2:1
@@ -150,6 +151,17 @@ $(FATE_FILTER_FRAMEPACK): CMD = framecrc -c:v pgmyuv -i $(TARGET_PATH)/tests/vsy
 FATE_FILTER_VSYNTH_PGMYUV-$(CONFIG_FRAMEPACK_FILTER) += $(FATE_FILTER_FRAMEPACK)
 fate-filter-framepack: $(FATE_FILTER_FRAMEPACK)
 
+# the same filters run with frame threads and with slice threads only must
+# give the same output; transpose gets its output buffers from pad
+FRAME_THREADS_GRAPH = gblur=sigma=2:thread_type=frame,unsharp=thread_type=frame,transpose=thread_type=frame,pad=320:384:16:16
+FATE_FILTER_VSYNTH_PGMYUV-$(call ALLYES, GBLUR_FILTER UNSHARP_FILTER TRANSPOSE_FILTER PAD_FILTER) += fate-filter-frame-threads fate-filter-frame-threads-slice fate-filter-frame-threads-count
+fate-filter-frame-threads: CMD = framecrc -c:v pgmyuv -i $(SRC) -filter_threads 4 -filter_thread_type slice+frame -vf $(FRAME_THREADS_GRAPH)
+fate-filter-frame-threads-slice: CMD = framecrc -c:v pgmyuv -i $(SRC) -filter_threads 4 -filter_thread_type slice -vf $(FRAME_THREADS_GRAPH)
+fate-filter-frame-threads-slice: REF = $(SRC_PATH)/tests/ref/fate/filter-frame-threads
+fate-filter-frame-threads-count: CMD = framecrc -v verbose -c:v pgmyuv -i $(SRC) -filter_threads 4 -filter_thread_type slice+frame -vf $(FRAME_THREADS_GRAPH)
+fate-filter-frame-threads-count: CMP = grep
+fate-filter-frame-threads-count: REF = Parsed_transpose_2 @ .*50 frames filtered on frame threads
+
 FATE_FILTER_VSYNTH_PGMYUV-$(CONFIG_GRADFUN_FILTER) += fate-filter-gradfun
 fate-filter-gradfun: CMD = framecrc -c:v pgmyuv -i $(SRC) -vf gradfun
 
@@ -162,9 +174,21 @@ fate-filter-interlace: CMD = framecrc -c:v pgmyuv -i $(SRC) -vf interlace
 FATE_FILTER_VSYNTH_PGMYUV-$(CONFIG_INTERLACE_FILTER) += fate-filter-interlace-complex
 fate-filter-interlace-complex: CMD = framecrc -c:v pgmyuv -i $(SRC) -vf interlace=lowpass=complex
 
+FATE_FILTER_VSYNTH_PGMYUV-$(CONFIG_LUT3D_FILTER) += fate-filter-lut3d-yuv
+fate-filter-lut3d-yuv: CMD = framecrc -c:v pgmyuv -i $(SRC) -vf lut3d=yuv=1:interp=trilinear
+
+FATE_FILTER_VSYNTH_PGMYUV-$(call ALLYES, SCALE_FILTER FORMAT_FILTER LUT3D_FILTER) += fate-filter-lut3d-yuv422p10
+fate-filter-lut3d-yuv422p10: CMD = framecrc -c:v pgmyuv -i $(SRC) -vf scale,format=yuv422p10,lut3d=yuv=1 -sws_flags +accurate_rnd+bitexact -pix_fmt yuv422p10le
+
 FATE_FILTER_VSYNTH_PGMYUV-$(call ALLYES, NEGATE_FILTER PERMS_FILTER) += fate-filter-negate
 fate-filter-negate: CMD = framecrc -c:v pgmyuv -i $(SRC) -vf perms=random,negate
 
+FATE_FILTER_VSYNTH_PGMYUV-$(call ALLYES, SETPARAMS_FILTER TONEMAP_FILTER) += fate-filter-tonemap-bt2390
+fate-filter-tonemap-bt2390: CMD = framecrc -c:v pgmyuv -i $(SRC) -vf setparams=color_trc=smpte2084:colorspace=bt2020nc:color_primaries=bt2020:range=tv,tonemap=bt2390
+
+FATE_FILTER_VSYNTH_PGMYUV-$(call ALLYES, SETPARAMS_FILTER TONEMAP_FILTER) += fate-filter-tonemap-hlg
+fate-filter-tonemap-hlg: CMD = framecrc -c:v pgmyuv -i $(SRC) -vf setparams=color_trc=arib-std-b67:colorspace=bt2020nc:color_primaries=bt2020:range=tv,tonemap=hable:desat=0
+
 FATE_FILTER_VSYNTH_PGMYUV-$(CONFIG_HISTOGRAM_FILTER) += fate-filter-histogram-levels
 fate-filter-histogram-levels: CMD = framecrc -c:v pgmyuv -i $(SRC) -vf histogram -flags +bitexact -sws_flags +accurate_rnd+bitexact
 
@@ -202,6 +226,10 @@ FATE_FILTER_VSYNTH_PGMYUV-$(CONFIG_MERGEPLANES_FILTER) += fate-filter-mergeplane
 fate-filter-mergeplanes: tests/data/filtergraphs/mergeplanes
 fate-filter-mergeplanes: CMD = framecrc -c:v pgmyuv -i $(SRC) -c:v pgmyuv -i $(SRC) -/filter_complex $(TARGET_PATH)/tests/data/filtergraphs/mergeplanes
 
+FATE_FILTER_VSYNTH_PGMYUV-$(CONFIG_SCALE_LADDER_FILTER) += fate-filter-scale_ladder
+fate-filter-scale_ladder: tests/data/filtergraphs/scale_ladder
+fate-filter-scale_ladder: CMD = framecrc -c:v pgmyuv -i $(SRC) -/filter_complex $(TARGET_PATH)/tests/data/filtergraphs/scale_ladder
+
 FATE_FILTER_VSYNTH_PGMYUV-$(CONFIG_HSTACK_FILTER) += fate-filter-hstack
 fate-filter-hstack: tests/data/filtergraphs/hstack
 fate-filter-hstack: CMD = framecrc -c:v pgmyuv -i $(SRC) -c:v pgmyuv -i $(SRC) -/filter_complex $(TARGET_PATH)/tests/data/filtergraphs/hstack
@@ -213,7 +241,8 @@ fate-filter-vstack: CMD = framecrc -c:v pgmyuv -i $(SRC) -c:v pgmyuv -i $(SRC) -
 FATE_FILTER_OVERLAY-$(call FILTERDEMDEC, SCALE OVERLAY, IMAGE2, PGMYUV) += fate-filter-overlay
 fate-filter-overlay: CMD = framecrc -c:v pgmyuv -i $(SRC) -c:v pgmyuv -i $(SRC) -/filter_complex $(FILTERGRAPH)
 
-FATE_FILTER_OVERLAY-$(call FILTERDEMDEC, SPLIT SCALE PAD OVERLAY, IMAGE2, PGMYUV) += $(addprefix fate-filter-overlay_, rgb yuv420 yuv420p10 nv12 nv21 yuv422 yuv422p10 yuv444 yuv444p10)
+FATE_FILTER_OVERLAY-$(call FILTERDEMDEC, SPLIT SCALE PAD OVERLAY, IMAGE2, PGMYUV) += $(addprefix fate-filter-overlay_, rgb yuv420 yuv420p10 nv12 nv21 yuv422 yuv422p10 yuv444 yuv444p10 skip_transparent)
+FATE_FILTER_OVERLAY-$(call FILTERDEMDEC, SPLIT SCALE PAD VSTACK OVERLAY, IMAGE2, PGMYUV) += fate-filter-overlay_skip_transparent_rows
 fate-filter-overlay_%: CMD = framecrc -auto_conversion_filters -c:v pgmyuv -i $(SRC) -/filter_complex $(FILTERGRAPH)
 fate-filter-overlay_yuv420: CMD = framecrc -c:v pgmyuv -i $(SRC) -/filter_complex $(FILTERGRAPH)
 fate-filter-overlay_%p10: CMD = framecrc -auto_conversion_filters -c:v pgmyuv -i $(SRC) -/filter_complex $(FILTERGRAPH) -pix_fmt $(@:fate-filter-overlay_%=%)le -frames:v 3
@@ -299,6 +328,11 @@ fate-filter-tblend: CMD = framecrc -c:v pgmyuv -i $(SRC) -vf tblend=all_mode=dif
 FATE_FILTER_VSYNTH_PGMYUV-$(CONFIG_TELECINE_FILTER) += fate-filter-telecine
 fate-filter-telecine: CMD = framecrc -c:v pgmyuv -i $(SRC) -vf telecine
 
+FATE_FILTER-$(call FILTERFRAMECRC, TESTSRC2 FORMAT DRAWTEXT) += fate-filter-drawtext
+fate-filter-drawtext: tests/data/seven_segment.ttf
+fate-filter-drawtext: FONT = $(TARGET_PATH)/tests/data/seven_segment.ttf
+fate-filter-drawtext: CMD = framecrc -lavfi 'testsrc2=s=320x240:r=5:d=2,format=yuv420p,drawtext=fontfile=$(FONT):fontsize=40:text=0123456789:x=10:y=30:borderw=4:bordercolor=blue:shadowx=3:shadowy=3,drawtext=fontfile=$(FONT):fontsize=40:text=%{frame_num}:start_number=95:x=10:y=120:fontcolor=yellow:borderw=3'
+
 FATE_FILTER-$(call FILTERFRAMECRC, TESTSRC2 TPAD) += fate-filter-tpad-add fate-filter-tpad-clone fate-filter-tpad-add-duration
 fate-filter-tpad-add:   CMD = framecrc -lavfi testsrc2=d=1:r=2,tpad=start=1:stop=3:color=gray
 fate-filter-tpad-clone: CMD = framecrc -lavfi testsrc2=d=1:r=2,tpad=start=1:stop=2:stop_mode=clone:color=black
@@ -391,6 +425,15 @@ fate-filter-fps-down-eof-pass: CMD = framecrc -lavfi testsrc2=r=7:d=3.5,fps=3:eo
 fate-filter-fps-start-drop: CMD = framecrc -lavfi testsrc2=r=7:d=3.5,fps=3:start_time=1.5
 fate-filter-fps-start-fill: CMD = framecrc -lavfi testsrc2=r=7:d=1.5,setpts=PTS+14,fps=3:start_time=1.5
 
+FRAME_CACHE_GRAPH = "testsrc2=r=2:d=2,fps=6,scale=160:120:flags=+accurate_rnd+bitexact:frame_cache=1[main];testsrc2=s=64x48:r=3:d=2,format=yuva420p,fps=6[over];[main][over]overlay=16:16:frame_cache=1"
+FATE_FILTER-$(call FILTERFRAMECRC, FPS SCALE TESTSRC2 FORMAT OVERLAY) += fate-filter-frame-cache fate-filter-frame-cache-scale-hits fate-filter-frame-cache-overlay-hits
+fate-filter-frame-cache: CMD = framecrc -lavfi $(FRAME_CACHE_GRAPH)
+# the scaler sees 4 distinct frames out of 12, the overlay 8 distinct pairs
+fate-filter-frame-cache-%-hits: CMD = framecrc -v verbose -lavfi $(FRAME_CACHE_GRAPH)
+fate-filter-frame-cache-%-hits: CMP = grep
+fate-filter-frame-cache-scale-hits: REF = Parsed_scale_2 @ .*Frame cache: 8 hits, 4 misses
+fate-filter-frame-cache-overlay-hits: REF = Parsed_overlay_6 @ .*Frame cache: 4 hits, 8 misses
+
 FATE_FILTER_SAMPLES-$(call FILTERDEMDEC, FPS SCALE, MOV, QTRLE) += fate-filter-fps-cfr fate-filter-fps
 fate-filter-fps-cfr: CMD = framecrc -auto_conversion_filters -i $(TARGET_SAMPLES)/qtrle/apple-animation-variable-fps-bug.mov -r 30 -fps_mode cfr -pix_fmt yuv420p
 fate-filter-fps:     CMD = framecrc -auto_conversion_filters -i $(TARGET_SAMPLES)/qtrle/apple-animation-variable-fps-bug.mov -vf fps=30 -pix_fmt yuv420p
@@ -606,6 +649,9 @@ fate-filter-pixfmts-kerndeint: CMD = pixfmts "" "tinterlace=interleave_top,"
 FATE_FILTER_PIXFMTS-$(CONFIG_LUT_FILTER) += fate-filter-pixfmts-lut
 fate-filter-pixfmts-lut: CMD = pixfmts "c0=2*val:c1=2*val:c2=val/2:c3=negval+40"
 
+FATE_FILTER_PIXFMTS-$(CONFIG_LUT3D_FILTER) += fate-filter-pixfmts-lut3d
+fate-filter-pixfmts-lut3d: CMD = pixfmts "interp=nearest"
+
 FATE_FILTER_PIXFMTS-$(CONFIG_NULL_FILTER) += fate-filter-pixfmts-null
 fate-filter-pixfmts-null:  CMD = pixfmts
 
@@ -221,6 +221,14 @@ FATE_HEVC-$(call FRAMECRC, HEVC, HEVC, HEVC_PARSER SCALE_FILTER) +=         \
 
 FATE_HEVC-$(call FRAMECRC, HEVC, HEVC, HEVC_PARSER SCALE_FILTER) += $(HEVC_TESTS_MULTIVIEW)
 
+# WPP rows decoded on a shared thread pool with frame threading, same output
+# as the conformance tests
+HEVC_TESTS_WPP_POOL = $(addprefix fate-hevc-wpp-pool-, $(filter WPP_%_ericsson_MAIN_2, $(HEVC_SAMPLES_8BIT)))
+$(HEVC_TESTS_WPP_POOL): CMD = threads=2 thread_type=frame framecrc -thread_pool 3 -i $(TARGET_SAMPLES)/hevc-conformance/$(subst fate-hevc-wpp-pool-,,$(@)).bit -pix_fmt yuv420p
+$(HEVC_TESTS_WPP_POOL): REF = $(SRC_PATH)/tests/ref/fate/$(subst wpp-pool,conformance,$(@:fate-%=%))
+
+FATE_HEVC-$(call FRAMECRC, HEVC, HEVC, HEVC_PARSER) += $(HEVC_TESTS_WPP_POOL)
+
 fate-hevc-paramchange-yuv420p-yuv420p10: CMD = framecrc -i $(TARGET_SAMPLES)/hevc/paramchange_yuv420p_yuv420p10.hevc -fps_mode passthrough -sws_flags area+accurate_rnd+bitexact
 FATE_HEVC-$(call FRAMECRC, HEVC, HEVC, HEVC_PARSER SCALE_FILTER LARGE_TESTS) += fate-hevc-paramchange-yuv420p-yuv420p10
 
@@ -213,6 +213,18 @@ FATE_MOV_FFMPEG-$(call TRANSCODE, PCM_S16LE, MOV, WAV_DEMUXER PAN_FILTER) \
 fate-mov-mp4-pcm-float: tests/data/asynth-44100-1.wav
 fate-mov-mp4-pcm-float: CMD = transcode wav $(TARGET_PATH)/tests/data/asynth-44100-1.wav mp4 "-af aresample,pan=FR+FL+FR|c0=c0|c1=c0|c2=c0 -c:a pcm_f32le" "-map 0 -c copy -frames:a 0"
 
+# Test faststart with asynchronous writes, which must be complete before the
+# file is read back to move the moov atom
+FATE_MOV_FFMPEG-$(call TRANSCODE, PCM_S16LE, MOV, WAV_DEMUXER) += fate-mov-faststart-aio
+fate-mov-faststart-aio: tests/data/asynth-44100-1.wav
+fate-mov-faststart-aio: CMD = transcode wav $(TARGET_PATH)/tests/data/asynth-44100-1.wav mov "-c:a pcm_s16le -movflags +faststart -aio 1 -aio_depth 4 -aio_block_size 4096" "-c copy -frames:a 10"
+
+# Demux uncompressed video, read in place, interleaved with small audio
+# packets, which are copied, with a seek
+FATE_MOV_FFMPEG-$(call TRANSCODE, RAWVIDEO, MOV, IMAGE2_DEMUXER PGMYUV_DECODER WAV_DEMUXER PCM_S16LE_DECODER SCALE_FILTER) += fate-mov-mmap
+fate-mov-mmap: $(VREF) tests/data/asynth-44100-2.wav
+fate-mov-mmap: CMD = mmap_demux "-auto_conversion_filters -f image2 -c:v pgmyuv -i $(TARGET_PATH)/tests/vsynth1/%02d.pgm -i $(TARGET_PATH)/tests/data/asynth-44100-2.wav" mov "-c:v rawvideo -pix_fmt uyvy422 -c:a pcm_s16le -shortest" "-ss 0.5"
+
 fate-mov-pcm-remux: tests/data/asynth-44100-1.wav
 fate-mov-pcm-remux: CMD = md5 -i $(TARGET_PATH)/tests/data/asynth-44100-1.wav -map 0 -c copy -fflags +bitexact -f mp4
 fate-mov-pcm-remux: CMP = oneline
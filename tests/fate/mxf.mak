@@ -53,8 +53,14 @@ fate-mxf-d10-user-comments: CMD = transcode mxf $(TARGET_SAMPLES)/mxf/Avid-00005
 FATE_MXF-$(call DEMMUX, MXF, MXF_OPATOM, MPEGVIDEO_PARSER MPEG2VIDEO_DECODER) += fate-mxf-opatom-user-comments
 fate-mxf-opatom-user-comments: CMD = md5 -y -i $(TARGET_SAMPLES)/mxf/Sony-00001.mxf -an -vcodec copy -metadata "comment_test=value" -fflags +bitexact -f mxf_opatom
 
+# D-10 frames are of constant size, large enough to be read in place
+FATE_MXF_FFMPEG-$(call TRANSCODE, MPEG2VIDEO PCM_S16LE, MXF_D10 MXF, IMAGE2_DEMUXER PGMYUV_DECODER WAV_DEMUXER SCALE_FILTER PAD_FILTER SETFIELD_FILTER) += fate-mxf-d10-mmap
+fate-mxf-d10-mmap: $(VREF) tests/data/asynth-44100-2.wav
+fate-mxf-d10-mmap: CMD = mmap_demux "-auto_conversion_filters -f image2 -c:v pgmyuv -i $(TARGET_PATH)/tests/vsynth1/%02d.pgm -i $(TARGET_PATH)/tests/data/asynth-44100-2.wav" mxf_d10 "-ar 48000 -ac 2 -r 25 -vf scale=720:576,pad=720:608:0:32,setfield=tff -c:v mpeg2video -g 0 -flags +ildct+low_delay -dc 10 -non_linear_quant 1 -intra_vlc 1 -qscale 1 -ps 1 -qmin 1 -rc_max_vbv_use 1 -rc_min_vbv_use 1 -pix_fmt yuv422p -minrate 30000k -maxrate 30000k -b 30000k -bufsize 1200000 -rc_init_occupancy 1200000 -qmax 12 -shortest" "-ss 0.6"
+
+FATE_FFMPEG += $(FATE_MXF_FFMPEG-yes)
 FATE_SAMPLES_FFMPEG += $(FATE_MXF-yes)
 FATE_SAMPLES_FFMPEG_FFPROBE += $(FATE_MXF_FFMPEG_FFPROBE-yes)
 FATE_SAMPLES_FFPROBE += $(FATE_MXF_PROBE-yes)
 
-fate-mxf: $(FATE_MXF-yes) $(FATE_MXF_PROBE-yes) $(FATE_MXF_FFMPEG_FFPROBE-yes)
+fate-mxf: $(FATE_MXF-yes) $(FATE_MXF_FFMPEG-yes) $(FATE_MXF_PROBE-yes) $(FATE_MXF_FFMPEG_FFPROBE-yes)
@@ -0,0 +1,305 @@
+/*
+ * Generate a minimal TrueType font with seven-segment digits, so that text
+ * rendering can be tested without a system font.
+ *
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#define UNITS_PER_EM 1000
+#define ADVANCE       600
+#define ASCENDER      800
+#define DESCENDER    -200
+
+/* glyph 0 is .notdef, 1-10 are '0'-'9', 11 is ':', 12 is ' ' */
+#define NB_GLYPHS      13
+#define MAX_RECTS       7
+
+/* segments as x0, y0, x1, y1; the corners overlap, filled with nonzero winding */
+static const int16_t segments[7][4] = {
+    {  50, 610, 550, 700 }, /* a: top */
+    { 460, 350, 550, 700 }, /* b: top right */
+    { 460,   0, 550, 350 }, /* c: bottom right */
+    {  50,   0, 550,  90 }, /* d: bottom */
+    {  50,   0, 140, 350 }, /* e: bottom left */
+    {  50, 350, 140, 700 }, /* f: top left */
+    {  50, 305, 550, 395 }, /* g: middle */
+};
+
+/* bit n set if segment 'a' + n is lit */
+static const uint8_t digits[10] = {
+    0x3f, 0x06, 0x5b, 0x4f, 0x66, 0x6d, 0x7d, 0x07, 0x7f, 0x6f,
+};
+
+static const int16_t colon[2][4] = {
+    { 255, 150, 345, 240 },
+    { 255, 460, 345, 550 },
+};
+
+static uint8_t out[16384];
+static int out_size;
+
+static void put8(uint8_t *buf, int *pos, unsigned v)
+{
+    buf[(*pos)++] = v;
+}
+
+static void put16(uint8_t *buf, int *pos, unsigned v)
+{
+    put8(buf, pos, v >> 8);
+    put8(buf, pos, v);
+}
+
+static void put32(uint8_t *buf, int *pos, uint32_t v)
+{
+    put16(buf, pos, v >> 16);
+    put16(buf, pos, v);
+}
+
+static int glyph_rects(int glyph, int16_t rects[MAX_RECTS][4])
+{
+    int nb_rects = 0;
+
+    if (glyph >= 1 && glyph <= 10) {
+        for (int i = 0; i < 7; i++)
+            if (digits[glyph - 1] & (1 << i))
+                memcpy(rects[nb_rects++], segments[i], sizeof(segments[i]));
+    } else if (glyph == 11) {
+        memcpy(rects[nb_rects++], colon[0], sizeof(colon[0]));
+        memcpy(rects[nb_rects++], colon[1], sizeof(colon[1]));
+    }
+
+    return nb_rects;
+}
+
+/* a simple glyph with one clockwise contour per rectangle */
+static int write_glyph(uint8_t *buf, int glyph, int16_t *xmin)
+{
+    int16_t rects[MAX_RECTS][4];
+    int nb_rects = glyph_rects(glyph, rects);
+    int16_t bbox[4] = { INT16_MAX, INT16_MAX, INT16_MIN, INT16_MIN };
+    int16_t last_x = 0, last_y = 0;
+    int pos = 0;
+
+    *xmin = 0;
+    if (!nb_rects)
+        return 0;
+
+    for (int i = 0; i < nb_rects; i++) {
+        bbox[0] = rects[i][0] < bbox[0] ? rects[i][0] : bbox[0];
+        bbox[1] = rects[i][1] < bbox[1] ? rects[i][1] : bbox[1];
+        bbox[2] = rects[i][2] > bbox[2] ? rects[i][2] : bbox[2];
+        bbox[3] = rects[i][3] > bbox[3] ? rects[i][3] : bbox[3];
+    }
+    *xmin = bbox[0];
+
+    put16(buf, &pos, nb_rects);
+    for (int i = 0; i < 4; i++)
+        put16(buf, &pos, (uint16_t)bbox[i]);
+    for (int i = 0; i < nb_rects; i++)
+        put16(buf, &pos, 4 * i + 3);
+    put16(buf, &pos, 0);              /* instructionLength */
+    for (int i = 0; i < 4 * nb_rects; i++)
+        put8(buf, &pos, 0x01);        /* ON_CURVE_POINT, 16-bit deltas */
+    for (int i = 0; i < nb_rects; i++) {
+        const int16_t x[4] = { rects[i][0], rects[i][0], rects[i][2], rects[i][2] };
+        for (int j = 0; j < 4; j++) {
+            put16(buf, &pos, (uint16_t)(x[j] - last_x));
+            last_x = x[j];
+        }
+    }
+    for (int i = 0; i < nb_rects; i++) {
+        const int16_t y[4] = { rects[i][1], rects[i][3], rects[i][3], rects[i][1] };
+        for (int j = 0; j < 4; j++) {
+            put16(buf, &pos, (uint16_t)(y[j] - last_y));
+            last_y = y[j];
+        }
+    }
+    while (pos & 3)
+        put8(buf, &pos, 0);
+
+    return pos;
+}
+
+static uint32_t checksum(const uint8_t *buf, int size)
+{
+    uint32_t sum = 0;
+
+    for (int i = 0; i < size; i += 4)
+        sum += (uint32_t)buf[i] << 24 | (uint32_t)buf[i + 1] << 16 |
+               (uint32_t)buf[i + 2] << 8 | buf[i + 3];
+    return sum;
+}
+
+int main(int argc, char **argv)
+{
+    static uint8_t tables[7][4096];
+    static const char tags[7][5] = {
+        "cmap", "glyf", "head", "hhea", "hmtx", "loca", "maxp",
+    };
+    enum { CMAP, GLYF, HEAD, HHEA, HMTX, LOCA, MAXP };
+    int sizes[7] = { 0 };
+    int16_t xmin[NB_GLYPHS];
+    uint32_t offset;
+    FILE *f;
+    int pos;
+
+    if (argc != 2) {
+        fprintf(stderr, "usage: %s file.ttf\n"
+                "generate a TrueType font with seven-segment digits\n", argv[0]);
+        return 1;
+    }
+
+    /* glyf and loca */
+    put32(tables[LOCA], &sizes[LOCA], 0);
+    for (int i = 0; i < NB_GLYPHS; i++) {
+        sizes[GLYF] += write_glyph(tables[GLYF] + sizes[GLYF], i, &xmin[i]);
+        put32(tables[LOCA], &sizes[LOCA], sizes[GLYF]);
+    }
+
+    /* cmap: one format 4 subtable for Unicode BMP */
+    pos = 0;
+    put16(tables[CMAP], &pos, 0);      /* version */
+    put16(tables[CMAP], &pos, 1);      /* numTables */
+    put16(tables[CMAP], &pos, 3);      /* Windows */
+    put16(tables[CMAP], &pos, 1);      /* Unicode BMP */
+    put32(tables[CMAP], &pos, 12);
+    put16(tables[CMAP], &pos, 4);      /* format */
+    put16(tables[CMAP], &pos, 16 + 3 * 8);
+    put16(tables[CMAP], &pos, 0);      /* language */
+    put16(tables[CMAP], &pos, 3 * 2);  /* segCountX2 */
+    put16(tables[CMAP], &pos, 4);      /* searchRange */
+    put16(tables[CMAP], &pos, 1);      /* entrySelector */
+    put16(tables[CMAP], &pos, 2);      /* rangeShift */
+    put16(tables[CMAP], &pos, ' ');    /* endCode */
+    put16(tables[CMAP], &pos, ':');
+    put16(tables[CMAP], &pos, 0xffff);
+    put16(tables[CMAP], &pos, 0);      /* reservedPad */
+    put16(tables[CMAP], &pos, ' ');    /* startCode */
+    put16(tables[CMAP], &pos, '0');
+    put16(tables[CMAP], &pos, 0xffff);
+    put16(tables[CMAP], &pos, (12 - ' ') & 0xffff); /* idDelta */
+    put16(tables[CMAP], &pos, (1 - '0') & 0xffff);
+    put16(tables[CMAP], &pos, 1);
+    put16(tables[CMAP], &pos, 0);      /* idRangeOffset */
+    put16(tables[CMAP], &pos, 0);
+    put16(tables[CMAP], &pos, 0);
+    sizes[CMAP] = pos;
+
+    /* head */
+    pos = 0;
+    put32(tables[HEAD], &pos, 0x00010000);
+    put32(tables[HEAD], &pos, 0x00010000); /* fontRevision */
+    put32(tables[HEAD], &pos, 0);          /* checksumAdjustment, set below */
+    put32(tables[HEAD], &pos, 0x5f0f3cf5);
+    put16(tables[HEAD], &pos, 0x000b);     /* flags */
+    put16(tables[HEAD], &pos, UNITS_PER_EM);
+    put32(tables[HEAD], &pos, 0);          /* created */
+    put32(tables[HEAD], &pos, 0);
+    put32(tables[HEAD], &pos, 0);          /* modified */
+    put32(tables[HEAD], &pos, 0);
+    put16(tables[HEAD], &pos, 50);         /* xMin */
+    put16(tables[HEAD], &pos, 0);
+    put16(tables[HEAD], &pos, 550);
+    put16(tables[HEAD], &pos, 700);
+    put16(tables[HEAD], &pos, 0);          /* macStyle */
+    put16(tables[HEAD], &pos, 8);          /* lowestRecPPEM */
+    put16(tables[HEAD], &pos, 2);          /* fontDirectionHint */
+    put16(tables[HEAD], &pos, 1);          /* indexToLocFormat: 32-bit */
+    put16(tables[HEAD], &pos, 0);          /* glyphDataFormat */
+    sizes[HEAD] = pos;
+
+    /* hhea */
+    pos = 0;
+    put32(tables[HHEA], &pos, 0x00010000);
+    put16(tables[HHEA], &pos, ASCENDER);
+    put16(tables[HHEA], &pos, (uint16_t)DESCENDER);
+    put16(tables[HHEA], &pos, 0);          /* lineGap */
+    put16(tables[HHEA], &pos, ADVANCE);    /* advanceWidthMax */
+    put16(tables[HHEA], &pos, 0);          /* minLeftSideBearing */
+    put16(tables[HHEA], &pos, 50);         /* minRightSideBearing */
+    put16(tables[HHEA], &pos, 550);        /* xMaxExtent */
+    put16(tables[HHEA], &pos, 1);          /* caretSlopeRise */
+    put16(tables[HHEA], &pos, 0);          /* caretSlopeRun */
+    put16(tables[HHEA], &pos, 0);          /* caretOffset */
+    for (int i = 0; i < 5; i++)
+        put16(tables[HHEA], &pos, 0);      /* reserved, metricDataFormat */
+    put16(tables[HHEA], &pos, NB_GLYPHS);  /* numberOfHMetrics */
+    sizes[HHEA] = pos;
+
+    /* hmtx */
+    pos = 0;
+    for (int i = 0; i < NB_GLYPHS; i++) {
+        put16(tables[HMTX], &pos, ADVANCE);
+        put16(tables[HMTX], &pos, (uint16_t)xmin[i]);
+    }
+    sizes[HMTX] = pos;
+
+    /* maxp */
+    pos = 0;
+    put32(tables[MAXP], &pos, 0x00010000);
+    put16(tables[MAXP], &pos, NB_GLYPHS);
+    put16(tables[MAXP], &pos, 4 * MAX_RECTS); /* maxPoints */
+    put16(tables[MAXP], &pos, MAX_RECTS);     /* maxContours */
+    put16(tables[MAXP], &pos, 0);             /* maxCompositePoints */
+    put16(tables[MAXP], &pos, 0);             /* maxCompositeContours */
+    put16(tables[MAXP], &pos, 2);             /* maxZones */
+    for (int i = 0; i < 8; i++)
+        put16(tables[MAXP], &pos, 0);
+    sizes[MAXP] = pos;
+
+    /* table directory, tables sorted by tag */
+    pos = 0;
+    put32(out, &pos, 0x00010000);
+    put16(out, &pos, 7);                   /* numTables */
+    put16(out, &pos, 4 * 16);              /* searchRange */
+    put16(out, &pos, 2);                   /* entrySelector */
+    put16(out, &pos, 7 * 16 - 4 * 16);     /* rangeShift */
+    offset = 12 + 7 * 16;
+    for (int i = 0; i < 7; i++) {
+        int padded = (sizes[i] + 3) & ~3;
+        memcpy(out + pos, tags[i], 4);
+        pos += 4;
+        put32(out, &pos, checksum(tables[i], padded));
+        put32(out, &pos, offset);
+        put32(out, &pos, sizes[i]);
+        memcpy(out + offset, tables[i], padded);
+        offset += padded;
+    }
+    out_size = offset;
+
+    /* checksumAdjustment at offset 8 of head */
+    {
+        uint32_t adj = 0xb1b0afba - checksum(out, out_size);
+        int head = 12 + 7 * 16 + ((sizes[CMAP] + 3) & ~3) + ((sizes[GLYF] + 3) & ~3);
+        pos = head + 8;
+        put32(out, &pos, adj);
+    }
+
+    f = fopen(argv[1], "wb");
+    if (!f) {
+        perror(argv[1]);
+        return 1;
+    }
+    fwrite(out, 1, out_size, f);
+    fclose(f);
+
+    return 0;
+}
@@ -0,0 +1,147 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/*
+ * Decode the same input with an increasing number of threads and print the
+ * decoding speed for each thread count, e.g. to measure how the VVC decoder
+ * scales with the number of cores.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "config.h"
+
+#if HAVE_UNISTD_H
+#include <unistd.h>             /* getopt */
+#endif
+
+#include "decode_simple.h"
+
+#include "libavutil/common.h"
+#include "libavutil/dict.h"
+#include "libavutil/error.h"
+#include "libavutil/threadpool.h"
+#include "libavutil/time.h"
+
+#include "libavcodec/avcodec.h"
+
+#if !HAVE_GETOPT
+#include "compat/getopt.c"
+#endif
+
+static int process_frame(DecodeContext *dc, AVFrame *frame)
+{
+    return 0;
+}
+
+static int run(const char *filename, int nb_threads, int max_frames,
+               const char *thread_type, int use_pool,
+               int64_t *elapsed, int64_t *nb_frames)
+{
+    DecodeContext dc;
+    int64_t start;
+    int ret;
+
+    ret = ds_open(&dc, filename, 0);
+    if (ret < 0)
+        return ret;
+
+    dc.process_frame = process_frame;
+    dc.max_frames    = max_frames;
+
+    ret = av_dict_set_int(&dc.decoder_opts, "threads", nb_threads, 0);
+    if (ret >= 0 && thread_type)
+        ret = av_dict_set(&dc.decoder_opts, "thread_type", thread_type, 0);
+    if (ret < 0)
+        goto finish;
+
+    if (use_pool) {
+        // the decoder runs its slice and WPP row jobs on this pool; the
+        // threads submitting them take part in the work as well
+        dc.decoder->thread_pool = av_threadpool_alloc(FFMAX(nb_threads - 1, 1));
+        if (!dc.decoder->thread_pool) {
+            ret = AVERROR(ENOMEM);
+            goto finish;
+        }
+    }
+
+    start = av_gettime_relative();
+    ret   = ds_run(&dc);
+    *elapsed   = av_gettime_relative() - start;
+    *nb_frames = dc.decoder->frame_num;
+
+finish:
+    ds_free(&dc);
+    return ret;
+}
+
+static void usage(const char *name)
+{
+    printf("Usage: %s [-t max_threads] [-n max_frames] [-m thread_type] [-p] <input file>\n"
+           "Decodes the first stream of the input with 1, 2, 4, ... up to max_threads threads.\n"
+           "With -p, the decoder is given a shared thread pool of the same size.\n",
+           name);
+}
+
+int main(int argc, char **argv)
+{
+    const char *filename, *thread_type = NULL;
+    int max_threads = 64, max_frames = 0, use_pool = 0;
+    double base_fps = 0.0;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "ht:n:m:p")) != -1) {
+        switch (opt) {
+        case 't': max_threads = FFMAX(strtol(optarg, NULL, 0), 1); break;
+        case 'n': max_frames  = FFMAX(strtol(optarg, NULL, 0), 0); break;
+        case 'm': thread_type = optarg;                            break;
+        case 'p': use_pool    = 1;                                 break;
+        case 'h': usage(argv[0]); return 0;
+        default:  usage(argv[0]); return 1;
+        }
+    }
+    if (optind >= argc) {
+        usage(argv[0]);
+        return 1;
+    }
+    filename = argv[optind];
+
+    for (int nb_threads = 1; nb_threads <= max_threads;
+         nb_threads = nb_threads < max_threads ? FFMIN(nb_threads * 2, max_threads) : nb_threads + 1) {
+        int64_t elapsed, nb_frames;
+        double fps;
+        int ret;
+
+        ret = run(filename, nb_threads, max_frames, thread_type, use_pool,
+                  &elapsed, &nb_frames);
+        if (ret < 0) {
+            fprintf(stderr, "Error decoding %s with %d threads: %s\n",
+                    filename, nb_threads, av_err2str(ret));
+            return 1;
+        }
+
+        fps = nb_frames * 1e6 / FFMAX(elapsed, 1);
+        if (nb_threads == 1)
+            base_fps = fps;
+        printf("threads %2d: %6"PRId64" frames in %8.3f s, %8.2f fps, speedup %5.2fx\n",
+               nb_threads, nb_frames, elapsed / 1e6, fps, base_fps > 0 ? fps / base_fps : 0.0);
+    }
+
+    return 0;
+}
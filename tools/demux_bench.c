@@ -0,0 +1,154 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/*
+ * Demux a file as fast as possible with the different I/O modes of the file
+ * protocol and print the throughput of each, e.g. for a mezzanine file made
+ * with
+ *   ffmpeg -f lavfi -i testsrc2=s=3840x2160:d=10 -c:v prores_ks -profile:v 4444 prores.mov
+ *
+ * Unless direct I/O is used, all runs after the first read from the page
+ * cache. Drop the caches between runs to measure the storage itself.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "config.h"
+
+#if HAVE_UNISTD_H
+#include <unistd.h>             /* getopt */
+#endif
+
+#include "libavcodec/packet.h"
+#include "libavformat/avformat.h"
+#include "libavutil/common.h"
+#include "libavutil/dict.h"
+#include "libavutil/error.h"
+#include "libavutil/time.h"
+
+#if !HAVE_GETOPT
+#include "compat/getopt.c"
+#endif
+
+/* busy time per packet, standing for the decoder */
+static int work_us;
+
+static int run(const char *filename, const char *name, const char *opts)
+{
+    AVFormatContext *fmt = NULL;
+    AVDictionary *dict = NULL;
+    AVPacket *pkt;
+    int64_t start, elapsed, bytes = 0, nb_pkts = 0;
+    unsigned sum = 0;
+    int ret;
+
+    pkt = av_packet_alloc();
+    if (!pkt)
+        return AVERROR(ENOMEM);
+
+    ret = av_dict_parse_string(&dict, opts, "=", ":", 0);
+    if (ret < 0)
+        goto fail;
+
+    start = av_gettime_relative();
+    ret = avformat_open_input(&fmt, filename, NULL, &dict);
+    if (ret < 0)
+        goto fail;
+
+    while ((ret = av_read_frame(fmt, pkt)) >= 0) {
+        /* touch every page, a mapped input is only read on access */
+        for (int i = 0; i < pkt->size; i += 4096)
+            sum += pkt->data[i];
+        bytes += pkt->size;
+        nb_pkts++;
+        if (work_us) {
+            int64_t end = av_gettime_relative() + work_us;
+            while (av_gettime_relative() < end);
+        }
+        av_packet_unref(pkt);
+    }
+    if (ret != AVERROR_EOF)
+        goto fail;
+    elapsed = FFMAX(av_gettime_relative() - start, 1);
+
+    printf("%-12s %8"PRId64" packets %10.1f MB/s %9.1f packets/s (%08x)\n", name,
+           nb_pkts, bytes / (double)elapsed, nb_pkts * 1000000.0 / elapsed, sum);
+    ret = 0;
+
+fail:
+    avformat_close_input(&fmt);
+    av_packet_free(&pkt);
+    av_dict_free(&dict);
+    return ret;
+}
+
+static void usage(void)
+{
+    printf("Usage: demux_bench [-d depth] [-b block_size] [-n runs] [-m mode] [-w us] file\n"
+           "mode is one of read, aio, aio+direct and mmap, all by default\n"
+           "-w spins for the given time after each packet, to simulate decoding\n");
+}
+
+int main(int argc, char **argv)
+{
+    int depth = 8, block_size = 1 << 18, nb_runs = 1;
+    const char *mode = NULL;
+    char aio[64], direct[80];
+    int opt;
+
+    while ((opt = getopt(argc, argv, "hd:b:n:m:w:")) != -1) {
+        switch (opt) {
+        case 'd': depth      = FFMAX(atoi(optarg), 1);    break;
+        case 'b': block_size = FFMAX(atoi(optarg), 4096); break;
+        case 'n': nb_runs    = FFMAX(atoi(optarg), 1);    break;
+        case 'm': mode       = optarg;                    break;
+        case 'w': work_us    = FFMAX(atoi(optarg), 0);    break;
+        case 'h': usage(); return 0;
+        default:  usage(); return 1;
+        }
+    }
+    if (optind != argc - 1) {
+        usage();
+        return 1;
+    }
+
+    snprintf(aio, sizeof(aio), "aio=1:aio_depth=%d:aio_block_size=%d",
+             depth, block_size);
+    snprintf(direct, sizeof(direct), "%s:direct=1", aio);
+
+    for (int i = 0; i < nb_runs; i++) {
+        static const char *const names[] = { "read", "aio", "aio+direct", "mmap" };
+        const char *opts[] = { "", aio, direct, "mmap=1" };
+
+        for (int j = 0; j < FF_ARRAY_ELEMS(names); j++) {
+            int ret;
+
+            if (mode && strcmp(mode, names[j]))
+                continue;
+            ret = run(argv[optind], names[j], opts[j]);
+            if (ret < 0) {
+                fprintf(stderr, "%s: %s\n", names[j], av_err2str(ret));
+                return 1;
+            }
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,224 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/*
+ * Microbenchmark for the fftools ThreadQueue: item throughput with one or
+ * more sending threads, and wakeup latency of an idle receiver, for the
+ * mutex-based and the lock-free implementation.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "config.h"
+
+#if HAVE_UNISTD_H
+#include <unistd.h>             /* getopt */
+#endif
+
+#include "libavcodec/packet.h"
+#include "libavutil/common.h"
+#include "libavutil/error.h"
+#include "libavutil/mem.h"
+#include "libavutil/thread.h"
+#include "libavutil/time.h"
+
+#include "fftools/objpool.h"
+#include "fftools/thread_queue.h"
+
+#if !HAVE_GETOPT
+#include "compat/getopt.c"
+#endif
+
+typedef struct Producer {
+    pthread_t    thread;
+    ThreadQueue *tq;
+    unsigned     stream_idx;
+    unsigned     nb_items;
+    // microseconds to sleep between items, 0 for back-to-back sending
+    unsigned     interval;
+    int          ret;
+} Producer;
+
+static void pkt_move(void *dst, void *src)
+{
+    av_packet_move_ref(dst, src);
+}
+
+static void *producer_thread(void *arg)
+{
+    Producer *p = arg;
+    AVPacket *pkt = av_packet_alloc();
+
+    if (!pkt) {
+        p->ret = AVERROR(ENOMEM);
+        goto finish;
+    }
+
+    for (unsigned i = 0; i < p->nb_items; i++) {
+        if (p->interval)
+            av_usleep(p->interval);
+
+        pkt->pts = av_gettime_relative();
+        p->ret = tq_send(p->tq, p->stream_idx, pkt);
+        if (p->ret < 0)
+            break;
+    }
+
+finish:
+    tq_send_finish(p->tq, p->stream_idx);
+    av_packet_free(&pkt);
+    return NULL;
+}
+
+static int run(const char *name, unsigned flags, unsigned nb_producers,
+               unsigned nb_items, unsigned interval, unsigned queue_size)
+{
+    Producer *producers = NULL;
+    AVPacket *pkt       = NULL;
+    ThreadQueue *tq     = NULL;
+    ObjPool *op;
+    int64_t start, elapsed, lat_sum = 0, lat_max = 0;
+    uint64_t received = 0;
+    int ret;
+
+    op = objpool_alloc_packets();
+    if (!op)
+        return AVERROR(ENOMEM);
+
+    tq = tq_alloc(nb_producers, queue_size, op, pkt_move, flags);
+    if (!tq) {
+        objpool_free(&op);
+        return AVERROR(ENOMEM);
+    }
+
+    producers = av_calloc(nb_producers, sizeof(*producers));
+    pkt       = av_packet_alloc();
+    if (!producers || !pkt) {
+        ret = AVERROR(ENOMEM);
+        goto finish;
+    }
+
+    start = av_gettime_relative();
+
+    for (unsigned i = 0; i < nb_producers; i++) {
+        Producer *p = &producers[i];
+
+        p->tq         = tq;
+        p->stream_idx = i;
+        p->nb_items   = nb_items;
+        p->interval   = interval;
+
+        ret = pthread_create(&p->thread, NULL, producer_thread, p);
+        if (ret) {
+            ret = AVERROR(ret);
+            goto finish;
+        }
+    }
+
+    while (1) {
+        int stream_idx;
+
+        ret = tq_receive(tq, &stream_idx, pkt);
+        if (ret == AVERROR_EOF && stream_idx < 0)
+            break;
+        if (ret < 0)
+            continue;
+
+        elapsed  = av_gettime_relative() - pkt->pts;
+        lat_sum += elapsed;
+        lat_max  = FFMAX(lat_max, elapsed);
+        received++;
+        av_packet_unref(pkt);
+    }
+
+    elapsed = av_gettime_relative() - start;
+
+    ret = 0;
+    for (unsigned i = 0; i < nb_producers; i++) {
+        pthread_join(producers[i].thread, NULL);
+        if (producers[i].ret < 0)
+            ret = producers[i].ret;
+    }
+
+    if (interval)
+        printf("%-24s %2u sender(s): latency avg %6.1f us, max %6"PRId64" us\n",
+               name, nb_producers, received ? (double)lat_sum / received : 0.0,
+               lat_max);
+    else
+        printf("%-24s %2u sender(s): %10.0f items/s\n", name, nb_producers,
+               received * 1e6 / FFMAX(elapsed, 1));
+
+finish:
+    av_packet_free(&pkt);
+    av_freep(&producers);
+    tq_free(&tq);
+    return ret;
+}
+
+static void usage(void)
+{
+    printf("Usage: thread_queue_bench [-n items] [-p senders] [-q queue_size] [-i interval_us]\n");
+}
+
+int main(int argc, char **argv)
+{
+    static const struct {
+        const char *name;
+        unsigned    flags;
+    } impls[] = {
+        { "mutex",           0 },
+        { "lockfree",        THREAD_QUEUE_FLAG_LOCKFREE },
+        { "lockfree (spsc)", THREAD_QUEUE_FLAG_LOCKFREE |
+                             THREAD_QUEUE_FLAG_SINGLE_PRODUCER },
+    };
+    unsigned nb_items = 1000000, nb_producers = 4, queue_size = 8;
+    unsigned interval = 200;
+    int opt, ret;
+
+    while ((opt = getopt(argc, argv, "hn:p:q:i:")) != -1) {
+        switch (opt) {
+        case 'n': nb_items     = strtoul(optarg, NULL, 0);           break;
+        case 'p': nb_producers = FFMAX(strtoul(optarg, NULL, 0), 1); break;
+        case 'q': queue_size   = FFMAX(strtoul(optarg, NULL, 0), 1); break;
+        case 'i': interval     = FFMAX(strtoul(optarg, NULL, 0), 1); break;
+        case 'h': usage(); return 0;
+        default:  usage(); return 1;
+        }
+    }
+
+    for (int i = 0; i < FF_ARRAY_ELEMS(impls); i++) {
+        int spsc = impls[i].flags & THREAD_QUEUE_FLAG_SINGLE_PRODUCER;
+
+        // throughput
+        ret = run(impls[i].name, impls[i].flags, 1, nb_items, 0, queue_size);
+        if (!spsc && ret >= 0 && nb_producers > 1)
+            ret = run(impls[i].name, impls[i].flags, nb_producers,
+                      nb_items / nb_producers, 0, queue_size);
+        // wakeup latency of a receiver that is mostly idle
+        if (ret >= 0)
+            ret = run(impls[i].name, impls[i].flags, 1,
+                      FFMAX(nb_items / 1000, 100), interval, queue_size);
+        if (ret < 0) {
+            fprintf(stderr, "%s: %s\n", impls[i].name, av_err2str(ret));
+            return 1;
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,185 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/*
+ * Send MPEG-TS sized datagrams over the loopback interface as fast as
+ * possible with the udp protocol, with and without batched I/O, and print
+ * the packet rates and the CPU time spent per gigabit received.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "config.h"
+
+#if HAVE_UNISTD_H
+#include <unistd.h>             /* getopt */
+#endif
+#if HAVE_GETRUSAGE
+#include <sys/resource.h>
+#endif
+
+#include "libavformat/avio.h"
+#include "libavutil/common.h"
+#include "libavutil/error.h"
+#include "libavutil/log.h"
+#include "libavutil/thread.h"
+#include "libavutil/time.h"
+
+#if !HAVE_GETOPT
+#include "compat/getopt.c"
+#endif
+
+typedef struct Sender {
+    pthread_t thread;
+    char      url[256];
+    int       pkt_size;
+    int64_t   duration;
+    int64_t   nb_pkts;
+    int       ret;
+} Sender;
+
+static int64_t cpu_time(void)
+{
+#if HAVE_GETRUSAGE
+    struct rusage ru;
+
+    getrusage(RUSAGE_SELF, &ru);
+    return (ru.ru_utime.tv_sec + ru.ru_stime.tv_sec) * 1000000LL +
+            ru.ru_utime.tv_usec + ru.ru_stime.tv_usec;
+#else
+    return 0;
+#endif
+}
+
+static void *sender_thread(void *arg)
+{
+    Sender *s = arg;
+    uint8_t buf[65536] = { 0x47 };
+    AVIOContext *pb;
+    int64_t start;
+
+    s->ret = avio_open2(&pb, s->url, AVIO_FLAG_WRITE, NULL, NULL);
+    if (s->ret < 0)
+        return NULL;
+
+    start = av_gettime_relative();
+    while (av_gettime_relative() - start < s->duration) {
+        for (int i = 0; i < 256; i++) {
+            avio_write(pb, buf, s->pkt_size);
+            avio_flush(pb);
+        }
+        s->nb_pkts += 256;
+        if ((s->ret = pb->error) < 0)
+            break;
+    }
+
+    avio_closep(&pb);
+    return NULL;
+}
+
+static int run(const char *name, const char *rx_opts, const char *tx_opts,
+               int port, int pkt_size, int64_t duration)
+{
+    Sender sender = { .pkt_size = pkt_size, .duration = duration };
+    uint8_t buf[65536];
+    char url[256];
+    AVIOContext *pb;
+    int64_t start, end, cpu, bytes = 0;
+    int ret;
+
+    snprintf(url, sizeof(url), "udp://127.0.0.1:%d?timeout=500000"
+             "&fifo_size=100000&overrun_nonfatal=1%s", port, rx_opts);
+    ret = avio_open2(&pb, url, AVIO_FLAG_READ, NULL, NULL);
+    if (ret < 0)
+        return ret;
+    snprintf(sender.url, sizeof(sender.url),
+             "udp://127.0.0.1:%d?pkt_size=%d%s", port, pkt_size, tx_opts);
+
+    cpu   = cpu_time();
+    start = end = av_gettime_relative();
+    ret = pthread_create(&sender.thread, NULL, sender_thread, &sender);
+    if (ret) {
+        avio_closep(&pb);
+        return AVERROR(ret);
+    }
+
+    // read until nothing arrived for the timeout
+    while ((ret = avio_read_partial(pb, buf, sizeof(buf))) >= 0) {
+        bytes += ret;
+        end    = av_gettime_relative();
+    }
+
+    pthread_join(sender.thread, NULL);
+    cpu = cpu_time() - cpu;
+    avio_closep(&pb);
+    if (sender.ret < 0)
+        return sender.ret;
+
+    end = FFMAX(end - start, 1);
+    printf("%-16s %10.0f pkt/s sent %10.0f pkt/s received %6.2f Gbps "
+           "%6.2f CPU s/Gbit\n", name,
+           sender.nb_pkts * 1000000.0 / end,
+           bytes / pkt_size * 1000000.0 / end,
+           bytes * 8.0 / end / 1000.0,
+           cpu / 1000.0 / FFMAX(bytes * 8 / 1000000.0, 1));
+    return 0;
+}
+
+static void usage(void)
+{
+    printf("Usage: udp_bench [-t seconds] [-s pkt_size] [-b batch] [-p port]\n");
+}
+
+int main(int argc, char **argv)
+{
+    int pkt_size = 1316, batch = 32, port = 23456, seconds = 2;
+    char rx_opts[64], tx_opts[64];
+    int opt, ret;
+
+    while ((opt = getopt(argc, argv, "ht:s:b:p:")) != -1) {
+        switch (opt) {
+        case 't': seconds  = FFMAX(atoi(optarg), 1);                 break;
+        case 's': pkt_size = av_clip(atoi(optarg), 1, 65507);        break;
+        case 'b': batch    = av_clip(atoi(optarg), 1, 1024);         break;
+        case 'p': port     = atoi(optarg);                           break;
+        case 'h': usage(); return 0;
+        default:  usage(); return 1;
+        }
+    }
+
+    // overruns are expected, the sender is not rate limited
+    av_log_set_level(AV_LOG_ERROR);
+
+    ret = run("single", "", "", port, pkt_size, seconds * 1000000LL);
+    if (ret >= 0) {
+        snprintf(rx_opts, sizeof(rx_opts), "&batch=%d", batch);
+        ret = run("batch", rx_opts, rx_opts, port, pkt_size, seconds * 1000000LL);
+    }
+    if (ret >= 0) {
+        snprintf(rx_opts, sizeof(rx_opts), "&batch=%d&gro=1", batch);
+        snprintf(tx_opts, sizeof(tx_opts), "&batch=%d&gso=1", batch);
+        ret = run("batch+gro/gso", rx_opts, tx_opts, port, pkt_size, seconds * 1000000LL);
+    }
+    if (ret < 0) {
+        fprintf(stderr, "%s\n", av_err2str(ret));
+        return 1;
+    }
+
+    return 0;
+}